@@ -15,6 +15,11 @@ typedef struct {
   double late;
   double frequency_offset;
   double frame_timing;
+  // k_factor the producer used to timestamp the samples.
+  double k_factor;
+  // Tracked subcarriers after FOC, DFT and TOC, when the producer has
+  // already computed them on the OpenCL device. Empty otherwise.
+  itpp::cvec syms;
 } td_fifo_pdu_t;
 
 // Structure to describe a cell which is currently being tracked.
@@ -30,8 +35,9 @@ class tracked_cell_t {
       const phich_duration_t::phich_duration_t & phich_duration,
       const phich_resource_t::phich_resource_t & phich_resource,
       const double & ft,
-      const uint32 & serial_num//,
-//      const double & freq_superfine
+      const uint32 & track_id,
+      const int8 & n_rb_track,
+      const double & freq_superfine
     ) :
       n_id_1(floor(n_id_cell/3.0)),
       n_id_2(n_id_cell-3*floor(n_id_cell/3.0)),
@@ -42,16 +48,25 @@ class tracked_cell_t {
       n_rb_dl(n_rb_dl),
       phich_duration(phich_duration),
       phich_resource(phich_resource),
-      serial_num(serial_num)
+      track_id(track_id),
+      n_rb_track(n_rb_track),
+      freq_superfine(freq_superfine)
     {
-//      freq_superfine_private=freq_superfine;
       frame_timing_private=ft;
+      frequency_offset_private=freq_superfine;
       fifo_peak_size=0;
+      fd_jobs_pending=0;
       kill_me=false;
       ac_fd.set_size(12);
       ac_fd=std::complex <double> (0,0);
       ac_td.set_size(72);
       ac_td=std::complex <double> (0,0);
+      ac_td_23.set_size(72);
+      ac_td_23=std::complex <double> (0,0);
+      ac_fd_weight.set_size(12);
+      ac_fd_weight=0;
+      ac_td_weight=0;
+      ac_td_23_weight=0;
       tracker_thread_ready=false;
       mib_decode_failures=0;
       crs_tp=itpp::vec(4);
@@ -73,10 +88,20 @@ class tracked_cell_t {
       sync_np_av=NAN;
       sync_np_blank_av=NAN;
       launched=false;
+      init_sfn=-1;
+      sfn_first=-1;
     }
     inline uint8 const n_symb_dl() const {
       return (cp_type==cp_type_t::NORMAL)?7:((cp_type==cp_type_t::EXTENDED)?6:-1);
     }
+    // Number of subcarriers that are tracked.
+    inline uint16 const n_sc() const {
+      return 12*n_rb_track;
+    }
+    // Offset of the central 6 RB's within the tracked subcarriers.
+    inline uint16 const sc_offset_6rb() const {
+      return 6*(n_rb_track-6);
+    }
     // Constants that do not change and can be read freely.
     const uint8 n_id_1;
     const uint8 n_id_2;
@@ -87,8 +112,15 @@ class tracked_cell_t {
     const int8 n_rb_dl;
     const phich_duration_t::phich_duration_t phich_duration;
     const phich_resource_t::phich_resource_t phich_resource;
-    const uint32 serial_num;
-//    const double freq_superfine;
+    // Unique identifier of the track. Several tracks may share the same
+    // cell ID when the cell ID is reused by nearby cells. A tracker that
+    // resumes a lost track keeps its track ID.
+    const uint32 track_id;
+    // Number of RB's that are tracked. All measurements are performed
+    // on these RB's. The PSS, SSS, and MIB only use the central 6 RB's.
+    const int8 n_rb_track;
+    // Residual frequency offset measured when the track was created.
+    const double freq_superfine;
 
     // Do we need this?
     boost::thread thread;
@@ -99,6 +131,19 @@ class tracked_cell_t {
     boost::condition fifo_condition;
     std::queue <td_fifo_pdu_t> fifo;
     uint32 fifo_peak_size;
+    // Number of OFDM symbols of this cell that wait for their DFT on the
+    // OpenCL device (protected by fifo_mutex). The batching thread holds a
+    // pointer to the cell until it reaches zero.
+    uint32 fd_jobs_pending;
+    boost::condition fd_jobs_condition;
+    // Wait until the batching thread has let go of this cell. Must be
+    // called before the cell is deleted.
+    inline void wait_fd_jobs() {
+      boost::mutex::scoped_lock lock(fifo_mutex);
+      while (fd_jobs_pending) {
+        fd_jobs_condition.wait(lock);
+      }
+    }
 
     // Indicates that the tracker process is ready to receive data.
     bool tracker_thread_ready;
@@ -127,8 +172,45 @@ class tracked_cell_t {
     double sync_np_blank_av;
     // Frequency domain channel autocorrelation.
     itpp::cvec ac_fd;
-    // Time domain channel autocorrelation.
+    // Time domain channel autocorrelation of ports 0 and 1, and of ports 2
+    // and 3, whose RS symbols are twice as far apart.
     itpp::cvec ac_td;
+    itpp::cvec ac_td_23;
+    // The autocorrelations are slow averages that start from zero. These
+    // are the same averages of a constant 1, by which the autocorrelations
+    // are divided to remove the bias while the averages converge.
+    itpp::vec ac_fd_weight;
+    double ac_td_weight;
+    double ac_td_23_weight;
+    // Autocorrelations without that bias. The caller must hold meas_mutex.
+    inline itpp::cvec ac_fd_est() const {
+      itpp::cvec r(ac_fd.size());
+      for (int32 k=0;k<ac_fd.size();k++) {
+        r(k)=(ac_fd_weight(k)>0)?ac_fd(k)/ac_fd_weight(k):0;
+      }
+      return r;
+    }
+    inline itpp::cvec ac_td_est(
+      const uint8 & port_num
+    ) const {
+      const double w=(port_num<2)?ac_td_weight:ac_td_23_weight;
+      if (w<=0)
+        return itpp::zeros_c(ac_td.size());
+      return ((port_num<2)?ac_td:ac_td_23)/w;
+    }
+
+    // Frame synchronization handed over by the searcher. The frame with
+    // SFN init_sfn starts at producer sample number init_sample_num.
+    // init_sfn is -1 if the SFN is unknown.
+    int16 init_sfn;
+    uint64 init_sample_num;
+    // SFN of the first frame sent to the tracker thread, -1 if unknown.
+    // Written by the producer thread before the first PDU is sent.
+    int16 sfn_first;
+
+    // Producer sample number at which lock was lost. Only valid once the
+    // cell has been moved to the lost cell cache.
+    uint64 lost_sample_num;
 
     // Read/write frame_timing (via mutex).
     // Only one thread (tracker_thread) can update frame_timing. We
@@ -144,17 +226,30 @@ class tracked_cell_t {
       frame_timing_private=ft;
     }
 
-//    inline double freq_superfine() {
-//      boost::mutex::scoped_lock lock(freq_superfine_mutex);
-//      double r=freq_superfine_private;
-//      return r;
-//    }
-//
-//    void freq_superfine(const double & fs) {
-//      boost::mutex::scoped_lock lock(freq_superfine_mutex);
-//      freq_superfine_private=fs;
-////      freq_superfine_private++;
-//    }
+    // Read/write the frequency offset of this cell, as measured by its
+    // tracker (via mutex). Starts out as freq_superfine.
+    inline double frequency_offset() {
+      boost::mutex::scoped_lock lock(frequency_offset_mutex);
+      double r=frequency_offset_private;
+      return r;
+    }
+    inline void frequency_offset(const double & f) {
+      boost::mutex::scoped_lock lock(frequency_offset_mutex);
+      frequency_offset_private=f;
+    }
+
+    // Does a detection of cell n_id_cell with frame timing ft and fine
+    // frequency offset fo belong to this track?
+    inline bool matches(
+      const uint16 & n_id_cell_in,
+      const double & ft,
+      const double & fo
+    ) {
+      return
+        (n_id_cell_in==n_id_cell) &&
+        (std::abs(WRAP(ft-frame_timing(),-19200.0/2,19200.0/2))<TRACK_TIMING_TOL) &&
+        (std::abs(fo-frequency_offset())<TRACK_FREQ_TOL);
+    }
 
     bool kill_me;
 
@@ -163,9 +258,10 @@ class tracked_cell_t {
     // threads.
     boost::mutex frame_timing_mutex;
     double frame_timing_private;
-
-//    boost::mutex freq_superfine_mutex;
-//    double freq_superfine_private;
+    // Frequency offset is written by tracker_thread and read by the
+    // searcher and the re-acquisition thread.
+    boost::mutex frequency_offset_mutex;
+    double frequency_offset_private;
 };
 
 // Structure that stores the list of all the tracked cells.
@@ -175,8 +271,34 @@ typedef struct {
   // Only the main thread can remove elements from this list.
   boost::mutex mutex;
   std::list <tracked_cell_t *> tracked_cells;
+  // Cells whose tracker has recently lost lock. The tracker thread has
+  // exited but the measurement history is kept so that tracking can be
+  // resumed if the cell reappears.
+  // Only the main thread can add elements to this list.
+  // Only the re-acquisition thread can remove elements from this list.
+  std::list <tracked_cell_t *> lost_cells;
+  // Last track ID that was handed out.
+  uint32 last_track_id;
 } tracked_cell_list_t;
 
+// Does a detection of cell n_id_cell with frame timing ft and frequency
+// offset fo belong to a cell that is already being tracked? The caller
+// must hold tracked_cell_list.mutex.
+inline bool cell_is_tracked(
+  const tracked_cell_list_t & tracked_cell_list,
+  const uint16 & n_id_cell,
+  const double & ft,
+  const double & fo
+) {
+  std::list <tracked_cell_t *>::const_iterator tci=tracked_cell_list.tracked_cells.begin();
+  while (tci!=tracked_cell_list.tracked_cells.end()) {
+    if ((*tci)->matches(n_id_cell,ft,fo))
+      return true;
+    ++tci;
+  }
+  return false;
+}
+
 // Global data shared by all threads
 class global_thread_data_t {
   public:
@@ -184,20 +306,36 @@ class global_thread_data_t {
     global_thread_data_t(
       const double & fc_requested,
       const double & fc_programmed,
-      const double & fs_programmed
+      const double & fs_programmed,
+      const uint16 & oversample,
+      const int8 & n_rb_track_max,
+      const placement_t::placement_t & placement_mode
     ) :
       fc_requested(fc_requested),
       fc_programmed(fc_programmed),
-      fs_programmed(fs_programmed)
+      fs_programmed(fs_programmed),
+      oversample(oversample),
+      n_rb_track_max(n_rb_track_max),
+      placement(placement_mode)
     {
       searcher_cycle_time_private=0;
+      search_duty_private=1;
+      tracker_opencl_private=false;
+      tracker_fd_thread_id=0;
       cell_seconds_dropped_private=0;
       raw_seconds_dropped_private=0;
     }
     // These values will never change.
     const double fc_requested;
     const double fc_programmed;
+    // Sample rate seen by the searcher, nominally 1.92MHz. The device
+    // delivers samples at oversample times this rate.
     const double fs_programmed;
+    const uint16 oversample;
+    // Maximum number of RB's that a tracker may process.
+    const int8 n_rb_track_max;
+    // CPU affinity and scheduling policy of all the threads.
+    thread_placement_t placement;
     // Read/write frequency offset, k_factor, sampling_carrier_twist (via mutex).
     // Mutex makes sure that no read or write is interrupted when
     // only part of the data has been read.
@@ -248,6 +386,24 @@ class global_thread_data_t {
       boost::mutex::scoped_lock lock(xcorr_workitem_mutex);
       xcorr_workitem_private=f;
     }
+    inline uint16 search_duty() {
+      boost::mutex::scoped_lock lock(search_duty_mutex);
+      uint16 r=search_duty_private;
+      return r;
+    }
+    inline void search_duty(const uint16 & f) {
+      boost::mutex::scoped_lock lock(search_duty_mutex);
+      search_duty_private=f;
+    }
+    inline bool tracker_opencl() {
+      boost::mutex::scoped_lock lock(tracker_opencl_mutex);
+      bool r=tracker_opencl_private;
+      return r;
+    }
+    inline void tracker_opencl(const bool & f) {
+      boost::mutex::scoped_lock lock(tracker_opencl_mutex);
+      tracker_opencl_private=f;
+    }
     inline bool sampling_carrier_twist() {
       boost::mutex::scoped_lock lock(sampling_carrier_twist_mutex);
       bool r=sampling_carrier_twist_private;
@@ -359,7 +515,10 @@ class global_thread_data_t {
       raw_seconds_dropped_private+=1;
     }
     uint32 searcher_thread_id;
+    uint32 reacq_thread_id;
     uint32 producer_thread_id;
+    // Zero unless the producer's batching thread is running.
+    uint32 tracker_fd_thread_id;
     uint32 main_thread_id;
     uint32 display_thread_id;
   private:
@@ -380,6 +539,12 @@ class global_thread_data_t {
     boost::mutex filter_workitem_mutex;
     uint16 filter_workitem_private;
 
+    boost::mutex search_duty_mutex;
+    uint16 search_duty_private;
+
+    boost::mutex tracker_opencl_mutex;
+    bool tracker_opencl_private;
+
     boost::mutex sampling_carrier_twist_mutex;
     bool sampling_carrier_twist_private;
 
@@ -414,14 +579,40 @@ class global_thread_data_t {
     bladerf_device* bladerf_dev_private;
 };
 
-// IPC between main thread and searcher thread covering data capture issues.
+// IPC between the producer thread and the searcher thread. The producer
+// writes every decimated sample into a ring buffer and the searcher
+// consumes the stream at its own pace. The producer never waits for the
+// searcher: the ring is written and copied without the mutex, and the
+// searcher discards any samples that were overwritten during its copy.
+typedef struct {
+  // Only used to wait for and to notify new samples.
+  boost::mutex mutex;
+  // Notified whenever new samples have been written.
+  boost::condition condition;
+  // Decimated sample number n is stored at index n%SEARCH_RING_LENGTH.
+  itpp::cvec ring;
+  // Timestamp of every sample of the ring.
+  itpp::vec ring_timestamp;
+  // Producer sample number of every sample of the ring.
+  std::vector <uint64> ring_sample_num;
+  // Number of decimated samples written so far. Only the producer writes
+  // it, with __atomic_store_n(), after the sample itself. Other threads
+  // read it with __atomic_load_n().
+  uint64 n_written;
+} capbuf_sync_t;
+
+// IPC between the re-acquisition thread and the producer thread. Unlike
+// the searcher's capture, this capture begins as soon as it is requested.
 typedef struct {
   boost::mutex mutex;
   boost::condition condition;
   bool request;
   itpp::cvec capbuf;
-  double late;
-} capbuf_sync_t;
+  // Timestamp of the first sample of capbuf.
+  double timestamp;
+  // Producer sample number of the first sample of capbuf.
+  uint64 sample_num;
+} reacq_sync_t;
 
 // IPC between main thread and producer thread.
 typedef struct {
@@ -429,6 +620,10 @@ typedef struct {
   boost::condition condition;
   std::deque <int8> fifo;
   uint32 fifo_peak_size;
+  // When the device runs at its native rate, the fifo holds samples at
+  // the device rate and the producer resamples them with this. NULL
+  // otherwise.
+  resampler_t * resampler;
 } sampbuf_sync_t;
 
 // Small helper function to increment the slot number and the symbol number.
@@ -442,10 +637,86 @@ inline void slot_sym_inc(
     slot_num=itpp::mod(slot_num+1,20);
 }
 
+// Initialize the measurements of a tracked cell from the channel estimates
+// that the searcher obtained while decoding the MIB. ce contains one row of
+// channel estimates of the central subcarriers per port. The frequency
+// offset found by the searcher is folded into the system frequency offset.
+void tracker_warm_start(
+  global_thread_data_t & global_thread_data,
+  tracked_cell_t & tracked_cell,
+  const itpp::cmat & ce,
+  const itpp::vec & sp,
+  const itpp::vec & np
+);
+
+// FOC, DFT and TOC of one OFDM symbol of a tracked cell. data holds the
+// n_fft samples of the symbol and sample n is rotated by dphi*n. The DFT
+// starts n_fft/64 samples into the symbol and subcarriers -n_half..-1 and
+// 1..n_half are returned, in that order, compensated for a DFT that was
+// taken late samples (at 1.92MHz) too late. The OpenCL kernels in
+// tracker_kernels.cl perform the same operation.
+void tracker_sym_fd(
+  // Inputs
+  const itpp::cvec & data,
+  const double & dphi,
+  const double & late,
+  const uint16 & n_half,
+  // Outputs
+  itpp::cvec & syms
+);
+
+// Update the global k_factor from the drift of the frame timing of one
+// cell. The frame timing drifted by diff samples (with noise power
+// diff_np) in elapsed samples, all of which were timestamped using
+// k_factor_capture. Every tracker thread calls this once every
+// SCLK_UPDATE_SLOTS slots.
+void do_sclk(
+  global_thread_data_t & global_thread_data,
+  const double & diff,
+  const double & diff_np,
+  const double & elapsed,
+  const double & k_factor_capture
+);
+
+// Look for the PSS and the SSS of a lost cell near the location where
+// they are expected to be found. capbuf starts at timestamp and period is
+// the number of timestamp units per sample. Returns true if both were
+// found and updates frame_timing with the measured timing.
+bool reacq_detect(
+  // Inputs
+  tracked_cell_t & cell,
+  const SSS_td & sss_td,
+  const itpp::cvec & capbuf,
+  const double & timestamp,
+  const double & period,
+  // Outputs
+  double & frame_timing
+);
+
+// Remove a lost cell from the lost cell cache. If found is true, a new
+// track with the history of the lost cell and the given frame timing is
+// added to the list of tracked cells, unless the cell has been found
+// again in the meantime. Returns the new track or NULL. Only the
+// re-acquisition thread may call this. The caller deletes lost_cell.
+tracked_cell_t * reacq_resume(
+  tracked_cell_list_t & tracked_cell_list,
+  tracked_cell_t & lost_cell,
+  const bool & found,
+  const double & frame_timing
+);
+
+// Copy the measurement history of a cell that had been lost into the
+// tracker that is taking over from it.
+void tracker_resume(
+  tracked_cell_t & tracked_cell,
+  const tracked_cell_t & lost_cell
+);
+
 // Prototypes for all the threads.
 void producer_thread(
   sampbuf_sync_t & sampbuf_sync,
   capbuf_sync_t & capbuf_sync,
+  reacq_sync_t & reacq_sync,
   global_thread_data_t & global_thread_data,
   tracked_cell_list_t & tracked_cell_list,
   double & fc
@@ -459,6 +730,11 @@ void searcher_thread(
   global_thread_data_t & global_thread_data,
   tracked_cell_list_t & tracked_cell_list
 );
+void reacq_thread(
+  reacq_sync_t & reacq_sync,
+  global_thread_data_t & global_thread_data,
+  tracked_cell_list_t & tracked_cell_list
+);
 void display_thread(
   sampbuf_sync_t & sampbuf_sync,
   global_thread_data_t & global_thread_data,
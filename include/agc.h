@@ -0,0 +1,103 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HAVE_AGC_H
+#define HAVE_AGC_H
+
+#include <map>
+
+// Desired RMS level of the captured signal. LTE has a PAPR of around
+// 11dB, so this leaves a few dB of headroom before the ADC clips.
+#define AGC_TARGET_DBFS (-15.0)
+// The gain is left alone while the RMS level is within this many dB of
+// the target.
+#define AGC_HYSTERESIS_DB 3.0
+// Maximum fraction of I/Q values that may be at the ADC rails.
+#define AGC_CLIP_RATE_MAX 1e-4
+// Minimum gain reduction, in dB, when clipping is detected. While the
+// ADC is clipping, the RMS level underestimates the true level.
+#define AGC_CLIP_BACKOFF_DB 10.0
+// Number of samples at the head of a capture buffer that are examined.
+// This is also the length of the probe captures made by agc_set_gain().
+#define AGC_HEAD_LENGTH 19200
+// Maximum number of probe captures before a gain is accepted.
+#define AGC_MAX_ITER 5
+
+// Level of a capture buffer relative to the ADC full scale.
+typedef struct {
+  double rms_dbfs;
+  // Fraction of the I and Q values that were at the ADC rails.
+  double clip_rate;
+} agc_stats_t;
+
+// Measure the level of the first n_samp samples of capbuf. Samples are
+// assumed to be normalized so that the ADC full scale is 1.0. Values whose
+// magnitude is at least clip_level are counted as clipped.
+agc_stats_t agc_measure(
+  const itpp::cvec & capbuf,
+  const uint32 & n_samp,
+  const double & clip_level
+);
+
+// Closed loop gain control. A gain is chosen independently for every
+// center frequency and is remembered so that later scans of the same
+// frequency start from the correct gain.
+class agc_t {
+  public:
+    // Initializer. gain_init is the gain requested on the command line,
+    // -9999 if none was requested.
+    agc_t(
+      const dev_type_t::dev_type_t & dev_use,
+      const int16 & gain_init
+    );
+    // Gain, in the units of the -g option, to use when capturing at fc.
+    int16 gain(
+      const double & fc
+    ) const;
+    // Has a gain already been chosen for fc?
+    bool known(
+      const double & fc
+    ) const;
+    // Update the gain used at fc based on a capture that was performed at
+    // gain(fc). Returns true if the gain was changed.
+    bool update(
+      const double & fc,
+      const agc_stats_t & stats
+    );
+    // Load and store the gain chosen for each center frequency.
+    void load(
+      const std::string & filename
+    );
+    void save(
+      const std::string & filename
+    ) const;
+
+    // Gains supported by the device in ascending order, in dB.
+    itpp::ivec gain_table;
+    // Normalized level at which the device's ADC clips.
+    double clip_level;
+  private:
+    uint16 gain_idx_init;
+    // Index into gain_table for each center frequency, in kHz.
+    std::map <int32,uint16> fc_gain_idx;
+    uint16 nearest_idx(
+      const double & g
+    ) const;
+};
+
+#endif
+
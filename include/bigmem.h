@@ -0,0 +1,115 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HAVE_BIGMEM_H
+#define HAVE_BIGMEM_H
+
+// Size of a huge page on x86 and most ARM64 kernels.
+#define BIGMEM_HUGE_PAGE_SIZE (2*1024*1024)
+
+// How buffers that span many pages (capture buffers, correlation results,
+// OpenCL staging buffers) are backed by memory.
+//   NONE:     regular pages.
+//   THP:      ask the kernel for transparent huge pages.
+//   EXPLICIT: use pages from the hugetlbfs pool (see
+//             /proc/sys/vm/nr_hugepages) for the buffers allocated with
+//             bigmem_alloc(). Other buffers use transparent huge pages.
+namespace bigmem_policy_t {
+  enum bigmem_policy_t {NONE,THP,EXPLICIT};
+}
+
+// Parse the argument of the -H option. Aborts on an unknown mode.
+bigmem_policy_t::bigmem_policy_t bigmem_parse(
+  const char * mode
+);
+
+// Select the policy. Must be called before any large buffer is created.
+void bigmem_policy(
+  const bigmem_policy_t::bigmem_policy_t & policy
+);
+
+// Ask for huge pages to back an existing buffer. The advice is rounded out
+// to whole huge pages so that the first and last partial huge page of the
+// buffer are covered as well.
+//
+// Unless the policy is NONE, the buffer is also bound to the NUMA node of
+// the calling thread. Pages that were already written on another node are
+// migrated. This should be called by the thread that uses the buffer.
+void bigmem_advise(
+  void * p,
+  const size_t & bytes
+);
+template <class T>
+inline void bigmem_advise(
+  itpp::Vec <T> & v
+) {
+  bigmem_advise(v._data(),v.size()*sizeof(T));
+}
+template <class T>
+inline void bigmem_advise(
+  itpp::Mat <T> & m
+) {
+  bigmem_advise(m._data(),m.size()*sizeof(T));
+}
+
+// Allocate a large buffer that is written by the calling thread. The
+// buffer is bound to the NUMA node of the calling thread (unless the
+// policy is NONE) and zeroed. If pin is true, the buffer is also locked in memory
+// so that DMA transfers to and from an OpenCL device do not need to go
+// through a bounce buffer.
+void * bigmem_alloc(
+  const size_t & bytes,
+  const bool & pin
+);
+// Free a buffer allocated by bigmem_alloc(). NULL is ignored.
+void bigmem_free(
+  void * p
+);
+
+// Fraction of the pages of a buffer that reside on a NUMA node other than
+// the one of the calling thread. At most 1024 pages, evenly spaced, are
+// examined. Returns NAN if the kernel cannot report page locations.
+double bigmem_remote_fraction(
+  const void * p,
+  const size_t & bytes
+);
+template <class T>
+inline double bigmem_remote_fraction(
+  const itpp::Mat <T> & m
+) {
+  return bigmem_remote_fraction(m._data(),m.size()*sizeof(T));
+}
+
+// Count the data TLB misses of the calling thread, and of the threads it
+// creates, between start() and stop(). stop() returns -1 if the kernel
+// does not give access to the performance counters
+// (see /proc/sys/kernel/perf_event_paranoid).
+class bigmem_tlb_counter_t {
+  public:
+    bigmem_tlb_counter_t();
+    ~bigmem_tlb_counter_t();
+    void start();
+    int64 stop();
+  private:
+    int fd;
+    // Not copyable, the descriptor is closed by the destructor.
+    bigmem_tlb_counter_t(const bigmem_tlb_counter_t &);
+    bigmem_tlb_counter_t & operator=(const bigmem_tlb_counter_t &);
+};
+
+#endif
+
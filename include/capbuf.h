@@ -48,6 +48,8 @@ typedef struct bladerf{} bladerf_device;
 typedef struct {
   std::vector <unsigned char> * buf;
   rtlsdr_device * dev;
+  // Number of bytes to read.
+  uint32 len;
 } callback_package_t;
 double calculate_fc_programmed_in_context(
   // Inputs
@@ -75,6 +77,35 @@ int read_header_from_bin(
   double & fs_programmed
 );
 
+// By default, the device is programmed at 1.92MHz*correction. When a
+// native sample rate is requested, the device is programmed at that rate
+// instead and every live capture is resampled to 1.92MHz*correction. The
+// crystal correction is then applied by the resampler rather than by the
+// device.
+//
+// fs_native is the rate requested with -R, or 0 if none was requested.
+class resampler_t;
+// Parse the argument of the -R option. Aborts if it is not a positive
+// number.
+double frontend_parse(
+  const char * rate
+);
+// Sample rate at which the device should be programmed.
+double frontend_device_rate(
+  const double & fs_native,
+  const double & correction
+);
+// Called by the device configuration routines once the device has been
+// programmed at fs_device. Returns the sample rate of the captured data.
+double frontend_setup(
+  const double & fs_native,
+  const double & fs_device,
+  const double & correction
+);
+// Resampler from the device sample rate to the sample rate returned by
+// frontend_setup(), or NULL if the device does not need one.
+resampler_t * frontend_resampler();
+
 // Returns a capture buffer either from a file or from live data read
 // from the dongle.
 int capture_data(
@@ -94,7 +125,48 @@ int capture_data(
   itpp::cvec & capbuf,
   double & fc_programmed,
   double & fs_programmed,
-  const bool & read_all_in_bin
+  const bool & read_all_in_bin,
+  // Captures that are not part of the capture sequence, such as AGC
+  // probes and monitoring verifications, are neither saved nor recorded.
+  const bool & no_save=false,
+  // Number of samples of a live capture. Captures read from files are
+  // always CAPLENGTH samples long.
+  const uint32 & n_samples=CAPLENGTH
+);
+
+// Put the device in its lowest power state until the next capture. The
+// bladeRF RX module is already disabled after every capture and the
+// RTL-SDR is idle once rtlsdr_cancel_async() returns, so only the HackRF
+// needs to be told to stop streaming.
+void device_standby(
+  const dev_type_t::dev_type_t & dev_use,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev
+);
+
+// Change the gain of a device that has already been configured. gain has
+// the same units as the -g command line option.
+int set_gain(
+  const dev_type_t::dev_type_t & dev_use,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev,
+  const int16 & gain
+);
+
+// Program the device with the gain that the AGC has chosen for
+// fc_requested. If the AGC has not seen this frequency before, probe
+// captures are performed until the gain settles.
+class agc_t;
+void agc_set_gain(
+  agc_t & agc,
+  const double & fc_requested,
+  const double & correction,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev,
+  const dev_type_t::dev_type_t & dev_use
 );
 
 #endif
@@ -0,0 +1,99 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HAVE_CE_FILTER_H
+#define HAVE_CE_FILTER_H
+
+// The filters are designed for an exponential power delay profile with an
+// RMS delay spread of CE_FILTER_DS_MIN*2^k seconds, a Jakes Doppler
+// spectrum with a maximum Doppler frequency of CE_FILTER_FD_MIN*2^k Hz,
+// and an SNR of CE_FILTER_SNR_MIN_DB+k*CE_FILTER_SNR_STEP_DB dB.
+#define CE_FILTER_N_DS 6
+#define CE_FILTER_DS_MIN 0.1e-6
+#define CE_FILTER_N_FD 7
+#define CE_FILTER_FD_MIN 5.0
+#define CE_FILTER_N_SNR 9
+#define CE_FILTER_SNR_MIN_DB -10.0
+#define CE_FILTER_SNR_STEP_DB 5.0
+// The Doppler frequency is measured from the time domain autocorrelation
+// at a lag of CE_FILTER_AC_TD_LAG RS symbols. It is measured separately for
+// ports 0 and 1, whose RS symbols are 0.25ms apart on average, and for
+// ports 2 and 3, whose RS symbols are 0.5ms apart.
+#define CE_FILTER_AC_TD_LAG 4
+// The time domain autocorrelation is a slow average that starts from
+// zero. Until the weight of the measurements in that average reaches
+// CE_FILTER_AC_TD_MIN_WEIGHT, about 1000 measurements, the tracker filters
+// with filter_ce() instead.
+#define CE_FILTER_AC_TD_MIN_WEIGHT 0.01
+
+// Bank of precomputed 2-D MMSE (Wiener) filters for the raw channel
+// estimates of one OFDM symbol that contains RS. Like filter_ce() in the
+// tracker, every estimate is computed from the 3 nearest RS of the same
+// OFDM symbol and the 2 nearest RS of each of the previous and next OFDM
+// symbols that contain RS for the same port. The weights depend on the
+// delay spread, the Doppler frequency and the SNR, which are selected from
+// the autocorrelations measured by the tracker.
+class ce_filter_bank_t {
+  public:
+    // Initializer. Designs all the filters.
+    ce_filter_bank_t();
+    // Index of the filter that best matches the channel. rho_fd is the
+    // normalized frequency domain autocorrelation at a lag of one RS (6
+    // subcarriers) and rho_td is the normalized time domain autocorrelation
+    // at a lag of CE_FILTER_AC_TD_LAG RS symbols of port port_num.
+    uint16 select(
+      const uint8 & port_num,
+      const double & rho_fd,
+      const double & rho_td,
+      const double & snr
+    ) const;
+    // Filter the raw channel estimates of the current OFDM symbol.
+    // prev_left is true when the RS of the previous and next OFDM symbols
+    // are shifted to the left of the RS of the current OFDM symbol.
+    itpp::cvec filter(
+      const uint16 & idx,
+      const itpp::cvec & ce_prev,
+      const itpp::cvec & ce_curr,
+      const itpp::cvec & ce_next,
+      const bool & prev_left
+    ) const;
+    // Weights of one filter. Rows are the geometries (center, left edge,
+    // and right edge of the band, with either 2 or 1 RS of the previous
+    // and next OFDM symbols) and the columns are the taps at subcarrier
+    // offsets -6, 0, 6 of the current OFDM symbol, and -3, 3 of the
+    // previous and the next OFDM symbols.
+    const itpp::cmat & weights(
+      const uint16 & idx
+    ) const;
+    // Mean squared error of the estimates in the center of the band,
+    // relative to the power of the channel, for a channel that matches
+    // the design of the filter.
+    double mse(
+      const uint16 & idx
+    ) const;
+  private:
+    std::vector <itpp::cmat> bank;
+    std::vector <double> bank_mse;
+    // rho_fd at the boundaries between the delay spread classes and, for
+    // each port class, rho_td at the boundaries between the Doppler
+    // classes.
+    itpp::vec rho_fd_bound;
+    itpp::mat rho_td_bound;
+};
+
+#endif
+
@@ -33,6 +33,52 @@ extern Rom_tables ROM_TABLES;
 #define N_RB_MAXDL 110
 
 #define CELL_DROP_THRESHOLD 400.0
+// Number of consecutive MIB failures after which a tracker no longer trusts
+// its PBCH TTI alignment.
+#define MIB_RESYNC_THRESHOLD 4
+
+// When sampling and carrier are not twisted, every tracker reports the
+// drift of its frame timing once every SCLK_UPDATE_SLOTS slots. The reports
+// are used to estimate the sampling clock. Each report is turned into a
+// k_factor measurement using the k_factor its samples were timestamped
+// with. SCLK_PRIOR_NP is the variance assigned to the current k_factor
+// estimate when a measurement is combined.
+#define SCLK_UPDATE_SLOTS 200
+#define SCLK_PRIOR_NP 1e-13
+
+// A cell whose tracker has lost lock is remembered for REACQ_CACHE_TIME
+// seconds. Every REACQ_PERIOD_FRAMES frames, the PSS and SSS of each
+// remembered cell are searched for within +/-REACQ_WINDOW samples of
+// where they are expected to be. REACQ_THRESH is the minimum normalized
+// correlation for both of them.
+#define REACQ_CACHE_TIME 10.0
+#define REACQ_PERIOD_FRAMES 4
+#define REACQ_WINDOW 16
+#define REACQ_THRESH 0.15
+// Long enough to contain at least one complete PSS/SSS search window.
+#define REACQ_CAPLENGTH (9600+1024)
+
+// A detection belongs to an existing track only if it has the same cell ID
+// and its frame timing and frequency offset are within TRACK_TIMING_TOL
+// samples and TRACK_FREQ_TOL Hz of the track. Otherwise it is a different
+// cell that reuses the same cell ID and gets a track of its own.
+#define TRACK_TIMING_TOL 8.0
+#define TRACK_FREQ_TOL 5e3
+
+// The searcher in LTE-Tracker examines one half frame out of every
+// search_duty half frames of the decimated sample stream. The PSS
+// correlations of the last SEARCH_N_COMB examined half frames are combined
+// incoherently and a peak that crosses the detection threshold is verified
+// with the SSS and the MIB using the most recent 80ms of samples. The
+// stream is kept in a ring of SEARCH_RING_LENGTH samples. Peaks within
+// SEARCH_MASK_ARM samples of a tracked cell are ignored, and so are peaks
+// near an already verified peak for SEARCH_HOLDOFF examined half frames.
+// The PSS correlations are performed with DFT's of SEARCH_N_FFT samples.
+#define SEARCH_N_COMB 16
+#define SEARCH_RING_LENGTH (2*153600)
+#define SEARCH_MASK_ARM 274
+#define SEARCH_HOLDOFF 200
+#define SEARCH_N_FFT 4096
 
 #endif
 
@@ -0,0 +1,848 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Fused complex vector primitives that operate directly on the memory
+// of itpp vectors (v._data()) so that expressions such as
+// sum(elem_mult(conj(a),b)) can be evaluated without allocating any
+// temporary vectors.
+//
+// Each kernel has a scalar implementation and, depending on the target,
+// SSE3, AVX2+FMA, AVX-512F, or NEON implementations. On x86 the fastest
+// implementation supported by the CPU is selected at runtime. Every
+// kernel can also be called with an explicit level so that all the
+// implementations can be tested against each other.
+
+#ifndef HAVE_CVEC_SIMD_H
+#define HAVE_CVEC_SIMD_H
+
+#include <complex>
+#include <math.h>
+#include <ostream>
+#include <vector>
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CVEC_SIMD_X86
+#include <immintrin.h>
+#if (__GNUC__>=5) || defined(__clang__)
+#define CVEC_SIMD_AVX512
+#endif
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define CVEC_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace cvec_simd {
+
+typedef std::complex <double> complex_t;
+
+// Implementations that are available.
+typedef enum {
+  LEVEL_SCALAR=0,
+  LEVEL_SSE3,
+  LEVEL_AVX2,
+  LEVEL_AVX512,
+  LEVEL_NEON
+} level_t;
+
+inline const char * level_name(
+  const level_t & level
+) {
+  switch (level) {
+    case LEVEL_SSE3: return "SSE3";
+    case LEVEL_AVX2: return "AVX2";
+    case LEVEL_AVX512: return "AVX512";
+    case LEVEL_NEON: return "NEON";
+    default: return "scalar";
+  }
+}
+
+// Can the current CPU execute the implementation?
+inline bool level_supported(
+  const level_t & level
+) {
+  switch (level) {
+    case LEVEL_SCALAR:
+      return true;
+#ifdef CVEC_SIMD_X86
+    case LEVEL_SSE3:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse3");
+    case LEVEL_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2")&&__builtin_cpu_supports("fma");
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f")&&__builtin_cpu_supports("avx2")&&__builtin_cpu_supports("fma");
+#endif
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+// Fastest implementation supported by the current CPU. Only evaluated
+// once.
+inline level_t detect_level() {
+  const level_t order[]={LEVEL_AVX512,LEVEL_AVX2,LEVEL_SSE3,LEVEL_NEON};
+  for (uint8 t=0;t<sizeof(order)/sizeof(order[0]);t++) {
+    if (level_supported(order[t]))
+      return order[t];
+  }
+  return LEVEL_SCALAR;
+}
+inline level_t active_level() {
+  static const level_t level=detect_level();
+  return level;
+}
+
+namespace impl {
+
+// Scalar implementations. These are also used to process the samples
+// left over by the vector implementations.
+inline complex_t dot_scalar(const complex_t * a,const complex_t * b,const uint32 n) {
+  double re=0,im=0;
+  for (uint32 t=0;t<n;t++) {
+    re+=a[t].real()*b[t].real()-a[t].imag()*b[t].imag();
+    im+=a[t].real()*b[t].imag()+a[t].imag()*b[t].real();
+  }
+  return complex_t(re,im);
+}
+inline complex_t rdot_scalar(const complex_t * a,const double * b,const uint32 n) {
+  double re=0,im=0;
+  for (uint32 t=0;t<n;t++) {
+    re+=a[t].real()*b[t];
+    im+=a[t].imag()*b[t];
+  }
+  return complex_t(re,im);
+}
+inline complex_t cdot_scalar(const complex_t * a,const complex_t * b,const uint32 n) {
+  double re=0,im=0;
+  for (uint32 t=0;t<n;t++) {
+    re+=a[t].real()*b[t].real()+a[t].imag()*b[t].imag();
+    im+=a[t].real()*b[t].imag()-a[t].imag()*b[t].real();
+  }
+  return complex_t(re,im);
+}
+inline void mult_scalar(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  for (uint32 t=0;t<n;t++) {
+    const double re=a[t].real()*b[t].real()-a[t].imag()*b[t].imag();
+    const double im=a[t].real()*b[t].imag()+a[t].imag()*b[t].real();
+    y[t]=complex_t(re,im);
+  }
+}
+inline void mult_conj_scalar(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  for (uint32 t=0;t<n;t++) {
+    const double re=a[t].real()*b[t].real()+a[t].imag()*b[t].imag();
+    const double im=a[t].real()*b[t].imag()-a[t].imag()*b[t].real();
+    y[t]=complex_t(re,im);
+  }
+}
+inline void mac_scalar(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  for (uint32 t=0;t<n;t++) {
+    const double re=a[t].real()*b[t].real()-a[t].imag()*b[t].imag();
+    const double im=a[t].real()*b[t].imag()+a[t].imag()*b[t].real();
+    y[t]+=complex_t(re,im);
+  }
+}
+inline void axpy_scalar(const complex_t & alpha,const complex_t * x,complex_t * y,const uint32 n) {
+  for (uint32 t=0;t<n;t++) {
+    const double re=alpha.real()*x[t].real()-alpha.imag()*x[t].imag();
+    const double im=alpha.real()*x[t].imag()+alpha.imag()*x[t].real();
+    y[t]+=complex_t(re,im);
+  }
+}
+inline double power_scalar(const complex_t * a,const uint32 n) {
+  double r=0;
+  for (uint32 t=0;t<n;t++) {
+    r+=a[t].real()*a[t].real()+a[t].imag()*a[t].imag();
+  }
+  return r;
+}
+inline void mag2_scalar(const complex_t * a,double * y,const uint32 n) {
+  for (uint32 t=0;t<n;t++) {
+    y[t]=a[t].real()*a[t].real()+a[t].imag()*a[t].imag();
+  }
+}
+
+#ifdef CVEC_SIMD_X86
+// SSE3: one complex number per register.
+__attribute__((target("sse3")))
+inline complex_t dot_sse3(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  __m128d acc_re=_mm_setzero_pd();
+  __m128d acc_im=_mm_setzero_pd();
+  for (uint32 t=0;t<n;t++) {
+    const __m128d va=_mm_loadu_pd(pa+2*t);
+    const __m128d vb=_mm_loadu_pd(pb+2*t);
+    acc_re=_mm_add_pd(acc_re,_mm_mul_pd(va,_mm_movedup_pd(vb)));
+    acc_im=_mm_add_pd(acc_im,_mm_mul_pd(_mm_shuffle_pd(va,va,1),_mm_shuffle_pd(vb,vb,3)));
+  }
+  double r[2];
+  _mm_storeu_pd(r,_mm_addsub_pd(acc_re,acc_im));
+  return complex_t(r[0],r[1]);
+}
+__attribute__((target("sse3")))
+inline complex_t rdot_sse3(const complex_t * a,const double * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  __m128d acc=_mm_setzero_pd();
+  for (uint32 t=0;t<n;t++) {
+    acc=_mm_add_pd(acc,_mm_mul_pd(_mm_loadu_pd(pa+2*t),_mm_set1_pd(b[t])));
+  }
+  double r[2];
+  _mm_storeu_pd(r,acc);
+  return complex_t(r[0],r[1]);
+}
+__attribute__((target("sse3")))
+inline complex_t cdot_sse3(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  __m128d acc_re=_mm_setzero_pd();
+  __m128d acc_im=_mm_setzero_pd();
+  for (uint32 t=0;t<n;t++) {
+    const __m128d va=_mm_loadu_pd(pa+2*t);
+    const __m128d vb=_mm_loadu_pd(pb+2*t);
+    acc_re=_mm_add_pd(acc_re,_mm_mul_pd(vb,_mm_movedup_pd(va)));
+    acc_im=_mm_add_pd(acc_im,_mm_mul_pd(_mm_shuffle_pd(vb,vb,1),_mm_shuffle_pd(va,va,3)));
+  }
+  double r[2];
+  _mm_storeu_pd(r,_mm_addsub_pd(acc_re,_mm_sub_pd(_mm_setzero_pd(),acc_im)));
+  return complex_t(r[0],r[1]);
+}
+__attribute__((target("sse3")))
+inline __m128d cmul_sse3(const __m128d & va,const __m128d & vb) {
+  return _mm_addsub_pd(_mm_mul_pd(va,_mm_movedup_pd(vb)),_mm_mul_pd(_mm_shuffle_pd(va,va,1),_mm_shuffle_pd(vb,vb,3)));
+}
+__attribute__((target("sse3")))
+inline void mult_sse3(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  for (uint32 t=0;t<n;t++) {
+    _mm_storeu_pd(py+2*t,cmul_sse3(_mm_loadu_pd(pa+2*t),_mm_loadu_pd(pb+2*t)));
+  }
+}
+__attribute__((target("sse3")))
+inline void mult_conj_sse3(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  const __m128d sign=_mm_set_pd(-0.0,0.0);
+  for (uint32 t=0;t<n;t++) {
+    const __m128d va=_mm_xor_pd(_mm_loadu_pd(pa+2*t),sign);
+    _mm_storeu_pd(py+2*t,cmul_sse3(va,_mm_loadu_pd(pb+2*t)));
+  }
+}
+__attribute__((target("sse3")))
+inline void mac_sse3(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  for (uint32 t=0;t<n;t++) {
+    const __m128d p=cmul_sse3(_mm_loadu_pd(pa+2*t),_mm_loadu_pd(pb+2*t));
+    _mm_storeu_pd(py+2*t,_mm_add_pd(_mm_loadu_pd(py+2*t),p));
+  }
+}
+__attribute__((target("sse3")))
+inline void axpy_sse3(const complex_t & alpha,const complex_t * x,complex_t * y,const uint32 n) {
+  const double * px=reinterpret_cast<const double *>(x);
+  double * py=reinterpret_cast<double *>(y);
+  const __m128d va=_mm_set_pd(alpha.imag(),alpha.real());
+  for (uint32 t=0;t<n;t++) {
+    const __m128d p=cmul_sse3(_mm_loadu_pd(px+2*t),va);
+    _mm_storeu_pd(py+2*t,_mm_add_pd(_mm_loadu_pd(py+2*t),p));
+  }
+}
+__attribute__((target("sse3")))
+inline double power_sse3(const complex_t * a,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  __m128d acc=_mm_setzero_pd();
+  for (uint32 t=0;t<n;t++) {
+    const __m128d va=_mm_loadu_pd(pa+2*t);
+    acc=_mm_add_pd(acc,_mm_mul_pd(va,va));
+  }
+  double r[2];
+  _mm_storeu_pd(r,_mm_hadd_pd(acc,acc));
+  return r[0];
+}
+__attribute__((target("sse3")))
+inline void mag2_sse3(const complex_t * a,double * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  uint32 t=0;
+  for (;t+2<=n;t+=2) {
+    const __m128d v0=_mm_loadu_pd(pa+2*t);
+    const __m128d v1=_mm_loadu_pd(pa+2*t+2);
+    _mm_storeu_pd(y+t,_mm_hadd_pd(_mm_mul_pd(v0,v0),_mm_mul_pd(v1,v1)));
+  }
+  mag2_scalar(a+t,y+t,n-t);
+}
+
+// AVX2+FMA: two complex numbers per register. Two sets of accumulators
+// are used to hide the latency of the FMA instructions.
+__attribute__((target("avx2,fma")))
+inline complex_t hsum_avx2(const __m256d & acc_re,const __m256d & acc_im,const bool & conj_a) {
+  const __m256d v=conj_a?
+    _mm256_addsub_pd(acc_re,_mm256_sub_pd(_mm256_setzero_pd(),acc_im)):
+    _mm256_addsub_pd(acc_re,acc_im);
+  double r[2];
+  _mm_storeu_pd(r,_mm_add_pd(_mm256_castpd256_pd128(v),_mm256_extractf128_pd(v,1)));
+  return complex_t(r[0],r[1]);
+}
+__attribute__((target("avx2,fma")))
+inline complex_t dot_avx2(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  __m256d acc_re0=_mm256_setzero_pd(),acc_im0=_mm256_setzero_pd();
+  __m256d acc_re1=_mm256_setzero_pd(),acc_im1=_mm256_setzero_pd();
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m256d va0=_mm256_loadu_pd(pa+2*t);
+    const __m256d vb0=_mm256_loadu_pd(pb+2*t);
+    const __m256d va1=_mm256_loadu_pd(pa+2*t+4);
+    const __m256d vb1=_mm256_loadu_pd(pb+2*t+4);
+    acc_re0=_mm256_fmadd_pd(va0,_mm256_movedup_pd(vb0),acc_re0);
+    acc_im0=_mm256_fmadd_pd(_mm256_permute_pd(va0,0x5),_mm256_permute_pd(vb0,0xF),acc_im0);
+    acc_re1=_mm256_fmadd_pd(va1,_mm256_movedup_pd(vb1),acc_re1);
+    acc_im1=_mm256_fmadd_pd(_mm256_permute_pd(va1,0x5),_mm256_permute_pd(vb1,0xF),acc_im1);
+  }
+  const complex_t r=hsum_avx2(_mm256_add_pd(acc_re0,acc_re1),_mm256_add_pd(acc_im0,acc_im1),false);
+  return r+dot_scalar(a+t,b+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline complex_t rdot_avx2(const complex_t * a,const double * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  __m256d acc0=_mm256_setzero_pd();
+  __m256d acc1=_mm256_setzero_pd();
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    // b0 b0 b1 b1 and b2 b2 b3 b3.
+    const __m256d vb0=_mm256_permute4x64_pd(_mm256_castpd128_pd256(_mm_loadu_pd(b+t)),0x50);
+    const __m256d vb1=_mm256_permute4x64_pd(_mm256_castpd128_pd256(_mm_loadu_pd(b+t+2)),0x50);
+    acc0=_mm256_fmadd_pd(_mm256_loadu_pd(pa+2*t),vb0,acc0);
+    acc1=_mm256_fmadd_pd(_mm256_loadu_pd(pa+2*t+4),vb1,acc1);
+  }
+  const __m256d acc=_mm256_add_pd(acc0,acc1);
+  double r[2];
+  _mm_storeu_pd(r,_mm_add_pd(_mm256_castpd256_pd128(acc),_mm256_extractf128_pd(acc,1)));
+  return complex_t(r[0],r[1])+rdot_scalar(a+t,b+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline complex_t cdot_avx2(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  __m256d acc_re0=_mm256_setzero_pd(),acc_im0=_mm256_setzero_pd();
+  __m256d acc_re1=_mm256_setzero_pd(),acc_im1=_mm256_setzero_pd();
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m256d va0=_mm256_loadu_pd(pa+2*t);
+    const __m256d vb0=_mm256_loadu_pd(pb+2*t);
+    const __m256d va1=_mm256_loadu_pd(pa+2*t+4);
+    const __m256d vb1=_mm256_loadu_pd(pb+2*t+4);
+    acc_re0=_mm256_fmadd_pd(vb0,_mm256_movedup_pd(va0),acc_re0);
+    acc_im0=_mm256_fmadd_pd(_mm256_permute_pd(vb0,0x5),_mm256_permute_pd(va0,0xF),acc_im0);
+    acc_re1=_mm256_fmadd_pd(vb1,_mm256_movedup_pd(va1),acc_re1);
+    acc_im1=_mm256_fmadd_pd(_mm256_permute_pd(vb1,0x5),_mm256_permute_pd(va1,0xF),acc_im1);
+  }
+  const complex_t r=hsum_avx2(_mm256_add_pd(acc_re0,acc_re1),_mm256_add_pd(acc_im0,acc_im1),true);
+  return r+cdot_scalar(a+t,b+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline __m256d cmul_avx2(const __m256d & va,const __m256d & vb) {
+  return _mm256_fmaddsub_pd(va,_mm256_movedup_pd(vb),_mm256_mul_pd(_mm256_permute_pd(va,0x5),_mm256_permute_pd(vb,0xF)));
+}
+__attribute__((target("avx2,fma")))
+inline __m256d cmul_conj_avx2(const __m256d & va,const __m256d & vb) {
+  return _mm256_fmsubadd_pd(vb,_mm256_movedup_pd(va),_mm256_mul_pd(_mm256_permute_pd(vb,0x5),_mm256_permute_pd(va,0xF)));
+}
+__attribute__((target("avx2,fma")))
+inline void mult_avx2(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  uint32 t=0;
+  for (;t+2<=n;t+=2) {
+    _mm256_storeu_pd(py+2*t,cmul_avx2(_mm256_loadu_pd(pa+2*t),_mm256_loadu_pd(pb+2*t)));
+  }
+  mult_scalar(a+t,b+t,y+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline void mult_conj_avx2(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  uint32 t=0;
+  for (;t+2<=n;t+=2) {
+    _mm256_storeu_pd(py+2*t,cmul_conj_avx2(_mm256_loadu_pd(pa+2*t),_mm256_loadu_pd(pb+2*t)));
+  }
+  mult_conj_scalar(a+t,b+t,y+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline void mac_avx2(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  uint32 t=0;
+  for (;t+2<=n;t+=2) {
+    const __m256d p=cmul_avx2(_mm256_loadu_pd(pa+2*t),_mm256_loadu_pd(pb+2*t));
+    _mm256_storeu_pd(py+2*t,_mm256_add_pd(_mm256_loadu_pd(py+2*t),p));
+  }
+  mac_scalar(a+t,b+t,y+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline void axpy_avx2(const complex_t & alpha,const complex_t * x,complex_t * y,const uint32 n) {
+  const double * px=reinterpret_cast<const double *>(x);
+  double * py=reinterpret_cast<double *>(y);
+  const __m256d alpha_re=_mm256_set1_pd(alpha.real());
+  const __m256d alpha_im=_mm256_set1_pd(alpha.imag());
+  uint32 t=0;
+  for (;t+2<=n;t+=2) {
+    const __m256d vx=_mm256_loadu_pd(px+2*t);
+    const __m256d p=_mm256_fmaddsub_pd(vx,alpha_re,_mm256_mul_pd(_mm256_permute_pd(vx,0x5),alpha_im));
+    _mm256_storeu_pd(py+2*t,_mm256_add_pd(_mm256_loadu_pd(py+2*t),p));
+  }
+  axpy_scalar(alpha,x+t,y+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline double power_avx2(const complex_t * a,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  __m256d acc0=_mm256_setzero_pd();
+  __m256d acc1=_mm256_setzero_pd();
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m256d v0=_mm256_loadu_pd(pa+2*t);
+    const __m256d v1=_mm256_loadu_pd(pa+2*t+4);
+    acc0=_mm256_fmadd_pd(v0,v0,acc0);
+    acc1=_mm256_fmadd_pd(v1,v1,acc1);
+  }
+  const __m256d acc=_mm256_add_pd(acc0,acc1);
+  __m128d s=_mm_add_pd(_mm256_castpd256_pd128(acc),_mm256_extractf128_pd(acc,1));
+  s=_mm_hadd_pd(s,s);
+  return _mm_cvtsd_f64(s)+power_scalar(a+t,n-t);
+}
+__attribute__((target("avx2,fma")))
+inline void mag2_avx2(const complex_t * a,double * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m256d v0=_mm256_loadu_pd(pa+2*t);
+    const __m256d v1=_mm256_loadu_pd(pa+2*t+4);
+    // hadd interleaves the two 128 bit lanes: 0 2 1 3.
+    const __m256d h=_mm256_hadd_pd(_mm256_mul_pd(v0,v0),_mm256_mul_pd(v1,v1));
+    _mm256_storeu_pd(y+t,_mm256_permute4x64_pd(h,0xD8));
+  }
+  mag2_scalar(a+t,y+t,n-t);
+}
+
+#ifdef CVEC_SIMD_AVX512
+// AVX-512F: four complex numbers per register. Only the kernels that
+// benefit from the wider registers are implemented, the others reuse
+// the AVX2 implementation.
+// Some versions of gcc produce spurious warnings for the AVX-512
+// intrinsics, which break the -Werror debug build.
+#ifndef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f,avx2,fma")))
+inline complex_t hsum_avx512(const __m512d & acc_re,const __m512d & acc_im,const bool & conj_a) {
+  double re[8],im[8];
+  _mm512_storeu_pd(re,acc_re);
+  _mm512_storeu_pd(im,acc_im);
+  double r_re=0,r_im=0;
+  for (uint8 t=0;t<8;t+=2) {
+    r_re+=conj_a?re[t]+im[t]:re[t]-im[t];
+    r_im+=conj_a?re[t+1]-im[t+1]:re[t+1]+im[t+1];
+  }
+  return complex_t(r_re,r_im);
+}
+__attribute__((target("avx512f,avx2,fma")))
+inline complex_t dot_avx512(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  __m512d acc_re=_mm512_setzero_pd(),acc_im=_mm512_setzero_pd();
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m512d va=_mm512_loadu_pd(pa+2*t);
+    const __m512d vb=_mm512_loadu_pd(pb+2*t);
+    acc_re=_mm512_fmadd_pd(va,_mm512_unpacklo_pd(vb,vb),acc_re);
+    acc_im=_mm512_fmadd_pd(_mm512_shuffle_pd(va,va,0x55),_mm512_unpackhi_pd(vb,vb),acc_im);
+  }
+  return hsum_avx512(acc_re,acc_im,false)+dot_scalar(a+t,b+t,n-t);
+}
+__attribute__((target("avx512f,avx2,fma")))
+inline complex_t cdot_avx512(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  __m512d acc_re=_mm512_setzero_pd(),acc_im=_mm512_setzero_pd();
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m512d va=_mm512_loadu_pd(pa+2*t);
+    const __m512d vb=_mm512_loadu_pd(pb+2*t);
+    acc_re=_mm512_fmadd_pd(vb,_mm512_unpacklo_pd(va,va),acc_re);
+    acc_im=_mm512_fmadd_pd(_mm512_shuffle_pd(vb,vb,0x55),_mm512_unpackhi_pd(va,va),acc_im);
+  }
+  return hsum_avx512(acc_re,acc_im,true)+cdot_scalar(a+t,b+t,n-t);
+}
+__attribute__((target("avx512f,avx2,fma")))
+inline __m512d cmul_avx512(const __m512d & va,const __m512d & vb) {
+  return _mm512_fmaddsub_pd(va,_mm512_unpacklo_pd(vb,vb),_mm512_mul_pd(_mm512_shuffle_pd(va,va,0x55),_mm512_unpackhi_pd(vb,vb)));
+}
+__attribute__((target("avx512f,avx2,fma")))
+inline void mult_avx512(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    _mm512_storeu_pd(py+2*t,cmul_avx512(_mm512_loadu_pd(pa+2*t),_mm512_loadu_pd(pb+2*t)));
+  }
+  mult_avx2(a+t,b+t,y+t,n-t);
+}
+__attribute__((target("avx512f,avx2,fma")))
+inline void mac_avx512(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m512d p=cmul_avx512(_mm512_loadu_pd(pa+2*t),_mm512_loadu_pd(pb+2*t));
+    _mm512_storeu_pd(py+2*t,_mm512_add_pd(_mm512_loadu_pd(py+2*t),p));
+  }
+  mac_avx2(a+t,b+t,y+t,n-t);
+}
+__attribute__((target("avx512f,avx2,fma")))
+inline double power_avx512(const complex_t * a,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  __m512d acc=_mm512_setzero_pd();
+  uint32 t=0;
+  for (;t+4<=n;t+=4) {
+    const __m512d v=_mm512_loadu_pd(pa+2*t);
+    acc=_mm512_fmadd_pd(v,v,acc);
+  }
+  double r[8];
+  _mm512_storeu_pd(r,acc);
+  return r[0]+r[1]+r[2]+r[3]+r[4]+r[5]+r[6]+r[7]+power_scalar(a+t,n-t);
+}
+#ifndef __clang__
+#pragma GCC diagnostic pop
+#endif
+#endif
+#endif
+
+#ifdef CVEC_SIMD_NEON
+// NEON: one complex number per register.
+inline float64x2_t cmul_neon(const float64x2_t & va,const float64x2_t & vb) {
+  const float64x2_t sign={-1.0,1.0};
+  const float64x2_t a_swap=vmulq_f64(vextq_f64(va,va,1),sign);
+  return vfmaq_f64(vmulq_f64(va,vdupq_laneq_f64(vb,0)),a_swap,vdupq_laneq_f64(vb,1));
+}
+inline complex_t dot_neon(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  float64x2_t acc=vdupq_n_f64(0);
+  for (uint32 t=0;t<n;t++) {
+    acc=vaddq_f64(acc,cmul_neon(vld1q_f64(pa+2*t),vld1q_f64(pb+2*t)));
+  }
+  return complex_t(vgetq_lane_f64(acc,0),vgetq_lane_f64(acc,1));
+}
+inline complex_t rdot_neon(const complex_t * a,const double * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  float64x2_t acc=vdupq_n_f64(0);
+  for (uint32 t=0;t<n;t++) {
+    acc=vfmaq_n_f64(acc,vld1q_f64(pa+2*t),b[t]);
+  }
+  return complex_t(vgetq_lane_f64(acc,0),vgetq_lane_f64(acc,1));
+}
+inline complex_t cdot_neon(const complex_t * a,const complex_t * b,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  const float64x2_t conj={1.0,-1.0};
+  float64x2_t acc=vdupq_n_f64(0);
+  for (uint32 t=0;t<n;t++) {
+    acc=vaddq_f64(acc,cmul_neon(vmulq_f64(vld1q_f64(pa+2*t),conj),vld1q_f64(pb+2*t)));
+  }
+  return complex_t(vgetq_lane_f64(acc,0),vgetq_lane_f64(acc,1));
+}
+inline void mult_neon(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  for (uint32 t=0;t<n;t++) {
+    vst1q_f64(py+2*t,cmul_neon(vld1q_f64(pa+2*t),vld1q_f64(pb+2*t)));
+  }
+}
+inline void mult_conj_neon(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  const float64x2_t conj={1.0,-1.0};
+  for (uint32 t=0;t<n;t++) {
+    vst1q_f64(py+2*t,cmul_neon(vmulq_f64(vld1q_f64(pa+2*t),conj),vld1q_f64(pb+2*t)));
+  }
+}
+inline void mac_neon(const complex_t * a,const complex_t * b,complex_t * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  const double * pb=reinterpret_cast<const double *>(b);
+  double * py=reinterpret_cast<double *>(y);
+  for (uint32 t=0;t<n;t++) {
+    vst1q_f64(py+2*t,vaddq_f64(vld1q_f64(py+2*t),cmul_neon(vld1q_f64(pa+2*t),vld1q_f64(pb+2*t))));
+  }
+}
+inline void axpy_neon(const complex_t & alpha,const complex_t * x,complex_t * y,const uint32 n) {
+  const double * px=reinterpret_cast<const double *>(x);
+  double * py=reinterpret_cast<double *>(y);
+  const float64x2_t va={alpha.real(),alpha.imag()};
+  for (uint32 t=0;t<n;t++) {
+    vst1q_f64(py+2*t,vaddq_f64(vld1q_f64(py+2*t),cmul_neon(vld1q_f64(px+2*t),va)));
+  }
+}
+inline double power_neon(const complex_t * a,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  float64x2_t acc=vdupq_n_f64(0);
+  for (uint32 t=0;t<n;t++) {
+    const float64x2_t v=vld1q_f64(pa+2*t);
+    acc=vfmaq_f64(acc,v,v);
+  }
+  return vaddvq_f64(acc);
+}
+inline void mag2_neon(const complex_t * a,double * y,const uint32 n) {
+  const double * pa=reinterpret_cast<const double *>(a);
+  uint32 t=0;
+  for (;t+2<=n;t+=2) {
+    const float64x2_t v0=vld1q_f64(pa+2*t);
+    const float64x2_t v1=vld1q_f64(pa+2*t+2);
+    vst1q_f64(y+t,vpaddq_f64(vmulq_f64(v0,v0),vmulq_f64(v1,v1)));
+  }
+  mag2_scalar(a+t,y+t,n-t);
+}
+#endif
+
+}
+
+// sum(elem_mult(a,b))
+inline complex_t dot(const level_t & level,const complex_t * a,const complex_t * b,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512: return impl::dot_avx512(a,b,n);
+#endif
+    case LEVEL_AVX2: return impl::dot_avx2(a,b,n);
+    case LEVEL_SSE3: return impl::dot_sse3(a,b,n);
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: return impl::dot_neon(a,b,n);
+#endif
+    default: return impl::dot_scalar(a,b,n);
+  }
+}
+
+// sum(elem_mult(a,b)) for a real b
+inline complex_t rdot(const level_t & level,const complex_t * a,const double * b,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512:
+#endif
+    case LEVEL_AVX2: return impl::rdot_avx2(a,b,n);
+    case LEVEL_SSE3: return impl::rdot_sse3(a,b,n);
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: return impl::rdot_neon(a,b,n);
+#endif
+    default: return impl::rdot_scalar(a,b,n);
+  }
+}
+
+// sum(elem_mult(conj(a),b))
+inline complex_t cdot(const level_t & level,const complex_t * a,const complex_t * b,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512: return impl::cdot_avx512(a,b,n);
+#endif
+    case LEVEL_AVX2: return impl::cdot_avx2(a,b,n);
+    case LEVEL_SSE3: return impl::cdot_sse3(a,b,n);
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: return impl::cdot_neon(a,b,n);
+#endif
+    default: return impl::cdot_scalar(a,b,n);
+  }
+}
+
+// y=elem_mult(a,b). y may be the same as a or b.
+inline void mult(const level_t & level,const complex_t * a,const complex_t * b,complex_t * y,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512: impl::mult_avx512(a,b,y,n); break;
+#endif
+    case LEVEL_AVX2: impl::mult_avx2(a,b,y,n); break;
+    case LEVEL_SSE3: impl::mult_sse3(a,b,y,n); break;
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: impl::mult_neon(a,b,y,n); break;
+#endif
+    default: impl::mult_scalar(a,b,y,n);
+  }
+}
+
+// y=elem_mult(conj(a),b). y may be the same as a or b.
+inline void mult_conj(const level_t & level,const complex_t * a,const complex_t * b,complex_t * y,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512:
+#endif
+    case LEVEL_AVX2: impl::mult_conj_avx2(a,b,y,n); break;
+    case LEVEL_SSE3: impl::mult_conj_sse3(a,b,y,n); break;
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: impl::mult_conj_neon(a,b,y,n); break;
+#endif
+    default: impl::mult_conj_scalar(a,b,y,n);
+  }
+}
+
+// y+=elem_mult(a,b)
+inline void mac(const level_t & level,const complex_t * a,const complex_t * b,complex_t * y,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512: impl::mac_avx512(a,b,y,n); break;
+#endif
+    case LEVEL_AVX2: impl::mac_avx2(a,b,y,n); break;
+    case LEVEL_SSE3: impl::mac_sse3(a,b,y,n); break;
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: impl::mac_neon(a,b,y,n); break;
+#endif
+    default: impl::mac_scalar(a,b,y,n);
+  }
+}
+
+// y+=alpha*x
+inline void axpy(const level_t & level,const complex_t & alpha,const complex_t * x,complex_t * y,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512:
+#endif
+    case LEVEL_AVX2: impl::axpy_avx2(alpha,x,y,n); break;
+    case LEVEL_SSE3: impl::axpy_sse3(alpha,x,y,n); break;
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: impl::axpy_neon(alpha,x,y,n); break;
+#endif
+    default: impl::axpy_scalar(alpha,x,y,n);
+  }
+}
+
+// sum(sqr(a))
+inline double power(const level_t & level,const complex_t * a,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512: return impl::power_avx512(a,n);
+#endif
+    case LEVEL_AVX2: return impl::power_avx2(a,n);
+    case LEVEL_SSE3: return impl::power_sse3(a,n);
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: return impl::power_neon(a,n);
+#endif
+    default: return impl::power_scalar(a,n);
+  }
+}
+
+// y=sqr(a)
+inline void mag2(const level_t & level,const complex_t * a,double * y,const uint32 & n) {
+  switch (level) {
+#ifdef CVEC_SIMD_X86
+#ifdef CVEC_SIMD_AVX512
+    case LEVEL_AVX512:
+#endif
+    case LEVEL_AVX2: impl::mag2_avx2(a,y,n); break;
+    case LEVEL_SSE3: impl::mag2_sse3(a,y,n); break;
+#endif
+#ifdef CVEC_SIMD_NEON
+    case LEVEL_NEON: impl::mag2_neon(a,y,n); break;
+#endif
+    default: impl::mag2_scalar(a,y,n);
+  }
+}
+
+// y=elem_mult(a,exp(J*(phase+dphase*(0:n-1)))). y may be the same as a.
+// The phasors are generated by a recurrence that is reseeded every
+// CVEC_SIMD_ROTATE_BLOCK samples so that the accumulated phase error stays
+// negligible.
+#define CVEC_SIMD_ROTATE_BLOCK 64
+inline void rotate(const level_t & level,const complex_t * a,const double & phase,const double & dphase,complex_t * y,const uint32 & n) {
+  complex_t phasor[CVEC_SIMD_ROTATE_BLOCK];
+  const complex_t step(cos(dphase),sin(dphase));
+  for (uint32 t=0;t<n;t+=CVEC_SIMD_ROTATE_BLOCK) {
+    const uint32 n_block=(n-t<CVEC_SIMD_ROTATE_BLOCK)?n-t:CVEC_SIMD_ROTATE_BLOCK;
+    const double p=phase+dphase*t;
+    phasor[0]=complex_t(cos(p),sin(p));
+    for (uint32 k=1;k<n_block;k++) {
+      phasor[k]=phasor[k-1]*step;
+    }
+    mult(level,a+t,phasor,y+t,n_block);
+  }
+}
+
+// Versions that use the fastest implementation supported by the CPU.
+inline complex_t dot(const complex_t * a,const complex_t * b,const uint32 & n) {
+  return dot(active_level(),a,b,n);
+}
+inline complex_t rdot(const complex_t * a,const double * b,const uint32 & n) {
+  return rdot(active_level(),a,b,n);
+}
+inline complex_t cdot(const complex_t * a,const complex_t * b,const uint32 & n) {
+  return cdot(active_level(),a,b,n);
+}
+inline void mult(const complex_t * a,const complex_t * b,complex_t * y,const uint32 & n) {
+  mult(active_level(),a,b,y,n);
+}
+inline void mult_conj(const complex_t * a,const complex_t * b,complex_t * y,const uint32 & n) {
+  mult_conj(active_level(),a,b,y,n);
+}
+inline void mac(const complex_t * a,const complex_t * b,complex_t * y,const uint32 & n) {
+  mac(active_level(),a,b,y,n);
+}
+inline void axpy(const complex_t & alpha,const complex_t * x,complex_t * y,const uint32 & n) {
+  axpy(active_level(),alpha,x,y,n);
+}
+inline double power(const complex_t * a,const uint32 & n) {
+  return power(active_level(),a,n);
+}
+inline void mag2(const complex_t * a,double * y,const uint32 & n) {
+  mag2(active_level(),a,y,n);
+}
+inline void rotate(const complex_t * a,const double & phase,const double & dphase,complex_t * y,const uint32 & n) {
+  rotate(active_level(),a,phase,dphase,y,n);
+}
+
+}
+
+#endif
@@ -18,6 +18,9 @@
 #ifndef HAVE_DSP_H
 #define HAVE_DSP_H
 
+#include <boost/math/special_functions/gamma.hpp>
+#include "cvec_simd.h"
+
 // Return the average power of a vector.
 template <class myType>
 double sigpower(const myType v) {
@@ -27,6 +30,9 @@ double sigpower(const myType v) {
   }
   return (r/length(v));
 }
+inline double sigpower(const itpp::cvec & v) {
+  return cvec_simd::power(v._data(),length(v))/length(v);
+}
 
 // Wrapers to properly scale fft and ifft output so that
 // sigpower(fft(x))==sigpower(x).
@@ -42,13 +48,7 @@ inline itpp::cvec fshift(const itpp::cvec &seq,const double f,const double fs) {
   double k=itpp::pi*f/(fs/2);
   const uint32 len=length(seq);
   itpp::cvec r(len);
-  std::complex<double>coeff;
-  for (uint32 t=0;t<len;t++) {
-    coeff.real()=cos(k*t);
-    coeff.imag()=sin(k*t);
-    //r(t)=seq(t)*exp(k*((double)t));
-    r(t)=seq(t)*coeff;
-  }
+  cvec_simd::rotate(seq._data(),0,k,r._data(),len);
   return r;
 }
 // Shift vector seq up by f Hz assuming that seq was sampled at 2 Hz.
@@ -59,13 +59,7 @@ inline void fshift_inplace(itpp::cvec &seq,const double f,const double fs) {
   //std::complex <double> k=std::complex<double>(0,pi*f/(fs/2));
   double k=itpp::pi*f/(fs/2);
   const uint32 len=length(seq);
-  std::complex<double>coeff;
-  for (uint32 t=0;t<len;t++) {
-    coeff.real()=cos(k*t);
-    coeff.imag()=sin(k*t);
-    //r(t)=seq(t)*exp(k*((double)t));
-    seq(t)*=coeff;
-  }
+  cvec_simd::rotate(seq._data(),0,k,seq._data(),len);
 }
 inline void fshift_inplace(itpp::cvec &seq,const double f) {
   fshift_inplace(seq,f,2);
@@ -206,5 +200,138 @@ itpp::cvec interpft(
   const uint32 & n_y_pre
 );
 
+// Number of captures over which the IQ imbalance statistics are averaged.
+#define IQ_CORR_AVG_LENGTH 16
+
+// Blind DC offset and IQ imbalance correction.
+//
+// The received LTE signal is circular: its I and Q components have equal
+// power and are uncorrelated. Gain and phase mismatch between the I and
+// Q branches of the receiver break this property and create an image of
+// every signal at the mirrored frequency. The mismatch is estimated from
+// the I/Q powers and the I/Q correlation, averaged over successive
+// captures from the same device, and is undone by re-orthogonalizing Q
+// against I.
+class iq_corr_t {
+  public:
+    // Initializer
+    iq_corr_t();
+    // Remove the DC offset from capbuf, update the IQ imbalance estimate
+    // with capbuf, and correct the IQ imbalance of capbuf.
+    void correct(
+      itpp::cvec & capbuf
+    );
+    // Image rejection ratio, in dB, of the uncorrected signal.
+    double irr_db() const;
+    // Estimated gain of the Q branch relative to the I branch.
+    double gain;
+    // Estimated phase error of the Q branch, in radians.
+    double phase;
+  private:
+    double p_ii;
+    double p_qq;
+    double p_iq;
+    uint32 n_capture;
+};
+
+// Ratio between the sample rate fs and the 1.92MHz sample rate used by
+// the searcher, rounded to an integer. Returns 1 if fs is unknown.
+uint16 lte_oversample(
+  const double & fs
+);
+// Largest LTE bandwidth, in RB's, that fits within a sample rate of
+// oversample*1.92MHz.
+int8 lte_max_rb(
+  const uint16 & oversample
+);
+
+// Number of filter taps per output sample used by decimator_t.
+#define DECIMATOR_TAPS_PER_PHASE 16
+
+// Streaming decimation by an integer factor. A Hamming windowed sinc
+// lowpass filter with a cutoff at the output Nyquist frequency is only
+// evaluated for the samples that are kept. The filter delays the signal
+// by exactly DECIMATOR_TAPS_PER_PHASE/2 output samples.
+class decimator_t {
+  public:
+    // Initializer
+    decimator_t(
+      const uint16 & factor
+    );
+    // Push one input sample. Returns true, and writes the output sample to
+    // y, once every factor input samples.
+    bool push(
+      const std::complex <double> & x,
+      std::complex <double> & y
+    );
+    // Delay, in output samples, introduced by the filter.
+    uint16 delay() const;
+    const uint16 factor;
+  private:
+    itpp::cvec taps;
+    // The most recent input samples are stored twice so that the filter
+    // can always be applied to a contiguous block of memory.
+    itpp::cvec hist;
+    uint32 hist_idx;
+    uint16 phase;
+};
+
+// Number of filter taps per sample at the lower of the two sample rates
+// used by resampler_t.
+#define RESAMPLER_TAPS_PER_PHASE 16
+// Number of fractional delays for which resampler_t precomputes the
+// filter. Output times are rounded to the nearest of these, which limits
+// the timing error to 1/(2*RESAMPLER_PHASES) input samples.
+#define RESAMPLER_PHASES 256
+
+// Streaming polyphase resampler from fs_in to fs_out. The ratio does not
+// need to be an integer or a ratio of small integers. A Hamming windowed
+// sinc lowpass filter with a cutoff at the lower of the two Nyquist
+// frequencies is precomputed for RESAMPLER_PHASES fractional delays and
+// only the branch closest to each output time is evaluated.
+//
+// Output sample k is the signal at the time of input sample k*fs_in/fs_out.
+// It becomes available delay() input samples after that time.
+class resampler_t {
+  public:
+    // Initializer
+    resampler_t(
+      const double & fs_in,
+      const double & fs_out
+    );
+    // Forget all the samples pushed so far. The next input sample is
+    // input sample 0 again.
+    void reset();
+    // Push one input sample. Writes the output samples that become
+    // available to y and returns their number, which is at most
+    // max_out().
+    uint16 push(
+      const std::complex <double> & x,
+      std::complex <double> * y
+    );
+    // Resample a block of input samples.
+    itpp::cvec push(
+      const itpp::cvec & x
+    );
+    // Largest number of output samples produced by one input sample.
+    uint16 max_out() const;
+    // Delay, in input samples, between the time of an output sample and
+    // the moment it becomes available.
+    uint16 delay() const;
+    // Input samples per output sample.
+    const double step;
+  private:
+    uint16 n_taps;
+    // The branches of the filter, one after the other.
+    itpp::vec taps;
+    // The most recent input samples are stored twice so that the filter
+    // can always be applied to a contiguous block of memory.
+    itpp::cvec hist;
+    uint32 hist_idx;
+    // Time of the next output sample relative to the input sample that is
+    // at the center of the filter.
+    double frac;
+};
+
 #endif
 
@@ -133,5 +133,17 @@ itpp::bvec lte_calc_crc(
   const crc_t crc
 );
 
+// Generate n_frames frames of the FDD downlink of a cell that transmits
+// the PSS, SSS, CRS, and PBCH and nothing else. The first frame has SFN
+// cell.sfn and begins at the first returned sample. The signal is sampled
+// at oversample*1.92MHz. Port t reaches the receiver through a flat channel
+// with gain port_gain(t). Every RE has unit power before the channel.
+itpp::cvec lte_dl_generate(
+  const Cell & cell,
+  const itpp::cvec & port_gain,
+  const uint16 & n_frames,
+  const uint16 & oversample
+);
+
 #endif
 
@@ -0,0 +1,100 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HAVE_MONITOR_H
+#define HAVE_MONITOR_H
+
+// Number of samples captured by a verification job. Two frames contain two
+// PSS/SSS pairs no matter where the capture starts.
+#define MONITOR_VERIFY_CAPLENGTH 38400
+// Minimum normalized correlation of the PSS and of the SSS for a known cell
+// to be considered present.
+#define MONITOR_VERIFY_THRESH 0.2
+
+// Energy consumed by the CPU packages, as measured by the RAPL counters
+// that Linux exposes under /sys/class/powercap. Only the top level
+// package domains are read so that no energy is counted twice.
+class energy_meter_t {
+  public:
+    // Initializer. Finds the package domains.
+    energy_meter_t();
+    // False if the counters cannot be read, either because the CPU does
+    // not support RAPL or because reading them requires root.
+    bool available() const;
+    // Start a new measurement.
+    void start();
+    // Energy, in Joules, consumed since the last call to start().
+    double joules() const;
+  private:
+    std::vector <std::string> domains;
+    std::vector <double> max_uj;
+    std::vector <double> start_uj;
+};
+
+// Decides which monitoring job runs next and when. A full scan is due
+// every scan_interval seconds. In between, the cells found by the last
+// scan are verified every verify_interval seconds. A verification that
+// misses a cell makes the next scan due immediately. Times are in seconds
+// on any clock that does not go backwards.
+class monitor_schedule_t {
+  public:
+    // Initializer. A verify_interval of 0 disables the verifications.
+    monitor_schedule_t(
+      const double & scan_interval,
+      const double & verify_interval
+    );
+    // A full scan that started at scan_begin finished at now and found
+    // n_cells cells.
+    void scan_done(
+      const double & scan_begin,
+      const double & now,
+      const uint32 & n_cells
+    );
+    // A verification finished at now. all_found is false if one of the
+    // known cells was missing.
+    void verify_done(
+      const double & now,
+      const bool & all_found
+    );
+    // True if the next job is a full scan, false if it is a verification.
+    bool scan_due() const;
+    // Time at which the next job should start.
+    double next_job() const;
+  private:
+    double scan_interval;
+    double verify_interval;
+    double next_scan;
+    double next_verify;
+    uint32 n_cells;
+};
+
+// Run the signal processing of the calling process on at most n_cores
+// CPU's. The process is pinned to the first n_cores CPU's of its affinity
+// mask and OpenMP is limited to n_cores threads. 0 leaves everything as
+// it is.
+void limit_cores(
+  const uint16 & n_cores
+);
+
+// Sleep for the given number of seconds. Negative values return
+// immediately.
+void monitor_sleep(
+  const double & seconds
+);
+
+#endif
+
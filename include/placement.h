@@ -0,0 +1,87 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HAVE_PLACEMENT_H
+#define HAVE_PLACEMENT_H
+
+#include <complex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "common.h"
+
+// Real-time priorities of the threads that must keep up with the device.
+// The pre-producer runs above the producer so that USB transfers are
+// never starved.
+#define PLACEMENT_PRE_PRODUCER_PRIO 50
+#define PLACEMENT_PRODUCER_PRIO 49
+// Minimum number of usable CPU's. Two are reserved for the pre-producer
+// and the producer and everything else runs on the rest.
+#define PLACEMENT_MIN_CPUS 3
+
+// How the threads are placed on the CPU's.
+//   NONE:     leave placement to the OS.
+//   PIN:      pin the pre-producer and the producer to their own cores and
+//             spread the trackers over the remaining cores.
+//   REALTIME: same as PIN but the pre-producer and the producer also use
+//             SCHED_FIFO.
+namespace placement_t {
+  enum placement_t {NONE,PIN,REALTIME};
+}
+
+// Parse the argument of the -P option. Aborts if it is not one of none,
+// pin, or rt.
+placement_t::placement_t placement_parse(
+  const char * mode
+);
+
+namespace thread_role_t {
+  enum thread_role_t {PRE_PRODUCER,PRODUCER,TRACKER,SEARCHER,OTHER};
+}
+
+// Placement policy shared by all the threads. Every thread calls apply()
+// once, from within the thread, when it starts.
+class thread_placement_t {
+  public:
+    // Initializer. Reads the CPU topology from sysfs.
+    thread_placement_t(
+      const placement_t::placement_t & mode
+    );
+    // Place the calling thread. Parts of the policy that cannot be applied,
+    // usually because of missing privileges, are skipped with a warning.
+    void apply(
+      const thread_role_t::thread_role_t & role
+    );
+    // Short description of the policy that is in effect.
+    std::string summary();
+  private:
+    boost::mutex mutex;
+    placement_t::placement_t mode;
+    int pre_producer_cpu;
+    int producer_cpu;
+    // CPU's shared by the trackers, the searcher, and all other threads.
+    // Ordered so that consecutive trackers are placed on different caches
+    // and cores before SMT siblings are shared.
+    std::vector <int> worker_cpus;
+    uint32 n_trackers;
+    bool rt_failed;
+    bool affinity_failed;
+};
+
+#endif
+
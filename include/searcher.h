@@ -31,6 +31,14 @@
 #include <CL/cl.h>
 #define MAX_NUM_PLATFORM 8
 #define MAX_NUM_DEVICE 8
+// Largest batch of DFTs and widest DFT output handled by the kernels of
+// search_post_kernels.cl.
+#define SEARCH_POST_MAX_ROWS 1024
+#define SEARCH_POST_MAX_N_HALF 36
+// Largest batch of tracked OFDM symbols handled by tracker_kernels.cl.
+#define TRACKER_FD_MAX_ROWS 1024
+// Longest time that a tracked OFDM symbol waits for its batch to fill.
+#define TRACKER_FD_TIMEOUT_MS 2
 // Class related to OpenCL
 class lte_opencl_t {
   public:
@@ -56,6 +64,9 @@ class lte_opencl_t {
     // setup OpenCL environment
     int setup_opencl();
 
+    // Read and build the program in an OpenCL source file. Aborts on error.
+    cl_program build_program(const std::string & kernels_filename, const std::string & caller);
+
     // for filter_my
     size_t filter_my_length;
     uint filter_my_workitem;
@@ -111,10 +122,79 @@ class lte_opencl_t {
 
     int filter_mchn(const itpp::cvec & capbuf, const itpp::cmat & pss_fo_set, itpp::mat & corr_store);
 
-  private:
+    // for sss_detect and extract_tfg
+    size_t search_post_capbuf_length;
+
+    float *search_post_in_host;
+    float *search_post_out_host;
+
+    cl_mem search_post_in;
+    cl_mem search_post_start;
+    cl_mem search_post_phase0;
+    cl_mem search_post_late;
+    cl_mem search_post_out;
+    cl_mem search_post_est;
+    cl_mem search_post_np_inv;
+    cl_mem search_post_sss_try;
+    cl_mem search_post_log_lik;
+
+    cl_kernel search_post_dft128;
+    cl_kernel search_post_sss_ml;
+
+    int setup_search_post(std::string search_post_kernels_filename, const size_t & capbuf_length_in);
+
+    // True if the post correlation stages can be run on the device for a
+    // capture buffer of this length.
+    bool search_post_ready(const size_t & capbuf_length) const;
+
+    // Row r of dft_out holds subcarriers -n_half..-1,1..n_half of the DFT
+    // of the 128 samples of capbuf starting at start(r), after sample n has
+    // been rotated by phase0(r)+dphi*n, compensated for a DFT that was
+    // taken late(r) samples too late.
+    int dft128(const itpp::cvec & capbuf, const itpp::ivec & start, const itpp::vec & phase0, const itpp::vec & late, const double & dphi, const uint16 & n_half, itpp::cmat & dft_out);
+
+    // Same as sss_detect_ml.
+    int sss_ml(const uint8 & n_id_2, const itpp::vec & sss_h12_np_est, const itpp::cvec & sss_h12_nrm_est, const itpp::cvec & sss_h12_ext_est, itpp::mat & log_lik_nrm, itpp::mat & log_lik_ext);
+
+    // for the FOC and DFT of the symbols of all the tracked cells
+    uint16 tracker_fd_n_fft;
+    uint16 tracker_fd_n_sc_max;
 
+    float *tracker_fd_in_host;
+    float *tracker_fd_out_host;
+
+    cl_mem tracker_fd_in;
+    cl_mem tracker_fd_dphi;
+    cl_mem tracker_fd_late;
+    cl_mem tracker_fd_n_half;
+    cl_mem tracker_fd_twiddle;
+    cl_mem tracker_fd_out;
+
+    cl_kernel tracker_fd_foc;
+    cl_kernel tracker_fd_dft;
+
+    int setup_tracker_fd(std::string tracker_fd_kernels_filename, const uint16 & n_fft_in, const uint16 & n_sc_max_in);
+
+    // Row r of data holds the n_fft time domain samples of one OFDM symbol
+    // of some cell. Same as get_fd() in the tracker, without the bulk phase
+    // offset: sample n is rotated by dphi(r)*n, the DFT is taken 2*n_fft/128
+    // samples into the symbol, and subcarriers -n_half(r)..-1,1..n_half(r)
+    // are compensated for a DFT that was taken late(r) samples too late.
+    // Row r of syms holds these subcarriers followed by zeros.
+    int tracker_fd(const itpp::cmat & data, const itpp::vec & dphi, const itpp::vec & late, const itpp::ivec & n_half, itpp::cmat & syms);
+
+  private:
+    void release_search_post();
+    void release_tracker_fd();
 };
 
+// True if the OpenCL platform and device exist. Unlike lte_opencl_t, this
+// does not abort when there is no OpenCL platform at all.
+bool opencl_device_present(
+  const uint & platform_id,
+  const uint & device_id
+);
+
 #else
 class lte_opencl_t {
   public:
@@ -169,6 +249,40 @@ void pss_fo_set_gen(
   itpp::cmat & pss_fo_set
 );
 
+// Squared magnitude of the correlation of s against every row of
+// pss_fo_set at every offset for which the PSS fits within s.
+// corr_store must have pss_fo_set.rows() rows and
+// length(s)-pss_fo_set.cols()+1 columns.
+void conv_capbuf_with_pss(
+  // Inputs
+  const itpp::cvec & s,
+  const itpp::cmat & pss_fo_set,
+  // Output
+  itpp::mat & corr_store
+);
+
+// DFT's of size n_fft of the time reversed rows of pss_fo_set, for use
+// with conv_capbuf_with_pss_fft().
+void pss_fo_set_fft_gen(
+  // Inputs
+  const itpp::cmat & pss_fo_set,
+  const uint16 & n_fft,
+  // Output
+  itpp::cmat & pss_fo_set_fft
+);
+
+// Same as conv_capbuf_with_pss(), but the correlations are performed by
+// overlap-save fast convolution with the DFT's produced by
+// pss_fo_set_fft_gen(). n_fft must be larger than len_pss.
+void conv_capbuf_with_pss_fft(
+  // Inputs
+  const itpp::cvec & s,
+  const itpp::cmat & pss_fo_set_fft,
+  const uint16 & len_pss,
+  // Output
+  itpp::mat & corr_store
+);
+
 void sampling_ppm_f_search_set_by_pss(
   // Inputs
   lte_opencl_t & lte_ocl,
@@ -220,6 +334,48 @@ void xcorr_pss(
   const bool & sampling_carrier_twist,
   const double k_facotr
 );
+// Same as above except that every row of xc is a separate (frequency
+// offset, k_factor) hypothesis. All the hypotheses are combined in a single
+// pass and the received power is only estimated once.
+void xcorr_pss(
+  // Inputs
+  const itpp::cvec & capbuf,
+  const itpp::vec & f_search_set,
+  const itpp::vec & k_factor_set,
+  const uint8 & ds_comb_arm,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  const std::vector <itpp::mat> & xc,
+  // Outputs
+  itpp::mat & xc_incoherent_collapsed_pow,
+  itpp::imat & xc_incoherent_collapsed_frq,
+  // Only used for testing
+  std::vector <itpp::mat> & xc_incoherent_single,
+  std::vector <itpp::mat> & xc_incoherent,
+  itpp::vec & sp_incoherent,
+  itpp::vec & sp,
+  uint16 & n_comb_xc,
+  uint16 & n_comb_sp
+);
+
+// Stages of xcorr_pss(). Combine adjacent taps of the incoherently
+// combined correlations and then keep the strongest frequency offset of
+// every time offset.
+void xc_delay_spread(
+  // Inputs
+  const std::vector <itpp::mat> & xc_incoherent_single,
+  const uint8 & ds_comb_arm,
+  // Outputs
+  std::vector <itpp::mat> & xc_incoherent
+);
+void xc_peak_freq(
+  // Inputs
+  const std::vector <itpp::mat> & xc_incoherent,
+  // Outputs
+  itpp::mat & xc_incoherent_collapsed_pow,
+  itpp::imat & xc_incoherent_collapsed_frq
+);
 
 // Search the correlations for peaks.
 void peak_search(
@@ -237,6 +393,78 @@ void peak_search(
   // Outputs
   std::list <Cell> & cells
 );
+// Same as above except that each row of the correlations has its own
+// k_factor.
+void peak_search(
+  // Inputs
+  const itpp::mat & xc_incoherent_collapsed_pow,
+  const itpp::imat & xc_incoherent_collapsed_frq,
+  const itpp::vec & Z_th1,
+  const itpp::vec & f_search_set,
+  const itpp::vec & k_factor_set,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const std::vector <itpp::mat> & xc_incoherent_single,
+  const uint8 & ds_comb_arm,
+  // Outputs
+  std::list <Cell> & cells
+);
+
+// IQ imbalance creates an image of every cell at the mirrored baseband
+// frequency with the same frame timing and the conjugate PSS. The image
+// of n_id_2 1 looks like n_id_2 2 and vice versa, while the image of
+// n_id_2 0 is not a PSS. Peaks whose frequency, timing, and n_id_2 match
+// the image of a peak that is at least IQ_IMAGE_MARGIN_DB stronger are
+// removed. freq_correction is the shift
+// that was removed from the samples before the peaks were searched for,
+// so the image of a peak at f is at -f-2*freq_correction.
+#define IQ_IMAGE_MARGIN_DB 10.0
+#define IQ_IMAGE_F_TOL 5e3
+#define IQ_IMAGE_T_TOL 4
+void reject_image_peaks(
+  // Inputs
+  const double & freq_correction,
+  // Inputs&Outputs
+  std::list <Cell> & cells
+);
+
+// Location of the DFT window of a symbol, relative to the start of the
+// frame.
+uint16 sym_dft_offset(
+  const cp_type_t::cp_type_t & cp_type,
+  const uint8 & slot_num,
+  const uint8 & sym_num
+);
+
+// Number of samples between the start of the DFT window of the SSS and
+// the start of the DFT window of the PSS.
+uint16 pss_sss_distance(
+  const cp_type_t::cp_type_t & cp_type,
+  const int8 & duplex_mode
+);
+
+// Look for the PSS and the SSS of a cell whose identity, CP type, and
+// duplex mode are already known. The DFT window of the PSS is searched
+// from capbuf(pss_start) to capbuf(pss_start+n_lag-1). Returns true if the
+// normalized correlations with both the PSS and the SSS reach thresh. The
+// location of the PSS, the half frame indicated by the SSS, and the
+// normalized PSS correlation are returned as well.
+bool known_cell_detect(
+  // Inputs
+  const itpp::cvec & capbuf,
+  const int16 & n_id_1,
+  const int8 & n_id_2,
+  const cp_type_t::cp_type_t & cp_type,
+  const int8 & duplex_mode,
+  const SSS_td & sss_td,
+  const uint32 & pss_start,
+  const uint32 & n_lag,
+  const double & thresh,
+  // Outputs
+  uint32 & pss_lag,
+  uint8 & half,
+  double & pss_xc
+);
 
 // For a certain detected PSS, attempt to find the SSS.
 Cell sss_detect(
@@ -260,6 +488,30 @@ Cell sss_detect(
   const int & tdd_flag
 );
 
+// Same as above but runs the DFTs and the maximum likelihood detection on
+// the OpenCL device if setup_search_post() was called.
+Cell sss_detect(
+  // Inputs
+  lte_opencl_t & lte_ocl,
+  const Cell & cell,
+  const itpp::cvec & capbuf,
+  const double & thresh2_n_sigma,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  // Only used for testing
+  itpp::vec & sss_h1_np_est,
+  itpp::vec & sss_h2_np_est,
+  itpp::cvec & sss_h1_nrm_est,
+  itpp::cvec & sss_h2_nrm_est,
+  itpp::cvec & sss_h1_ext_est,
+  itpp::cvec & sss_h2_ext_est,
+  itpp::mat & log_lik_nrm,
+  itpp::mat & log_lik_ext,
+  const bool & sampling_carrier_twist,
+  const int & tdd_flag
+);
+
 // Perform FOE based only on the PSS and SSS
 Cell pss_sss_foe(
   Cell & cell_in,
@@ -285,6 +537,22 @@ void extract_tfg(
   const bool & sampling_carrier_twist
 );
 
+// Same as above but runs the FOC and the DFTs on the OpenCL device if
+// setup_search_post() was called.
+void extract_tfg(
+  // Inputs
+  lte_opencl_t & lte_ocl,
+  const Cell & cell,
+  const itpp::cvec & capbuf_raw,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  // Outputs
+  itpp::cmat & tfg,
+  itpp::vec & tfg_timestamp,
+  const bool & sampling_carrier_twist
+);
+
 // Perform TOE/FOE/TOC/FOC on the time/ frequency grid.
 Cell tfoec(
   // Inputs
@@ -300,6 +568,38 @@ Cell tfoec(
   const bool & sampling_carrier_twist
 );
 
+// Channel estimates for every RE of the time/ frequency grid for one
+// antenna port. Also returns the noise power and the RS power.
+void chan_est(
+  // Inputs
+  const Cell & cell,
+  const RS_DL & rs_dl,
+  const itpp::cmat & tfg,
+  const uint8 & port,
+  // Outputs
+  itpp::cmat & ce_tfg,
+  double & np,
+  double & sp
+);
+
+// Soft bits of one 40ms PBCH TTI that could not be decoded on its own.
+// d_est(0), d_est(1), and d_est(2) contain the deratematched soft bits
+// for the 1, 2, and 4 port hypotheses respectively. An empty matrix
+// indicates that the hypothesis was not evaluated.
+typedef struct {
+  // Absolute frame number of the first frame of the TTI.
+  int32 frame_num;
+  itpp::Array <itpp::mat> d_est;
+} pbch_tti_t;
+typedef std::list <pbch_tti_t> pbch_history_t;
+
+// Maximum distance, in TTI's, between PBCH TTI's that are combined.
+#define PBCH_COMBINE_MAX_TTI 4
+
+// Minimum fraction of soft bits that must agree with a MIB that was decoded
+// from only one or two PBCH bursts.
+#define PBCH_BURST_MIN_AGREEMENT 0.75
+
 // Attempt to decode the MIB.
 Cell decode_mib(
   const Cell & cell,
@@ -307,6 +607,57 @@ Cell decode_mib(
   const RS_DL & rs_dl
 );
 
+// Attempt to decode the MIB. If decoding fails, the soft bits of this
+// attempt are stored in pbch_history and are combined with the soft bits
+// of subsequent attempts. frame_num is the absolute frame number of the
+// first frame in tfg.
+Cell decode_mib(
+  const Cell & cell,
+  const itpp::cmat & tfg,
+  const RS_DL & rs_dl,
+  const int32 & frame_num,
+  pbch_history_t & pbch_history
+);
+
+// Perform channel compensation for 1, 2, or 4 transmit antennas and
+// extract the soft bits from the PBCH symbols.
+itpp::vec pbch_demod(
+  // Inputs
+  const itpp::cvec & pbch_sym,
+  const itpp::cmat & pbch_ce,
+  const itpp::mat & pbch_np,
+  const uint8 & n_ports
+);
+
+// Decode the deratematched PBCH soft bits and check the CRC.
+bool pbch_decode(
+  // Inputs
+  const itpp::mat & d_est,
+  const uint8 & n_ports,
+  // Outputs
+  itpp::bvec & c_est
+);
+
+// Combine the soft bits of this TTI with the soft bits of previous TTI's
+// that have the same frame alignment and attempt to decode the result.
+bool pbch_decode_combined(
+  // Inputs
+  const itpp::mat & d_est,
+  const int32 & frame_num,
+  const uint8 & n_ports,
+  const pbch_history_t & pbch_history,
+  // Outputs
+  itpp::bvec & c_est
+);
+
+// Store the soft bits of a TTI that could not be decoded and discard
+// TTI's that are too old to be combined.
+void pbch_history_add(
+  pbch_history_t & pbch_history,
+  const int32 & frame_num,
+  const itpp::Array <itpp::mat> & d_est
+);
+
 // Small helper function that is used by LTE-Tracker
 void del_oob(
   itpp::ivec & v
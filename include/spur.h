@@ -0,0 +1,72 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HAVE_SPUR_H
+#define HAVE_SPUR_H
+
+#include <map>
+
+// Length of the FFT used to estimate the spectrum of a capture.
+#define SPUR_FFT_LENGTH 1024
+// A bin is considered a spur when its power exceeds the median power of
+// the surrounding bins by this many dB.
+#define SPUR_THRESH_DB 12.0
+// Lower threshold used for spurs that have already been learned.
+#define SPUR_LEARNED_THRESH_DB 6.0
+// Number of bins on either side of a bin that are used to estimate the
+// local noise floor. Bins within SPUR_NOTCH_HALF_WIDTH of the bin itself
+// are excluded.
+#define SPUR_REF_HALF_WIDTH 16
+// Number of bins on either side of a spur that are removed. The Hann
+// window spreads a tone over 2 bins on either side.
+#define SPUR_NOTCH_HALF_WIDTH 2
+// Number of captures a spur must be seen in before it is learned.
+#define SPUR_LEARN_COUNT 2
+// Number of captures without the spur after which a spur that has been
+// seen many times is forgotten is SPUR_MEMORY-SPUR_LEARN_COUNT+1.
+#define SPUR_MEMORY 8
+// Wideband interference is not a spur. Nothing is removed if more than
+// this fraction of the spectrum would be notched.
+#define SPUR_MAX_NOTCH_FRACTION 0.1
+
+// Detect and remove narrowband spurs, such as clock harmonics and tuner
+// spurs. Spurs are detected from an averaged spectrum of each capture and
+// are remembered separately for every center frequency so that spurs
+// that are temporarily masked by a strong signal are still removed.
+class spur_excision_t {
+  public:
+    // Initializer
+    spur_excision_t();
+    // Detect the spurs in capbuf and remove them by zeroing the
+    // corresponding FFT bins. Returns the number of spurs removed.
+    uint16 excise(
+      // Inputs
+      const double & fc,
+      // Inputs&Outputs
+      itpp::cvec & capbuf
+    );
+    // Fraction of the spectrum that was removed by the last call to
+    // excise().
+    double notch_fraction;
+  private:
+    // For every center frequency, in kHz, the number of recent captures in
+    // which each bin contained a spur.
+    std::map <int32,itpp::ivec> hits;
+};
+
+#endif
+
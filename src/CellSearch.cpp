@@ -30,7 +30,9 @@
 #include <itpp/stat/misc_stat.h>
 #include <boost/math/special_functions/gamma.hpp>
 #include <list>
+#include <map>
 #include <sstream>
+#include <fstream>
 #include <curses.h>
 #include <sys/time.h>
 #include <signal.h>
@@ -76,6 +78,10 @@ void sigint_callback_handler(int signum)
 #include "itpp_ext.h"
 #include "searcher.h"
 #include "dsp.h"
+#include "spur.h"
+#include "agc.h"
+#include "bigmem.h"
+#include "monitor.h"
 
 using namespace itpp;
 using namespace std;
@@ -99,12 +105,30 @@ void print_usage() {
   cout << "      specify which OpenCL platform to use (default: 0)" << endl;
   cout << "    -g --gain G" << endl;
   cout << "      specify gain to hardware (rtl default 0(auto); HACKRF default 40; bladeRF default LNA-MAX VGA-66)" << endl;
+  cout << "    -R --rate fs" << endl;
+  cout << "      run the device at sample rate fs (e.g. 2.048e6) and resample to 1.92MHz (default: run the device at 1.92MHz)" << endl;
+  cout << "    -A --agc file" << endl;
+  cout << "      adjust the gain at each frequency, starting from G, and remember the chosen gains in file" << endl;
+  cout << "    -o --output file" << endl;
+  cout << "      write each cell to file ('-' for stdout), one comma separated line, as soon as it is found" << endl;
   cout << "    -j --opencl-device N" << endl;
   cout << "      specify which OpenCL device of selected platform to use (default: 0)" << endl;
   cout << "    -w --filter-workitem N" << endl;
   cout << "      specify how many OpenCL workitems are used for the 1st dim of 6RB filter (you'd better use values like 2^n)" << endl;
   cout << "    -u --xcorr-workitem N" << endl;
   cout << "      specify how many OpenCL workitems are used for the PSS xcorr (you'd better use values like 2^n)" << endl;
+  cout << "    -H --hugepages mode" << endl;
+  cout << "      none: use regular pages for the large buffers" << endl;
+  cout << "      thp: use transparent huge pages for the large buffers (default)" << endl;
+  cout << "      explicit: use the huge page pool (/proc/sys/vm/nr_hugepages) for the OpenCL buffers" << endl;
+  cout << "      with thp and explicit, the large buffers are also kept on the NUMA node of the thread that uses them" << endl;
+  cout << "    -N --cores n" << endl;
+  cout << "      run the signal processing on at most n CPU cores (default: all)" << endl;
+  cout << "  Monitoring options:" << endl;
+  cout << "    -M --monitor interval" << endl;
+  cout << "      keep monitoring with live data and repeat the full scan every interval seconds" << endl;
+  cout << "    -V --verify-interval interval" << endl;
+  cout << "      between full scans, verify that the known cells are still present every interval seconds (default: 10, 0 disables)" << endl;
   cout << "  Frequency search options:" << endl;
   cout << "    -s --freq-start fs" << endl;
   cout << "      frequency where cell search should start" << endl;
@@ -175,7 +199,14 @@ void parse_commandline(
   uint16 & xcorr_workitem,
   uint16 & num_reserve,
   uint16 & num_loop,
-  int16  & gain
+  int16  & gain,
+  string & agc_filename,
+  string & output_filename,
+  bigmem_policy_t::bigmem_policy_t & bigmem_mode,
+  double & fs_native,
+  double & monitor_interval,
+  double & verify_interval,
+  uint16 & n_cores
 ) {
   // Default values
   freq_start=-1;
@@ -195,6 +226,13 @@ void parse_commandline(
   num_reserve = 2;
   num_loop = 0;
   gain = -9999;
+  agc_filename = "";
+  output_filename = "";
+  bigmem_mode = bigmem_policy_t::THP;
+  fs_native = 0;
+  monitor_interval = 0;
+  verify_interval = 10;
+  n_cores = 0;
 
   while (1) {
     static struct option long_options[] = {
@@ -215,16 +253,23 @@ void parse_commandline(
       {"device-index", required_argument, 0, 'i'},
       {"opencl-platform", required_argument, 0, 'a'},
       {"gain",         required_argument, 0, 'g'},
+      {"rate",         required_argument, 0, 'R'},
+      {"agc",          required_argument, 0, 'A'},
+      {"output",       required_argument, 0, 'o'},
       {"opencl-device", required_argument, 0, 'j'},
       {"filter-workitem", required_argument, 0, 'w'},
       {"xcorr-workitem", required_argument, 0, 'u'},
       {"num-reserve", required_argument, 0, 'm'},
       {"num-loop", required_argument, 0, 'k'},
+      {"hugepages",    required_argument, 0, 'H'},
+      {"monitor",      required_argument, 0, 'M'},
+      {"verify-interval", required_argument, 0, 'V'},
+      {"cores",        required_argument, 0, 'N'},
       {0, 0, 0, 0}
     };
     /* getopt_long stores the option index here. */
     int option_index = 0;
-    int c = getopt_long (argc, argv, "hvbs:e:n:tp:c:z:y:rld:i:a:g:j:w:u:m:k:",
+    int c = getopt_long (argc, argv, "hvbs:e:n:tp:c:z:y:rld:i:a:g:R:A:o:j:w:u:m:k:H:M:V:N:",
                      long_options, &option_index);
 
     /* Detect the end of the options. */
@@ -352,6 +397,39 @@ void parse_commandline(
       case 'g':
         gain=strtol(optarg,&endp,10);
         break;
+      case 'A':
+        agc_filename=optarg;
+        break;
+      case 'o':
+        output_filename=optarg;
+        break;
+      case 'R':
+        fs_native=frontend_parse(optarg);
+        break;
+      case 'H':
+        bigmem_mode=bigmem_parse(optarg);
+        break;
+      case 'M':
+        monitor_interval=strtod(optarg,&endp);
+        if ((optarg==endp)||(*endp!='\0')||(monitor_interval<=0)) {
+          cerr << "Error: could not parse monitoring interval" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'V':
+        verify_interval=strtod(optarg,&endp);
+        if ((optarg==endp)||(*endp!='\0')||(verify_interval<0)) {
+          cerr << "Error: could not parse verification interval" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'N':
+        n_cores=strtol(optarg,&endp,10);
+        if ((optarg==endp)||(*endp!='\0')||(n_cores<1)) {
+          cerr << "Error: could not parse number of cores" << endl;
+          ABORT(-1);
+        }
+        break;
       case 'j':
         opencl_device=strtol(optarg,&endp,10);
         break;
@@ -433,6 +511,15 @@ void parse_commandline(
     cerr << "Error: cannot read and write captured data at the same time!" << endl;
     ABORT(-1);
   }
+  // Monitoring only makes sense with live data.
+  if ((monitor_interval>0)&&(use_recorded_data||(strlen(load_bin_filename)>0))) {
+    cerr << "Error: monitoring requires live data" << endl;
+    ABORT(-1);
+  }
+  if ((monitor_interval>0)&&(save_cap||(strlen(record_bin_filename)>0))) {
+    cerr << "Error: cannot record captured data while monitoring" << endl;
+    ABORT(-1);
+  }
   // Should never both read from .it and read from .bin file.
   if ( use_recorded_data && (strlen(load_bin_filename)>4) ) {
     cerr << "Error: cannot read from .it and .bin file at the same time!" << endl;
@@ -462,6 +549,43 @@ void parse_commandline(
   }
 }
 
+// Results of dedup_insert().
+#define DEDUP_DISCARDED 0
+#define DEDUP_NEW 1
+#define DEDUP_UPDATED 2
+
+// Add a newly detected cell to a list of unique cells. If the list already
+// contains the same cell, only the detection with the highest received
+// power is kept.
+uint8 dedup_insert(
+  // Inputs
+  const Cell & cell,
+  // Inputs&Outputs
+  list <Cell> & cells_final
+) {
+  list <Cell>::iterator it_f=cells_final.begin();
+  while (it_f!=cells_final.end()) {
+    // Do these detected cells match and are they close to each other
+    // in frequency?
+    if (
+      (cell.n_id_cell()==(*it_f).n_id_cell()) &&
+      (abs((cell.fc_requested+cell.freq_superfine)-((*it_f).fc_requested+(*it_f).freq_superfine))<1e6)
+    ) {
+      // Keep either the new cell or the old cell, but not both.
+      if (cell.pss_pow>(*it_f).pss_pow) {
+        (*it_f)=cell;
+        return DEDUP_UPDATED;
+      }
+      return DEDUP_DISCARDED;
+    }
+    ++it_f;
+  }
+  // This cell does not match any previous cells. Add this to the
+  // final list of cells.
+  cells_final.push_back(cell);
+  return DEDUP_NEW;
+}
+
 // In high SNR environments, a cell may be detected on different carrier
 // frequencies and with different frequency offsets. Keep only the cell
 // with the highest received power.
@@ -473,34 +597,61 @@ void dedup(
   for (uint16 t=0;t<detected_cells.size();t++) {
     list <Cell>::const_iterator it_n=detected_cells[t].begin();
     while (it_n!=detected_cells[t].end()) {
-      bool match=false;
-      list <Cell>::iterator it_f=cells_final.begin();
-      while (it_f!=cells_final.end()) {
-        // Do these detected cells match and are they close to each other
-        // in frequency?
-        if (
-          ((*it_n).n_id_cell()==(*it_f).n_id_cell()) &&
-          (abs(((*it_n).fc_requested+(*it_n).freq_superfine)-((*it_f).fc_requested+(*it_f).freq_superfine))<1e6)
-        ) {
-          match=true;
-          // Keep either the new cell or the old cell, but not both.
-          if ((*it_n).pss_pow>(*it_f).pss_pow) {
-            (*it_f)=(*it_n);
-          }
-          break;
-        }
-        ++it_f;
-      }
-      if (!match) {
-        // This cell does not match any previous cells. Add this to the
-        // final list of cells.
-        cells_final.push_back((*it_n));
-      }
+      dedup_insert((*it_n),cells_final);
       ++it_n;
     }
   }
 }
 
+// Crystal correction factor implied by the frequency offset of a cell.
+double correction_factor(
+  const Cell & cell,
+  const double & correction
+) {
+  // This is where we know the carrier is located
+  const double true_location=cell.fc_programmed;
+  // We can calculate the RTLSDR's actualy frequency
+  const double crystal_freq_actual=cell.fc_programmed-cell.freq_superfine;
+  // Calculate correction factors
+  const double correction_residual=true_location/crystal_freq_actual;
+  return correction*correction_residual;
+}
+
+// Write one line describing a cell to the output stream. The first field
+// is "new" for a cell that has not been reported before and "update" when
+// a stronger detection of a previously reported cell replaces it.
+void stream_cell(
+  ostream & os,
+  const uint8 & dedup_result,
+  const Cell & cell,
+  const double & correction,
+  const double & elapsed
+) {
+  stringstream ss;
+  ss << ((dedup_result==DEDUP_NEW)?"new":"update");
+  ss << "," << setprecision(3) << fixed << elapsed;
+  ss << "," << setprecision(0) << fixed << cell.fc_requested;
+  ss << "," << cell.n_id_cell();
+  ss << "," << ((cell.cp_type==cp_type_t::NORMAL)?"N":(((cell.cp_type==cp_type_t::UNKNOWN)?"U":"E")));
+  ss << "," << ((cell.duplex_mode==1)?"TDD":"FDD");
+  ss << "," << (int)cell.n_ports;
+  ss << "," << (int)cell.n_rb_dl;
+  ss << "," << ((cell.phich_duration==phich_duration_t::NORMAL)?"N":(((cell.phich_duration==phich_duration_t::UNKNOWN)?"U":"E")));
+  switch (cell.phich_resource) {
+    case phich_resource_t::UNKNOWN: ss << ",UNK"; break;
+    case phich_resource_t::oneSixth: ss << ",1/6"; break;
+    case phich_resource_t::half: ss << ",1/2"; break;
+    case phich_resource_t::one: ss << ",one"; break;
+    case phich_resource_t::two: ss << ",two"; break;
+  }
+  ss << "," << setprecision(2) << fixed << db10(cell.pss_pow);
+  ss << "," << setprecision(1) << fixed << cell.freq_superfine;
+  ss << "," << setprecision(3) << fixed << (correction_factor(cell,correction)-1)*1e6;
+  ss << "," << setprecision(1) << fixed << cell.frame_start;
+  // Flush so that a crash does not lose the cells found so far.
+  os << ss.str() << endl;
+}
+
 // Helper function to assist in formatting frequency offsets.
 string freq_formatter(
   const double & freq
@@ -531,7 +682,8 @@ int config_rtlsdr(
   const double & fc,
   rtlsdr_device *& dev,
   double & fs_programmed,
-  const int16 & gain
+  const int16 & gain,
+  const double & fs_native
 ) {
   int32 device_index=device_index_cmdline;
 
@@ -567,7 +719,7 @@ int config_rtlsdr(
 
   double sampling_rate = 0;
 //  if (sampling_carrier_twist)
-    sampling_rate = (FS_LTE/16)*correction;
+    sampling_rate = frontend_device_rate(fs_native,correction);
 //  else
 //    sampling_rate = 1920000;
   // Sampling frequency
@@ -579,6 +731,8 @@ int config_rtlsdr(
 
   // Calculate the actual fs that was programmed
   fs_programmed=(double)rtlsdr_get_sample_rate(dev);
+  // Captures are resampled when the device runs at its native rate.
+  fs_programmed=frontend_setup(fs_native,fs_programmed,correction);
 
   // Center frequency
   uint8 n_fail=0;
@@ -661,7 +815,8 @@ int config_hackrf(
   const double & fc,
   hackrf_device * & dev,
   double & fs_programmed,
-  const int16 & gain
+  const int16 & gain,
+  const double & fs_native
 ) {
 
   unsigned int lna_gain=40; // default value
@@ -683,7 +838,7 @@ int config_hackrf(
     return(result);
 	}
 
-  double sampling_rate =  (FS_LTE/16)*correction;
+  double sampling_rate = frontend_device_rate(fs_native,correction);
 
   // Sampling frequency
   result = hackrf_set_sample_rate_manual(dev, sampling_rate, 1);
@@ -695,6 +850,8 @@ int config_hackrf(
 
   // Need to handle in the future
   fs_programmed=sampling_rate;
+  // Captures are resampled when the device runs at its native rate.
+  fs_programmed=frontend_setup(fs_native,fs_programmed,correction);
 
   result = hackrf_set_baseband_filter_bandwidth(dev, 1.45e6);
 	if( result != HACKRF_SUCCESS ) {
@@ -751,7 +908,8 @@ int config_bladerf(
   const double & fc,
   bladerf_device * & dev,
   double & fs_programmed,
-  const int16 & gain
+  const int16 & gain,
+  const double & fs_native
 ) {
   bladerf_devinfo *devices = NULL;
   int n_devices = bladerf_get_device_list(&devices);
@@ -791,7 +949,7 @@ int config_bladerf(
       if (dev!=NULL) {bladerf_close(dev); dev = NULL; return(-1);}
   }
 
-  double sampling_rate =  (FS_LTE/16)*correction;
+  double sampling_rate = frontend_device_rate(fs_native,correction);
   unsigned int actual_sample_rate;
   status = bladerf_set_sample_rate(dev, BLADERF_MODULE_RX, (unsigned int)sampling_rate, &actual_sample_rate);
   if (status != 0) {
@@ -800,6 +958,8 @@ int config_bladerf(
       if (dev!=NULL) {bladerf_close(dev); dev = NULL; return(-1);}
   }
   fs_programmed = actual_sample_rate;
+  // Captures are resampled when the device runs at its native rate.
+  fs_programmed=frontend_setup(fs_native,fs_programmed,correction);
 
   unsigned int actual_bw;
   status = bladerf_set_bandwidth(dev, BLADERF_MODULE_RX, 1500000, &actual_bw);
@@ -893,282 +1053,268 @@ int config_bladerf(
 }
 #endif
 
-// Main cell search routine.
-int main(
-  const int argc,
-  char * const argv[]
+// PBCH soft bits of one cell that are combined across tries. tfg_start
+// is the location of the first time/frequency grid of the cell, in samples
+// since the first try.
+typedef struct {
+  double tfg_start;
+  pbch_history_t pbch_history;
+} mib_combine_t;
+
+// Cells are identified by n_id_cell, CP type, and duplex mode.
+int32 cell_key(
+  const Cell & cell,
+  const int & tdd_flag
 ) {
-  // Command line parameters are stored here.
-  double freq_start;
-  double freq_end;
-  uint16 num_try;
-  bool sampling_carrier_twist;
-  double ppm;
-  double correction;
-  bool save_cap;
-  bool use_recorded_data;
-  string data_dir;
-  int device_index;
-  char record_bin_filename[256] = {0};
-  char load_bin_filename[256] = {0};
-  int16  gain;
-  uint16 opencl_platform;
-  uint16 opencl_device;
-  uint16 filter_workitem;
-  uint16 xcorr_workitem;
-  uint16 num_reserve;
-  uint16 num_loop; // it is not so useful
-
-  // Get search parameters from user
-  parse_commandline(argc,argv,freq_start,freq_end,num_try,sampling_carrier_twist,ppm,correction,save_cap,use_recorded_data,data_dir,device_index, record_bin_filename, load_bin_filename,opencl_platform,opencl_device,filter_workitem,xcorr_workitem,num_reserve,num_loop,gain);
-
-  // Open the USB device (if necessary).
-  dev_type_t::dev_type_t dev_use = dev_type_t::UNKNOWN;
-  rtlsdr_device * rtlsdr_dev=NULL;
-  hackrf_device * hackrf_dev = NULL; // if HAVE_HACKRF isn't defined, hackrf_device will be asigned a fake type.
-  bladerf_device * bladerf_dev = NULL; // if HAVE_BLADERF isn't defined, bladerf_device will be asigned a fake type.
+  return cell.n_id_cell()*4+((cell.cp_type==cp_type_t::EXTENDED)?2:0)+tdd_flag;
+}
 
-  double fs_programmed = FS_LTE/16; // in case not initialized by config_rtlsdr
-  double fc_programmed; // for correction frequency calculation
-  double fc_requested, fc_requested_tmp, fc_programmed_tmp, fs_requested_tmp, fs_programmed_tmp;
+// Cells whose MIB has already been decoded during this scan, indexed by
+// cell_key(). Neighbouring center frequencies see the same cell, so a new
+// detection of a cell on the same carrier frequency can reuse the MIB
+// instead of decoding it again.
+#define CELL_CACHE_F_TOL 5e3
+typedef map <int32, list <Cell> > cell_cache_t;
+
+// Find a verified cell with the same identity as cell and a carrier
+// frequency within CELL_CACHE_F_TOL of the coarse carrier frequency of
+// cell. Returns NULL if there is no such cell.
+const Cell * cell_cache_find(
+  const cell_cache_t & cell_cache,
+  const Cell & cell,
+  const int & tdd_flag
+) {
+  cell_cache_t::const_iterator it=cell_cache.find(cell_key(cell,tdd_flag));
+  if (it==cell_cache.end())
+    return NULL;
+  const double f_carrier=cell.fc_requested+cell.freq_fine;
+  for (list <Cell>::const_iterator c=it->second.begin();c!=it->second.end();c++) {
+    if (abs((*c).fc_requested+(*c).freq_superfine-f_carrier)<CELL_CACHE_F_TOL)
+      return &(*c);
+  }
+  return NULL;
+}
 
-  bool dongle_used = (!use_recorded_data) && (strlen(load_bin_filename)==0);
-  if ( dongle_used && freq_start!=9999e6) {
+// Print out a list of detected cells.
+void print_cells(
+  const list <Cell> & cells_final,
+  const double & correction
+) {
+  if (cells_final.size()==0) {
+    cout << "No LTE cells were found..." << endl;
+  } else {
+    cout << "Detected the following cells:" << endl;
+    cout << "DPX:TDD/FDD; A: #antenna ports C: CP type ; P: PHICH duration ; PR: PHICH resource type" << endl;
+    cout << "DPX CID A      fc   freq-offset RXPWR C nRB P  PR CrystalCorrectionFactor" << endl;
+    list <Cell>::const_iterator it=cells_final.begin();
+    while (it!=cells_final.end()) {
+      // Use a stringstream to avoid polluting the iostream settings of cout.
+      stringstream ss;
+      if ((*it).duplex_mode == 1)
+        ss << "TDD ";
+      else
+        ss << "FDD ";
+      ss << setw(3) << (*it).n_id_cell();
+      ss << setw(2) << (*it).n_ports;
+      ss << " " << setw(6) << setprecision(5) << (*it).fc_requested/1e6 << "M";
+      ss << " " << setw(13) << freq_formatter((*it).freq_superfine);
+      ss << " " << setw(5) << setprecision(3) << db10((*it).pss_pow);
+      ss << " " << (((*it).cp_type==cp_type_t::NORMAL)?"N":(((*it).cp_type==cp_type_t::UNKNOWN)?"U":"E"));
+      ss << " " << setw(3) << (*it).n_rb_dl;
+      ss << " " << (((*it).phich_duration==phich_duration_t::NORMAL)?"N":(((*it).phich_duration==phich_duration_t::UNKNOWN)?"U":"E"));
+      switch ((*it).phich_resource) {
+        case phich_resource_t::UNKNOWN: ss << " UNK"; break;
+        case phich_resource_t::oneSixth: ss << " 1/6"; break;
+        case phich_resource_t::half: ss << " 1/2"; break;
+        case phich_resource_t::one: ss << " one"; break;
+        case phich_resource_t::two: ss << " two"; break;
+      }
 
-    #ifdef HAVE_RTLSDR
-    if ( config_rtlsdr(sampling_carrier_twist,correction,device_index,freq_start,rtlsdr_dev,fs_programmed,gain) == 0 ) {
-      dev_use = dev_type_t::RTLSDR;
-      cout << "RTLSDR device FOUND!\n";
-    } else {
-      cout << "RTLSDR device not FOUND!\n";
-      ABORT(-1);
-    }
-    #endif
+      // Calculate the correction factor.
+      double correction_new=correction_factor((*it),correction);
+//      if (!sampling_carrier_twist) {
+//        correction_new = (*it).k_factor;
+//      }
+      ss << " " << setprecision(20) << correction_new;
+      cout << ss.str() << endl;
 
-    #ifdef HAVE_HACKRF
-    if ( config_hackrf(sampling_carrier_twist,correction,device_index,freq_start,hackrf_dev,fs_programmed,gain) == 0 ) {
-      dev_use = dev_type_t::HACKRF;
-      cout << "HACKRF device FOUND!\n";
-    } else {
-      cout << "HACKRF device not FOUND!\n";
-      ABORT(-1);
+      ++it;
     }
-    #endif
+  }
+}
 
-    #ifdef HAVE_BLADERF
-    if ( config_bladerf(sampling_carrier_twist,correction,device_index,freq_start,bladerf_dev,fs_programmed,gain) == 0 ) {
-      dev_use = dev_type_t::BLADERF;
-      cout << "BLADERF device FOUND!\n";
-    } else {
-      cout << "BLADERF device not FOUND!\n";
-      ABORT(-1);
+// Verify that the cells found by the last full scan are still present.
+// Each carrier is captured once, for MONITOR_VERIFY_CAPLENGTH samples, and
+// only the PSS and SSS of the known cells are searched for. Returns the
+// number of cells that were found.
+uint16 monitor_verify(
+  // Inputs
+  const list <Cell> & cells,
+  const double & correction,
+  const SSS_td & sss_td,
+  const string & data_dir,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev,
+  const dev_type_t::dev_type_t & dev_use,
+  // Inputs&Outputs
+  iq_corr_t & iq_corr
+) {
+  uint16 n_found=0;
+  cvec capbuf;
+  double fc_captured=-1;
+  double fc_programmed=0;
+  double fs_programmed=0;
+  list <Cell>::const_iterator it=cells.begin();
+  while (it!=cells.end()) {
+    const Cell & cell=(*it);
+    ++it;
+    // The cells are ordered by center frequency, so each carrier is only
+    // captured once.
+    if (cell.fc_requested!=fc_captured) {
+      fc_captured=cell.fc_requested;
+      // Verification captures are neither saved nor recorded.
+      const bool no_save=true;
+      capture_data(fc_captured,correction,false,"",false,"",data_dir,rtlsdr_dev,hackrf_dev,bladerf_dev,dev_use,capbuf,fc_programmed,fs_programmed,false,no_save,MONITOR_VERIFY_CAPLENGTH);
+      iq_corr.correct(capbuf);
+      const double freq_correction=fc_programmed*(correction-1)/correction;
+      capbuf=fshift(capbuf,-freq_correction,fs_programmed);
     }
-    #endif
 
-    if (dev_use == dev_type_t::RTLSDR) {
-      #ifdef HAVE_RTLSDR
-      fc_programmed_tmp = calculate_fc_programmed_in_context(freq_start, use_recorded_data, load_bin_filename, rtlsdr_dev);
-      #endif // HAVE_RTLSDR
-    } else if (dev_use == dev_type_t::HACKRF) {
-      fc_programmed_tmp = freq_start;
-    } else if (dev_use == dev_type_t::BLADERF) {
-      fc_programmed_tmp = freq_start;
-    } else {
-      cout << "No valid device present or configured.\n";
-      ABORT(-1);
+    // Move the cell to baseband. As in extract_tfg(), the capture was
+    // already corrected for the crystal and only the offset of the cell
+    // remains.
+    const cvec cell_bb=fshift(capbuf,-cell.freq_superfine,fs_programmed);
+    uint32 pss_lag;
+    uint8 half;
+    double pss_xc;
+    const bool found=known_cell_detect(cell_bb,cell.n_id_1,cell.n_id_2,cell.cp_type,cell.duplex_mode,sss_td,pss_sss_distance(cell.cp_type,cell.duplex_mode),9600,MONITOR_VERIFY_THRESH,pss_lag,half,pss_xc);
+    n_found+=found;
+    if (verbosity>=2) {
+      cout << "  Cell " << cell.n_id_cell() << " at " << (cell.fc_requested+cell.freq_superfine)/1e6 << " MHz " << (found?"present":"missing") << " (PSS correlation " << pss_xc << ")" << endl;
     }
+  }
+  return n_found;
+}
 
-    cout << "Use  HW  begin with " << ( freq_start/1e6 ) << "MHz actual " << (fc_programmed_tmp/1e6) << "MHz " << fs_programmed << "MHz\n";
-  } else {
-    if (strlen(load_bin_filename)!=0) { // use captured bin file
-      if ( read_header_from_bin( load_bin_filename, fc_requested_tmp, fc_programmed_tmp, fs_requested_tmp, fs_programmed_tmp) ) {
-        cerr << "main: read_header_from_bin failed.\n";
-        ABORT(-1);
-      }
-      if (fc_requested_tmp==NAN) { //  no valid header information is found
-        cerr << "Neither frequency nor valid bin file header information is specified!\n";
-        ABORT(-1);
-      }
-    } else if (use_recorded_data){ // use captured .it file
+// Report the duration and, if available, the energy consumed by a
+// monitoring job.
+void monitor_report(
+  const string & job,
+  const double & elapsed,
+  const energy_meter_t & energy
+) {
+  stringstream ss;
+  ss << "Monitor: " << job << " took " << setprecision(3) << fixed << elapsed << " s";
+  if (energy.available())
+    ss << ", " << setprecision(2) << fixed << energy.joules() << " J";
+  cout << ss.str() << endl;
+}
 
-      stringstream filename;
-      filename << data_dir << "/capbuf_" << setw(4) << setfill('0') << 0 << ".it";
-      it_ifile itf(filename.str());
+// Search every center frequency for cells. Each center frequency is tried
+// up to num_try times. The cells found at each center frequency are
+// returned in detected_cells.
+void full_scan(
+  // Inputs
+  const vec & fc_search_set_multi_try,
+  const uint16 & num_try,
+  const double & correction,
+  const bool & save_cap,
+  const char * record_bin_filename,
+  const bool & use_recorded_data,
+  const char * load_bin_filename,
+  const string & data_dir,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev,
+  const dev_type_t::dev_type_t & dev_use,
+  agc_t * agc,
+  const string & agc_filename,
+  lte_opencl_t & lte_ocl,
+  const vec & coef,
+  const vec & f_search_set,
+  const cmat & pss_fo_set,
+  const uint16 & num_loop,
+  const bool & sampling_carrier_twist,
+  const uint16 & num_reserve,
+  ostream * cell_stream,
+  const Real_Timer & scan_timer,
+  // Inputs&Outputs
+  double & fc_programmed,
+  double & fs_programmed,
+  iq_corr_t & iq_corr,
+  spur_excision_t & spur,
+  list <Cell> & cells_online,
+  // Outputs
+  vector < list<Cell> > & detected_cells
+) {
+  const uint32 n_fc_multi_try=length(fc_search_set_multi_try);
+  for (uint32 t=0;t<detected_cells.size();t++)
+    detected_cells[t].clear();
+  double fc_requested;
+  double freq_correction;
+  cvec capbuf;
 
-      itf.seek("fc");
-      ivec fc_v;
-      itf>>fc_v;
+  vec period_ppm;
+  vec k_factor_set;
 
-      itf.seek("fcp");
-      ivec fc_p;
-      itf>>fc_p;
+  // Calculate the threshold vector
+  const uint8 thresh1_n_nines=12;
+  double rx_cutoff=(6*12*15e3/2+4*15e3)/(FS_LTE/16/2);
 
-      itf.seek("fsp");
-      ivec fs_p;
-      itf>>fs_p;
+  // for PSS correlate
+  //cout << "DS_COMB_ARM override!!!" << endl;
+#define DS_COMB_ARM 2
+  mat xc_incoherent_collapsed_pow;
+  imat xc_incoherent_collapsed_frq;
+  vector <mat>  xc_incoherent_single(3);
+  vector <mat>  xc_incoherent(3);
+  vector <mat> xc(3);
+  vec sp_incoherent;
+  vec sp;
 
-      itf.close();
+  // for SSS detection
+#define THRESH2_N_SIGMA 3
+  vec sss_h1_np_est_meas;
+  vec sss_h2_np_est_meas;
+  cvec sss_h1_nrm_est_meas;
+  cvec sss_h2_nrm_est_meas;
+  cvec sss_h1_ext_est_meas;
+  cvec sss_h2_ext_est_meas;
+  mat log_lik_nrm;
+  mat log_lik_ext;
 
-      fc_requested_tmp = fc_v(0);
-      fc_programmed_tmp = fc_p(0);
-      fs_programmed_tmp = fs_p(0);
+  // for time frequency grid
+  // Extract time and frequency grid
+  cmat tfg;
+  vec tfg_timestamp;
+  // Compensate for time and frequency offsets
+  cmat tfg_comp;
+  vec tfg_comp_timestamp;
 
-    }
-    fs_programmed = fs_programmed_tmp;
-    cout << "Use file begin with " << ( fc_requested_tmp/1e6 ) << "MHz actual " << (fc_programmed_tmp/1e6) << "MHz " << fs_programmed_tmp << "MHz\n";
-  }
+  Real_Timer tt; // for profiling
 
-  if (use_recorded_data)
-    num_try=1; // compatible to .it file case
+  // PBCH soft bits of cells whose MIB could not be decoded in one try.
+  // Successive tries are only contiguous in time when they are read from
+  // a .bin file, so only then can the soft bits of several tries be
+  // combined. Cells are identified by n_id_cell, CP type, and duplex mode.
+  const bool mib_combine_tries=(strlen(load_bin_filename)>4)&&(num_try>1);
+  map <int32, mib_combine_t> mib_combine;
+  double capture_offset=0;
+  cell_cache_t cell_cache;
 
-  // Generate a list of center frequencies that should be searched and also
-  // a list of frequency offsets that should be searched for each center
-  // frequency.
-  vec fc_search_set;
-  double freq_correction = 0;
-  if (freq_start!=9999e6) { // if frequency scanning range is specified
-    fc_search_set=itpp_ext::matlab_range(freq_start,100e3,freq_end);
-  } else { // if frequency scanning range is not specified. a file is as input
-    if (strlen(load_bin_filename)!=0 || use_recorded_data) { // use captured file
+  // Loop for each center frequency.
+  for (uint32 fci=0;fci<n_fc_multi_try;fci++) {
+    fc_requested=fc_search_set_multi_try(fci);
+    uint32 fc_idx = fci/num_try;
+    uint32 try_idx = fci - fc_idx*num_try;
 
-        freq_start = fc_requested_tmp;
-        freq_end = freq_start;
-        fc_search_set.set_length(1, false);
-        fc_search_set[0] = fc_requested_tmp;
+    if (verbosity>=1) {
+      cout << "\nExamining center frequency " << fc_requested/1e6 << " MHz ... try " << try_idx << endl;
+    }
 
-    } else {
-      cerr << "Neither frequency nor captured file is specified!\n";
-      ABORT(-1);
-    }
-  }
-  freq_correction = fc_programmed_tmp*(correction-1)/correction;
-
-  cout << "    Search frequency: " << fc_search_set(0)/1e6 << " to " <<  fc_search_set( length(fc_search_set)-1 )/1e6 << " MHz" << endl;
-  cout << "with freq correction: " << freq_correction/1e3 << " kHz" << endl;
-
-  cmat pss_fo_set;// pre-generate frequencies offseted pss time domain sequence
-  vec f_search_set;
-  if (sampling_carrier_twist) { // original mode
-    uint16 n_extra=0;
-    if (ppm!=0)
-      n_extra=floor_i((fc_search_set(0)*ppm/1e6+2.5e3)/5e3);
-    else
-      n_extra=28;
-
-    f_search_set=to_vec(itpp_ext::matlab_range( -n_extra*5000,5000, (n_extra-1)*5000));
-    // for graphic card which has limited mem, you should turn num_loop on if OpenCL reports -4: CL_MEM_OBJECT_ALLOCATION_FAILURE
-//    if (num_loop == 0) // it is not so useful
-//      num_loop = length(f_search_set)/2;
-  } else {
-    if (length(fc_search_set)==1) {//when only one frequency is specified, whole PPM range should be covered
-      uint16 n_extra=0;
-      if (ppm!=0)
-        n_extra=floor_i((fc_search_set(0)*ppm/1e6+2.5e3)/5e3);
-      else
-        n_extra=28; //-140kHz to 135kHz
-
-      f_search_set=to_vec(itpp_ext::matlab_range( -n_extra*5000,5000, (n_extra-1)*5000));
-    } else {
-      // since we have frequency step is 100e3, why not have sub search set limited by this regardless PPM?
-      f_search_set=to_vec(itpp_ext::matlab_range(-60000,5000,55000)); // 2*65kHz > 100kHz, overlap adjacent frequencies
-  //    if (num_loop == 0) // it is not so useful
-  //      num_loop = 36;
-  //      f_search_set=to_vec(itpp_ext::matlab_range(-100000,5000,100000)); // align to matlab script
-    }
-  }
-
-  cout << "    Search PSS at fo: " << f_search_set(0)/1e3 << " to " << f_search_set( length(f_search_set)-1 )/1e3 << " kHz" << endl;
-
-  pss_fo_set_gen(f_search_set, pss_fo_set);
-
-//  cout << "Search PSS fo(crect): " << f_search_set(0)/1e3 << " to " << f_search_set( length(f_search_set)-1 )/1e3 << " kHz" << endl;
-
-  const uint16 n_fc=length(fc_search_set);
-
-  // construct data for multiple tries
-  const uint32 n_fc_multi_try=n_fc*num_try;
-  vec fc_search_set_multi_try;
-  fc_search_set_multi_try.set_length(n_fc_multi_try, false);
-  for(uint32 i=0; i<n_fc; i++) {
-    uint32 sp = i*num_try;
-    uint32 ep = sp + num_try;
-    fc_search_set_multi_try.set_subvector(sp, ep-1, fc_search_set(i));
-  }
-
-  // get coefficients of 6 RB filter (to improve SNR)
-  // coef = fir1(46, (0.18e6*6+150e3)/sampling_rate);
-  vec coef(( sizeof( chn_6RB_filter_coef )/sizeof(float) ));
-  for (uint16 i=0; i<length(coef); i++) {
-    coef(i) = chn_6RB_filter_coef[i];
-  }
-
-  cvec capbuf;
-
-  lte_opencl_t lte_ocl(opencl_platform, opencl_device);
-
-  #ifdef USE_OPENCL
-  lte_ocl.setup_filter_my((string)"filter_my_kernels.cl", CAPLENGTH, filter_workitem);
-
-//  if ( (length(f_search_set)*3)%num_loop != 0 ){
-//    cerr << "length(f_search_set)*3 can not be divided by num_loop. " << (length(f_search_set)*3) << " " << num_loop << "\n";
-//    ABORT(-1);
-//  }
-//  lte_ocl.setup_filter_mchn((string)"filter_mchn_kernels.cl", CAPLENGTH, length(f_search_set)*3/num_loop, pss_fo_set.cols(), xcorr_workitem);
-  #ifdef FILTER_MCHN_SIMPLE_KERNEL
-  lte_ocl.setup_filter_mchn((string)"filter_mchn_simple_kernel.cl", CAPLENGTH, length(f_search_set)*3, pss_fo_set.cols(), xcorr_workitem);
-  #else
-  lte_ocl.setup_filter_mchn((string)"filter_mchn_kernels.cl", CAPLENGTH, length(f_search_set)*3, pss_fo_set.cols(), xcorr_workitem);
-  #endif
-  #endif
-
-  vec period_ppm;
-  vec k_factor_set;
-
-  // Calculate the threshold vector
-  const uint8 thresh1_n_nines=12;
-  double rx_cutoff=(6*12*15e3/2+4*15e3)/(FS_LTE/16/2);
-
-  // for PSS correlate
-  //cout << "DS_COMB_ARM override!!!" << endl;
-#define DS_COMB_ARM 2
-  mat xc_incoherent_collapsed_pow;
-  imat xc_incoherent_collapsed_frq;
-  vector <mat>  xc_incoherent_single(3);
-  vector <mat>  xc_incoherent(3);
-  vector <mat> xc(3);
-  vec sp_incoherent;
-  vec sp;
-
-  // for SSS detection
-#define THRESH2_N_SIGMA 3
-  vec sss_h1_np_est_meas;
-  vec sss_h2_np_est_meas;
-  cvec sss_h1_nrm_est_meas;
-  cvec sss_h2_nrm_est_meas;
-  cvec sss_h1_ext_est_meas;
-  cvec sss_h2_ext_est_meas;
-  mat log_lik_nrm;
-  mat log_lik_ext;
-
-  // for time frequency grid
-  // Extract time and frequency grid
-  cmat tfg;
-  vec tfg_timestamp;
-  // Compensate for time and frequency offsets
-  cmat tfg_comp;
-  vec tfg_comp_timestamp;
-
-  Real_Timer tt; // for profiling
-  // Each center frequency is searched independently. Results are stored in this vector.
-  vector < list<Cell> > detected_cells(n_fc);
-  // Loop for each center frequency.
-  for (uint32 fci=0;fci<n_fc_multi_try;fci++) {
-    fc_requested=fc_search_set_multi_try(fci);
-    uint32 fc_idx = fci/num_try;
-    uint32 try_idx = fci - fc_idx*num_try;
-
-    if (verbosity>=1) {
-      cout << "\nExamining center frequency " << fc_requested/1e6 << " MHz ... try " << try_idx << endl;
+    if (agc) {
+      agc_set_gain(*agc,fc_requested,correction,rtlsdr_dev,hackrf_dev,bladerf_dev,dev_use);
     }
 
     // Fill capture buffer
@@ -1178,7 +1324,25 @@ int main(
       continue;
     }
 
-    capbuf = capbuf - mean(capbuf); // remove DC
+    // The gain is not changed for this capture but the next capture at
+    // this frequency will use the corrected gain.
+    if (agc) {
+      agc->update(fc_requested,agc_measure(capbuf,AGC_HEAD_LENGTH,agc->clip_level));
+      agc->save(agc_filename);
+    }
+    if (try_idx==0) {
+      mib_combine.clear();
+      capture_offset=0;
+    }
+    const double capture_start=capture_offset;
+    capture_offset+=length(capbuf);
+
+    iq_corr.correct(capbuf); // remove DC and IQ imbalance
+    if (verbosity>=2) {
+      cout << "  IQ image rejection ratio " << iq_corr.irr_db() << " dB" << endl;
+    }
+    // Spurs would otherwise raise the detection threshold.
+    spur.excise(fc_programmed,capbuf);
 
     freq_correction = fc_programmed*(correction-1)/correction;
 //    if (!dongle_used) { // if dongle is not used, do correction explicitly. Because if dongle is used, the correction is done when tuning dongle's frequency.
@@ -1202,8 +1366,19 @@ int main(
 
     vec dynamic_f_search_set = f_search_set; // don't touch the original
     double xcorr_pss_time;
+    bigmem_tlb_counter_t tlb_counter;
+    tlb_counter.start();
     sampling_ppm_f_search_set_by_pss(lte_ocl, num_loop, capbuf, pss_fo_set, sampling_carrier_twist, num_reserve, dynamic_f_search_set, period_ppm, xc, xcorr_pss_time);
+    const int64 tlb_misses=tlb_counter.stop();
     cout << "PSS XCORR  cost " << xcorr_pss_time << "s\n";
+    if (verbosity>=2) {
+      // Effect of the -H policy on the correlation stage.
+      if (tlb_misses>=0)
+        cout << "  PSS XCORR  dTLB load misses " << tlb_misses << endl;
+      const double remote=bigmem_remote_fraction(xc[0]);
+      if (!isnan(remote))
+        cout << "  PSS XCORR  results on a remote NUMA node " << remote*100 << "%" << endl;
+    }
 
     list <Cell> peak_search_cells;
     if (!sampling_carrier_twist) {
@@ -1215,40 +1390,29 @@ int main(
         k_factor_set = 1 + period_ppm*1e-6;
       }
 
-      vec tmp_f_search(1);
-      vector <mat> tmp_xc(3);
-      tmp_xc[0].set_size(1, length(capbuf)-136);
-      tmp_xc[1].set_size(1, length(capbuf)-136);
-      tmp_xc[2].set_size(1, length(capbuf)-136);
-      for (uint16 i=0; i<length(k_factor_set); i++) {
-
-        tmp_f_search(0) = dynamic_f_search_set(i);
-        tmp_xc[0].set_row(0, xc[0].get_row(i));
-        tmp_xc[1].set_row(0, xc[1].get_row(i));
-        tmp_xc[2].set_row(0, xc[2].get_row(i));
-
-        // Correlate
-        uint16 n_comb_xc;
-        uint16 n_comb_sp;
-        if (verbosity>=2) {
-          cout << "  Calculating PSS correlations" << endl;
-        }
-//        tt.tic();
-        xcorr_pss(capbuf,tmp_f_search,DS_COMB_ARM,fc_requested,fc_programmed,fs_programmed,tmp_xc,xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,xc_incoherent_single,xc_incoherent,sp_incoherent,sp,n_comb_xc,n_comb_sp,sampling_carrier_twist,(const double)k_factor_set[i]);
-//        cout << "PSS post cost " << tt.get_time() << "s\n";
+      // Every (frequency offset, ppm) pair that survived the pre-search is
+      // a row of xc. All of them are combined and searched in one pass.
+      // Correlate
+      uint16 n_comb_xc;
+      uint16 n_comb_sp;
+      if (verbosity>=2) {
+        cout << "  Calculating PSS correlations for " << length(k_factor_set) << " hypotheses" << endl;
+      }
+//      tt.tic();
+      xcorr_pss(capbuf,dynamic_f_search_set,k_factor_set,DS_COMB_ARM,fc_requested,fc_programmed,fs_programmed,xc,xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,xc_incoherent_single,xc_incoherent,sp_incoherent,sp,n_comb_xc,n_comb_sp);
+//      cout << "PSS post cost " << tt.get_time() << "s\n";
 
-        // Calculate the threshold vector
-        double R_th1=chi2cdf_inv(1-pow(10.0,-thresh1_n_nines),2*n_comb_xc*(2*DS_COMB_ARM+1));
-        vec Z_th1=R_th1*sp_incoherent/rx_cutoff/137/n_comb_xc/(2*DS_COMB_ARM+1); // remove /2 to avoid many false alarm
+      // Calculate the threshold vector
+      double R_th1=chi2cdf_inv(1-pow(10.0,-thresh1_n_nines),2*n_comb_xc*(2*DS_COMB_ARM+1));
+      vec Z_th1=R_th1*sp_incoherent/rx_cutoff/137/n_comb_xc/(2*DS_COMB_ARM+1); // remove /2 to avoid many false alarm
 
-        // Search for the peaks
-        if (verbosity>=2) {
-          cout << "  Searching for and examining correlation peaks..." << endl;
-        }
-//        tt.tic();
-        peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,tmp_f_search,fc_requested,fc_programmed,xc_incoherent_single,DS_COMB_ARM,sampling_carrier_twist,(const double)k_factor_set[i],peak_search_cells);
-//        cout << "peak_search cost " << tt.get_time() << "s\n";
+      // Search for the peaks
+      if (verbosity>=2) {
+        cout << "  Searching for and examining correlation peaks..." << endl;
       }
+//      tt.tic();
+      peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,dynamic_f_search_set,k_factor_set,fc_requested,fc_programmed,xc_incoherent_single,DS_COMB_ARM,peak_search_cells);
+//      cout << "peak_search cost " << tt.get_time() << "s\n";
 
     } else {
 
@@ -1275,6 +1439,7 @@ int main(
 //      cout << "peak_search cost " << tt.get_time() << "s\n";
     }
 
+    reject_image_peaks(freq_correction,peak_search_cells);
     detected_cells[fc_idx]=peak_search_cells;
     cout << "Hit  num peaks " << detected_cells[fc_idx].size()/2 << "\n";
 
@@ -1289,18 +1454,54 @@ int main(
 //      cout << tdd_flag << "\n";
 //      cout << (*iterator).ind << "\n";
       // Detect SSS if possible
-      (*iterator)=sss_detect((*iterator),capbuf,THRESH2_N_SIGMA,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est_meas,sss_h2_np_est_meas,sss_h1_nrm_est_meas,sss_h2_nrm_est_meas,sss_h1_ext_est_meas,sss_h2_ext_est_meas,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
+      (*iterator)=sss_detect(lte_ocl,(*iterator),capbuf,THRESH2_N_SIGMA,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est_meas,sss_h2_np_est_meas,sss_h1_nrm_est_meas,sss_h2_nrm_est_meas,sss_h1_ext_est_meas,sss_h2_ext_est_meas,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
       if ((*iterator).n_id_1!=-1) {
         // Fine FOE
         (*iterator)=pss_sss_foe((*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,sampling_carrier_twist,tdd_flag);
+        // The same cell was already verified from a neighbouring center
+        // frequency. Reuse its MIB and place this detection on the
+        // carrier frequency that was measured then. dedup() will keep
+        // whichever detection is stronger.
+        const Cell * cached=cell_cache_find(cell_cache,(*iterator),tdd_flag);
+        if (cached) {
+          const Cell & c=*cached;
+          (*iterator).freq_superfine=c.fc_requested+c.freq_superfine-fc_requested;
+          (*iterator).n_ports=c.n_ports;
+          (*iterator).n_rb_dl=c.n_rb_dl;
+          (*iterator).phich_duration=c.phich_duration;
+          (*iterator).phich_resource=c.phich_resource;
+          if (verbosity>=2) {
+            cout << "  Cell " << (*iterator).n_id_cell() << " was already verified at " << c.fc_requested/1e6 << " MHz" << endl;
+          }
+          if (cell_stream) {
+            const uint8 r=dedup_insert((*iterator),cells_online);
+            if (r!=DEDUP_DISCARDED)
+              stream_cell(*cell_stream,r,(*iterator),correction,scan_timer.get_time());
+          }
+          ++iterator;
+          continue;
+        }
         // Extract time and frequency grid
-        extract_tfg((*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
+        extract_tfg(lte_ocl,(*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
         // Create object containing all RS
         RS_DL rs_dl((*iterator).n_id_cell(),6,(*iterator).cp_type);
         // Compensate for time and frequency offsets
         (*iterator)=tfoec((*iterator),tfg,tfg_timestamp,fc_requested,fc_programmed,rs_dl,tfg_comp,tfg_comp_timestamp,sampling_carrier_twist);
         // Finally, attempt to decode the MIB
-        (*iterator)=decode_mib((*iterator),tfg_comp,rs_dl);
+        if (mib_combine_tries) {
+          // Number the frames relative to the first try in which this cell
+          // was seen so that the PBCH soft bits of the tries line up.
+          const int32 key=cell_key((*iterator),tdd_flag);
+          const double tfg_start=capture_start+tfg_timestamp(0);
+          if (mib_combine.find(key)==mib_combine.end()) {
+            mib_combine[key].tfg_start=tfg_start;
+          }
+          mib_combine_t & mc=mib_combine[key];
+          const int32 frame_num=itpp::round_i((tfg_start-mc.tfg_start)/(.01*fs_programmed*(*iterator).k_factor));
+          (*iterator)=decode_mib((*iterator),tfg_comp,rs_dl,frame_num,mc.pbch_history);
+        } else {
+          (*iterator)=decode_mib((*iterator),tfg_comp,rs_dl);
+        }
 
         if ((*iterator).n_rb_dl==-1) {
           // No MIB could be successfully decoded.
@@ -1320,6 +1521,12 @@ int main(
           cout << "                     k_factor: " << (*iterator).k_factor << endl;
         }
 
+        cell_cache[cell_key((*iterator),tdd_flag)].push_back(*iterator);
+        if (cell_stream) {
+          const uint8 r=dedup_insert((*iterator),cells_online);
+          if (r!=DEDUP_DISCARDED)
+            stream_cell(*cell_stream,r,(*iterator),correction,scan_timer.get_time());
+        }
         ++iterator;
 
       } else {
@@ -1387,6 +1594,326 @@ int main(
       fci = (fc_idx+1)*num_try - 1; // skip to next frequency
     }
   }
+}
+
+// Main cell search routine.
+int main(
+  const int argc,
+  char * const argv[]
+) {
+  // Command line parameters are stored here.
+  double freq_start;
+  double freq_end;
+  uint16 num_try;
+  bool sampling_carrier_twist;
+  double ppm;
+  double correction;
+  bool save_cap;
+  bool use_recorded_data;
+  string data_dir;
+  int device_index;
+  char record_bin_filename[256] = {0};
+  char load_bin_filename[256] = {0};
+  int16  gain;
+  string agc_filename;
+  string output_filename;
+  uint16 opencl_platform;
+  uint16 opencl_device;
+  uint16 filter_workitem;
+  uint16 xcorr_workitem;
+  uint16 num_reserve;
+  uint16 num_loop; // it is not so useful
+  bigmem_policy_t::bigmem_policy_t bigmem_mode;
+  double fs_native;
+  double monitor_interval;
+  double verify_interval;
+  uint16 n_cores;
+
+  // Get search parameters from user
+  parse_commandline(argc,argv,freq_start,freq_end,num_try,sampling_carrier_twist,ppm,correction,save_cap,use_recorded_data,data_dir,device_index, record_bin_filename, load_bin_filename,opencl_platform,opencl_device,filter_workitem,xcorr_workitem,num_reserve,num_loop,gain,agc_filename,output_filename,bigmem_mode,fs_native,monitor_interval,verify_interval,n_cores);
+  bigmem_policy(bigmem_mode);
+  limit_cores(n_cores);
+
+  // Open the USB device (if necessary).
+  dev_type_t::dev_type_t dev_use = dev_type_t::UNKNOWN;
+  rtlsdr_device * rtlsdr_dev=NULL;
+  hackrf_device * hackrf_dev = NULL; // if HAVE_HACKRF isn't defined, hackrf_device will be asigned a fake type.
+  bladerf_device * bladerf_dev = NULL; // if HAVE_BLADERF isn't defined, bladerf_device will be asigned a fake type.
+
+  double fs_programmed = FS_LTE/16; // in case not initialized by config_rtlsdr
+  double fc_programmed; // for correction frequency calculation
+  double fc_requested, fc_requested_tmp, fc_programmed_tmp, fs_requested_tmp, fs_programmed_tmp;
+
+  bool dongle_used = (!use_recorded_data) && (strlen(load_bin_filename)==0);
+  if ( dongle_used && freq_start!=9999e6) {
+
+    #ifdef HAVE_RTLSDR
+    if ( config_rtlsdr(sampling_carrier_twist,correction,device_index,freq_start,rtlsdr_dev,fs_programmed,gain,fs_native) == 0 ) {
+      dev_use = dev_type_t::RTLSDR;
+      cout << "RTLSDR device FOUND!\n";
+    } else {
+      cout << "RTLSDR device not FOUND!\n";
+      ABORT(-1);
+    }
+    #endif
+
+    #ifdef HAVE_HACKRF
+    if ( config_hackrf(sampling_carrier_twist,correction,device_index,freq_start,hackrf_dev,fs_programmed,gain,fs_native) == 0 ) {
+      dev_use = dev_type_t::HACKRF;
+      cout << "HACKRF device FOUND!\n";
+    } else {
+      cout << "HACKRF device not FOUND!\n";
+      ABORT(-1);
+    }
+    #endif
+
+    #ifdef HAVE_BLADERF
+    if ( config_bladerf(sampling_carrier_twist,correction,device_index,freq_start,bladerf_dev,fs_programmed,gain,fs_native) == 0 ) {
+      dev_use = dev_type_t::BLADERF;
+      cout << "BLADERF device FOUND!\n";
+    } else {
+      cout << "BLADERF device not FOUND!\n";
+      ABORT(-1);
+    }
+    #endif
+
+    if (dev_use == dev_type_t::RTLSDR) {
+      #ifdef HAVE_RTLSDR
+      fc_programmed_tmp = calculate_fc_programmed_in_context(freq_start, use_recorded_data, load_bin_filename, rtlsdr_dev);
+      #endif // HAVE_RTLSDR
+    } else if (dev_use == dev_type_t::HACKRF) {
+      fc_programmed_tmp = freq_start;
+    } else if (dev_use == dev_type_t::BLADERF) {
+      fc_programmed_tmp = freq_start;
+    } else {
+      cout << "No valid device present or configured.\n";
+      ABORT(-1);
+    }
+
+    cout << "Use  HW  begin with " << ( freq_start/1e6 ) << "MHz actual " << (fc_programmed_tmp/1e6) << "MHz " << fs_programmed << "MHz\n";
+  } else {
+    if (agc_filename.length()) {
+      cout << "Warning: AGC is only used with live data.\n";
+      agc_filename="";
+    }
+    if (strlen(load_bin_filename)!=0) { // use captured bin file
+      if ( read_header_from_bin( load_bin_filename, fc_requested_tmp, fc_programmed_tmp, fs_requested_tmp, fs_programmed_tmp) ) {
+        cerr << "main: read_header_from_bin failed.\n";
+        ABORT(-1);
+      }
+      if (fc_requested_tmp==NAN) { //  no valid header information is found
+        cerr << "Neither frequency nor valid bin file header information is specified!\n";
+        ABORT(-1);
+      }
+    } else if (use_recorded_data){ // use captured .it file
+
+      stringstream filename;
+      filename << data_dir << "/capbuf_" << setw(4) << setfill('0') << 0 << ".it";
+      it_ifile itf(filename.str());
+
+      itf.seek("fc");
+      ivec fc_v;
+      itf>>fc_v;
+
+      itf.seek("fcp");
+      ivec fc_p;
+      itf>>fc_p;
+
+      itf.seek("fsp");
+      ivec fs_p;
+      itf>>fs_p;
+
+      itf.close();
+
+      fc_requested_tmp = fc_v(0);
+      fc_programmed_tmp = fc_p(0);
+      fs_programmed_tmp = fs_p(0);
+
+    }
+    fs_programmed = fs_programmed_tmp;
+    cout << "Use file begin with " << ( fc_requested_tmp/1e6 ) << "MHz actual " << (fc_programmed_tmp/1e6) << "MHz " << fs_programmed_tmp << "MHz\n";
+  }
+
+  if (use_recorded_data)
+    num_try=1; // compatible to .it file case
+
+  // Generate a list of center frequencies that should be searched and also
+  // a list of frequency offsets that should be searched for each center
+  // frequency.
+  vec fc_search_set;
+  double freq_correction = 0;
+  if (freq_start!=9999e6) { // if frequency scanning range is specified
+    fc_search_set=itpp_ext::matlab_range(freq_start,100e3,freq_end);
+  } else { // if frequency scanning range is not specified. a file is as input
+    if (strlen(load_bin_filename)!=0 || use_recorded_data) { // use captured file
+
+        freq_start = fc_requested_tmp;
+        freq_end = freq_start;
+        fc_search_set.set_length(1, false);
+        fc_search_set[0] = fc_requested_tmp;
+
+    } else {
+      cerr << "Neither frequency nor captured file is specified!\n";
+      ABORT(-1);
+    }
+  }
+  freq_correction = fc_programmed_tmp*(correction-1)/correction;
+
+  cout << "    Search frequency: " << fc_search_set(0)/1e6 << " to " <<  fc_search_set( length(fc_search_set)-1 )/1e6 << " MHz" << endl;
+  cout << "with freq correction: " << freq_correction/1e3 << " kHz" << endl;
+
+  cmat pss_fo_set;// pre-generate frequencies offseted pss time domain sequence
+  vec f_search_set;
+  if (sampling_carrier_twist) { // original mode
+    uint16 n_extra=0;
+    if (ppm!=0)
+      n_extra=floor_i((fc_search_set(0)*ppm/1e6+2.5e3)/5e3);
+    else
+      n_extra=28;
+
+    f_search_set=to_vec(itpp_ext::matlab_range( -n_extra*5000,5000, (n_extra-1)*5000));
+    // for graphic card which has limited mem, you should turn num_loop on if OpenCL reports -4: CL_MEM_OBJECT_ALLOCATION_FAILURE
+//    if (num_loop == 0) // it is not so useful
+//      num_loop = length(f_search_set)/2;
+  } else {
+    if (length(fc_search_set)==1) {//when only one frequency is specified, whole PPM range should be covered
+      uint16 n_extra=0;
+      if (ppm!=0)
+        n_extra=floor_i((fc_search_set(0)*ppm/1e6+2.5e3)/5e3);
+      else
+        n_extra=28; //-140kHz to 135kHz
+
+      f_search_set=to_vec(itpp_ext::matlab_range( -n_extra*5000,5000, (n_extra-1)*5000));
+    } else {
+      // since we have frequency step is 100e3, why not have sub search set limited by this regardless PPM?
+      f_search_set=to_vec(itpp_ext::matlab_range(-60000,5000,55000)); // 2*65kHz > 100kHz, overlap adjacent frequencies
+  //    if (num_loop == 0) // it is not so useful
+  //      num_loop = 36;
+  //      f_search_set=to_vec(itpp_ext::matlab_range(-100000,5000,100000)); // align to matlab script
+    }
+  }
+
+  cout << "    Search PSS at fo: " << f_search_set(0)/1e3 << " to " << f_search_set( length(f_search_set)-1 )/1e3 << " kHz" << endl;
+
+  pss_fo_set_gen(f_search_set, pss_fo_set);
+
+//  cout << "Search PSS fo(crect): " << f_search_set(0)/1e3 << " to " << f_search_set( length(f_search_set)-1 )/1e3 << " kHz" << endl;
+
+  const uint16 n_fc=length(fc_search_set);
+
+  // construct data for multiple tries
+  const uint32 n_fc_multi_try=n_fc*num_try;
+  vec fc_search_set_multi_try;
+  fc_search_set_multi_try.set_length(n_fc_multi_try, false);
+  for(uint32 i=0; i<n_fc; i++) {
+    uint32 sp = i*num_try;
+    uint32 ep = sp + num_try;
+    fc_search_set_multi_try.set_subvector(sp, ep-1, fc_search_set(i));
+  }
+
+  // get coefficients of 6 RB filter (to improve SNR)
+  // coef = fir1(46, (0.18e6*6+150e3)/sampling_rate);
+  vec coef(( sizeof( chn_6RB_filter_coef )/sizeof(float) ));
+  for (uint16 i=0; i<length(coef); i++) {
+    coef(i) = chn_6RB_filter_coef[i];
+  }
+
+  cvec capbuf;
+
+  lte_opencl_t lte_ocl(opencl_platform, opencl_device);
+
+  #ifdef USE_OPENCL
+  lte_ocl.setup_filter_my((string)"filter_my_kernels.cl", CAPLENGTH, filter_workitem);
+  lte_ocl.setup_search_post((string)"search_post_kernels.cl", CAPLENGTH);
+
+//  if ( (length(f_search_set)*3)%num_loop != 0 ){
+//    cerr << "length(f_search_set)*3 can not be divided by num_loop. " << (length(f_search_set)*3) << " " << num_loop << "\n";
+//    ABORT(-1);
+//  }
+//  lte_ocl.setup_filter_mchn((string)"filter_mchn_kernels.cl", CAPLENGTH, length(f_search_set)*3/num_loop, pss_fo_set.cols(), xcorr_workitem);
+  #ifdef FILTER_MCHN_SIMPLE_KERNEL
+  lte_ocl.setup_filter_mchn((string)"filter_mchn_simple_kernel.cl", CAPLENGTH, length(f_search_set)*3, pss_fo_set.cols(), xcorr_workitem);
+  #else
+  lte_ocl.setup_filter_mchn((string)"filter_mchn_kernels.cl", CAPLENGTH, length(f_search_set)*3, pss_fo_set.cols(), xcorr_workitem);
+  #endif
+  #endif
+
+  // Each center frequency is searched independently. Results are stored in this vector.
+  vector < list<Cell> > detected_cells(n_fc);
+  // Cells are written to the output file as soon as they are found. An
+  // online dedup suppresses cells that have already been reported and
+  // reports stronger detections as updates.
+  ostream * cell_stream=NULL;
+  ofstream cell_file;
+  list <Cell> cells_online;
+  Real_Timer scan_timer;
+  if (output_filename.length()) {
+    if (output_filename=="-") {
+      cell_stream=&cout;
+    } else {
+      cell_file.open(output_filename.c_str());
+      if (!cell_file) {
+        cerr << "Error: unable to open output file " << output_filename << endl;
+        ABORT(-1);
+      }
+      cell_stream=&cell_file;
+    }
+    (*cell_stream) << "# event,time_s,fc_hz,cell_id,cp,duplex,n_ports,n_rb_dl,phich_duration,phich_resource,rx_power_db,freq_offset_hz,ppm,frame_start" << endl;
+  }
+  scan_timer.tic();
+  // Gains that were chosen in previous scans are reused.
+  agc_t * agc=NULL;
+  if (agc_filename.length()) {
+    agc=new agc_t(dev_use,gain);
+    agc->load(agc_filename);
+  }
+  // IQ imbalance is a property of the device and is averaged over
+  // successive captures.
+  iq_corr_t iq_corr;
+  // Spurs are learned separately for each center frequency.
+  spur_excision_t spur;
+  // In monitoring mode, a full scan is performed every monitor_interval
+  // seconds. In between, the cells found by the last scan are verified
+  // every verify_interval seconds and a full scan is started early when
+  // one of them is missing. The device is put in standby and the process
+  // sleeps between jobs.
+  energy_meter_t energy;
+  if ((monitor_interval>0)&&(!energy.available())) {
+    cout << "Warning: RAPL energy counters cannot be read, energy will not be reported" << endl;
+  }
+  const SSS_td sss_td;
+  Real_Timer monitor_timer;
+  monitor_timer.tic();
+  monitor_schedule_t schedule(monitor_interval,verify_interval);
+  list <Cell> cells_final;
+  while (true) {
+    const double scan_begin=monitor_timer.get_time();
+    energy.start();
+    full_scan(fc_search_set_multi_try,num_try,correction,save_cap,record_bin_filename,use_recorded_data,load_bin_filename,data_dir,rtlsdr_dev,hackrf_dev,bladerf_dev,dev_use,agc,agc_filename,lte_ocl,coef,f_search_set,pss_fo_set,num_loop,sampling_carrier_twist,num_reserve,cell_stream,scan_timer,fc_programmed,fs_programmed,iq_corr,spur,cells_online,detected_cells);
+
+    // Generate final list of detected cells.
+    dedup(detected_cells,cells_final);
+    if (monitor_interval==0)
+      break;
+
+    print_cells(cells_final,correction);
+    monitor_report("scan",monitor_timer.get_time()-scan_begin,energy);
+    schedule.scan_done(scan_begin,monitor_timer.get_time(),cells_final.size());
+    while (true) {
+      device_standby(dev_use,rtlsdr_dev,hackrf_dev,bladerf_dev);
+      monitor_sleep(schedule.next_job()-monitor_timer.get_time());
+      if (schedule.scan_due())
+        break;
+
+      const double verify_begin=monitor_timer.get_time();
+      energy.start();
+      const uint16 n_found=monitor_verify(cells_final,correction,sss_td,data_dir,rtlsdr_dev,hackrf_dev,bladerf_dev,dev_use,iq_corr);
+      stringstream job;
+      job << "verification of " << n_found << "/" << cells_final.size() << " cells";
+      monitor_report(job.str(),monitor_timer.get_time()-verify_begin,energy);
+      schedule.verify_done(monitor_timer.get_time(),n_found==cells_final.size());
+    }
+  }
 
   if (dev_use == dev_type_t::HACKRF) {
     #ifdef HAVE_HACKRF
@@ -1414,58 +1941,10 @@ int main(
     #endif
   }
 
-  // Generate final list of detected cells.
-  list <Cell> cells_final;
-  dedup(detected_cells,cells_final);
-
   // Print out the final list of detected cells.
-  if (cells_final.size()==0) {
-    cout << "No LTE cells were found..." << endl;
-  } else {
-    cout << "Detected the following cells:" << endl;
-    cout << "DPX:TDD/FDD; A: #antenna ports C: CP type ; P: PHICH duration ; PR: PHICH resource type" << endl;
-    cout << "DPX CID A      fc   freq-offset RXPWR C nRB P  PR CrystalCorrectionFactor" << endl;
-    list <Cell>::iterator it=cells_final.begin();
-    while (it!=cells_final.end()) {
-      // Use a stringstream to avoid polluting the iostream settings of cout.
-      stringstream ss;
-      if ((*it).duplex_mode == 1)
-        ss << "TDD ";
-      else
-        ss << "FDD ";
-      ss << setw(3) << (*it).n_id_cell();
-      ss << setw(2) << (*it).n_ports;
-      ss << " " << setw(6) << setprecision(5) << (*it).fc_requested/1e6 << "M";
-      ss << " " << setw(13) << freq_formatter((*it).freq_superfine);
-      ss << " " << setw(5) << setprecision(3) << db10((*it).pss_pow);
-      ss << " " << (((*it).cp_type==cp_type_t::NORMAL)?"N":(((*it).cp_type==cp_type_t::UNKNOWN)?"U":"E"));
-      ss << " " << setw(3) << (*it).n_rb_dl;
-      ss << " " << (((*it).phich_duration==phich_duration_t::NORMAL)?"N":(((*it).phich_duration==phich_duration_t::UNKNOWN)?"U":"E"));
-      switch ((*it).phich_resource) {
-        case phich_resource_t::UNKNOWN: ss << " UNK"; break;
-        case phich_resource_t::oneSixth: ss << " 1/6"; break;
-        case phich_resource_t::half: ss << " 1/2"; break;
-        case phich_resource_t::one: ss << " one"; break;
-        case phich_resource_t::two: ss << " two"; break;
-      }
+  print_cells(cells_final,correction);
 
-      // Calculate the correction factor.
-      // This is where we know the carrier is located
-      const double true_location=(*it).fc_programmed;
-      // We can calculate the RTLSDR's actualy frequency
-      const double crystal_freq_actual=(*it).fc_programmed-(*it).freq_superfine;
-      // Calculate correction factors
-      const double correction_residual=true_location/crystal_freq_actual;
-      double correction_new=correction*correction_residual;
-//      if (!sampling_carrier_twist) {
-//        correction_new = (*it).k_factor;
-//      }
-      ss << " " << setprecision(20) << correction_new;
-      cout << ss.str() << endl;
-
-      ++it;
-    }
-  }
+  delete agc;
 
   // Successful exit.
   return 0;
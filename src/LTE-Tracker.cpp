@@ -36,6 +36,8 @@
 #include <list>
 #include <sstream>
 #include <queue>
+#include <vector>
+#include <map>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -83,6 +85,9 @@ void sigint_callback_handler(int signum)
 #include "itpp_ext.h"
 #include "searcher.h"
 #include "dsp.h"
+#include "spur.h"
+#include "placement.h"
+#include "bigmem.h"
 #include "LTE-Tracker.h"
 #include "filter_coef.h"
 
@@ -123,6 +128,9 @@ void print_usage() {
   cout << "      specify which OpenCL platform to use (default: 0)" << endl;
   cout << "    -g --gain G" << endl;
   cout << "      specify gain to hardware (rtl default 0(auto); HACKRF default 40; bladeRF default LNA-MAX VGA-66)" << endl;
+  cout << "    -R --rate fs" << endl;
+  cout << "      run the device at sample rate fs (e.g. 2.048e6) and resample to 1.92MHz (default: run the device at 1.92MHz)" << endl;
+  cout << "      only applies to live devices and cannot be combined with -W" << endl;
   cout << "    -j --opencl-device N" << endl;
   cout << "      specify which OpenCL device of selected platform to use (default: 0)" << endl;
   cout << "    -w --filter-workitem N" << endl;
@@ -148,6 +156,23 @@ void print_usage() {
   cout << "      save captured data in the bin file. (only supports single frequency scanning)" << endl;
   cout << "    -y --loadbin" << endl;
   cout << "      used data in captured bin file. (only supports single frequency scanning)" << endl;
+  cout << "    -W --wideband n_rb" << endl;
+  cout << "      track up to n_rb RB's of each cell instead of only the central 6 RB's (6, 15, 25, 50, 75, or 100)." << endl;
+  cout << "      requires a bin file that was captured at a sample rate of at least n_rb*12*15kHz/0.71" << endl;
+  cout << "  Performance options:" << endl;
+  cout << "    -D --search-duty D" << endl;
+  cout << "      search for new cells in one out of every D half frames (default: 1)" << endl;
+  cout << "    -T --tracker-opencl" << endl;
+  cout << "      perform the FOC and DFT of the OFDM symbols of all the tracked cells in batches on the OpenCL device" << endl;
+  cout << "    -P --placement mode" << endl;
+  cout << "      none: let the OS place the threads (default)" << endl;
+  cout << "      pin: pin the sample reading and distribution threads to their own cores and spread the trackers over the rest" << endl;
+  cout << "      rt: same as pin and also use SCHED_FIFO for the sample reading and distribution threads (requires privileges)" << endl;
+  cout << "    -H --hugepages mode" << endl;
+  cout << "      none: use regular pages for the large buffers" << endl;
+  cout << "      thp: use transparent huge pages for the large buffers (default)" << endl;
+  cout << "      explicit: use the huge page pool (/proc/sys/vm/nr_hugepages) for the OpenCL buffers" << endl;
+  cout << "      with thp and explicit, the large buffers are also kept on the NUMA node of the thread that uses them" << endl;
   // Hidden option...
   //cout << "    -x --expert" << endl;
   //cout << "      enable expert mode display" << endl;
@@ -207,7 +232,13 @@ void parse_commandline(
   uint16 & filter_workitem,
   uint16 & xcorr_workitem,
   uint16 & num_reserve,
-  int16  & gain
+  int16  & gain,
+  int8 & n_rb_track_max,
+  placement_t::placement_t & placement_mode,
+  bigmem_policy_t::bigmem_policy_t & bigmem_mode,
+  double & fs_native,
+  uint16 & search_duty,
+  bool & tracker_opencl
 ) {
   // Default values
   fc=-1;
@@ -227,6 +258,12 @@ void parse_commandline(
   xcorr_workitem = 2;
   num_reserve = 2;
   gain = -9999;
+  n_rb_track_max = 6;
+  placement_mode = placement_t::NONE;
+  bigmem_mode = bigmem_policy_t::THP;
+  fs_native = 0;
+  search_duty = 1;
+  tracker_opencl = false;
 
   while (1) {
     static struct option long_options[] = {
@@ -241,12 +278,18 @@ void parse_commandline(
       {"device-index", required_argument, 0, 'i'},
       {"opencl-platform", required_argument, 0, 'a'},
       {"gain", required_argument, 0, 'g'},
+      {"rate",         required_argument, 0, 'R'},
       {"opencl-device", required_argument, 0, 'j'},
       {"filter-workitem", required_argument, 0, 'w'},
       {"xcorr-workitem", required_argument, 0, 'u'},
       {"expert",       no_argument,       0, 'x'},
       {"recbin",       required_argument, 0, 'z'},
       {"loadbin",      required_argument, 0, 'y'},
+      {"wideband",     required_argument, 0, 'W'},
+      {"placement",    required_argument, 0, 'P'},
+      {"hugepages",    required_argument, 0, 'H'},
+      {"search-duty",  required_argument, 0, 'D'},
+      {"tracker-opencl", no_argument,     0, 'T'},
       {"load",         required_argument, 0, 'l'},
       {"repeat",       no_argument,       0, 'r'},
       {"drop",         required_argument, 0, 'd'},
@@ -265,7 +308,7 @@ void parse_commandline(
     };
     /* getopt_long stores the option index here. */
     int option_index = 0;
-    int c = getopt_long (argc, argv, "hvbf:m:tp:c:i:a:g:j:w:u:xz:y:l:rd:sn:1:2:3:4:5:6:7:8:9:",
+    int c = getopt_long (argc, argv, "hvbf:m:tp:c:i:a:g:R:j:w:u:xz:y:W:P:H:D:Tl:rd:sn:1:2:3:4:5:6:7:8:9:",
                      long_options, &option_index);
 
     /* Detect the end of the options. */
@@ -345,6 +388,45 @@ void parse_commandline(
       case 'x':
         expert_mode=true;
         break;
+      case 'W':
+        n_rb_track_max=strtol(optarg,&endp,10);
+        if ((optarg==endp)||(*endp!='\0')) {
+          cerr << "Error: could not parse number of RB's to track" << endl;
+          ABORT(-1);
+        }
+        if ((n_rb_track_max!=6)&&(n_rb_track_max!=15)&&(n_rb_track_max!=25)&&(n_rb_track_max!=50)&&(n_rb_track_max!=75)&&(n_rb_track_max!=100)) {
+          cerr << "Error: number of RB's to track must be 6, 15, 25, 50, 75, or 100" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'P':
+        placement_mode=placement_parse(optarg);
+        break;
+      case 'R':
+        fs_native=frontend_parse(optarg);
+        break;
+      case 'H':
+        bigmem_mode=bigmem_parse(optarg);
+        break;
+      case 'D':
+        search_duty=strtol(optarg,&endp,10);
+        if ((optarg==endp)||(*endp!='\0')) {
+          cerr << "Error: could not parse search duty" << endl;
+          ABORT(-1);
+        }
+        if (search_duty<1) {
+          cerr << "Error: search duty must be at least 1" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'T':
+#ifdef USE_OPENCL
+        tracker_opencl=true;
+#else
+        cerr << "Error: the tracker can only use OpenCL when it was built with OpenCL support" << endl;
+        ABORT(-1);
+#endif
+        break;
       case 'l':
         use_recorded_data=true;
         filename=optarg;
@@ -532,6 +614,16 @@ void parse_commandline(
     cerr << "Error: cannot read from .it and .bin file at the same time!" << endl;
     ABORT(-1);
   }
+  // Live devices are always sampled at 1.92MHz.
+  if ( (n_rb_track_max>6) && (strlen(load_bin_filename)<=4) ) {
+    cerr << "Error: --wideband requires data from a bin file (-y)" << endl;
+    ABORT(-1);
+  }
+  // The resampler always produces 1.92MHz, which only fits 6 RB's.
+  if ( (n_rb_track_max>6) && (fs_native>0) ) {
+    cerr << "Error: --rate cannot be combined with --wideband" << endl;
+    ABORT(-1);
+  }
 
   if (verbosity>=1) {
     cout << "OpenCL LTE Tracker (" << BUILD_TYPE << ") beginning. 1.0 to " << MAJOR_VERSION << "." << MINOR_VERSION << "." << PATCH_LEVEL << ": OpenCL/TDD/HACKRF/bladeRF/ext-LNB added by Jiao Xianjun(putaoshu@gmail.com)" << endl;
@@ -624,7 +716,8 @@ int config_rtlsdr(
   const double & fc,
   rtlsdr_device *& dev,
   double & fs_programmed,
-  const int16 gain
+  const int16 gain,
+  const double & fs_native
 ) {
   int32 device_index=device_index_cmdline;
 
@@ -660,7 +753,7 @@ int config_rtlsdr(
 
   double sampling_rate = 0;
 //  if (sampling_carrier_twist)
-    sampling_rate = (FS_LTE/16)*correction;
+    sampling_rate = frontend_device_rate(fs_native,correction);
 //  else
 //    sampling_rate = 1920000;
   // Sampling frequency
@@ -672,6 +765,8 @@ int config_rtlsdr(
 
   // Calculate the actual fs that was programmed
   fs_programmed=(double)rtlsdr_get_sample_rate(dev);
+  // Captures are resampled when the device runs at its native rate.
+  fs_programmed=frontend_setup(fs_native,fs_programmed,correction);
 
   // Center frequency
   uint8 n_fail=0;
@@ -754,7 +849,8 @@ int config_hackrf(
   const double & fc,
   hackrf_device *& dev,
   double & fs_programmed,
-  const int16 & gain
+  const int16 & gain,
+  const double & fs_native
 ) {
   unsigned int lna_gain=40; // default value
   unsigned int vga_gain=40; // default value
@@ -775,7 +871,7 @@ int config_hackrf(
     return(result);
 	}
 
-  double sampling_rate =  (FS_LTE/16)*correction;
+  double sampling_rate = frontend_device_rate(fs_native,correction);
 
   // Sampling frequency
   result = hackrf_set_sample_rate_manual(dev, sampling_rate, 1);
@@ -787,6 +883,8 @@ int config_hackrf(
 
   // Need to handle in the future
   fs_programmed=sampling_rate;
+  // Captures are resampled when the device runs at its native rate.
+  fs_programmed=frontend_setup(fs_native,fs_programmed,correction);
 
   result = hackrf_set_baseband_filter_bandwidth(dev, 1.45e6);
 	if( result != HACKRF_SUCCESS ) {
@@ -843,7 +941,8 @@ int config_bladerf(
   const double & fc,
   bladerf_device * & dev,
   double & fs_programmed,
-  const int16 & gain
+  const int16 & gain,
+  const double & fs_native
 ) {
   bladerf_devinfo *devices = NULL;
   int n_devices = bladerf_get_device_list(&devices);
@@ -883,7 +982,7 @@ int config_bladerf(
       if (dev!=NULL) {bladerf_close(dev); dev = NULL; return(-1);}
   }
 
-  double sampling_rate =  (FS_LTE/16)*correction;
+  double sampling_rate = frontend_device_rate(fs_native,correction);
   unsigned int actual_sample_rate;
   status = bladerf_set_sample_rate(dev, BLADERF_MODULE_RX, (unsigned int)sampling_rate, &actual_sample_rate);
   if (status != 0) {
@@ -892,6 +991,8 @@ int config_bladerf(
       if (dev!=NULL) {bladerf_close(dev); dev = NULL; return(-1);}
   }
   fs_programmed = actual_sample_rate;
+  // Captures are resampled when the device runs at its native rate.
+  fs_programmed=frontend_setup(fs_native,fs_programmed,correction);
 
   unsigned int actual_bw;
   status = bladerf_set_bandwidth(dev, BLADERF_MODULE_RX, 1500000, &actual_bw);
@@ -1139,6 +1240,7 @@ double kalibrate(
 
   #ifdef USE_OPENCL
   lte_ocl.setup_filter_my((string)"filter_my_kernels.cl", CAPLENGTH, filter_workitem);
+  lte_ocl.setup_search_post((string)"search_post_kernels.cl", CAPLENGTH);
   #ifdef FILTER_MCHN_SIMPLE_KERNEL
   lte_ocl.setup_filter_mchn((string)"filter_mchn_simple_kernel.cl", CAPLENGTH, length(f_search_set)*3, pss_fo_set.cols(), xcorr_workitem);
   #else
@@ -1187,6 +1289,11 @@ double kalibrate(
 
   // Results are stored in this vector.
   list <Cell> detected_cells;
+  // IQ imbalance is a property of the device and is averaged over
+  // successive captures.
+  iq_corr_t iq_corr;
+  // Spurs are learned separately for each center frequency.
+  spur_excision_t spur;
   // Loop until a cell is found
   while (detected_cells.size()<1) {
    // Fill capture buffer either from a file or from live data.
@@ -1215,7 +1322,12 @@ double kalibrate(
       ABORT(-1);
     }
 
-    capbuf = capbuf - mean(capbuf); // remove DC
+    iq_corr.correct(capbuf); // remove DC and IQ imbalance
+    if (verbosity>=2) {
+      cout << "  IQ image rejection ratio " << iq_corr.irr_db() << " dB" << endl;
+    }
+    // Spurs would otherwise raise the detection threshold.
+    spur.excise(fc_programmed,capbuf);
 
     freq_correction = fc_programmed*(correction-1)/correction;
     capbuf = fshift(capbuf,-freq_correction,fs_programmed);
@@ -1248,37 +1360,25 @@ double kalibrate(
         k_factor_set = 1 + period_ppm*1e-6;
       }
 
-      vec tmp_f_search(1);
-      vector <mat> tmp_xc(3);
-      tmp_xc[0].set_size(1, length(capbuf)-136);
-      tmp_xc[1].set_size(1, length(capbuf)-136);
-      tmp_xc[2].set_size(1, length(capbuf)-136);
-      for (uint16 i=0; i<length(k_factor_set); i++) {
-
-        tmp_f_search(0) = dynamic_f_search_set(i);
-        tmp_xc[0].set_row(0, xc[0].get_row(i));
-        tmp_xc[1].set_row(0, xc[1].get_row(i));
-        tmp_xc[2].set_row(0, xc[2].get_row(i));
-
-        // Correlate
-        uint16 n_comb_xc;
-        uint16 n_comb_sp;
-        if (verbosity>=2) {
-          cout << "  Calculating PSS correlations" << endl;
-        }
-        xcorr_pss(capbuf,tmp_f_search,DS_COMB_ARM,fc_requested,fc_programmed,fs_programmed,tmp_xc,xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,xc_incoherent_single,xc_incoherent,sp_incoherent,sp,n_comb_xc,n_comb_sp,sampling_carrier_twist,(const double)k_factor_set[i]);
-
-        // Calculate the threshold vector
-        double R_th1=chi2cdf_inv(1-pow(10.0,-thresh1_n_nines),2*n_comb_xc*(2*DS_COMB_ARM+1));
-        vec Z_th1=R_th1*sp_incoherent/rx_cutoff/137/n_comb_xc/(2*DS_COMB_ARM+1);
+      // Every (frequency offset, ppm) pair that survived the pre-search is
+      // a row of xc. All of them are combined and searched in one pass.
+      // Correlate
+      uint16 n_comb_xc;
+      uint16 n_comb_sp;
+      if (verbosity>=2) {
+        cout << "  Calculating PSS correlations for " << length(k_factor_set) << " hypotheses" << endl;
+      }
+      xcorr_pss(capbuf,dynamic_f_search_set,k_factor_set,DS_COMB_ARM,fc_requested,fc_programmed,fs_programmed,xc,xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,xc_incoherent_single,xc_incoherent,sp_incoherent,sp,n_comb_xc,n_comb_sp);
 
-        // Search for the peaks
-        if (verbosity>=2) {
-          cout << "  Searching for and examining correlation peaks..." << endl;
-        }
-        peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,tmp_f_search,fc_requested,fc_programmed,xc_incoherent_single,DS_COMB_ARM,sampling_carrier_twist,(const double)k_factor_set[i],peak_search_cells);
+      // Calculate the threshold vector
+      double R_th1=chi2cdf_inv(1-pow(10.0,-thresh1_n_nines),2*n_comb_xc*(2*DS_COMB_ARM+1));
+      vec Z_th1=R_th1*sp_incoherent/rx_cutoff/137/n_comb_xc/(2*DS_COMB_ARM+1);
 
+      // Search for the peaks
+      if (verbosity>=2) {
+        cout << "  Searching for and examining correlation peaks..." << endl;
       }
+      peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,dynamic_f_search_set,k_factor_set,fc_requested,fc_programmed,xc_incoherent_single,DS_COMB_ARM,peak_search_cells);
 
     } else {
 
@@ -1301,6 +1401,7 @@ double kalibrate(
       peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,dynamic_f_search_set,fc_requested,fc_programmed,xc_incoherent_single,DS_COMB_ARM,sampling_carrier_twist,NAN,peak_search_cells);
 
     }
+    reject_image_peaks(freq_correction,peak_search_cells);
     detected_cells=peak_search_cells;
 
     // Loop and check each peak
@@ -1310,12 +1411,12 @@ double kalibrate(
       tdd_flag = !tdd_flag;
 
       // Detect SSS if possible
-      (*iterator)=sss_detect((*iterator),capbuf,THRESH2_N_SIGMA,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est_meas,sss_h2_np_est_meas,sss_h1_nrm_est_meas,sss_h2_nrm_est_meas,sss_h1_ext_est_meas,sss_h2_ext_est_meas,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
+      (*iterator)=sss_detect(lte_ocl,(*iterator),capbuf,THRESH2_N_SIGMA,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est_meas,sss_h2_np_est_meas,sss_h1_nrm_est_meas,sss_h2_nrm_est_meas,sss_h1_ext_est_meas,sss_h2_ext_est_meas,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
       if ((*iterator).n_id_1!=-1) {
         // Fine FOE
         (*iterator)=pss_sss_foe((*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,sampling_carrier_twist,tdd_flag);
         // Extract time and frequency grid
-        extract_tfg((*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
+        extract_tfg(lte_ocl,(*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
 
         // Create object containing all RS
         RS_DL rs_dl((*iterator).n_id_cell(),6,(*iterator).cp_type);
@@ -1471,8 +1572,15 @@ int main(
   uint16 xcorr_workitem;
   uint16 num_reserve;
   int16 gain;
+  int8 n_rb_track_max;
+  placement_t::placement_t placement_mode;
+  bigmem_policy_t::bigmem_policy_t bigmem_mode;
+  double fs_native;
+  uint16 search_duty;
+  bool tracker_opencl;
   // Get search parameters from the user
-  parse_commandline(argc,argv,fc_requested,ppm,correction,device_index,expert_mode,use_recorded_data,filename,repeat,drop_secs,rtl_sdr_format,noise_power,initial_sampling_carrier_twist,record_bin_filename,load_bin_filename,opencl_platform,opencl_device,filter_workitem,xcorr_workitem,num_reserve,gain);
+  parse_commandline(argc,argv,fc_requested,ppm,correction,device_index,expert_mode,use_recorded_data,filename,repeat,drop_secs,rtl_sdr_format,noise_power,initial_sampling_carrier_twist,record_bin_filename,load_bin_filename,opencl_platform,opencl_device,filter_workitem,xcorr_workitem,num_reserve,gain,n_rb_track_max,placement_mode,bigmem_mode,fs_native,search_duty,tracker_opencl);
+  bigmem_policy(bigmem_mode);
 
   // Open the USB device.
   dev_type_t::dev_type_t dev_use = dev_type_t::UNKNOWN;
@@ -1484,7 +1592,7 @@ int main(
   if ( (!use_recorded_data) && (strlen(load_bin_filename)==0) ) {
 
     #ifdef HAVE_RTLSDR
-    if ( config_rtlsdr(initial_sampling_carrier_twist,correction,device_index,fc_requested,rtlsdr_dev,fs_programmed,gain) == 0 ) {
+    if ( config_rtlsdr(initial_sampling_carrier_twist,correction,device_index,fc_requested,rtlsdr_dev,fs_programmed,gain,fs_native) == 0 ) {
       dev_use = dev_type_t::RTLSDR;
       cout << "RTLSDR device FOUND!\n";
     } else {
@@ -1494,7 +1602,7 @@ int main(
     #endif
 
     #ifdef HAVE_HACKRF
-    if ( config_hackrf(initial_sampling_carrier_twist,correction,device_index,fc_requested,hackrf_dev,fs_programmed,gain) == 0 ) {
+    if ( config_hackrf(initial_sampling_carrier_twist,correction,device_index,fc_requested,hackrf_dev,fs_programmed,gain,fs_native) == 0 ) {
       dev_use = dev_type_t::HACKRF;
       cout << "HACKRF device FOUND!\n";
     } else {
@@ -1504,7 +1612,7 @@ int main(
     #endif
 
     #ifdef HAVE_BLADERF
-    if ( config_bladerf(initial_sampling_carrier_twist,correction,device_index,fc_requested,bladerf_dev,fs_programmed,gain) == 0 ) {
+    if ( config_bladerf(initial_sampling_carrier_twist,correction,device_index,fc_requested,bladerf_dev,fs_programmed,gain,fs_native) == 0 ) {
       dev_use = dev_type_t::BLADERF;
       cout << "BLADERF device FOUND!\n";
     } else {
@@ -1551,8 +1659,25 @@ int main(
   // Data shared between threads
 //  sampbuf_sync_t sampbuf_sync;
   tracked_cell_list_t tracked_cell_list;
+  tracked_cell_list.last_track_id=0;
   capbuf_sync_t capbuf_sync;
-  global_thread_data_t global_thread_data(fc_requested,fc_programmed,fs_programmed);
+  reacq_sync_t reacq_sync;
+  // Samples read from a bin file arrive at the rate at which they were
+  // captured. The searcher operates on a decimated version of these samples
+  // and the trackers use the full rate to track more than 6 RB's.
+  uint16 oversample=1;
+  if (strlen(load_bin_filename)!=0) {
+    double fc_requested_tmp, fc_programmed_tmp, fs_requested_tmp, fs_programmed_tmp;
+    if ( read_header_from_bin( load_bin_filename, fc_requested_tmp, fc_programmed_tmp, fs_requested_tmp, fs_programmed_tmp) ) {
+      cerr << "main: read_header_from_bin failed.\n";
+      ABORT(-1);
+    }
+    oversample=lte_oversample(fs_programmed_tmp);
+  }
+  if (lte_max_rb(oversample)<n_rb_track_max) {
+    cout << "Warning: sample rate only allows " << (int)lte_max_rb(oversample) << " RB's to be tracked" << endl;
+  }
+  global_thread_data_t global_thread_data(fc_requested,fc_programmed,fs_programmed,oversample,MIN(n_rb_track_max,lte_max_rb(oversample)),placement_mode);
   /*
   cout << "fc_requested = " << fc_requested << endl;
   cout << "fc_programmed = " << fc_programmed << endl;
@@ -1574,6 +1699,8 @@ int main(
   global_thread_data.xcorr_workitem(filter_workitem/4);
   global_thread_data.opencl_platform(opencl_platform);
   global_thread_data.opencl_device(opencl_device);
+  global_thread_data.search_duty(search_duty);
+  global_thread_data.tracker_opencl(tracker_opencl);
 
   global_thread_data.rtlsdr_dev(rtlsdr_dev);
   global_thread_data.hackrf_dev(hackrf_dev);
@@ -1582,12 +1709,24 @@ int main(
   // Start the cell searcher thread.
   // Now that the oscillator has been calibrated, we can perform
   // a 'real' search.
-  capbuf_sync.request=false;
-  capbuf_sync.capbuf.set_size(19200*8);
+  capbuf_sync.ring.set_size(SEARCH_RING_LENGTH);
+  capbuf_sync.ring_timestamp.set_size(SEARCH_RING_LENGTH);
+  capbuf_sync.ring_sample_num.resize(SEARCH_RING_LENGTH);
+  capbuf_sync.n_written=0;
+  bigmem_advise(capbuf_sync.ring);
   boost::thread searcher_thr(searcher_thread,boost::ref(capbuf_sync),boost::ref(global_thread_data),boost::ref(tracked_cell_list));
 
+  // Start the thread that looks for cells that were recently lost.
+  reacq_sync.request=false;
+  reacq_sync.capbuf.set_size(REACQ_CAPLENGTH);
+  boost::thread reacq_thr(reacq_thread,boost::ref(reacq_sync),boost::ref(global_thread_data),boost::ref(tracked_cell_list));
+
+  // Only the streamed RTL-SDR samples are resampled by the producer. The
+  // other devices deliver their samples through capture_data().
+  sampbuf_sync.resampler=(dev_use==dev_type_t::RTLSDR)?frontend_resampler():NULL;
+
   // Start the producer thread.
-  boost::thread producer_thr(producer_thread,boost::ref(sampbuf_sync),boost::ref(capbuf_sync),boost::ref(global_thread_data),boost::ref(tracked_cell_list),boost::ref(fc_programmed));
+  boost::thread producer_thr(producer_thread,boost::ref(sampbuf_sync),boost::ref(capbuf_sync),boost::ref(reacq_sync),boost::ref(global_thread_data),boost::ref(tracked_cell_list),boost::ref(fc_programmed));
 
   sampbuf_sync.fifo_peak_size=0;
 
@@ -1597,6 +1736,7 @@ int main(
   // The remainder of this thread simply copies data received from the USB
   // device (or a file!) to the producer thread. This can be considered
   // the pre_producer thread.
+  global_thread_data.placement.apply(thread_role_t::PRE_PRODUCER);
 //  bool record_bin_flag = (strlen(record_bin_filename)>4);
   bool load_bin_flag = (strlen(load_bin_filename)>4);
   if (use_recorded_data || load_bin_flag) {
@@ -0,0 +1,163 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <curses.h>
+#include <fstream>
+#include <map>
+#include "common.h"
+#include "macros.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "agc.h"
+
+using namespace itpp;
+using namespace std;
+
+agc_stats_t agc_measure(
+  const cvec & capbuf,
+  const uint32 & n_samp,
+  const double & clip_level
+) {
+  const uint32 n=MIN(n_samp,(uint32)length(capbuf));
+  ASSERT(n>0);
+
+  uint32 n_clip=0;
+  for (uint32 t=0;t<n;t++) {
+    n_clip+=(fabs(capbuf(t).real())>=clip_level)+(fabs(capbuf(t).imag())>=clip_level);
+  }
+
+  agc_stats_t stats;
+  stats.rms_dbfs=db10(cvec_simd::power(capbuf._data(),n)/n+1e-12);
+  stats.clip_rate=n_clip/(2.0*n);
+  return stats;
+}
+
+agc_t::agc_t(
+  const dev_type_t::dev_type_t & dev_use,
+  const int16 & gain_init
+) {
+  int16 gain_default;
+  if (dev_use==dev_type_t::RTLSDR) {
+    // Gain 0 selects the tuner AGC, so it is not part of the table. The
+    // tuner rounds to the nearest gain it supports.
+    gain_table="1 4 7 10 13 16 19 22 25 28 31 34 37 40 43 46 49";
+    clip_level=127.0/128;
+    gain_default=28;
+  } else if (dev_use==dev_type_t::HACKRF) {
+    // VGA gain. The LNA gain stays at its default.
+    gain_table=itpp_ext::matlab_range(0,2,62);
+    clip_level=127.0/128;
+    gain_default=40;
+  } else if (dev_use==dev_type_t::BLADERF) {
+    gain_table=itpp_ext::matlab_range(6,3,66);
+    clip_level=2047.0/2048;
+    gain_default=66;
+  } else {
+    cerr << "agc_t Error: unknown device" << endl;
+    ABORT(-1);
+  }
+
+  // rtlsdr uses a gain of 0 to mean tuner AGC.
+  const bool gain_specified=(gain_init!=-9999)&&!((dev_use==dev_type_t::RTLSDR)&&(gain_init==0));
+  gain_idx_init=nearest_idx(gain_specified?gain_init:gain_default);
+}
+
+uint16 agc_t::nearest_idx(
+  const double & g
+) const {
+  uint16 idx=0;
+  for (uint16 t=1;t<length(gain_table);t++) {
+    if (fabs(gain_table(t)-g)<fabs(gain_table(idx)-g))
+      idx=t;
+  }
+  return idx;
+}
+
+int16 agc_t::gain(
+  const double & fc
+) const {
+  map <int32,uint16>::const_iterator it=fc_gain_idx.find(round_i(fc/1e3));
+  return gain_table(it==fc_gain_idx.end()?gain_idx_init:it->second);
+}
+
+bool agc_t::known(
+  const double & fc
+) const {
+  return fc_gain_idx.find(round_i(fc/1e3))!=fc_gain_idx.end();
+}
+
+bool agc_t::update(
+  const double & fc,
+  const agc_stats_t & stats
+) {
+  const int32 fc_khz=round_i(fc/1e3);
+  map <int32,uint16>::iterator it=fc_gain_idx.find(fc_khz);
+  if (it==fc_gain_idx.end()) {
+    it=fc_gain_idx.insert(make_pair(fc_khz,gain_idx_init)).first;
+  }
+  const uint16 idx=it->second;
+  const double error=AGC_TARGET_DBFS-stats.rms_dbfs;
+
+  uint16 idx_new=idx;
+  if (stats.clip_rate>AGC_CLIP_RATE_MAX) {
+    idx_new=nearest_idx(gain_table(idx)+MIN(error,-AGC_CLIP_BACKOFF_DB));
+    // Always reduce the gain while the ADC is clipping.
+    if ((idx_new>=idx)&&(idx>0))
+      idx_new=idx-1;
+  } else if (fabs(error)>AGC_HYSTERESIS_DB) {
+    idx_new=nearest_idx(gain_table(idx)+error);
+  }
+
+  if (verbosity>=2) {
+    cout << "AGC: fc " << fc/1e6 << " MHz gain " << gain_table(idx) << " rms " << stats.rms_dbfs << " dBFS clip rate " << stats.clip_rate;
+    if (idx_new!=idx)
+      cout << " --> gain " << gain_table(idx_new);
+    cout << endl;
+  }
+
+  it->second=idx_new;
+  return idx_new!=idx;
+}
+
+// The file contains one line per center frequency: the frequency in kHz
+// followed by the gain.
+void agc_t::load(
+  const string & filename
+) {
+  ifstream file(filename.c_str());
+  int32 fc_khz;
+  int32 g;
+  while (file >> fc_khz >> g) {
+    fc_gain_idx[fc_khz]=nearest_idx(g);
+  }
+}
+
+void agc_t::save(
+  const string & filename
+) const {
+  ofstream file(filename.c_str());
+  if (!file) {
+    cerr << "agc_t Warning: unable to write gain file " << filename << endl;
+    return;
+  }
+  for (map <int32,uint16>::const_iterator it=fc_gain_idx.begin();it!=fc_gain_idx.end();it++) {
+    file << it->first << " " << gain_table(it->second) << endl;
+  }
+}
+
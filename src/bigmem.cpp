@@ -0,0 +1,268 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <curses.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
+#endif
+#include "common.h"
+#include "macros.h"
+#include "bigmem.h"
+
+using namespace std;
+
+static bigmem_policy_t::bigmem_policy_t policy=bigmem_policy_t::THP;
+
+// Length of every buffer returned by bigmem_alloc().
+static boost::mutex blocks_mutex;
+static map <void *,size_t> blocks;
+
+// Number of NUMA nodes. Buffers are only bound to a node if there is
+// more than one.
+static int n_nodes=1;
+
+bigmem_policy_t::bigmem_policy_t bigmem_parse(
+  const char * mode
+) {
+  if (strcmp(mode,"none")==0) {
+    return bigmem_policy_t::NONE;
+  } else if (strcmp(mode,"thp")==0) {
+    return bigmem_policy_t::THP;
+  } else if (strcmp(mode,"explicit")==0) {
+    return bigmem_policy_t::EXPLICIT;
+  }
+  cerr << "Error: huge page mode must be none, thp, or explicit" << endl;
+  ABORT(-1);
+  return bigmem_policy_t::NONE;
+}
+
+void bigmem_policy(
+  const bigmem_policy_t::bigmem_policy_t & p
+) {
+  policy=p;
+  n_nodes=0;
+  while (true) {
+    stringstream path;
+    path << "/sys/devices/system/node/node" << n_nodes;
+    if (access(path.str().c_str(),F_OK))
+      break;
+    n_nodes++;
+  }
+}
+
+// NUMA node of the CPU the calling thread runs on, or -1 if unknown.
+static int current_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned int cpu;
+  unsigned int node;
+  if (syscall(SYS_getcpu,&cpu,&node,NULL)==0)
+    return node;
+#endif
+  return -1;
+}
+
+// Prefer the NUMA node of the calling thread for a buffer. If move is
+// true, pages that are already on another node are migrated.
+static void bind_local(
+  void * p,
+  const size_t & bytes,
+  const bool & move
+) {
+#if defined(__linux__) && defined(SYS_mbind) && defined(MPOL_MF_MOVE)
+  if ((policy==bigmem_policy_t::NONE)||(n_nodes<=1))
+    return;
+  const int node=current_node();
+  if ((node<0)||(node>=(int)(8*sizeof(unsigned long))))
+    return;
+  const uintptr_t mask=sysconf(_SC_PAGESIZE)-1;
+  const uintptr_t start=(uintptr_t)p&~mask;
+  const uintptr_t end=((uintptr_t)p+bytes+mask)&~mask;
+  unsigned long nodemask=1UL<<node;
+  // Failures (no permission, no NUMA support) leave the default policy.
+  syscall(SYS_mbind,(void *)start,end-start,MPOL_PREFERRED,&nodemask,8*sizeof(unsigned long)+1,move?MPOL_MF_MOVE:0);
+#endif
+}
+
+void bigmem_advise(
+  void * p,
+  const size_t & bytes
+) {
+  if (bytes==0)
+    return;
+  bind_local(p,bytes,true);
+#ifdef MADV_HUGEPAGE
+  if (policy==bigmem_policy_t::NONE)
+    return;
+  // Round out to whole huge pages. A huge page can only back an aligned
+  // 2 MB range, and the advice is only a hint, so covering a little of
+  // the neighbouring memory is harmless.
+  const uintptr_t mask=BIGMEM_HUGE_PAGE_SIZE-1;
+  const uintptr_t start=(uintptr_t)p&~mask;
+  const uintptr_t end=((uintptr_t)p+bytes+mask)&~mask;
+  madvise((void *)start,end-start,MADV_HUGEPAGE);
+#endif
+}
+
+void * bigmem_alloc(
+  const size_t & bytes,
+  const bool & pin
+) {
+  static bool warned_hugetlb=false;
+  static bool warned_mlock=false;
+
+  void * p=MAP_FAILED;
+  size_t len=bytes;
+#ifdef MAP_HUGETLB
+  if (policy==bigmem_policy_t::EXPLICIT) {
+    len=(bytes+BIGMEM_HUGE_PAGE_SIZE-1)&~((size_t)BIGMEM_HUGE_PAGE_SIZE-1);
+    p=mmap(NULL,len,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+    if ((p==MAP_FAILED)&&(!warned_hugetlb)) {
+      cout << "Warning: no explicit huge pages available (see /proc/sys/vm/nr_hugepages), using transparent huge pages" << endl;
+      warned_hugetlb=true;
+    }
+  }
+#endif
+  if (p==MAP_FAILED) {
+    const size_t page=sysconf(_SC_PAGESIZE);
+    len=(bytes+page-1)/page*page;
+    p=mmap(NULL,len,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if (p==MAP_FAILED) {
+      cerr << "bigmem_alloc Error: unable to allocate " << bytes << " bytes" << endl;
+      ABORT(-1);
+    }
+    bigmem_advise(p,len);
+  } else {
+    bind_local(p,len,false);
+  }
+
+  memset(p,0,len);
+  if (pin&&mlock(p,len)&&(!warned_mlock)) {
+    cout << "Warning: could not lock OpenCL buffers in memory (see ulimit -l)" << endl;
+    warned_mlock=true;
+  }
+
+  boost::mutex::scoped_lock lock(blocks_mutex);
+  blocks[p]=len;
+  return p;
+}
+
+void bigmem_free(
+  void * p
+) {
+  if (p==NULL)
+    return;
+  boost::mutex::scoped_lock lock(blocks_mutex);
+  map <void *,size_t>::iterator it=blocks.find(p);
+  ASSERT(it!=blocks.end());
+  munmap(p,(*it).second);
+  blocks.erase(it);
+}
+
+
+double bigmem_remote_fraction(
+  const void * p,
+  const size_t & bytes
+) {
+#if defined(__linux__) && defined(SYS_move_pages)
+  const int node=current_node();
+  const uintptr_t page=sysconf(_SC_PAGESIZE);
+  const uintptr_t start=(uintptr_t)p&~(page-1);
+  const size_t n_pages=((uintptr_t)p+bytes-start+page-1)/page;
+  if ((node<0)||(bytes==0))
+    return NAN;
+  const size_t n_sample=min(n_pages,(size_t)1024);
+  vector <void *> pages(n_sample);
+  vector <int> status(n_sample);
+  for (size_t t=0;t<n_sample;t++) {
+    pages[t]=(void *)(start+t*n_pages/n_sample*page);
+  }
+  // Without a list of target nodes, move_pages() only reports where each
+  // page is.
+  if (syscall(SYS_move_pages,0,n_sample,&pages[0],NULL,&status[0],0))
+    return NAN;
+  uint32 n_present=0;
+  uint32 n_remote=0;
+  for (size_t t=0;t<n_sample;t++) {
+    if (status[t]<0)
+      continue;
+    n_present++;
+    if (status[t]!=node)
+      n_remote++;
+  }
+  if (n_present==0)
+    return NAN;
+  return (double)n_remote/n_present;
+#else
+  return NAN;
+#endif
+}
+
+bigmem_tlb_counter_t::bigmem_tlb_counter_t() {
+  fd=-1;
+#if defined(__linux__) && defined(SYS_perf_event_open)
+  struct perf_event_attr attr;
+  memset(&attr,0,sizeof(attr));
+  attr.size=sizeof(attr);
+  attr.type=PERF_TYPE_HW_CACHE;
+  attr.config=PERF_COUNT_HW_CACHE_DTLB|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16);
+  attr.disabled=1;
+  attr.inherit=1;
+  attr.exclude_kernel=1;
+  attr.exclude_hv=1;
+  fd=syscall(SYS_perf_event_open,&attr,0,-1,-1,0);
+#endif
+}
+
+bigmem_tlb_counter_t::~bigmem_tlb_counter_t() {
+  if (fd>=0)
+    close(fd);
+}
+
+void bigmem_tlb_counter_t::start() {
+#if defined(__linux__) && defined(SYS_perf_event_open)
+  if (fd<0)
+    return;
+  ioctl(fd,PERF_EVENT_IOC_RESET,0);
+  ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+#endif
+}
+
+int64 bigmem_tlb_counter_t::stop() {
+#if defined(__linux__) && defined(SYS_perf_event_open)
+  if (fd<0)
+    return -1;
+  ioctl(fd,PERF_EVENT_IOC_DISABLE,0);
+  uint64 count;
+  if (read(fd,&count,sizeof(count))!=(ssize_t)sizeof(count))
+    return -1;
+  return count;
+#else
+  return -1;
+#endif
+}
@@ -19,13 +19,18 @@
 #include <iomanip>
 #include <sstream>
 #include <queue>
+#include <map>
 #include <curses.h>
 #include <boost/math/special_functions/gamma.hpp>
 #include "common.h"
 #include "capbuf.h"
 #include "macros.h"
 #include "itpp_ext.h"
+#include "lte_lib.h"
+#include "constants.h"
 #include "dsp.h"
+#include "agc.h"
+#include "bigmem.h"
 
 #ifdef HAVE_RTLSDR
 #include "rtl-sdr.h"
@@ -44,14 +49,14 @@ using namespace std;
 
 #ifdef HAVE_HACKRF
 
-int8 hackrf_rx_buf[CAPLENGTH*2];  // used for capture_data() and hackrf rx callback
+vector <int8> hackrf_rx_buf;  // used for capture_data() and hackrf rx callback
 int hackrf_rx_count;  // used for capture_data() and hackrf rx callback
 
 static int capbuf_hackrf_callback(hackrf_transfer* transfer) {
   size_t bytes_to_write;
   size_t hackrf_rx_count_new = hackrf_rx_count + transfer->valid_length;
 
-  int count_left = (CAPLENGTH*2) - hackrf_rx_count_new;
+  int count_left = hackrf_rx_buf.size() - hackrf_rx_count_new;
   if ( count_left <= 0 ) {
     bytes_to_write = transfer->valid_length + count_left;
   } else {
@@ -61,7 +66,7 @@ static int capbuf_hackrf_callback(hackrf_transfer* transfer) {
 //  cout << transfer->valid_length  << " " << hackrf_rx_count << " " << bytes_to_write << "\n";
   if (bytes_to_write!=0)
   {
-    memcpy( hackrf_rx_buf+hackrf_rx_count, transfer->buffer, bytes_to_write );
+    memcpy( &hackrf_rx_buf[0]+hackrf_rx_count, transfer->buffer, bytes_to_write );
 //    for (size_t i=0; i<bytes_to_write; i++) {
 //      hackrf_rx_buf[hackrf_rx_count+i] = transfer->buffer[i];
 //    }
@@ -75,7 +80,7 @@ static int capbuf_hackrf_callback(hackrf_transfer* transfer) {
 #endif
 
 #ifdef HAVE_BLADERF
-int16 bladerf_rx_buf[CAPLENGTH*2];  // used for capture_data()
+vector <int16> bladerf_rx_buf;  // used for capture_data()
 volatile bool do_exit = false;
 int open_bladerf_board(bladerf_device * & bladerf_dev, unsigned int freq_hz, unsigned int buffer_size) {
   int status;
@@ -138,10 +143,10 @@ static void capbuf_rtlsdr_callback(
 
   for (uint32 t=0;t<len;t++) {
     //cout << capbuf_raw.size() << endl;
-    if (capbuf_raw.size()<CAPLENGTH*2) {
+    if (capbuf_raw.size()<cp.len) {
       capbuf_raw.push_back(buf[t]);
     }
-    if (capbuf_raw.size()==CAPLENGTH*2) {
+    if (capbuf_raw.size()==cp.len) {
       //cout << rtlsdr_cancel_async(dev) << endl;
       rtlsdr_cancel_async(dev);
       break;
@@ -332,6 +337,53 @@ int read_header_from_bin(
 
 }
 
+// Resampler used when the device is not programmed at 1.92MHz*correction.
+static resampler_t * frontend=NULL;
+
+double frontend_parse(
+  const char * rate
+) {
+  char * endp;
+  const double fs_native=strtod(rate,&endp);
+  if ((rate==endp)||(*endp!='\0')||(fs_native<=0)) {
+    cerr << "Error: could not parse device sample rate" << endl;
+    ABORT(-1);
+  }
+  return fs_native;
+}
+
+double frontend_device_rate(
+  const double & fs_native,
+  const double & correction
+) {
+  return (fs_native>0)?fs_native:(FS_LTE/16)*correction;
+}
+
+double frontend_setup(
+  const double & fs_native,
+  const double & fs_device,
+  const double & correction
+) {
+  delete frontend;
+  frontend=NULL;
+  // Without -R the device itself runs at 1.92MHz*correction, up to the
+  // precision of its clock.
+  if (fs_native<=0)
+    return fs_device;
+  const double fs_out=(FS_LTE/16)*correction;
+  if (fs_device!=fs_out) {
+    frontend=new resampler_t(fs_device,fs_out);
+    if (verbosity>=2) {
+      cout << "Resampling from " << fs_device/1e6 << "MHz to " << fs_out/1e6 << "MHz" << endl;
+    }
+  }
+  return fs_out;
+}
+
+resampler_t * frontend_resampler() {
+  return frontend;
+}
+
 // This function produces a vector of captured data. The data can either
 // come from live data received by the RTLSDR, or from a file containing
 // previously captured data.
@@ -354,7 +406,9 @@ int capture_data(
   cvec & capbuf,
   double & fc_programmed,
   double & fs_programmed,
-  const bool & read_all_in_bin // only for .bin file! if it is true, all data in bin file will be read in one time.
+  const bool & read_all_in_bin, // only for .bin file! if it is true, all data in bin file will be read in one time.
+  const bool & no_save,
+  const uint32 & n_samples
 ) {
   // Filename used for recording or loading captured data.
   static uint32 capture_number=0;
@@ -422,7 +476,11 @@ int capture_data(
       }
     }
 
-    unsigned char *capbuf_raw = new unsigned char[2*CAPLENGTH];
+    // Files recorded at a multiple of 1.92MHz are decimated so that
+    // the searcher always receives 1.92MHz data. When all the data is
+    // read, it is returned at the recorded sample rate.
+    const uint16 oversample=read_all_in_bin?1:lte_oversample(fs_programmed_tmp);
+    unsigned char *capbuf_raw = new unsigned char[2*CAPLENGTH*oversample];
 
     if (read_all_in_bin) {
       capbuf.set_size(0, false);
@@ -463,6 +521,7 @@ int capture_data(
       fclose(fp);
     } else {
       capbuf.set_size(CAPLENGTH, false);
+      bigmem_advise(capbuf);
 
       FILE *fp = fopen(load_bin_filename, "rb");
       if (fp == NULL)
@@ -480,8 +539,8 @@ int capture_data(
       }
 
       for(uint16 i=0; i<(capture_number+1); i++) {
-        int read_count = fread(capbuf_raw, sizeof(unsigned char), 2*CAPLENGTH, fp);
-        if (read_count != (2*CAPLENGTH))
+        int read_count = fread(capbuf_raw, sizeof(unsigned char), 2*CAPLENGTH*oversample, fp);
+        if (read_count != (int)(2*CAPLENGTH*oversample))
         {
 //          fclose(fp);
 //          cerr << "Error: file " << load_bin_filename << " size is not sufficient" << endl;
@@ -492,8 +551,13 @@ int capture_data(
         }
       }
       fclose(fp);
-      for (uint32 t=0;t<CAPLENGTH;t++) {
-        capbuf(t)=complex<double>((((double)capbuf_raw[(t<<1)])-128.0)/128.0,(((double)capbuf_raw[(t<<1)+1])-128.0)/128.0); // 127 --> 128.
+      decimator_t decimator(oversample);
+      uint32 n_out=0;
+      for (uint32 t=0;t<CAPLENGTH*oversample;t++) {
+        complex <double> y;
+        if (decimator.push(complex<double>((((double)capbuf_raw[(t<<1)])-128.0)/128.0,(((double)capbuf_raw[(t<<1)+1])-128.0)/128.0),y)) { // 127 --> 128.
+          capbuf(n_out++)=y;
+        }
       }
     }
 
@@ -502,12 +566,22 @@ int capture_data(
 //    fc_programmed=fc_requested; // be careful about this!
 //    fc_programmed = calculate_fc_programmed_in_context(fc_requested, use_recorded_data, load_bin_filename, rtlsdr_dev);
     fc_programmed = fc_programmed_tmp;
-    fs_programmed = fs_programmed_tmp;
+    fs_programmed = fs_programmed_tmp/oversample;
   } else {
     if (verbosity>=2) {
       cout << "Capturing live data" << endl;
     }
 
+    // Number of samples to read from the device. When the device runs at
+    // its native rate, enough samples are read so that n_samples resampled
+    // samples remain after the filter has settled.
+    uint32 n_dev=n_samples;
+    uint32 n_skip=0;
+    if (frontend) {
+      n_skip=ceil_i(frontend->delay()/frontend->step)+1;
+      n_dev=floor_i((n_skip+n_samples-1)*frontend->step)+frontend->delay()+1;
+    }
+
     if (dev_use == dev_type_t::RTLSDR) {
       #ifdef HAVE_RTLSDR
       // Calculate the actual center frequency that was programmed.
@@ -555,19 +629,21 @@ int capture_data(
       // Read and store the data.
       // This will block until the call to rtlsdr_cancel_async().
       vector <unsigned char> capbuf_raw;
-      capbuf_raw.reserve(CAPLENGTH*2);
+      capbuf_raw.reserve(n_dev*2);
       callback_package_t cp;
       cp.buf=&capbuf_raw;
       cp.dev=rtlsdr_dev;
+      cp.len=n_dev*2;
 
       rtlsdr_read_async(rtlsdr_dev,capbuf_rtlsdr_callback,(void *)&cp,0,0);
 
       // Convert to complex
-      capbuf.set_size(CAPLENGTH, false);
+      capbuf.set_size(n_dev, false);
+      bigmem_advise(capbuf);
   #ifndef NDEBUG
       capbuf=NAN;
   #endif
-      for (uint32 t=0;t<CAPLENGTH;t++) {
+      for (uint32 t=0;t<n_dev;t++) {
         // Normal
         capbuf(t)=complex<double>((((double)capbuf_raw[(t<<1)])-128.0)/128.0,(((double)capbuf_raw[(t<<1)+1])-128.0)/128.0);
         //// 127 --> 128.
@@ -600,6 +676,7 @@ int capture_data(
         ABORT(-1);
       }
 
+      hackrf_rx_buf.resize(n_dev*2);
       hackrf_rx_count = 0; // clear counter
       result = hackrf_start_rx(hackrf_dev, capbuf_hackrf_callback, NULL);
 
@@ -610,7 +687,7 @@ int capture_data(
 
       while(hackrf_is_streaming(hackrf_dev) == HACKRF_TRUE) {
 //        cout << hackrf_rx_count << "\n";
-        if( hackrf_rx_count == (CAPLENGTH*2) )
+        if( hackrf_rx_count == (int)hackrf_rx_buf.size() )
           break;
       }
 
@@ -623,8 +700,9 @@ int capture_data(
 //      }
 
       // Convert to complex
-      capbuf.set_size(CAPLENGTH, false);
-      for (uint32 t=0;t<CAPLENGTH;t++) {
+      capbuf.set_size(n_dev, false);
+      bigmem_advise(capbuf);
+      for (uint32 t=0;t<n_dev;t++) {
 //        capbuf(t)=complex<double>((((double)hackrf_rx_buf[(t<<1)])-128.0)/128.0,(((double)hackrf_rx_buf[(t<<1)+1])-128.0)/128.0);
         capbuf(t)=complex<double>((((double)hackrf_rx_buf[(t<<1)])-0.0)/128.0,(((double)hackrf_rx_buf[(t<<1)+1])-0.0)/128.0);
       }
@@ -641,7 +719,8 @@ int capture_data(
       }
 
       // Receive samples
-      status = bladerf_sync_rx(bladerf_dev, (void *)bladerf_rx_buf, CAPLENGTH, NULL, 3500);
+      bladerf_rx_buf.resize(n_dev*2);
+      status = bladerf_sync_rx(bladerf_dev, (void *)&bladerf_rx_buf[0], n_dev, NULL, 3500);
       if (status != 0) {
         printf("capture_data: bladerf_sync_rx : Failed to RX samples 1: %s\n",
                  bladerf_strerror(status));
@@ -661,14 +740,25 @@ int capture_data(
       }
 
       // Convert to complex
-      capbuf.set_size(CAPLENGTH, false);
-      for (uint32 t=0;t<CAPLENGTH;t++) {
+      capbuf.set_size(n_dev, false);
+      bigmem_advise(capbuf);
+      for (uint32 t=0;t<n_dev;t++) {
         capbuf(t)=complex<double>((((double)bladerf_rx_buf[(t<<1)])-0.0)/2048.0,(((double)bladerf_rx_buf[(t<<1)+1])-0.0)/2048.0);
       }
       #endif
     }
+
+    if (frontend) {
+      // Every capture is resampled independently.
+      frontend->reset();
+      capbuf=frontend->push(capbuf).mid(n_skip,n_samples);
+    }
   }
 
+  // Captures that are not part of the capture sequence.
+  if (no_save)
+    return(run_out_of_data);
+
   // Save the capture data, if requested.
   if (save_cap) {
     if (verbosity>=2) {
@@ -731,3 +821,87 @@ int capture_data(
   return(run_out_of_data);
 }
 
+void device_standby(
+  const dev_type_t::dev_type_t & dev_use,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev
+) {
+  if (dev_use == dev_type_t::HACKRF) {
+    #ifdef HAVE_HACKRF
+    if (hackrf_is_streaming(hackrf_dev) == HACKRF_TRUE) {
+      int result = hackrf_stop_rx(hackrf_dev);
+      if( result != HACKRF_SUCCESS ) {
+        printf("hackrf_stop_rx() failed: %s (%d)\n", hackrf_error_name((hackrf_error)result), result);
+      }
+    }
+    #endif
+  }
+}
+
+int set_gain(
+  const dev_type_t::dev_type_t & dev_use,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev,
+  const int16 & gain
+) {
+  if (dev_use == dev_type_t::RTLSDR) {
+    #ifdef HAVE_RTLSDR
+    if (rtlsdr_set_tuner_gain_mode(rtlsdr_dev,1)<0) {
+      cerr << "set_gain Error: unable to enter manual gain mode" << endl;
+      return(-1);
+    }
+    if (rtlsdr_set_tuner_gain(rtlsdr_dev,gain*10)<0) {
+      cerr << "set_gain Error: unable to rtlsdr_set_tuner_gain" << endl;
+      return(-1);
+    }
+    #endif
+  } else if (dev_use == dev_type_t::HACKRF) {
+    #ifdef HAVE_HACKRF
+    int result = hackrf_set_vga_gain(hackrf_dev, (gain/2)*2);
+    if( result != HACKRF_SUCCESS ) {
+      printf("set_gain hackrf_set_vga_gain failed: %s (%d)\n", hackrf_error_name((hackrf_error)result), result);
+      return(-1);
+    }
+    #endif
+  } else if (dev_use == dev_type_t::BLADERF) {
+    #ifdef HAVE_BLADERF
+    int status = bladerf_set_gain(bladerf_dev, BLADERF_MODULE_RX, gain);
+    if (status != 0) {
+      printf("set_gain bladerf_set_gain: Failed to set gain: %s\n", bladerf_strerror(status));
+      return(-1);
+    }
+    #endif
+  }
+  return(0);
+}
+
+void agc_set_gain(
+  agc_t & agc,
+  const double & fc_requested,
+  const double & correction,
+  rtlsdr_device * & rtlsdr_dev,
+  hackrf_device * & hackrf_dev,
+  bladerf_device * & bladerf_dev,
+  const dev_type_t::dev_type_t & dev_use
+) {
+  if (!agc.known(fc_requested)) {
+    cvec capbuf_probe;
+    double fc_programmed_probe;
+    double fs_programmed_probe;
+    for (uint8 t=0;t<AGC_MAX_ITER;t++) {
+      if (set_gain(dev_use,rtlsdr_dev,hackrf_dev,bladerf_dev,agc.gain(fc_requested))) {
+        ABORT(-1);
+      }
+      // Only the head of a capture is measured so the probes are kept
+      // short.
+      capture_data(fc_requested,correction,false," ",false," ",".",rtlsdr_dev,hackrf_dev,bladerf_dev,dev_use,capbuf_probe,fc_programmed_probe,fs_programmed_probe,false,true,AGC_HEAD_LENGTH);
+      if (!agc.update(fc_requested,agc_measure(capbuf_probe,AGC_HEAD_LENGTH,agc.clip_level)))
+        break;
+    }
+  }
+  if (set_gain(dev_use,rtlsdr_dev,hackrf_dev,bladerf_dev,agc.gain(fc_requested))) {
+    ABORT(-1);
+  }
+}
@@ -0,0 +1,188 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include <vector>
+#include "common.h"
+#include "macros.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "ce_filter.h"
+
+using namespace itpp;
+using namespace std;
+
+// Location of every tap relative to the estimate, in subcarriers and in
+// units of the spacing between the OFDM symbols that contain RS.
+static const int8 tap_df[7]={-6,0,6,-3,3,-3,3};
+static const int8 tap_dt[7]={0,0,0,-1,-1,1,1};
+// Taps that are available for each geometry.
+static const bool tap_mask[5][7]={
+  {true,true,true,true,true,true,true},
+  {false,true,true,true,true,true,true},
+  {false,true,true,false,true,false,true},
+  {true,true,false,true,true,true,true},
+  {true,true,false,true,false,true,false}
+};
+
+// Normalized frequency domain correlation of an exponential power delay
+// profile with RMS delay spread ds.
+static complex <double> corr_fd(
+  const double & df,
+  const double & ds
+) {
+  return 1.0/complex <double>(1,2*pi*df*ds);
+}
+
+// Normalized time domain correlation of a Jakes Doppler spectrum.
+static double corr_td(
+  const double & dt,
+  const double & fd
+) {
+  return besselj(0,2*pi*fd*dt);
+}
+
+ce_filter_bank_t::ce_filter_bank_t() {
+  bank.resize(2*CE_FILTER_N_DS*CE_FILTER_N_FD*CE_FILTER_N_SNR);
+  bank_mse.resize(2*CE_FILTER_N_DS*CE_FILTER_N_FD*CE_FILTER_N_SNR);
+  for (uint8 port_class=0;port_class<2;port_class++) {
+    // Ports 2 and 3 only have RS in one OFDM symbol per slot.
+    const double rs_period=(port_class==0)?0.25e-3:0.5e-3;
+    for (uint8 ds_idx=0;ds_idx<CE_FILTER_N_DS;ds_idx++) {
+      const double ds=CE_FILTER_DS_MIN*pow(2.0,ds_idx);
+      for (uint8 fd_idx=0;fd_idx<CE_FILTER_N_FD;fd_idx++) {
+        const double fd=CE_FILTER_FD_MIN*pow(2.0,fd_idx);
+        for (uint8 snr_idx=0;snr_idx<CE_FILTER_N_SNR;snr_idx++) {
+          const double np=udb10(-(CE_FILTER_SNR_MIN_DB+snr_idx*CE_FILTER_SNR_STEP_DB));
+          cmat w(5,7);
+          w.zeros();
+          double w_mse=NAN;
+          for (uint8 g=0;g<5;g++) {
+            ivec taps;
+            for (uint8 t=0;t<7;t++) {
+              if (tap_mask[g][t])
+                taps=concat(taps,(int)t);
+            }
+            const uint8 n_taps=length(taps);
+            // Correlation of the observations with each other and with
+            // the channel at the location of the estimate.
+            cmat R(n_taps,n_taps);
+            cvec p(n_taps);
+            for (uint8 i=0;i<n_taps;i++) {
+              for (uint8 j=0;j<n_taps;j++) {
+                R(i,j)=corr_fd(15e3*(tap_df[taps(i)]-tap_df[taps(j)]),ds)*corr_td(rs_period*(tap_dt[taps(i)]-tap_dt[taps(j)]),fd);
+              }
+              R(i,i)+=np;
+              p(i)=corr_fd(-15e3*tap_df[taps(i)],ds)*corr_td(-rs_period*tap_dt[taps(i)],fd);
+            }
+            const cvec c=inv(conj(R))*p;
+            for (uint8 i=0;i<n_taps;i++) {
+              w(g,taps(i))=c(i);
+            }
+            if (g==0)
+              w_mse=1-real(sum(elem_mult(c,conj(p))));
+          }
+          const uint16 idx=((port_class*CE_FILTER_N_DS+ds_idx)*CE_FILTER_N_FD+fd_idx)*CE_FILTER_N_SNR+snr_idx;
+          bank[idx]=w;
+          bank_mse[idx]=w_mse;
+        }
+      }
+    }
+  }
+
+  // Class boundaries are halfway between the classes on a log scale.
+  rho_fd_bound.set_size(CE_FILTER_N_DS-1);
+  for (uint8 k=0;k<CE_FILTER_N_DS-1;k++) {
+    rho_fd_bound(k)=abs(corr_fd(6*15e3,CE_FILTER_DS_MIN*pow(2.0,k+0.5)));
+  }
+  rho_td_bound.set_size(2,CE_FILTER_N_FD-1);
+  for (uint8 port_class=0;port_class<2;port_class++) {
+    const double rs_period=(port_class==0)?0.25e-3:0.5e-3;
+    for (uint8 k=0;k<CE_FILTER_N_FD-1;k++) {
+      rho_td_bound(port_class,k)=corr_td(CE_FILTER_AC_TD_LAG*rs_period,CE_FILTER_FD_MIN*pow(2.0,k+0.5));
+    }
+  }
+}
+
+uint16 ce_filter_bank_t::select(
+  const uint8 & port_num,
+  const double & rho_fd,
+  const double & rho_td,
+  const double & snr
+) const {
+  // Both autocorrelations decrease as the delay spread and the Doppler
+  // frequency increase.
+  const uint8 port_class=(port_num<2)?0:1;
+  uint8 ds_idx=0;
+  while ((ds_idx<CE_FILTER_N_DS-1)&&(rho_fd<rho_fd_bound(ds_idx)))
+    ds_idx++;
+  uint8 fd_idx=0;
+  while ((fd_idx<CE_FILTER_N_FD-1)&&(rho_td<rho_td_bound(port_class,fd_idx)))
+    fd_idx++;
+  double snr_db=(snr>0)?db10(snr):CE_FILTER_SNR_MIN_DB;
+  snr_db=MAX(CE_FILTER_SNR_MIN_DB,MIN(CE_FILTER_SNR_MIN_DB+(CE_FILTER_N_SNR-1)*CE_FILTER_SNR_STEP_DB,snr_db));
+  const uint8 snr_idx=round_i((snr_db-CE_FILTER_SNR_MIN_DB)/CE_FILTER_SNR_STEP_DB);
+  return ((port_class*CE_FILTER_N_DS+ds_idx)*CE_FILTER_N_FD+fd_idx)*CE_FILTER_N_SNR+snr_idx;
+}
+
+cvec ce_filter_bank_t::filter(
+  const uint16 & idx,
+  const cvec & ce_prev,
+  const cvec & ce_curr,
+  const cvec & ce_next,
+  const bool & prev_left
+) const {
+  const cmat & w=bank[idx];
+  const int16 n_rs=length(ce_curr);
+  // RS t+lo of the previous and next OFDM symbols is 3 subcarriers to the
+  // left of RS t of the current OFDM symbol.
+  const int16 lo=prev_left?0:-1;
+  cvec ce_filt(n_rs);
+  for (int16 t=0;t<n_rs;t++) {
+    uint8 g=0;
+    if (t==0) {
+      g=prev_left?1:2;
+    } else if (t==n_rs-1) {
+      g=prev_left?4:3;
+    }
+    complex <double> total=0;
+    for (int16 d=-1;d<=1;d++) {
+      const int16 k=t+d;
+      if ((k>=0)&&(k<n_rs))
+        total+=w(g,1+d)*ce_curr(k);
+    }
+    for (int16 d=0;d<=1;d++) {
+      const int16 k=t+lo+d;
+      if ((k>=0)&&(k<n_rs))
+        total+=w(g,3+d)*ce_prev(k)+w(g,5+d)*ce_next(k);
+    }
+    ce_filt(t)=total;
+  }
+  return ce_filt;
+}
+
+const cmat & ce_filter_bank_t::weights(
+  const uint16 & idx
+) const {
+  return bank[idx];
+}
+
+double ce_filter_bank_t::mse(
+  const uint16 & idx
+) const {
+  return bank_mse[idx];
+}
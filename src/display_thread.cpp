@@ -25,6 +25,7 @@
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
 #include <list>
+#include <map>
 #include <sstream>
 #include <signal.h>
 #include <queue>
@@ -40,6 +41,7 @@
 #include "itpp_ext.h"
 #include "searcher.h"
 #include "dsp.h"
+#include "placement.h"
 #include "LTE-Tracker.h"
 
 #ifdef HAVE_HACKRF
@@ -76,6 +78,8 @@ typedef struct {
   bool occupied;
   // -1 indicates this row is is not one of the ports
   int16 n_id_cell;
+  // Track shown on this row. Only valid if n_id_cell is not -1.
+  uint32 track_id;
   // -1 indicates this is the 'synchronization' port.
   int8 port_num;
   int8 duplex_mode;
@@ -188,8 +192,9 @@ void display_cell(
         );
       }
       int8 CB=-1;
+      const cvec ac_fd=tracked_cell.ac_fd_est();
       for (uint8 k=1;k<12;k++) {
-        if (abs(tracked_cell.ac_fd(k))<=0.5) {
+        if (abs(ac_fd(k))<=0.5) {
           CB=k;
           break;
         }
@@ -258,11 +263,13 @@ void set_occupied(
   for (uint8 t=0;t<tracked_cell.n_ports;t++) {
     row_desc[print_row+t+1].occupied=true;
     row_desc[print_row+t+1].n_id_cell=tracked_cell.n_id_cell;
+    row_desc[print_row+t+1].track_id=tracked_cell.track_id;
     row_desc[print_row+t+1].duplex_mode=tracked_cell.duplex_mode;
     row_desc[print_row+t+1].port_num=t;
   }
   row_desc[print_row+tracked_cell.n_ports+1].occupied=true;
   row_desc[print_row+tracked_cell.n_ports+1].n_id_cell=tracked_cell.n_id_cell;
+  row_desc[print_row+tracked_cell.n_ports+1].track_id=tracked_cell.track_id;
   row_desc[print_row+tracked_cell.n_ports+1].duplex_mode=tracked_cell.duplex_mode;
   row_desc[print_row+tracked_cell.n_ports+1].port_num=-1;
 }
@@ -404,6 +411,7 @@ void display_thread(
   bool & expert_mode
 ) {
   global_thread_data.display_thread_id=syscall(SYS_gettid);
+  global_thread_data.placement.apply(thread_role_t::OTHER);
 
   // Initialize the curses screen
   initscr();
@@ -444,9 +452,8 @@ void display_thread(
   const uint16 CELL_DISP_END_ROW=LINES-6;
   const uint16 CELL_DISP_N_ROWS=CELL_DISP_END_ROW-CELL_DISP_START_ROW+1;
 
-  // Record where a particular cell was most recently printed.
-  ivec disp_history(504);
-  disp_history=-1;
+  // Record where a particular track was most recently printed.
+  map <uint32,uint16> disp_history;
   vector <row_desc_t> row_desc(CELL_DISP_N_ROWS);
   //bvec row_occupied(CELL_DISP_N_ROWS);
 
@@ -492,8 +499,8 @@ void display_thread(
 
         // If this cell has been displayed before, try to display it
         // in the same location.
-        if (disp_history(tracked_cell.n_id_cell)!=-1) {
-          uint16 row_desired=disp_history(tracked_cell.n_id_cell);
+        if (disp_history.find(tracked_cell.track_id)!=disp_history.end()) {
+          uint16 row_desired=disp_history[tracked_cell.track_id];
           if (will_fit(row_desc,row_desired,n_rows_required-1)) {
             if (disp_mode==STD)
               display_cell(tracked_cell,row_desired+CELL_DISP_START_ROW,fifo_status,avg_values,expert_mode);
@@ -523,7 +530,7 @@ void display_thread(
             if (disp_mode==STD)
               display_cell(tracked_cell,k+CELL_DISP_START_ROW,fifo_status,avg_values,expert_mode);
             set_occupied(tracked_cell,row_desc,k);
-            disp_history(tracked_cell.n_id_cell)=k;
+            disp_history[tracked_cell.track_id]=k;
             placed=true;
             break;
           }
@@ -590,6 +597,9 @@ void display_thread(
         stringstream ss;
         uint8 w=ceil(log10(sampbuf_sync.fifo_peak_size));
         ss << "[inp buf: " << setw(w) << sampbuf_sync.fifo.size() << "/" << sampbuf_sync.fifo_peak_size << "]";
+        // Worst case delay between a sample arriving and being processed.
+        ss << "[peak latency: " << setprecision(3) << sampbuf_sync.fifo_peak_size/2/(global_thread_data.fs_programmed*global_thread_data.oversample)*1e3 << " ms]";
+        ss << "[cpu: " << global_thread_data.placement.summary() << "]";
         //attron(A_BOLD);
         printw("%s\n",ss.str().c_str());
         //attroff(A_BOLD);
@@ -627,6 +637,7 @@ void display_thread(
 
       // Shortcuts
       const int16 & n_id_cell=row_desc[highlight_row].n_id_cell;
+      const uint32 & track_id=row_desc[highlight_row].track_id;
       const int8 & duplex_mode=row_desc[highlight_row].duplex_mode;
       const int8 & port_num=row_desc[highlight_row].port_num;
 
@@ -637,7 +648,7 @@ void display_thread(
         bool cell_found=false;
         while (it!=tracked_cell_list.tracked_cells.end()) {
           tracked_cell_t & tracked_cell=(*(*it));
-          if ((tracked_cell.n_id_cell==n_id_cell)&&((port_num==-1)||(port_num<tracked_cell.n_ports))) {
+          if ((tracked_cell.track_id==track_id)&&((port_num==-1)||(port_num<tracked_cell.n_ports))) {
             cell_found=true;
             break;
           }
@@ -654,11 +665,14 @@ void display_thread(
             } else {
               trace=db10(sqr(tracked_cell.ce.get_row(port_num)));
             }
+            // The CRS channel estimates span all the tracked subcarriers.
+            // Tick marks are placed every 6 RB's or less.
+            const double x_max=length(trace)-1;
             plot_trace(
               // Trace desc.
-              trace,itpp_ext::matlab_range(0.0,71.0),
+              trace,itpp_ext::matlab_range(0.0,x_max),
               // X axis
-              0,71,12,NAN,
+              0,x_max,12*ceil((x_max+1)/72),NAN,
               // Y axis
               -50,0,10,
               // UL corner
@@ -711,11 +725,12 @@ void display_thread(
               trace=arg(tracked_cell.ce.get_row(port_num)*exp(J*-mean_ang));
             }
             trace=trace/pi*180;
+            const double x_max=length(trace)-1;
             plot_trace(
               // Trace desc.
-              trace,itpp_ext::matlab_range(0.0,71.0),
+              trace,itpp_ext::matlab_range(0.0,x_max),
               // X axis
-              0,71,12,(mean_ang+pi)/(2*pi)*71,
+              0,x_max,12*ceil((x_max+1)/72),(mean_ang+pi)/(2*pi)*x_max,
               // Y axis
               -40,40,10,
               // UL corner
@@ -746,7 +761,7 @@ void display_thread(
             attroff(COLOR_PAIR(GREEN));
           } else if (detail_type==2) {
             // Frequency domain autocorrelation
-            const vec trace=abs(tracked_cell.ac_fd);
+            const vec trace=abs(tracked_cell.ac_fd_est());
             plot_trace(
               // Trace desc.
               trace,itpp_ext::matlab_range(0.0,11.0),
@@ -768,7 +783,7 @@ void display_thread(
             printw("Frequency domain channel autocorrelation function. x-axis spans 1.26MHz\n");
           } else if (detail_type==3) {
             // Time domain autocorrelation
-            const vec trace=abs(tracked_cell.ac_td);
+            const vec trace=abs(tracked_cell.ac_td_est(0));
             plot_trace(
               // Trace desc.
               trace,itpp_ext::matlab_range(0.0,71.0)*.0005,
@@ -23,6 +23,8 @@
 #include "common.h"
 #include "macros.h"
 #include "itpp_ext.h"
+#include "lte_lib.h"
+#include "constants.h"
 #include "dsp.h"
 
 #ifdef HAVE_RTLSDR
@@ -101,3 +103,216 @@ cvec interpft(
   return y;
 }
 
+iq_corr_t::iq_corr_t() {
+  gain=1;
+  phase=0;
+  p_ii=0;
+  p_qq=0;
+  p_iq=0;
+  n_capture=0;
+}
+
+void iq_corr_t::correct(
+  cvec & capbuf
+) {
+  const uint32 len=length(capbuf);
+  if (len==0)
+    return;
+
+  // The DC offset changes with the gain and frequency, so it is removed
+  // independently for each capture.
+  capbuf=capbuf-mean(capbuf);
+
+  // Second order statistics of this capture.
+  double c_ii=0;
+  double c_qq=0;
+  double c_iq=0;
+  for (uint32 t=0;t<len;t++) {
+    const double i=capbuf(t).real();
+    const double q=capbuf(t).imag();
+    c_ii+=i*i;
+    c_qq+=q*q;
+    c_iq+=i*q;
+  }
+  if ((c_ii==0)||(c_qq==0))
+    return;
+
+  // Average with the statistics of previous captures. Each capture is
+  // normalized so that a change of gain does not bias the average.
+  const double c_nrm=c_ii+c_qq;
+  n_capture++;
+  const double w=1.0/MIN(n_capture,(uint32)IQ_CORR_AVG_LENGTH);
+  p_ii=(1-w)*p_ii+w*c_ii/c_nrm;
+  p_qq=(1-w)*p_qq+w*c_qq/c_nrm;
+  p_iq=(1-w)*p_iq+w*c_iq/c_nrm;
+
+  gain=sqrt(p_qq/p_ii);
+  const double sin_phase=p_iq/sqrt(p_ii*p_qq);
+  phase=asin(sin_phase);
+
+  // I is the reference. Q is rescaled and the part of Q that is correlated
+  // with I is removed.
+  const double k_i=-tan(phase);
+  const double k_q=1/(gain*cos(phase));
+  for (uint32 t=0;t<len;t++) {
+    const double i=capbuf(t).real();
+    const double q=capbuf(t).imag();
+    capbuf(t)=complex<double>(i,k_i*i+k_q*q);
+  }
+}
+
+uint16 lte_oversample(
+  const double & fs
+) {
+  if (isnan(fs))
+    return 1;
+  const int32 oversample=round_i(fs/(FS_LTE/16));
+  return (oversample>1)?oversample:1;
+}
+
+int8 lte_max_rb(
+  const uint16 & oversample
+) {
+  // The standard sample rates of 1.92, 3.84, 7.68, 15.36, 23.04, and
+  // 30.72MHz leave at least 29% of the sample rate unoccupied.
+  const int8 n_rb_set[]={6,15,25,50,75,100};
+  int8 n_rb=6;
+  for (uint8 t=0;t<sizeof(n_rb_set)/sizeof(n_rb_set[0]);t++) {
+    if (n_rb_set[t]*12*15e3<=0.71*oversample*(FS_LTE/16))
+      n_rb=n_rb_set[t];
+  }
+  return n_rb;
+}
+
+decimator_t::decimator_t(
+  const uint16 & factor
+) : factor(factor) {
+  ASSERT(factor>=1);
+  const uint32 n_taps=(factor==1)?1:DECIMATOR_TAPS_PER_PHASE*factor+1;
+  taps.set_size(n_taps);
+  const double center=(n_taps-1)/2.0;
+  for (uint32 t=0;t<n_taps;t++) {
+    const double x=(t-center)/factor;
+    const double sinc=(x==0)?1:sin(pi*x)/(pi*x);
+    const double window=(n_taps==1)?1:0.54-0.46*cos(2*pi*t/(n_taps-1));
+    taps(t)=sinc*window;
+  }
+  // The taps are symmetric, so they can be applied to the samples in
+  // either order.
+  taps=taps/sum(taps);
+  hist.set_size(2*n_taps);
+  hist.zeros();
+  hist_idx=0;
+  phase=0;
+}
+
+bool decimator_t::push(
+  const complex <double> & x,
+  complex <double> & y
+) {
+  if (factor==1) {
+    y=x;
+    return true;
+  }
+  const uint32 n_taps=length(taps);
+  // hist(hist_idx..hist_idx+n_taps-1) holds the last n_taps samples,
+  // oldest first.
+  hist(hist_idx)=x;
+  hist(hist_idx+n_taps)=x;
+  hist_idx=(hist_idx+1==n_taps)?0:hist_idx+1;
+  phase++;
+  if (phase<factor)
+    return false;
+  phase=0;
+  y=cvec_simd::dot(hist._data()+hist_idx,taps._data(),n_taps);
+  return true;
+}
+
+uint16 decimator_t::delay() const {
+  return (factor==1)?0:DECIMATOR_TAPS_PER_PHASE/2;
+}
+
+resampler_t::resampler_t(
+  const double & fs_in,
+  const double & fs_out
+) : step(fs_in/fs_out) {
+  ASSERT((fs_in>0)&&(fs_out>0));
+  // The filter spans RESAMPLER_TAPS_PER_PHASE samples at the lower rate.
+  const double scale=MIN(1.0,1.0/step);
+  n_taps=2*ceil_i(RESAMPLER_TAPS_PER_PHASE/2/scale);
+  const double half=n_taps/2;
+  // Branch p is evaluated at a time p/RESAMPLER_PHASES input samples after
+  // the sample at the center of the filter. The last branch equals the
+  // first one, shifted by one sample.
+  taps.set_size((RESAMPLER_PHASES+1)*n_taps);
+  for (uint32 p=0;p<=RESAMPLER_PHASES;p++) {
+    double * branch=taps._data()+p*n_taps;
+    double total=0;
+    for (uint16 k=0;k<n_taps;k++) {
+      // Distance from the output time to input sample k of the history.
+      const double d=(double)p/RESAMPLER_PHASES+half-1-k;
+      const double x=d*scale;
+      const double sinc=(x==0)?1:sin(pi*x)/(pi*x);
+      const double window=(abs(d)>=half)?0:0.54+0.46*cos(pi*d/half);
+      branch[k]=sinc*window;
+      total+=sinc*window;
+    }
+    for (uint16 k=0;k<n_taps;k++) {
+      branch[k]/=total;
+    }
+  }
+  hist.set_size(2*n_taps);
+  reset();
+}
+
+void resampler_t::reset() {
+  hist.zeros();
+  hist_idx=0;
+  // Output sample 0 is at the time of input sample 0, which is at the
+  // center of the filter once delay() more samples have been pushed.
+  frac=1+delay();
+}
+
+uint16 resampler_t::push(
+  const complex <double> & x,
+  complex <double> * y
+) {
+  // hist(hist_idx..hist_idx+n_taps-1) holds the last n_taps samples,
+  // oldest first.
+  hist(hist_idx)=x;
+  hist(hist_idx+n_taps)=x;
+  hist_idx=(hist_idx+1==n_taps)?0:hist_idx+1;
+  frac-=1;
+  uint16 n=0;
+  while (frac<1) {
+    const uint32 p=round_i(frac*RESAMPLER_PHASES);
+    y[n++]=cvec_simd::rdot(hist._data()+hist_idx,taps._data()+p*n_taps,n_taps);
+    frac+=step;
+  }
+  return n;
+}
+
+cvec resampler_t::push(
+  const cvec & x
+) {
+  const uint32 n_x=length(x);
+  cvec y(ceil_i(n_x/step)+max_out());
+  uint32 n_y=0;
+  for (uint32 t=0;t<n_x;t++) {
+    n_y+=push(x(t),y._data()+n_y);
+  }
+  y.set_size(n_y,true);
+  return y;
+}
+
+uint16 resampler_t::max_out() const {
+  return ceil_i(1/step);
+}
+
+uint16 resampler_t::delay() const {
+  return n_taps/2;
+}
+
+double iq_corr_t::irr_db() const {
+  return db10((1+gain*gain+2*gain*cos(phase))/(1+gain*gain-2*gain*cos(phase)));
+}
@@ -669,3 +669,172 @@ bvec lte_calc_crc(
   return p;
 }
 
+
+// Coded, rate matched, and scrambled PBCH bits of the TTI that contains
+// frame sfn.
+static bvec pbch_tti_bits(
+  const Cell & cell,
+  const uint16 & sfn
+) {
+  // Pack the MIB. The inverse of the unpacking done by the receiver.
+  bvec c(24);
+  c.zeros();
+  const int8 n_rb_set[]={6,15,25,50,75,100};
+  for (uint8 t=0;t<6;t++) {
+    if (n_rb_set[t]==cell.n_rb_dl) {
+      c(0)=(t>>2)&1;
+      c(1)=(t>>1)&1;
+      c(2)=t&1;
+    }
+  }
+  c(3)=(cell.phich_duration==phich_duration_t::EXTENDED);
+  const uint8 phich_res=cell.phich_resource-phich_resource_t::oneSixth;
+  c(4)=(phich_res>>1)&1;
+  c(5)=phich_res&1;
+  for (uint8 t=0;t<8;t++) {
+    c(6+t)=((sfn>>2)>>(7-t))&1;
+  }
+
+  // The CRC mask signals the number of ports.
+  bvec crc=lte_calc_crc(c,CRC16);
+  if (cell.n_ports==2) {
+    for (uint8 t=0;t<16;t++) {
+      crc(t)=1-((int)crc(t));
+    }
+  } else if (cell.n_ports==4) {
+    for (uint8 t=1;t<16;t+=2) {
+      crc(t)=1-((int)crc(t));
+    }
+  }
+
+  const uint32 m_bit=(cell.cp_type==cp_type_t::NORMAL)?1920:1728;
+  const cvec e=lte_conv_ratematch(to_cmat(to_mat(lte_conv_encode(concat(c,crc)))),m_bit);
+  bvec e_bits(m_bit);
+  for (uint32 t=0;t<m_bit;t++) {
+    e_bits(t)=(real(e(t))>0.5);
+  }
+  return e_bits+lte_pn(cell.n_id_cell(),m_bit);
+}
+
+// Generate the FDD downlink of a cell that transmits only the PSS, SSS,
+// CRS, and PBCH.
+cvec lte_dl_generate(
+  const Cell & cell,
+  const cvec & port_gain,
+  const uint16 & n_frames,
+  const uint16 & oversample
+) {
+  const uint8 n_ports=cell.n_ports;
+  const uint8 n_symb_dl=cell.n_symb_dl();
+  const uint16 n_sc=12*cell.n_rb_dl;
+  const uint16 n_half=n_sc/2;
+  const uint16 n_fft=128*oversample;
+  ASSERT(cell.duplex_mode==0);
+  ASSERT(length(port_gain)==n_ports);
+  ASSERT(n_sc<n_fft);
+  // Start of the central 6 RB's.
+  const uint16 sc_6rb=n_half-36;
+  const uint8 v_shift_m3=mod(cell.n_id_cell(),3);
+  const RS_DL rs_dl(cell.n_id_cell(),cell.n_rb_dl,cell.cp_type);
+
+  cvec out(n_frames*19200*oversample);
+
+  cvec pbch_sym;
+  cmat grid(n_ports,n_sc);
+  cvec dft_in(n_fft);
+  uint32 idx=0;
+  for (uint16 fr=0;fr<n_frames;fr++) {
+    const uint16 sfn=mod(cell.sfn+fr,1024);
+    // Modulate the TTI's PBCH once, at the beginning of the TTI.
+    if ((fr==0)||(mod(sfn,4)==0)) {
+      pbch_sym=lte_modulate(pbch_tti_bits(cell,sfn),modulation_t::QAM);
+    }
+    const uint16 n_pbch=length(pbch_sym)/4;
+    uint16 pbch_idx=mod(sfn,4)*n_pbch;
+    for (uint8 slot_num=0;slot_num<20;slot_num++) {
+      for (uint8 sym_num=0;sym_num<n_symb_dl;sym_num++) {
+        grid.zeros();
+
+        // Reference symbols.
+        for (uint8 port=0;port<n_ports;port++) {
+          const double shift=rs_dl.get_shift(slot_num,sym_num,port);
+          if (isnan(shift))
+            continue;
+          const cvec & rs=rs_dl.get_rs(slot_num,sym_num);
+          for (uint16 t=0;t<length(rs);t++) {
+            grid(port,(uint16)shift+6*t)=rs(t);
+          }
+        }
+
+        // The PSS and SSS are sent on port 0.
+        if ((slot_num==0)||(slot_num==10)) {
+          if (sym_num==n_symb_dl-1) {
+            const cvec & pss=ROM_TABLES.pss_fd[cell.n_id_2];
+            for (uint8 t=0;t<62;t++) {
+              grid(0,sc_6rb+5+t)=pss(t);
+            }
+          } else if (sym_num==n_symb_dl-2) {
+            const ivec & sss=ROM_TABLES.sss_fd(cell.n_id_1,cell.n_id_2,slot_num);
+            for (uint8 t=0;t<62;t++) {
+              grid(0,sc_6rb+5+t)=sss(t);
+            }
+          }
+        }
+
+        // PBCH. The positions of the RS of all 4 ports are skipped no
+        // matter how many ports are in use. Pairs of symbols are transmit
+        // diversity encoded and alternate between ports 0/2 and 1/3 when 4
+        // ports are used.
+        if ((slot_num==1)&&(sym_num<=3)) {
+          for (uint16 sc=0;sc<72;sc++) {
+            if ((mod(sc,3)==v_shift_m3)&&((sym_num==0)||(sym_num==1)||((sym_num==3)&&(cell.cp_type==cp_type_t::EXTENDED)))) {
+              continue;
+            }
+            if (n_ports==1) {
+              grid(0,sc_6rb+sc)=pbch_sym(pbch_idx);
+            } else {
+              const uint16 pair=pbch_idx&~1;
+              const complex <double> x0=pbch_sym(pair)/sqrt(2.0);
+              const complex <double> x1=pbch_sym(pair+1)/sqrt(2.0);
+              const uint8 p0=((n_ports==4)&&(mod(pair,4)!=0))?1:0;
+              const uint8 p1=(n_ports==4)?p0+2:1;
+              if (pbch_idx==pair) {
+                grid(p0,sc_6rb+sc)=x0;
+                grid(p1,sc_6rb+sc)=-conj(x1);
+              } else {
+                grid(p0,sc_6rb+sc)=x1;
+                grid(p1,sc_6rb+sc)=conj(x0);
+              }
+            }
+            pbch_idx++;
+          }
+        }
+
+        // Combine the ports and convert to the time domain.
+        dft_in.zeros();
+        for (uint8 port=0;port<n_ports;port++) {
+          for (uint16 t=0;t<n_half;t++) {
+            dft_in(n_fft-n_half+t)+=port_gain(port)*grid(port,t);
+            dft_in(t+1)+=port_gain(port)*grid(port,n_half+t);
+          }
+        }
+        const cvec td=idft(dft_in);
+        uint16 n_cp;
+        if (cell.cp_type==cp_type_t::EXTENDED) {
+          n_cp=32*oversample;
+        } else {
+          n_cp=((sym_num==0)?10:9)*oversample;
+        }
+        for (uint16 t=0;t<n_cp;t++) {
+          out(idx++)=td(n_fft-n_cp+t);
+        }
+        for (uint16 t=0;t<n_fft;t++) {
+          out(idx++)=td(t);
+        }
+      }
+    }
+  }
+  ASSERT(idx==(uint32)length(out));
+
+  return out;
+}
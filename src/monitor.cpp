@@ -0,0 +1,167 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <itpp/itbase.h>
+#include <sched.h>
+#include <time.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "common.h"
+#include "macros.h"
+#include "monitor.h"
+
+using namespace std;
+
+// Value of a sysfs counter, or -1 if it cannot be read.
+static double read_counter(
+  const string & path
+) {
+  ifstream file(path.c_str());
+  double r=-1;
+  if (!(file >> r))
+    return -1;
+  return r;
+}
+
+energy_meter_t::energy_meter_t() {
+  for (uint16 t=0;;t++) {
+    stringstream dir;
+    dir << "/sys/class/powercap/intel-rapl:" << t << "/";
+    const double max=read_counter(dir.str()+"max_energy_range_uj");
+    if (max<0)
+      break;
+    if (read_counter(dir.str()+"energy_uj")<0) {
+      // The counters exist but are only readable by root.
+      domains.clear();
+      break;
+    }
+    domains.push_back(dir.str()+"energy_uj");
+    max_uj.push_back(max);
+  }
+  start();
+}
+
+bool energy_meter_t::available() const {
+  return !domains.empty();
+}
+
+void energy_meter_t::start() {
+  start_uj.resize(domains.size());
+  for (uint16 t=0;t<domains.size();t++)
+    start_uj[t]=read_counter(domains[t]);
+}
+
+double energy_meter_t::joules() const {
+  double uj=0;
+  for (uint16 t=0;t<domains.size();t++) {
+    double delta=read_counter(domains[t])-start_uj[t];
+    // The counter wraps around at max_energy_range_uj.
+    if (delta<0)
+      delta+=max_uj[t]+1;
+    uj+=delta;
+  }
+  return uj/1e6;
+}
+
+monitor_schedule_t::monitor_schedule_t(
+  const double & si,
+  const double & vi
+) {
+  scan_interval=si;
+  verify_interval=vi;
+  // The first scan is due immediately.
+  next_scan=0;
+  next_verify=0;
+  n_cells=0;
+}
+
+void monitor_schedule_t::scan_done(
+  const double & scan_begin,
+  const double & now,
+  const uint32 & n
+) {
+  next_scan=scan_begin+scan_interval;
+  next_verify=now+verify_interval;
+  n_cells=n;
+}
+
+void monitor_schedule_t::verify_done(
+  const double & now,
+  const bool & all_found
+) {
+  if (!all_found)
+    next_scan=now;
+  next_verify+=verify_interval;
+}
+
+bool monitor_schedule_t::scan_due() const {
+  return (verify_interval==0)||(n_cells==0)||(next_verify>=next_scan);
+}
+
+double monitor_schedule_t::next_job() const {
+  return scan_due()?next_scan:next_verify;
+}
+
+void limit_cores(
+  const uint16 & n_cores
+) {
+  if (n_cores==0)
+    return;
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0,sizeof(allowed),&allowed)==0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    uint16 n=0;
+    for (int t=0;(t<CPU_SETSIZE)&&(n<n_cores);t++) {
+      if (CPU_ISSET(t,&allowed)) {
+        CPU_SET(t,&set);
+        n++;
+      }
+    }
+    if (sched_setaffinity(0,sizeof(set),&set))
+      cout << "Warning: could not set CPU affinity" << endl;
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(n_cores);
+#endif
+}
+
+void monitor_sleep(
+  const double & seconds
+) {
+  if (seconds<=0)
+    return;
+  struct timespec req;
+  req.tv_sec=(time_t)floor(seconds);
+  req.tv_nsec=(long)((seconds-req.tv_sec)*1e9+0.5);
+  if (req.tv_nsec>=1000000000) {
+    req.tv_sec++;
+    req.tv_nsec-=1000000000;
+  }
+  // Resume the sleep if it is interrupted by a signal.
+  struct timespec rem;
+  while (nanosleep(&req,&rem)==-1)
+    req=rem;
+}
+
@@ -0,0 +1,273 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <curses.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include "common.h"
+#include "macros.h"
+#include "placement.h"
+
+using namespace std;
+
+placement_t::placement_t placement_parse(
+  const char * mode
+) {
+  if (strcmp(mode,"none")==0) {
+    return placement_t::NONE;
+  } else if (strcmp(mode,"pin")==0) {
+    return placement_t::PIN;
+  } else if (strcmp(mode,"rt")==0) {
+    return placement_t::REALTIME;
+  }
+  cerr << "Error: thread placement must be none, pin, or rt" << endl;
+  ABORT(-1);
+  return placement_t::NONE;
+}
+
+// Return the first line of a sysfs file or an empty string if the file
+// does not exist.
+static string read_sysfs(
+  const string & path
+) {
+  ifstream file(path.c_str());
+  string line;
+  getline(file,line);
+  return line;
+}
+
+// Parse a CPU list such as "0-3,8,10-11".
+static vector <int> parse_cpu_list(
+  const string & list
+) {
+  vector <int> cpus;
+  stringstream ss(list);
+  string range;
+  while (getline(ss,range,',')) {
+    int first;
+    int last;
+    const int n=sscanf(range.c_str(),"%d-%d",&first,&last);
+    if (n<1)
+      continue;
+    if (n==1)
+      last=first;
+    for (int t=first;t<=last;t++)
+      cpus.push_back(t);
+  }
+  return cpus;
+}
+
+// Integer read from a sysfs file, or def if it cannot be read.
+static int read_sysfs_int(
+  const string & path,
+  const int & def
+) {
+  int r;
+  return (sscanf(read_sysfs(path).c_str(),"%d",&r)==1)?r:def;
+}
+
+thread_placement_t::thread_placement_t(
+  const placement_t::placement_t & mode
+) :
+  mode(mode)
+{
+  pre_producer_cpu=-1;
+  producer_cpu=-1;
+  n_trackers=0;
+  rt_failed=false;
+  affinity_failed=false;
+  if (mode==placement_t::NONE)
+    return;
+
+  // Isolated CPU's are not part of the default affinity mask but are the
+  // best place for the threads that must keep up with the device.
+  vector <int> isolated=parse_cpu_list(read_sysfs("/sys/devices/system/cpu/isolated"));
+  vector <int> cpus=isolated;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0,sizeof(allowed),&allowed)==0) {
+    for (int t=0;t<CPU_SETSIZE;t++) {
+      if (CPU_ISSET(t,&allowed)&&(find(cpus.begin(),cpus.end(),t)==cpus.end()))
+        cpus.push_back(t);
+    }
+  }
+  sort(cpus.begin(),cpus.end());
+  if (cpus.size()<PLACEMENT_MIN_CPUS) {
+    cout << "Warning: too few CPU's for thread placement, leaving it to the OS" << endl;
+    this->mode=placement_t::NONE;
+    return;
+  }
+
+  // Physical core, cache, and SMT sibling rank of every CPU. The cache is
+  // the largest one described in sysfs and is identified by the first CPU
+  // that shares it.
+  map <int,int> core;
+  map <int,int> cache;
+  map <int,int> rank;
+  map <int,int> core_count;
+  for (uint32 t=0;t<cpus.size();t++) {
+    const int cpu=cpus[t];
+    stringstream dir;
+    dir << "/sys/devices/system/cpu/cpu" << cpu << "/";
+    core[cpu]=read_sysfs_int(dir.str()+"topology/physical_package_id",0)*65536+read_sysfs_int(dir.str()+"topology/core_id",cpu);
+    cache[cpu]=read_sysfs_int(dir.str()+"topology/physical_package_id",0);
+    for (int idx=3;idx>=0;idx--) {
+      stringstream path;
+      path << dir.str() << "cache/index" << idx << "/shared_cpu_list";
+      vector <int> shared=parse_cpu_list(read_sysfs(path.str()));
+      if (!shared.empty()) {
+        cache[cpu]=shared[0];
+        break;
+      }
+    }
+    rank[cpu]=core_count[core[cpu]]++;
+  }
+
+  // The pre-producer and the producer get two separate cores, preferably
+  // isolated ones. Otherwise the highest numbered cores are used since the
+  // first core usually services most of the interrupts.
+  vector <int> candidates;
+  for (uint32 t=0;t<isolated.size();t++) {
+    if (rank[isolated[t]]==0)
+      candidates.push_back(isolated[t]);
+  }
+  for (int32 t=cpus.size()-1;t>=0;t--) {
+    if (rank[cpus[t]]==0)
+      candidates.push_back(cpus[t]);
+  }
+  for (uint32 t=0;t<candidates.size();t++) {
+    if (pre_producer_cpu==-1) {
+      pre_producer_cpu=candidates[t];
+    } else if (core[candidates[t]]!=core[pre_producer_cpu]) {
+      producer_cpu=candidates[t];
+      break;
+    }
+  }
+  if (producer_cpu==-1) {
+    cout << "Warning: too few CPU cores for thread placement, leaving it to the OS" << endl;
+    this->mode=placement_t::NONE;
+    return;
+  }
+
+  // Everything else runs on the remaining cores of the allowed set. SMT
+  // siblings of the reserved cores are left idle if possible.
+  map <int,vector <int> > groups;
+  for (uint32 t=0;t<cpus.size();t++) {
+    const int cpu=cpus[t];
+    const bool reserved=(core[cpu]==core[pre_producer_cpu])||(core[cpu]==core[producer_cpu]);
+    if (!reserved&&CPU_ISSET(cpu,&allowed))
+      groups[cache[cpu]].push_back(cpu);
+  }
+  if (groups.empty()) {
+    cout << "Warning: no CPU's left for the tracker threads, leaving placement to the OS" << endl;
+    this->mode=placement_t::NONE;
+    return;
+  }
+  // Within a cache, use all the cores before using SMT siblings. Then
+  // interleave the caches.
+  uint32 n_max=0;
+  for (map <int,vector <int> >::iterator it=groups.begin();it!=groups.end();++it) {
+    vector <int> & g=(*it).second;
+    vector <pair <int,int> > keyed;
+    for (uint32 t=0;t<g.size();t++)
+      keyed.push_back(make_pair(rank[g[t]],g[t]));
+    sort(keyed.begin(),keyed.end());
+    for (uint32 t=0;t<g.size();t++)
+      g[t]=keyed[t].second;
+    n_max=MAX(n_max,(uint32)g.size());
+  }
+  for (uint32 k=0;k<n_max;k++) {
+    for (map <int,vector <int> >::iterator it=groups.begin();it!=groups.end();++it) {
+      if (k<(*it).second.size())
+        worker_cpus.push_back((*it).second[k]);
+    }
+  }
+
+  if (verbosity>=1) {
+    cout << "Thread placement: " << summary() << endl;
+  }
+}
+
+void thread_placement_t::apply(
+  const thread_role_t::thread_role_t & role
+) {
+  boost::mutex::scoped_lock lock(mutex);
+  if (mode==placement_t::NONE)
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  int policy=SCHED_OTHER;
+  struct sched_param param;
+  param.sched_priority=0;
+  if (role==thread_role_t::PRE_PRODUCER) {
+    CPU_SET(pre_producer_cpu,&set);
+    if (mode==placement_t::REALTIME) {
+      policy=SCHED_FIFO;
+      param.sched_priority=PLACEMENT_PRE_PRODUCER_PRIO;
+    }
+  } else if (role==thread_role_t::PRODUCER) {
+    CPU_SET(producer_cpu,&set);
+    if (mode==placement_t::REALTIME) {
+      policy=SCHED_FIFO;
+      param.sched_priority=PLACEMENT_PRODUCER_PRIO;
+    }
+  } else if (role==thread_role_t::TRACKER) {
+    CPU_SET(worker_cpus[n_trackers%worker_cpus.size()],&set);
+    n_trackers++;
+  } else {
+    for (uint32 t=0;t<worker_cpus.size();t++)
+      CPU_SET(worker_cpus[t],&set);
+  }
+
+  if (pthread_setaffinity_np(pthread_self(),sizeof(set),&set)) {
+    if (!affinity_failed)
+      cout << "Warning: could not set thread CPU affinity" << endl;
+    affinity_failed=true;
+  }
+  // Trackers are launched by the producer and would otherwise inherit its
+  // real-time policy.
+  if (pthread_setschedparam(pthread_self(),policy,&param)) {
+    if ((policy==SCHED_FIFO)&&(!rt_failed))
+      cout << "Warning: could not enable SCHED_FIFO (requires root, CAP_SYS_NICE, or an rtprio limit)" << endl;
+    rt_failed=rt_failed||(policy==SCHED_FIFO);
+  }
+}
+
+string thread_placement_t::summary() {
+  boost::mutex::scoped_lock lock(mutex);
+  if (mode==placement_t::NONE)
+    return "OS";
+  stringstream ss;
+  ss << "pre-producer cpu " << pre_producer_cpu << ", producer cpu " << producer_cpu << ", " << worker_cpus.size() << " worker cpus";
+  if (mode==placement_t::REALTIME)
+    ss << (rt_failed?", no SCHED_FIFO":", SCHED_FIFO");
+  if (affinity_failed)
+    ss << ", pinning failed";
+  return ss.str();
+}
+
@@ -25,9 +25,12 @@
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
 #include <list>
+#include <vector>
+#include <map>
 #include <sstream>
 #include <signal.h>
 #include <queue>
+#include <deque>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include "common.h"
@@ -38,6 +41,7 @@
 #include "itpp_ext.h"
 #include "searcher.h"
 #include "dsp.h"
+#include "placement.h"
 #include "LTE-Tracker.h"
 
 #ifdef HAVE_RTLSDR
@@ -57,127 +61,323 @@ using namespace std;
 
 // This is local storage for each cell that is being tracked.
 typedef struct {
-  uint32 serial_num;
   uint32 target_cap_start_time;
   bool filling;
+  // True until the first capture for this cell has begun.
+  bool first;
   uint16 buffer_offset;
   td_fifo_pdu_t pdu;
 } cell_local_t;
 
-// Process that takes samples and distributes them to the appropriate
-// process.
-void producer_thread(
+// Send one OFDM symbol to a tracker.
+static void push_pdu(
+  tracked_cell_t & tracked_cell,
+  const td_fifo_pdu_t & pdu
+) {
+  boost::mutex::scoped_lock lock(tracked_cell.fifo_mutex);
+  tracked_cell.fifo.push(pdu);
+  tracked_cell.fifo_peak_size=MAX(tracked_cell.fifo.size(),tracked_cell.fifo_peak_size);
+  tracked_cell.fifo_condition.notify_one();
+}
+
+// An OFDM symbol that waits for the next batch of DFTs on the OpenCL
+// device.
+typedef struct {
+  tracked_cell_t * tracked_cell;
+  td_fifo_pdu_t pdu;
+} tracker_fd_job_t;
+
+// Jobs passed from the producer to the batching thread.
+typedef struct {
+  boost::mutex mutex;
+  boost::condition condition;
+  deque <tracker_fd_job_t> jobs;
+} tracker_fd_sync_t;
+
+#ifdef USE_OPENCL
+// Called by the producer, with the tracked cell list locked, for each
+// OFDM symbol that is complete. The cell cannot be deleted until the
+// batching thread has finished with the job.
+static void tracker_fd_enqueue(
+  tracker_fd_sync_t & tracker_fd_sync,
+  tracked_cell_t & tracked_cell,
+  const td_fifo_pdu_t & pdu
+) {
+  {
+    boost::mutex::scoped_lock lock(tracked_cell.fifo_mutex);
+    tracked_cell.fd_jobs_pending++;
+  }
+  tracker_fd_job_t job;
+  job.tracked_cell=&tracked_cell;
+  job.pdu=pdu;
+  boost::mutex::scoped_lock lock(tracker_fd_sync.mutex);
+  tracker_fd_sync.jobs.push_back(job);
+  // The batching thread only needs to wake up for the first job of a
+  // batch and when a batch is full.
+  if ((tracker_fd_sync.jobs.size()==1)||(tracker_fd_sync.jobs.size()==TRACKER_FD_MAX_ROWS))
+    tracker_fd_sync.condition.notify_one();
+}
+
+// Deliver the symbols of a finished job, if any, and release the cell.
+static void tracker_fd_done(
+  tracker_fd_job_t & job,
+  const bool & deliver
+) {
+  tracked_cell_t & tracked_cell=*job.tracked_cell;
+  boost::mutex::scoped_lock lock(tracked_cell.fifo_mutex);
+  if (deliver) {
+    tracked_cell.fifo.push(job.pdu);
+    tracked_cell.fifo_peak_size=MAX(tracked_cell.fifo.size(),tracked_cell.fifo_peak_size);
+    tracked_cell.fifo_condition.notify_one();
+  }
+  tracked_cell.fd_jobs_pending--;
+  if (tracked_cell.fd_jobs_pending==0)
+    tracked_cell.fd_jobs_condition.notify_all();
+}
+
+// Perform the FOC, DFT and TOC of a batch of OFDM symbols on the OpenCL
+// device and send them to their trackers. Only the bulk phase offset is
+// left for get_fd() to compensate.
+static void tracker_fd_flush(
+  lte_opencl_t & lte_ocl,
+  global_thread_data_t & global_thread_data,
+  vector <tracker_fd_job_t> & batch
+) {
+  const uint16 n_rows=batch.size();
+  if (n_rows==0)
+    return;
+  const uint16 & oversample=global_thread_data.oversample;
+  const double & fs_programmed=global_thread_data.fs_programmed;
+
+  cmat data(n_rows,128*oversample);
+  vec dphi(n_rows);
+  vec late(n_rows);
+  ivec n_half(n_rows);
+  for (uint16 r=0;r<n_rows;r++) {
+    const td_fifo_pdu_t & pdu=batch[r].pdu;
+    data.set_row(r,pdu.data);
+    dphi(r)=2*pi*-pdu.frequency_offset/(fs_programmed*oversample*pdu.k_factor);
+    late(r)=pdu.late;
+    n_half(r)=batch[r].tracked_cell->n_sc()/2;
+  }
+  cmat syms;
+  lte_ocl.tracker_fd(data,dphi,late,n_half,syms);
+
+  for (uint16 r=0;r<n_rows;r++) {
+    batch[r].pdu.syms=syms.get_row(r).left(2*n_half(r));
+    tracker_fd_done(batch[r],true);
+  }
+  batch.clear();
+}
+
+// Thread that owns the OpenCL device used by the trackers. A batch is sent
+// to the device as soon as it holds TRACKER_FD_MAX_ROWS symbols or
+// TRACKER_FD_TIMEOUT_MS after its first symbol arrived, whichever comes
+// first. The jobs that are still waiting when the thread is interrupted
+// are dropped.
+static void tracker_fd_thread(
+  tracker_fd_sync_t & tracker_fd_sync,
+  global_thread_data_t & global_thread_data
+) {
+  global_thread_data.tracker_fd_thread_id=syscall(SYS_gettid);
+  global_thread_data.placement.apply(thread_role_t::OTHER);
+  lte_opencl_t lte_ocl(global_thread_data.opencl_platform(),global_thread_data.opencl_device());
+  lte_ocl.setup_tracker_fd((string)"tracker_kernels.cl",128*global_thread_data.oversample,12*global_thread_data.n_rb_track_max);
+
+  vector <tracker_fd_job_t> batch;
+  try {
+    while (true) {
+      {
+        boost::mutex::scoped_lock lock(tracker_fd_sync.mutex);
+        while (tracker_fd_sync.jobs.empty()) {
+          tracker_fd_sync.condition.wait(lock);
+        }
+        const boost::system_time deadline=boost::get_system_time()+boost::posix_time::milliseconds(TRACKER_FD_TIMEOUT_MS);
+        while (tracker_fd_sync.jobs.size()<TRACKER_FD_MAX_ROWS) {
+          if (!tracker_fd_sync.condition.timed_wait(lock,deadline))
+            break;
+        }
+        while ((!tracker_fd_sync.jobs.empty())&&(batch.size()<TRACKER_FD_MAX_ROWS)) {
+          batch.push_back(tracker_fd_sync.jobs.front());
+          tracker_fd_sync.jobs.pop_front();
+        }
+      }
+      tracker_fd_flush(lte_ocl,global_thread_data,batch);
+    }
+  } catch (boost::thread_interrupted &) {
+    boost::mutex::scoped_lock lock(tracker_fd_sync.mutex);
+    for (uint16 r=0;r<batch.size();r++) {
+      tracker_fd_done(batch[r],false);
+    }
+    while (!tracker_fd_sync.jobs.empty()) {
+      tracker_fd_done(tracker_fd_sync.jobs.front(),false);
+      tracker_fd_sync.jobs.pop_front();
+    }
+  }
+}
+#endif
+
+// Main loop of the producer. If tracker_fd_sync is not NULL, the OFDM
+// symbols of all the cells are passed to the batching thread, which
+// performs their DFTs on the OpenCL device, instead of directly to the
+// trackers.
+static void producer_helper(
   sampbuf_sync_t & sampbuf_sync,
   capbuf_sync_t & capbuf_sync,
+  reacq_sync_t & reacq_sync,
   global_thread_data_t & global_thread_data,
   tracked_cell_list_t & tracked_cell_list,
-  double & fc
+  tracker_fd_sync_t * tracker_fd_sync
 ) {
-  global_thread_data.producer_thread_id=syscall(SYS_gettid);
-
   // Main loop which distributes data to the appropriate subthread.
-  // Local storage for each cell.
-  cell_local_t cell_local[504];
-  for (uint16 t=0;t<504;t++) {
-    cell_local[t].serial_num=0;
-  }
+  // Local storage for each tracker, indexed by track ID. A tracker that
+  // resumes a lost track starts with fresh local storage.
+  map <uint32,cell_local_t> cell_local;
 
   //Real_Timer tt;
-  double sample_time=-1;
-  bool searcher_capbuf_filling=false;
-  uint32 searcher_capbuf_idx=0;
+  // Timestamps are calculated from an integer sample counter so that
+  // rounding errors do not accumulate from one sample to the next. The
+  // counter is rebased whenever the sample period changes.
+  uint64 sample_count=0;
+  uint64 base_count=0;
+  double base_time=-1;
+  double sample_period=0;
+  bool reacq_capbuf_filling=false;
+  uint32 reacq_capbuf_idx=0;
+  // The searcher always operates at 1.92MHz. When the device is sampling
+  // faster than this, the searcher's ring buffer is filled with decimated
+  // samples.
+  const uint16 & oversample=global_thread_data.oversample;
+  decimator_t searcher_decimator(oversample);
+  // IQ imbalance is a property of the device and is averaged over
+  // successive blocks.
+  iq_corr_t iq_corr;
   //unsigned long long int sample_number=0;
-  // Elevate privileges of the producer thread.
-  //int retval=nice(-10);
-  //if (retval==-1) {
-  //  cerr << "Error: could not set elevated privileges" << endl;
-  //  ABORT(-1);
-  //}
-  //int policy=SCHED_RR;
-  //struct sched_param param;
-  //param.sched_priority=50;
-  ////pthread_getschedparam(pthread_self(), &policy, &param);
-  //if (pthread_setschedparam(pthread_self(),policy,&param)) {
-  //  cerr << "Error: could not elevate main thread priority" << endl;
-  //  ABORT(-1);
-  //}
+  // Move to the producer's core and, if requested, elevate its priority.
+  global_thread_data.placement.apply(thread_role_t::PRODUCER);
   //tt.tic();
 #define BLOCK_SIZE 10000
   while (true) {
     // Each iteration of this loop processes one block of data.
     const double frequency_offset=global_thread_data.frequency_offset();
-    double k_factor = 1.0;// !!!THIS need to be handled correctly in the future when carrier-sampling isn't twisted. TIMING info should be updated according to phase rotation of FD response of main path
-
-//    if ( global_thread_data.dev_use()!=dev_type_t::RTLSDR ) {// !!!THIS need to be handled correctly in the future when carrier-sampling isn't twisted. TIMING info should be updated according to phase rotation of FD response of main path
-      if (global_thread_data.sampling_carrier_twist()){
-        k_factor=(global_thread_data.fc_programmed-frequency_offset)/global_thread_data.fc_programmed;
-      } else {
-        k_factor=global_thread_data.k_factor(); // !!!THIS need to be handled correctly in the future when carrier-sampling isn't twisted. TIMING info should be updated according to phase rotation of FD response of main path
-      }
-//    }
+    // When sampling and carrier are not twisted, k_factor is estimated by
+    // the tracker threads from the drift of the frame timing.
+    double k_factor;
+    if (global_thread_data.sampling_carrier_twist()){
+      k_factor=(global_thread_data.fc_programmed-frequency_offset)/global_thread_data.fc_programmed;
+    } else {
+      k_factor=global_thread_data.k_factor();
+    }
 
     //const double k_factor_inv=1/k_factor;
     const double & fs_programmed=global_thread_data.fs_programmed;
+    const double sample_period_new=(FS_LTE/16)/(fs_programmed*oversample*k_factor);
+    if (sample_period_new!=sample_period) {
+      base_time=itpp_ext::matlab_mod(base_time+(sample_count-base_count)*sample_period,19200.0);
+      base_count=sample_count;
+      sample_period=sample_period_new;
+    }
 
     // Get the next block
     //complex <double> sample;
-    cvec samples(BLOCK_SIZE);
-    vec samples_timestamp(BLOCK_SIZE);
-    uint32 n_samples;
+    // When the device runs at its native rate, the fifo holds samples at
+    // the device rate and they are resampled here rather than in the USB
+    // callback.
+    resampler_t * resampler=sampbuf_sync.resampler;
+    const double raw_per_sample=resampler?resampler->step:1;
+    cvec raw(BLOCK_SIZE);
+    uint32 n_raw;
     {
       boost::mutex::scoped_lock lock(sampbuf_sync.mutex);
       while (sampbuf_sync.fifo.size()<2) {
         sampbuf_sync.condition.wait(lock);
       }
       // Dump data if there is too much in the fifo
-      while (sampbuf_sync.fifo.size()>2*FS_LTE/16*1.5) {
-        for (uint32 t=0;t<(unsigned)round_i(fs_programmed*k_factor);t++) {
+      while (sampbuf_sync.fifo.size()>2*FS_LTE/16*oversample*1.5*raw_per_sample) {
+        const uint32 n_drop=2*round_i(fs_programmed*oversample*k_factor*raw_per_sample/2);
+        for (uint32 t=0;t<n_drop;t++) {
           sampbuf_sync.fifo.pop_front();
         }
+        // Time keeps running while the samples are discarded.
+        sample_count+=round_i(n_drop/2/raw_per_sample);
         global_thread_data.raw_seconds_dropped_inc();
       }
-      n_samples=BLOCK_SIZE;
+      n_raw=BLOCK_SIZE;
       complex <double> sample_temp;
       for (uint16 t=0;t<BLOCK_SIZE;t++) {
         if (sampbuf_sync.fifo.size()<2) {
-          n_samples=t;
+          n_raw=t;
           break;
         }
         sample_temp.real()=(sampbuf_sync.fifo.front())/128.0; // 127 should be 128?
         sampbuf_sync.fifo.pop_front();
         sample_temp.imag()=(sampbuf_sync.fifo.front())/128.0; // 127 should be 128?
         sampbuf_sync.fifo.pop_front();
-        samples(t)=sample_temp;
-        sample_time+=(FS_LTE/16)/(fs_programmed*k_factor);
-        //sample_time=itpp_ext::matlab_mod(sample_time,19200.0);
-        if (sample_time>19200.0)
-          sample_time-=19200.0;
-        samples_timestamp(t)=sample_time;
+        raw(t)=sample_temp;
       }
     }
+    cvec samples;
+    if (resampler) {
+      samples=resampler->push(raw.left(n_raw));
+    } else {
+      samples=raw.left(n_raw);
+    }
+    const uint32 n_samples=length(samples);
+    vec samples_timestamp(n_samples);
+    for (uint32 t=0;t<n_samples;t++) {
+      sample_count++;
+      samples_timestamp(t)=itpp_ext::matlab_mod(base_time+(sample_count-base_count)*sample_period,19200.0);
+    }
+
+    // Remove DC and IQ imbalance before the samples are passed to the
+    // searcher and the trackers.
+    if (n_samples) {
+      iq_corr.correct(samples);
+    }
 
-    // Handle the searcher capture buffer
+    // Handle the searcher ring buffer and the re-acquisition capture buffer
     for (uint32 t=0;t<n_samples;t++) {
-      if ((capbuf_sync.request)&&(abs(WRAP(samples_timestamp(t)-0,-19200.0/2,19200.0/2))<0.5)) {
-        //cout << "searcher data cap beginning" << samples_timestamp(t) << endl;
-        capbuf_sync.request=false;
-        searcher_capbuf_filling=true;
-        searcher_capbuf_idx=0;
-        capbuf_sync.late=WRAP(samples_timestamp(t)-0,-19200.0/2,19200.0/2);
-      }
+      complex <double> sample_dec;
+      if (!searcher_decimator.push(samples(t),sample_dec))
+        continue;
+      // Timestamp of the decimated sample, accounting for the delay
+      // of the decimation filter.
+      const double timestamp_dec=WRAP(samples_timestamp(t)-searcher_decimator.delay(),0.0,19200.0);
+      // Number of the input sample that corresponds to the decimated
+      // sample.
+      const uint64 sample_num_dec=sample_count-n_samples+t+1-searcher_decimator.delay()*oversample;
+
+      const uint32 ring_idx=capbuf_sync.n_written%SEARCH_RING_LENGTH;
+      capbuf_sync.ring(ring_idx)=sample_dec;
+      capbuf_sync.ring_timestamp(ring_idx)=timestamp_dec;
+      capbuf_sync.ring_sample_num[ring_idx]=sample_num_dec;
+      // The searcher copies out of the ring without the mutex, so the
+      // sample is only published once it has been written, and the next
+      // sample may only overwrite the ring once this one is published.
+      __atomic_store_n(&capbuf_sync.n_written,capbuf_sync.n_written+1,__ATOMIC_RELEASE);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
 
-      // Populate the capture buffer
-      if (searcher_capbuf_filling) {
-        capbuf_sync.capbuf(searcher_capbuf_idx++)=samples(t);
-        if (searcher_capbuf_idx==(unsigned)capbuf_sync.capbuf.size()) {
-          // Buffer is full. Signal the searcher thread.
-          searcher_capbuf_filling=false;
-          boost::mutex::scoped_lock lock(capbuf_sync.mutex);
-          capbuf_sync.condition.notify_one();
-          //cout << "searcher data cap finished" << endl;
+      // Populate the re-acquisition capture buffer.
+      if (reacq_sync.request) {
+        reacq_sync.request=false;
+        reacq_capbuf_filling=true;
+        reacq_capbuf_idx=0;
+        reacq_sync.timestamp=timestamp_dec;
+        reacq_sync.sample_num=sample_num_dec;
+      }
+      if (reacq_capbuf_filling) {
+        reacq_sync.capbuf(reacq_capbuf_idx++)=sample_dec;
+        if (reacq_capbuf_idx==(unsigned)reacq_sync.capbuf.size()) {
+          reacq_capbuf_filling=false;
+          boost::mutex::scoped_lock lock(reacq_sync.mutex);
+          reacq_sync.condition.notify_one();
         }
       }
     }
+    {
+      boost::mutex::scoped_lock capbuf_lock(capbuf_sync.mutex);
+      capbuf_sync.condition.notify_one();
+    }
 
     // Loop for each tracked cell and save data, if necessary. Also delete
     // threads that may have lost lock.
@@ -193,27 +393,31 @@ void producer_thread(
         }
         double frame_timing=tracked_cell.frame_timing();
 
-        cell_local_t & cl=cell_local[tracked_cell.n_id_cell];
+        // Stop tracking the cell if lock has been lost. The re-acquisition
+        // thread keeps looking for it for a while.
+        if (tracked_cell.kill_me) {
+          tracked_cell_t * temp=(*it);
+          it=tracked_cell_list.tracked_cells.erase(it);
+          temp->lost_sample_num=sample_count;
+          tracked_cell_list.lost_cells.push_back(temp);
+          cell_local.erase(temp->track_id);
+          continue;
+        }
 
         // Initialize local storage if necessary
-        if (tracked_cell.serial_num!=cl.serial_num) {
-          cl.serial_num=tracked_cell.serial_num;
+        map <uint32,cell_local_t>::iterator cli=cell_local.find(tracked_cell.track_id);
+        if (cli==cell_local.end()) {
+          cli=cell_local.insert(make_pair(tracked_cell.track_id,cell_local_t())).first;
+          cell_local_t & cl=(*cli).second;
           cl.pdu.slot_num=0;
           cl.pdu.sym_num=0;
           cl.target_cap_start_time=(tracked_cell.cp_type==cp_type_t::NORMAL)?10:32;
           cl.filling=false;
+          cl.first=true;
           cl.buffer_offset=0;
-          if (cl.serial_num==1)
-            cl.pdu.data.set_size(128);
-        }
-
-        // Delete the tracker if lock has been lost.
-        if (tracked_cell.kill_me) {
-          tracked_cell_t * temp=(*it);
-          it=tracked_cell_list.tracked_cells.erase(it);
-          delete temp;
-          continue;
+          cl.pdu.data.set_size(128*oversample);
         }
+        cell_local_t & cl=(*cli).second;
 
         // Loop for each sample in the buffer.
         for (uint32 t=0;t<n_samples;t++) {
@@ -222,7 +426,7 @@ void producer_thread(
             double tdiff=WRAP(samples_timestamp(t)-(frame_timing+cl.target_cap_start_time),-19200.0/2,19200.0/2);
             if (
               // Ideal start time is 0.5 samples away from current time
-              (abs(tdiff)<0.5) ||
+              (abs(tdiff)<0.5/oversample) ||
               // It's possible for the frame timing to change between iterations
               // of the outer loop and because of this, it's possible that
               // we missed the best start. Start capturing anyways.
@@ -232,10 +436,21 @@ void producer_thread(
               cl.filling=true;
               cl.pdu.late=tdiff;
               cl.buffer_offset=0;
-              // Record the frequency offset and frame timing as they were
-              // at the beginning of the capture.
+              // Record the frequency offset, k_factor, and frame timing as
+              // they were at the beginning of the capture.
               cl.pdu.frequency_offset=frequency_offset;
+              cl.pdu.k_factor=k_factor;
               cl.pdu.frame_timing=frame_timing;
+              // The searcher may have told us the SFN of one of the
+              // frames it captured. Work out the SFN of the first frame
+              // that will be sent to the tracker.
+              if (cl.first) {
+                cl.first=false;
+                if (tracked_cell.init_sfn>=0) {
+                  const int64 n_elapsed=(int64)(sample_count-n_samples+t+1-tracked_cell.init_sample_num);
+                  tracked_cell.sfn_first=mod(tracked_cell.init_sfn+round_i(n_elapsed*sample_period/19200),1024);
+                }
+              }
             }
           }
 
@@ -243,13 +458,14 @@ void producer_thread(
           // buffer.
           if (cl.filling) {
             cl.pdu.data(cl.buffer_offset++)=samples(t);
-            if (cl.buffer_offset==128) {
+            if (cl.buffer_offset==128*oversample) {
               // Buffer is full! Send PDU
-              {
-                boost::mutex::scoped_lock lock2(tracked_cell.fifo_mutex);
-                tracked_cell.fifo.push(cl.pdu);
-                tracked_cell.fifo_peak_size=MAX(tracked_cell.fifo.size(),tracked_cell.fifo_peak_size);
-                tracked_cell.fifo_condition.notify_one();
+              if (tracker_fd_sync==NULL) {
+                push_pdu(tracked_cell,cl.pdu);
+              } else {
+#ifdef USE_OPENCL
+                tracker_fd_enqueue(*tracker_fd_sync,tracked_cell,cl.pdu);
+#endif
               }
               //cout << "fifo size: " << tracked_cell.fifo.size() << endl;
               // Calculate trigger parameters of next capture
@@ -270,3 +486,33 @@ void producer_thread(
   }
 }
 
+// Process that takes samples and distributes them to the appropriate
+// process.
+void producer_thread(
+  sampbuf_sync_t & sampbuf_sync,
+  capbuf_sync_t & capbuf_sync,
+  reacq_sync_t & reacq_sync,
+  global_thread_data_t & global_thread_data,
+  tracked_cell_list_t & tracked_cell_list,
+  double & fc
+) {
+  global_thread_data.producer_thread_id=syscall(SYS_gettid);
+
+#ifdef USE_OPENCL
+  if (global_thread_data.tracker_opencl()) {
+    tracker_fd_sync_t tracker_fd_sync;
+    boost::thread tracker_fd_thr(tracker_fd_thread,boost::ref(tracker_fd_sync),boost::ref(global_thread_data));
+    try {
+      producer_helper(sampbuf_sync,capbuf_sync,reacq_sync,global_thread_data,tracked_cell_list,&tracker_fd_sync);
+    } catch (boost::thread_interrupted &) {
+      // Release the cells of the jobs that were never delivered.
+      tracker_fd_thr.interrupt();
+      tracker_fd_thr.join();
+      throw;
+    }
+    return;
+  }
+#endif
+  producer_helper(sampbuf_sync,capbuf_sync,reacq_sync,global_thread_data,tracked_cell_list,NULL);
+}
+
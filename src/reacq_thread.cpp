@@ -0,0 +1,197 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <list>
+#include <map>
+#include <queue>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "searcher.h"
+#include "dsp.h"
+#include "placement.h"
+#include "LTE-Tracker.h"
+
+using namespace itpp;
+using namespace std;
+
+bool reacq_detect(
+  // Inputs
+  tracked_cell_t & cell,
+  const SSS_td & sss_td,
+  const cvec & capbuf,
+  const double & timestamp,
+  const double & period,
+  // Outputs
+  double & frame_timing
+) {
+  const uint8 n_symb_dl=cell.n_symb_dl();
+  const uint16 distance=pss_sss_distance(cell.cp_type,cell.duplex_mode);
+  const uint16 sss_loc=(cell.duplex_mode==1)?sym_dft_offset(cell.cp_type,1,n_symb_dl-1):sym_dft_offset(cell.cp_type,0,n_symb_dl-2);
+
+  // frame_timing is 2 samples ahead of the true start of the frame.
+  const double ft=cell.frame_timing();
+  // Pick the half frame whose search window lies completely within the
+  // capture buffer.
+  const int32 span=distance+128+2*REACQ_WINDOW;
+  int32 start=-1;
+  uint8 half;
+  for (half=0;half<2;half++) {
+    const double t=itpp_ext::matlab_mod(ft+2+sss_loc+half*9600-REACQ_WINDOW-timestamp,19200.0);
+    start=round_i(t/period);
+    if (start+span<=length(capbuf))
+      break;
+  }
+  if (half==2)
+    return false;
+
+  // Search for the PSS and confirm the cell ID and the half frame using
+  // the SSS.
+  uint32 best_lag;
+  uint8 half_found;
+  double pss_xc;
+  if (!known_cell_detect(capbuf,cell.n_id_1,cell.n_id_2,cell.cp_type,cell.duplex_mode,sss_td,start+distance,2*REACQ_WINDOW+1,REACQ_THRESH,best_lag,half_found,pss_xc))
+    return false;
+  if (half_found!=half)
+    return false;
+
+  frame_timing=itpp_ext::matlab_mod(ft+((int32)best_lag-REACQ_WINDOW)*period,19200.0);
+  return true;
+}
+
+tracked_cell_t * reacq_resume(
+  tracked_cell_list_t & tracked_cell_list,
+  tracked_cell_t & lost_cell,
+  const bool & found,
+  const double & frame_timing
+) {
+  boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+  tracked_cell_list.lost_cells.remove(&lost_cell);
+  // The searcher may have started tracking the cell again while the lock
+  // was not held.
+  if ((!found)||(cell_is_tracked(tracked_cell_list,lost_cell.n_id_cell,frame_timing,lost_cell.frequency_offset()))) {
+    return NULL;
+  }
+  // Resume tracking with a new tracker thread.
+  tracked_cell_t * new_cell=new tracked_cell_t(
+    lost_cell.n_id_cell,
+    lost_cell.n_ports,
+    lost_cell.duplex_mode,
+    lost_cell.cp_type,
+    lost_cell.n_rb_dl,
+    lost_cell.phich_duration,
+    lost_cell.phich_resource,
+    frame_timing,
+    lost_cell.track_id,
+    lost_cell.n_rb_track,
+    lost_cell.freq_superfine
+  );
+  tracker_resume(*new_cell,lost_cell);
+  new_cell->frequency_offset(lost_cell.frequency_offset());
+  tracked_cell_list.tracked_cells.push_back(new_cell);
+  return new_cell;
+}
+
+// Process that tries to quickly find cells that were lost by their tracker
+// again. The searcher will also eventually find these cells but it needs
+// to perform a full search to do so.
+void reacq_thread(
+  reacq_sync_t & reacq_sync,
+  global_thread_data_t & global_thread_data,
+  tracked_cell_list_t & tracked_cell_list
+) {
+  global_thread_data.reacq_thread_id=syscall(SYS_gettid);
+  global_thread_data.placement.apply(thread_role_t::OTHER);
+
+  const double & fs_programmed=global_thread_data.fs_programmed;
+  const uint16 & oversample=global_thread_data.oversample;
+  const SSS_td sss_td;
+
+  while (true) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10*REACQ_PERIOD_FRAMES));
+
+    // Only the re-acquisition thread removes cells from the lost list so
+    // that the pointers remain valid after the mutex is released.
+    list <tracked_cell_t *> lost_cells;
+    {
+      boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+      lost_cells=tracked_cell_list.lost_cells;
+    }
+    if (lost_cells.empty())
+      continue;
+
+    // Request data.
+    {
+      boost::mutex::scoped_lock lock(reacq_sync.mutex);
+      reacq_sync.request=true;
+      reacq_sync.condition.wait(lock);
+    }
+
+    const double frequency_offset=global_thread_data.frequency_offset();
+    double k_factor;
+    if (global_thread_data.sampling_carrier_twist()) {
+      k_factor=(global_thread_data.fc_programmed-frequency_offset)/global_thread_data.fc_programmed;
+    } else {
+      k_factor=global_thread_data.k_factor();
+    }
+    const cvec capbuf=fshift(reacq_sync.capbuf,-frequency_offset,fs_programmed*k_factor);
+    // Timestamp units per captured sample.
+    const double period=(FS_LTE/16)/(fs_programmed*k_factor);
+
+    for (list <tracked_cell_t *>::iterator it=lost_cells.begin();it!=lost_cells.end();++it) {
+      tracked_cell_t * lost_cell=(*it);
+      // The tracker thread returns right after it sets kill_me.
+      lost_cell->thread.join();
+
+      const double age=(int64)(reacq_sync.sample_num-lost_cell->lost_sample_num)/(fs_programmed*oversample*k_factor);
+      bool tracked;
+      {
+        boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+        tracked=cell_is_tracked(tracked_cell_list,lost_cell->n_id_cell,lost_cell->frame_timing(),lost_cell->frequency_offset());
+      }
+
+      // Forget about cells that the searcher has already found again or
+      // that have been gone for too long.
+      double frame_timing=0;
+      bool found=false;
+      if ((!tracked)&&(age<REACQ_CACHE_TIME)) {
+        found=reacq_detect(*lost_cell,sss_td,capbuf,reacq_sync.timestamp,period,frame_timing);
+        if (!found)
+          continue;
+        if (verbosity>=2) {
+          cout << "Re-acquired cell " << lost_cell->n_id_cell << " after " << age << " s" << endl;
+        }
+      }
+
+      reacq_resume(tracked_cell_list,*lost_cell,found,frame_timing);
+      // The batching thread may still hold symbols of this cell.
+      lost_cell->wait_fd_jobs();
+      delete lost_cell;
+    }
+  }
+}
@@ -0,0 +1,108 @@
+// An OpenCL accelerated LTE Cell Scanner
+//
+// Written by Jiao Xianjun <putaoshu@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// kernels for the search stages that follow the PSS correlation
+// !!!This file should be put into $PATH directory or any other location where program can discover in runtime!!!
+
+#define PI_F 3.14159265358979f
+#define N_SSS 62  // remember to conform with main code
+#define N_ID_1 168  // remember to conform with main code
+
+// Batched 128 point DFTs. Row r is the DFT of the 128 samples of in that
+// start at start[r], after sample n has been rotated by phase0[r]+dphi*n.
+// Only the subcarriers -n_half..-1 and 1..n_half are returned, in that
+// order, and subcarrier k is rotated by -2*pi*late[r]*k/128 to compensate
+// for a DFT that was taken late[r] samples away from where it should have
+// been.
+__kernel void dft128( __global const float2* in,
+                      const int in_len,
+                      __global const int* start,
+                      __global const float* phase0,
+                      __global const float* late,
+                      const float dphi,
+                      const int n_half,
+                      __global float2* out
+                      )
+{// one work item per subcarrier (1st dim) of every row (2nd dim)
+  const int c = get_global_id(0);
+  const int r = get_global_id(1);
+  const int k = (c<n_half)?(c-n_half):(c-n_half+1);
+  const int s = start[r];
+  const float p0 = phase0[r];
+
+  float2 acc = (float2)(0.0f, 0.0f);
+  float cs, sn;
+  int n;
+  for (n=0; n<128; n++) {
+    if ((s+n<0)||(s+n>=in_len))
+      continue;
+    const float2 x = in[s+n];
+    // Reduce the twiddle index before it is converted to float.
+    const int tw = (k*n) & 127;
+    sn = sincos(p0 + dphi*n - 2.0f*PI_F*tw/128.0f, &cs);
+    acc = acc + (float2)( x.x*cs - x.y*sn, x.x*sn + x.y*cs );
+  }
+
+  sn = sincos(-2.0f*PI_F*late[r]*k/128.0f, &cs);
+  out[r*2*n_half + c] = (float2)( acc.x*cs - acc.y*sn, acc.x*sn + acc.y*cs );
+}
+
+// Log likelihood of every SSS hypothesis. est holds the received SSS of
+// both half frames assuming normal CP followed by the same assuming
+// extended CP, np_inv the inverse of the noise power of every subcarrier,
+// and sss_try the SSS of slot 0 and slot 10 for every n_id_2 and n_id_1.
+// out(cp,n_id_1,order) is the log likelihood for normal/extended CP and for
+// the 12/21 ordering of the half frames.
+__kernel void sss_ml( __global const float2* est,
+                      __global const float* np_inv,
+                      __global const float* sss_try,
+                      const int n_id_2,
+                      __global float* out
+                      )
+{// one work item per n_id_1 (1st dim) and ordering/CP (2nd dim)
+  const int t = get_global_id(0);
+  const int m = get_global_id(1);
+  const int order = m&1;
+  const int ext = m>>1;
+  __global const float2* e = est + ext*2*N_SSS;
+  __global const float* h = sss_try + (n_id_2*N_ID_1 + t)*2*N_SSS;
+
+  // Compensate for phase errors between the received and the tried
+  // sequences.
+  float2 xc = (float2)(0.0f, 0.0f);
+  int i;
+  for (i=0; i<2*N_SSS; i++) {
+    const float y = h[(i + order*N_SSS)%(2*N_SSS)];
+    xc = xc + (float2)( e[i].x*y, -e[i].y*y );
+  }
+  const float xc_abs = length(xc);
+  float cs = 1.0f;
+  float sn = 0.0f;
+  if (xc_abs>0.0f) {
+    cs = xc.x/xc_abs;
+    sn = xc.y/xc_abs;
+  }
+
+  float log_lik = 0.0f;
+  for (i=0; i<2*N_SSS; i++) {
+    const float y = h[(i + order*N_SSS)%(2*N_SSS)];
+    const float2 d = (float2)( y*cs - e[i].x, -y*sn - e[i].y );
+    log_lik = log_lik - (d.x*d.x + d.y*d.y)*np_inv[i];
+  }
+  out[(ext*N_ID_1 + t)*2 + order] = log_lik;
+}
+
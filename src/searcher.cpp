@@ -57,6 +57,7 @@
 #include <iomanip>
 #include <algorithm>
 #include <vector>
+#include <map>
 #include <boost/math/special_functions/gamma.hpp>
 #include <sys/time.h>
 #include <curses.h>
@@ -69,6 +70,7 @@
 #include "searcher.h"
 #include "filter_coef.h"
 #include "capbuf.h"
+#include "bigmem.h"
 
 #ifdef HAVE_RTLSDR
 #include "rtl-sdr.h"
@@ -196,23 +198,122 @@ device_id(device_id)
   filter_mchn_multi_filter = 0;
   filter_mchn_result_combine = 0;
 
+  // for sss_detect and extract_tfg
+  search_post_capbuf_length = 0;
+
+  search_post_in_host = 0;
+  search_post_out_host = 0;
+
+  search_post_in = 0;
+  search_post_start = 0;
+  search_post_phase0 = 0;
+  search_post_late = 0;
+  search_post_out = 0;
+  search_post_est = 0;
+  search_post_np_inv = 0;
+  search_post_sss_try = 0;
+  search_post_log_lik = 0;
+
+  search_post_dft128 = 0;
+  search_post_sss_ml = 0;
+
+  // for the FOC and DFT of the tracked symbols
+  tracker_fd_n_fft = 0;
+  tracker_fd_n_sc_max = 0;
+
+  tracker_fd_in_host = 0;
+  tracker_fd_out_host = 0;
+
+  tracker_fd_in = 0;
+  tracker_fd_dphi = 0;
+  tracker_fd_late = 0;
+  tracker_fd_n_half = 0;
+  tracker_fd_twiddle = 0;
+  tracker_fd_out = 0;
+
+  tracker_fd_foc = 0;
+  tracker_fd_dft = 0;
+
   setup_opencl();
 }
 
+// Read an OpenCL source file and build it for the devices of the context.
+// caller is the name of the setup function, for the error messages.
+cl_program lte_opencl_t::build_program(const std::string & kernels_filename, const std::string & caller)
+{
+  std::ifstream kernel_file;
+
+  kernel_file.open(kernels_filename.c_str());
+  if (!kernel_file.is_open())
+  {
+    cout << caller << ": open file failed! Please make sure program can find " << kernels_filename << "\n";
+    ABORT(-1);
+  }
+  std::filebuf* pbuf = kernel_file.rdbuf();
+
+  std::size_t size = pbuf->pubseekoff (0,kernel_file.end,kernel_file.in);
+  pbuf->pubseekpos (0,kernel_file.in);
+
+  char* buffer=new char[size+1];
+
+  // get file data
+  pbuf->sgetn(buffer,size);
+  buffer[size] = 0;
+  kernel_file.close();
+
+  int ret = 0;
+  const char* kernel_string[1] = {buffer};
+  cl_program program = clCreateProgramWithSource(context, 1, kernel_string, NULL, &ret);
+  delete [] buffer;
+  if (ret!=0) {
+    cout << caller << " clCreateProgramWithSource " << ret << "\n";
+    ABORT(-1);
+  }
+
+  ret = clBuildProgram(program, num_device, devices, NULL, NULL, NULL);
+  if (ret!=0) {
+    cout << "clBuildProgram " << ret << "\n";
+    char tmp_info[8192];
+    ret =  clGetProgramBuildInfo(program, devices[0], CL_PROGRAM_BUILD_LOG, 8192, tmp_info, NULL);
+    cout << tmp_info << "\n";
+    ABORT(-1);
+  }
+
+  return program;
+}
+
+bool opencl_device_present(
+  const uint & platform_id,
+  const uint & device_id
+) {
+  cl_uint n_platform=0;
+  if ((clGetPlatformIDs(0,NULL,&n_platform)!=0)||(platform_id>=n_platform))
+    return false;
+  cl_platform_id platforms[MAX_NUM_PLATFORM];
+  if (clGetPlatformIDs(MIN(n_platform,(cl_uint)MAX_NUM_PLATFORM),platforms,NULL)!=0)
+    return false;
+  if (platform_id>=MAX_NUM_PLATFORM)
+    return false;
+  cl_uint n_device=0;
+  if (clGetDeviceIDs(platforms[platform_id],CL_DEVICE_TYPE_ALL,0,NULL,&n_device)!=0)
+    return false;
+  return device_id<n_device;
+}
+
 #ifdef FILTER_MCHN_SIMPLE_KERNEL
 int lte_opencl_t::setup_filter_mchn(std::string filter_mchn_kernels_filename, const size_t & capbuf_length_in, const size_t & num_filter_in, const size_t & filter_length_in, const uint & xcorr_workitem_in)
 {
   // in case setup multiple times----------------------------------------
   if (filter_mchn_coef_host!=0) {
-    delete [] filter_mchn_coef_host;
+    bigmem_free(filter_mchn_coef_host);
     filter_mchn_coef_host = 0;
   }
   if (filter_mchn_in_host!=0) {
-    delete [] filter_mchn_in_host;
+    bigmem_free(filter_mchn_in_host);
     filter_mchn_in_host = 0;
   }
   if (filter_mchn_out_abs2_host!=0) {
-    delete [] filter_mchn_out_abs2_host;
+    bigmem_free(filter_mchn_out_abs2_host);
     filter_mchn_out_abs2_host = 0;
   }
 
@@ -245,48 +346,14 @@ int lte_opencl_t::setup_filter_mchn(std::string filter_mchn_kernels_filename, co
 
   filter_mchn_buf_out_len = filter_mchn_num_chn* ( filter_mchn_buf_in_len-filter_length_in+1 );
 
-  filter_mchn_in_host = new float[filter_mchn_buf_in_len*2]; // *2 for i&q
-  filter_mchn_out_abs2_host = new float[filter_mchn_buf_out_len];
-  filter_mchn_coef_host = new float[filter_mchn_buf_coef_len*2];
+  filter_mchn_in_host = (float *)bigmem_alloc(sizeof(float)*filter_mchn_buf_in_len*2, true); // *2 for i&q
+  filter_mchn_out_abs2_host = (float *)bigmem_alloc(sizeof(float)*filter_mchn_buf_out_len, true);
+  filter_mchn_coef_host = (float *)bigmem_alloc(sizeof(float)*filter_mchn_buf_coef_len*2, true);
 
   int ret = 0;
 
   // ---------------------------------------gen kernels---------------------
-  std::ifstream kernel_file;
-
-  kernel_file.open(filter_mchn_kernels_filename.c_str());
-  if (!kernel_file.is_open())
-  {
-    cout << "setup_filter_mchn: open file failed! Please make sure program can find " << filter_mchn_kernels_filename << "\n";
-    ABORT(-1);
-  }
-  std::filebuf* pbuf = kernel_file.rdbuf();
-
-  std::size_t size = pbuf->pubseekoff (0,kernel_file.end,kernel_file.in);
-  pbuf->pubseekpos (0,kernel_file.in);
-
-  char* buffer=new char[size];
-
-  // get file data
-  pbuf->sgetn(buffer,size-1);
-  buffer[size-1] = 0;
-  kernel_file.close();
-
-  const char* kernel_string[1] = {buffer};
-  cl_program program = clCreateProgramWithSource(context, 1, kernel_string, NULL, &ret);
-  if (ret!=0) {
-    cout << "setup_filter_mchn clCreateProgramWithSource " << ret << "\n";
-    ABORT(-1);
-  }
-
-  ret = clBuildProgram(program, num_device, devices, NULL, NULL, NULL);
-  if (ret!=0) {
-    cout << "clBuildProgram " << ret << "\n";
-    char tmp_info[8192];
-    ret =  clGetProgramBuildInfo(program, devices[0], CL_PROGRAM_BUILD_LOG, 8192, tmp_info, NULL);
-    cout << tmp_info << "\n";
-    ABORT(-1);
-  }
+  cl_program program = build_program(filter_mchn_kernels_filename, "setup_filter_mchn");
 
   filter_mchn_multi_filter = clCreateKernel(program, "multi_filter", &ret);
   if (ret!=0) {
@@ -294,7 +361,6 @@ int lte_opencl_t::setup_filter_mchn(std::string filter_mchn_kernels_filename, co
     ABORT(-1);
   }
 
-  delete [] buffer;
   // ---------------------------------------gen kernels---------------------
 
   // ---------------------------------gen buffers---------------------------
@@ -344,12 +410,12 @@ lte_opencl_t::~lte_opencl_t()
 {
   // for filter_my
   if (filter_my_in_host!=0) {
-    delete [] filter_my_in_host;
+    bigmem_free(filter_my_in_host);
     filter_my_in_host = 0;
   }
 
   if (filter_my_out_host!=0) {
-    delete [] filter_my_out_host;
+    bigmem_free(filter_my_out_host);
     filter_my_out_host = 0;
   }
 
@@ -387,15 +453,15 @@ lte_opencl_t::~lte_opencl_t()
 
   // for xcorr_pss
   if (filter_mchn_coef_host!=0) {
-    delete [] filter_mchn_coef_host;
+    bigmem_free(filter_mchn_coef_host);
     filter_mchn_coef_host = 0;
   }
   if (filter_mchn_in_host!=0) {
-    delete [] filter_mchn_in_host;
+    bigmem_free(filter_mchn_in_host);
     filter_mchn_in_host = 0;
   }
   if (filter_mchn_out_abs2_host!=0) {
-    delete [] filter_mchn_out_abs2_host;
+    bigmem_free(filter_mchn_out_abs2_host);
     filter_mchn_out_abs2_host = 0;
   }
 
@@ -418,6 +484,12 @@ lte_opencl_t::~lte_opencl_t()
     filter_mchn_multi_filter = 0;
   }
 
+  // for sss_detect and extract_tfg
+  release_search_post();
+
+  // for the FOC and DFT of the tracked symbols
+  release_tracker_fd();
+
   if (0!=cmdQueue)
   {
     clReleaseCommandQueue(cmdQueue);
@@ -515,15 +587,15 @@ int lte_opencl_t::setup_filter_mchn(std::string filter_mchn_kernels_filename, co
 {
   // in case setup multiple times----------------------------------------
   if (filter_mchn_coef_host!=0) {
-    delete [] filter_mchn_coef_host;
+    bigmem_free(filter_mchn_coef_host);
     filter_mchn_coef_host = 0;
   }
   if (filter_mchn_in_host!=0) {
-    delete [] filter_mchn_in_host;
+    bigmem_free(filter_mchn_in_host);
     filter_mchn_in_host = 0;
   }
   if (filter_mchn_out_abs2_host!=0) {
-    delete [] filter_mchn_out_abs2_host;
+    bigmem_free(filter_mchn_out_abs2_host);
     filter_mchn_out_abs2_host = 0;
   }
 
@@ -584,48 +656,14 @@ int lte_opencl_t::setup_filter_mchn(std::string filter_mchn_kernels_filename, co
 
   filter_mchn_buf_out_len = filter_mchn_num_chn* filter_mchn_buf_in_len;
 
-  filter_mchn_in_host = new float[filter_mchn_buf_in_len*2]; // *2 for i&q
-  filter_mchn_out_abs2_host = new float[filter_mchn_buf_out_len];
-  filter_mchn_coef_host = new float[filter_mchn_buf_coef_len*2];
+  filter_mchn_in_host = (float *)bigmem_alloc(sizeof(float)*filter_mchn_buf_in_len*2, true); // *2 for i&q
+  filter_mchn_out_abs2_host = (float *)bigmem_alloc(sizeof(float)*filter_mchn_buf_out_len, true);
+  filter_mchn_coef_host = (float *)bigmem_alloc(sizeof(float)*filter_mchn_buf_coef_len*2, true);
 
   int ret = 0;
 
   // ---------------------------------------gen kernels---------------------
-  std::ifstream kernel_file;
-
-  kernel_file.open(filter_mchn_kernels_filename.c_str());
-  if (!kernel_file.is_open())
-  {
-    cout << "setup_filter_mchn: open file failed! Please make sure program can find " << filter_mchn_kernels_filename << "\n";
-    ABORT(-1);
-  }
-  std::filebuf* pbuf = kernel_file.rdbuf();
-
-  std::size_t size = pbuf->pubseekoff (0,kernel_file.end,kernel_file.in);
-  pbuf->pubseekpos (0,kernel_file.in);
-
-  char* buffer=new char[size];
-
-  // get file data
-  pbuf->sgetn(buffer,size-1);
-  buffer[size-1] = 0;
-  kernel_file.close();
-
-  const char* kernel_string[1] = {buffer};
-  cl_program program = clCreateProgramWithSource(context, 1, kernel_string, NULL, &ret);
-  if (ret!=0) {
-    cout << "setup_filter_mchn clCreateProgramWithSource " << ret << "\n";
-    ABORT(-1);
-  }
-
-  ret = clBuildProgram(program, num_device, devices, NULL, NULL, NULL);
-  if (ret!=0) {
-    cout << "clBuildProgram " << ret << "\n";
-    char tmp_info[8192];
-    ret =  clGetProgramBuildInfo(program, devices[0], CL_PROGRAM_BUILD_LOG, 8192, tmp_info, NULL);
-    cout << tmp_info << "\n";
-    ABORT(-1);
-  }
+  cl_program program = build_program(filter_mchn_kernels_filename, "setup_filter_mchn");
 
   filter_mchn_skip2cols = clCreateKernel(program, "skip2cols", &ret);
   if (ret!=0) {
@@ -645,7 +683,6 @@ int lte_opencl_t::setup_filter_mchn(std::string filter_mchn_kernels_filename, co
     ABORT(-1);
   }
 
-  delete [] buffer;
   // ---------------------------------------gen kernels---------------------
 
   // ---------------------------------gen buffers---------------------------
@@ -774,12 +811,12 @@ lte_opencl_t::~lte_opencl_t()
 {
   // for filter_my
   if (filter_my_in_host!=0) {
-    delete [] filter_my_in_host;
+    bigmem_free(filter_my_in_host);
     filter_my_in_host = 0;
   }
 
   if (filter_my_out_host!=0) {
-    delete [] filter_my_out_host;
+    bigmem_free(filter_my_out_host);
     filter_my_out_host = 0;
   }
 
@@ -817,15 +854,15 @@ lte_opencl_t::~lte_opencl_t()
 
   // for xcorr_pss
   if (filter_mchn_coef_host!=0) {
-    delete [] filter_mchn_coef_host;
+    bigmem_free(filter_mchn_coef_host);
     filter_mchn_coef_host = 0;
   }
   if (filter_mchn_in_host!=0) {
-    delete [] filter_mchn_in_host;
+    bigmem_free(filter_mchn_in_host);
     filter_mchn_in_host = 0;
   }
   if (filter_mchn_out_abs2_host!=0) {
-    delete [] filter_mchn_out_abs2_host;
+    bigmem_free(filter_mchn_out_abs2_host);
     filter_mchn_out_abs2_host = 0;
   }
 
@@ -869,6 +906,11 @@ lte_opencl_t::~lte_opencl_t()
     filter_mchn_result_combine = 0;
   }
 
+  // for sss_detect and extract_tfg
+  release_search_post();
+
+  // for the FOC and DFT of the tracked symbols
+  release_tracker_fd();
 
   if (0!=cmdQueue)
   {
@@ -991,11 +1033,11 @@ int lte_opencl_t::setup_filter_my(std::string filter_my_kernels_filename, const
 {
   // in case setup multiple times----------------------------------------
   if (filter_my_in_host!=0) {
-    delete [] filter_my_in_host;
+    bigmem_free(filter_my_in_host);
     filter_my_in_host = 0;
   }
   if (filter_my_out_host!=0) {
-    delete [] filter_my_out_host;
+    bigmem_free(filter_my_out_host);
     filter_my_out_host = 0;
   }
 
@@ -1047,47 +1089,13 @@ int lte_opencl_t::setup_filter_my(std::string filter_my_kernels_filename, const
 
   filter_my_buf_out_len = filter_my_buf_in_len;
 
-  filter_my_in_host = new float[filter_my_buf_in_len*2]; // *2 for i&q
-  filter_my_out_host = new float[filter_my_buf_out_len*2];
+  filter_my_in_host = (float *)bigmem_alloc(sizeof(float)*filter_my_buf_in_len*2, true); // *2 for i&q
+  filter_my_out_host = (float *)bigmem_alloc(sizeof(float)*filter_my_buf_out_len*2, true);
 
   int ret = 0;
 
   // ---------------------------------------gen kernels---------------------
-  std::ifstream kernel_file;
-
-  kernel_file.open(filter_my_kernels_filename.c_str());
-  if (!kernel_file.is_open())
-  {
-    cout << "setup_filter_my: open file failed! Please make sure program can find " << filter_my_kernels_filename << "\n";
-    ABORT(-1);
-  }
-  std::filebuf* pbuf = kernel_file.rdbuf();
-
-  std::size_t size = pbuf->pubseekoff (0,kernel_file.end,kernel_file.in);
-  pbuf->pubseekpos (0,kernel_file.in);
-
-  char* buffer=new char[size];
-
-  // get file data
-  pbuf->sgetn(buffer,size-1);
-  buffer[size-1] = 0;
-  kernel_file.close();
-
-  const char* kernel_string[1] = {buffer};
-  cl_program program = clCreateProgramWithSource(context, 1, kernel_string, NULL, &ret);
-  if (ret!=0) {
-    cout << "setup_filter_my clCreateProgramWithSource " << ret << "\n";
-    ABORT(-1);
-  }
-
-  ret = clBuildProgram(program, num_device, devices, NULL, NULL, NULL);
-  if (ret!=0) {
-    cout << "clBuildProgram " << ret << "\n";
-    char tmp_info[8192];
-    ret =  clGetProgramBuildInfo(program, devices[0], CL_PROGRAM_BUILD_LOG, 8192, tmp_info, NULL);
-    cout << tmp_info << "\n";
-    ABORT(-1);
-  }
+  cl_program program = build_program(filter_my_kernels_filename, "setup_filter_my");
 
   filter_my_skip2cols = clCreateKernel(program, "skip2cols", &ret);
   if (ret!=0) {
@@ -1107,7 +1115,6 @@ int lte_opencl_t::setup_filter_my(std::string filter_my_kernels_filename, const
     ABORT(-1);
   }
 
-  delete [] buffer;
   // ---------------------------------------gen kernels---------------------
 
   // ---------------------------------gen buffers---------------------------
@@ -1261,108 +1268,577 @@ int lte_opencl_t::filter_my(cvec & capbuf)
   return(ret);
 }
 
-int lte_opencl_t::setup_opencl()
+void lte_opencl_t::release_search_post()
 {
-  int ret;
-  ret = clGetPlatformIDs(0, NULL, &num_platform);
+  if (search_post_in_host!=0) {
+    bigmem_free(search_post_in_host);
+    search_post_in_host = 0;
+  }
+  if (search_post_out_host!=0) {
+    bigmem_free(search_post_out_host);
+    search_post_out_host = 0;
+  }
+
+  cl_mem * bufs[] = {&search_post_in, &search_post_start, &search_post_phase0, &search_post_late, &search_post_out, &search_post_est, &search_post_np_inv, &search_post_sss_try, &search_post_log_lik};
+  for (uint i=0; i<sizeof(bufs)/sizeof(bufs[0]); i++) {
+    if (*bufs[i] != 0) {
+      clReleaseMemObject(*bufs[i]);
+      *bufs[i] = 0;
+    }
+  }
+
+  if (search_post_dft128 != 0) {
+    clReleaseKernel(search_post_dft128);
+    search_post_dft128 = 0;
+  }
+  if (search_post_sss_ml != 0) {
+    clReleaseKernel(search_post_sss_ml);
+    search_post_sss_ml = 0;
+  }
+}
+
+int lte_opencl_t::setup_search_post(std::string search_post_kernels_filename, const size_t & capbuf_length_in)
+{
+  // in case setup multiple times
+  release_search_post();
+
+  search_post_capbuf_length = capbuf_length_in;
+
+  search_post_in_host = (float *)bigmem_alloc(sizeof(float)*search_post_capbuf_length*2, true); // *2 for i&q
+  search_post_out_host = (float *)bigmem_alloc(sizeof(float)*SEARCH_POST_MAX_ROWS*2*SEARCH_POST_MAX_N_HALF*2, true);
+
+  int ret = 0;
+
+  // ---------------------------------------gen kernels---------------------
+  cl_program program = build_program(search_post_kernels_filename, "setup_search_post");
+
+  search_post_dft128 = clCreateKernel(program, "dft128", &ret);
   if (ret!=0) {
-    cout << "clGetPlatformIDs " << ret << "\n";
+    cout << "clCreateKernel search_post_dft128 " << ret << "\n";
     ABORT(-1);
-  }
-
-  cout << "OpenCL: number of platforms " << num_platform << "\n";
-  if ( num_platform > MAX_NUM_PLATFORM ) {
-    cout << "Warning! num_platform > MAX_NUM_PLATFORM! set num_platform to MAX_NUM_PLATFORM\n";
-    num_platform = MAX_NUM_PLATFORM;
   }
 
-  ret = clGetPlatformIDs(num_platform, platforms, NULL);
+  search_post_sss_ml = clCreateKernel(program, "sss_ml", &ret);
   if (ret!=0) {
-    cout << "clGetPlatformIDs " << ret << "\n";
+    cout << "clCreateKernel search_post_sss_ml " << ret << "\n";
     ABORT(-1);
   }
 
-  char info_return[1024];
-  cl_device_id tmp_devices[MAX_NUM_DEVICE];
+  // ---------------------------------------gen kernels---------------------
 
-  for (uint pidx=0; pidx<num_platform; pidx++) {
-    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_NAME, 1024, info_return, NULL);
+  // ---------------------------------gen buffers---------------------------
+  struct {
+    cl_mem * buf;
+    cl_mem_flags flags;
+    size_t size;
+    const char * name;
+  } bufs[] = {
+    {&search_post_in, CL_MEM_READ_ONLY, 2*sizeof(float)*search_post_capbuf_length, "search_post_in"},
+    {&search_post_start, CL_MEM_READ_ONLY, sizeof(cl_int)*SEARCH_POST_MAX_ROWS, "search_post_start"},
+    {&search_post_phase0, CL_MEM_READ_ONLY, sizeof(float)*SEARCH_POST_MAX_ROWS, "search_post_phase0"},
+    {&search_post_late, CL_MEM_READ_ONLY, sizeof(float)*SEARCH_POST_MAX_ROWS, "search_post_late"},
+    {&search_post_out, CL_MEM_WRITE_ONLY, 2*sizeof(float)*SEARCH_POST_MAX_ROWS*2*SEARCH_POST_MAX_N_HALF, "search_post_out"},
+    {&search_post_est, CL_MEM_READ_ONLY, 2*sizeof(float)*2*124, "search_post_est"},
+    {&search_post_np_inv, CL_MEM_READ_ONLY, sizeof(float)*124, "search_post_np_inv"},
+    {&search_post_sss_try, CL_MEM_READ_ONLY, sizeof(float)*3*168*124, "search_post_sss_try"},
+    {&search_post_log_lik, CL_MEM_WRITE_ONLY, sizeof(float)*2*168*2, "search_post_log_lik"}
+  };
+  for (uint i=0; i<sizeof(bufs)/sizeof(bufs[0]); i++) {
+    *bufs[i].buf = clCreateBuffer(context, bufs[i].flags, bufs[i].size, NULL, &ret);
     if (ret!=0) {
-      cout << "clGetPlatformInfo CL_PLATFORM_NAME " << ret << "\n";
+      cout << "clCreateBuffer " << bufs[i].name << " " << ret << "\n";
       ABORT(-1);
     }
-    if ( pidx==platform_id ) cout << "Platform " << pidx << " NAME: " << info_return << "\n";
+  }
 
-    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_VENDOR, 1024, info_return, NULL);
-    if (ret!=0) {
-      cout << "clGetPlatformInfo CL_PLATFORM_VENDOR " << ret << "\n";
-      ABORT(-1);
+  // The SSS of slot 0 followed by the SSS of slot 10 for every n_id_2 and
+  // n_id_1. These never change.
+  vector <float> sss_try_host(3*168*124);
+  for (uint8 n_id_2=0; n_id_2<3; n_id_2++) {
+    for (uint8 n_id_1=0; n_id_1<168; n_id_1++) {
+      const ivec sss_h1=ROM_TABLES.sss_fd(n_id_1,n_id_2,0);
+      const ivec sss_h2=ROM_TABLES.sss_fd(n_id_1,n_id_2,10);
+      for (uint8 i=0; i<62; i++) {
+        sss_try_host[(n_id_2*168+n_id_1)*124+i] = sss_h1(i);
+        sss_try_host[(n_id_2*168+n_id_1)*124+62+i] = sss_h2(i);
+      }
     }
-    DBG( cout << "Platform " << pidx << " VENDOR: " << info_return << "\n"; )
+  }
+  ret = clEnqueueWriteBuffer(cmdQueue, search_post_sss_try, CL_TRUE, 0, sizeof(float)*3*168*124, &sss_try_host[0], 0, NULL, NULL);
+  if (ret!=0) {
+    cout << "clEnqueueWriteBuffer search_post_sss_try " << ret << "\n";
+    ABORT(-1);
+  }
+  // ---------------------------------gen buffers---------------------------
 
-    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_VERSION, 1024, info_return, NULL);
+  // ------------------------------set buffers as kernel's args---------------------------
+  struct {
+    cl_kernel kernel;
+    cl_uint idx;
+    cl_mem * buf;
+    const char * name;
+  } args[] = {
+    {search_post_dft128, 0, &search_post_in, "search_post_dft128 0"},
+    {search_post_dft128, 2, &search_post_start, "search_post_dft128 2"},
+    {search_post_dft128, 3, &search_post_phase0, "search_post_dft128 3"},
+    {search_post_dft128, 4, &search_post_late, "search_post_dft128 4"},
+    {search_post_dft128, 7, &search_post_out, "search_post_dft128 7"},
+    {search_post_sss_ml, 0, &search_post_est, "search_post_sss_ml 0"},
+    {search_post_sss_ml, 1, &search_post_np_inv, "search_post_sss_ml 1"},
+    {search_post_sss_ml, 2, &search_post_sss_try, "search_post_sss_ml 2"},
+    {search_post_sss_ml, 4, &search_post_log_lik, "search_post_sss_ml 4"}
+  };
+  for (uint i=0; i<sizeof(args)/sizeof(args[0]); i++) {
+    ret = clSetKernelArg(args[i].kernel, args[i].idx, sizeof(cl_mem), args[i].buf);
     if (ret!=0) {
-      cout << "clGetPlatformInfo CL_PLATFORM_VERSION " << ret << "\n";
+      cout << "clSetKernelArg " << args[i].name << " " << ret << "\n";
       ABORT(-1);
     }
-    DBG( cout << "Platform " << pidx << " VERSION: " << info_return << "\n"; )
+  }
+  // ------------------------------set buffers as kernel's args---------------------------
 
-    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_PROFILE, 1024, info_return, NULL);
-    if (ret!=0) {
-      cout << "clGetPlatformInfo CL_PLATFORM_PROFILE " << ret << "\n";
-      ABORT(-1);
-    }
-    if ( pidx==platform_id ) cout << "Platform " << pidx << " PROFILE: " << info_return << "\n";
+  clReleaseProgram(program);
 
-    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_EXTENSIONS, 1024, info_return, NULL);
-    if (ret!=0) {
-      cout << "clGetPlatformInfo CL_PLATFORM_EXTENSIONS " << ret << "\n";
-      ABORT(-1);
-    }
-    DBG( cout << "Platform " << pidx << " EXTENSIONS: " << info_return << "\n"; )
+  return(ret);
+}
 
-    cl_uint numDevices;
-    ret = clGetDeviceIDs(platforms[pidx], CL_DEVICE_TYPE_ALL, 0, NULL, &numDevices);
-    if (ret!=0) {
-      cout << "clGetDeviceIDs " << ret << "\n";
-      ABORT(-1);
-    }
-    if ( pidx==platform_id ) cout << "OpenCL: number of devices " << numDevices << "\n";
+bool lte_opencl_t::search_post_ready(const size_t & capbuf_length) const
+{
+  return (search_post_dft128!=0)&&(capbuf_length<=search_post_capbuf_length);
+}
 
-    ret = clGetDeviceIDs(platforms[pidx], CL_DEVICE_TYPE_ALL, numDevices, tmp_devices, NULL);
-    if (ret!=0) {
-      cout << "clGetDeviceIDs " << ret << "\n";
-      ABORT(-1);
-    }
+int lte_opencl_t::dft128(const cvec & capbuf, const ivec & start, const vec & phase0, const vec & late, const double & dphi, const uint16 & n_half, cmat & dft_out)
+{
+  int ret = 0;
 
-    if (pidx == platform_id) {
-      context = clCreateContext(NULL, numDevices, tmp_devices, NULL, NULL, &ret);
-      if (ret!=0) {
-        cout << "clCreateContext " << ret << "\n";
-        ABORT(-1);
-      }
+  const cl_int in_len = length(capbuf);
+  const size_t n_rows = length(start);
+  if (((size_t)in_len>search_post_capbuf_length)||(n_rows>SEARCH_POST_MAX_ROWS)||(n_half>SEARCH_POST_MAX_N_HALF)) {
+    cout << "dft128: batch does not fit the buffers of setup_search_post\n";
+    ABORT(-1);
+  }
 
-      for (uint didx=0; didx<numDevices; didx++) {
-        devices[didx] = tmp_devices[didx];
-        if (didx == device_id) {
-          cmdQueue = clCreateCommandQueue(context, tmp_devices[didx], CL_QUEUE_PROFILING_ENABLE, &ret);
-          if (ret!=0) {
-            cout << "clCreateCommandQueue " << ret << "\n";
-            ABORT(-1);
-          }
-        }
-      }
-      num_device = numDevices;
-    }
+  for (cl_int i=0; i<in_len; i++) {
+    search_post_in_host[2*i+0] = real( capbuf(i) );
+    search_post_in_host[2*i+1] = imag( capbuf(i) );
+  }
+  cl_int start_host[SEARCH_POST_MAX_ROWS];
+  float phase0_host[SEARCH_POST_MAX_ROWS];
+  float late_host[SEARCH_POST_MAX_ROWS];
+  for (size_t r=0; r<n_rows; r++) {
+    start_host[r] = start(r);
+    // Large phases would lose their precision in single precision.
+    phase0_host[r] = fmod( phase0(r), 2*pi );
+    late_host[r] = late(r);
+  }
+  const float dphi_host = dphi;
+  const cl_int n_half_host = n_half;
 
-    // display devices info of all platforms
-    for (uint didx=0; didx<numDevices; didx++) {
-      ret = clGetDeviceInfo( tmp_devices[didx], CL_DEVICE_NAME,	1024, info_return, NULL);
-      if (ret!=0) {
-        cout << "clGetDeviceInfo CL_DEVICE_NAME " << ret << "\n";
-        ABORT(-1);
-      }
-      if ( pidx==platform_id && didx==device_id ) cout << "Platform " << pidx<< " Device " << didx << " NAME: " << info_return << "\n";
+  ret = clSetKernelArg(search_post_dft128, 1, sizeof(cl_int), &in_len);
+  ret |= clSetKernelArg(search_post_dft128, 5, sizeof(float), &dphi_host);
+  ret |= clSetKernelArg(search_post_dft128, 6, sizeof(cl_int), &n_half_host);
+  if (ret!=0) {
+    cout << "clSetKernelArg search_post_dft128 " << ret << "\n";
+    ABORT(-1);
+  }
+
+  cl_event write_done[4];
+  ret = clEnqueueWriteBuffer(cmdQueue, search_post_in, CL_FALSE, 0, 2*in_len*sizeof(float), search_post_in_host, 0, NULL, &(write_done[0]));
+  ret |= clEnqueueWriteBuffer(cmdQueue, search_post_start, CL_FALSE, 0, n_rows*sizeof(cl_int), start_host, 0, NULL, &(write_done[1]));
+  ret |= clEnqueueWriteBuffer(cmdQueue, search_post_phase0, CL_FALSE, 0, n_rows*sizeof(float), phase0_host, 0, NULL, &(write_done[2]));
+  ret |= clEnqueueWriteBuffer(cmdQueue, search_post_late, CL_FALSE, 0, n_rows*sizeof(float), late_host, 0, NULL, &(write_done[3]));
+  if (ret!=0) {
+    cout << "clEnqueueWriteBuffer search_post_dft128 " << ret << "\n";
+    ABORT(-1);
+  }
+
+  size_t global_work_size[2] = {2*(size_t)n_half, n_rows};
+  cl_event dft128_done;
+  ret = clEnqueueNDRangeKernel(cmdQueue, search_post_dft128, 2, NULL, global_work_size, NULL, 4, write_done, &dft128_done);
+  if (ret!=0) {
+    cout << "clEnqueueNDRangeKernel search_post_dft128 " << ret << "\n";
+    ABORT(-1);
+  }
+
+  ret = clEnqueueReadBuffer(cmdQueue, search_post_out, CL_FALSE, 0, 2*n_rows*2*n_half*sizeof(float), search_post_out_host, 1, &dft128_done, NULL);
+  if (ret!=0) {
+    cout << "clEnqueueReadBuffer search_post_out " << ret << "\n";
+    ABORT(-1);
+  }
+  clFinish(cmdQueue);
+  for (uint8 i=0; i<4; i++) {
+    clReleaseEvent(write_done[i]);
+  }
+  clReleaseEvent(dft128_done);
+
+  dft_out.set_size(n_rows,2*n_half);
+  for (size_t r=0; r<n_rows; r++) {
+    for (uint16 c=0; c<2*n_half; c++) {
+      const size_t idx = r*2*n_half + c;
+      dft_out(r,c) = complex <double>( search_post_out_host[2*idx+0], search_post_out_host[2*idx+1] );
+    }
+  }
+
+  return(ret);
+}
+
+int lte_opencl_t::sss_ml(const uint8 & n_id_2, const vec & sss_h12_np_est, const cvec & sss_h12_nrm_est, const cvec & sss_h12_ext_est, mat & log_lik_nrm, mat & log_lik_ext)
+{
+  int ret = 0;
+
+  float est_host[2*2*124];
+  float np_inv_host[124];
+  float log_lik_host[2*168*2];
+  for (uint8 i=0; i<124; i++) {
+    est_host[2*i+0] = real( sss_h12_nrm_est(i) );
+    est_host[2*i+1] = imag( sss_h12_nrm_est(i) );
+    est_host[2*(124+i)+0] = real( sss_h12_ext_est(i) );
+    est_host[2*(124+i)+1] = imag( sss_h12_ext_est(i) );
+    np_inv_host[i] = 1.0/sss_h12_np_est(i);
+  }
+  const cl_int n_id_2_host = n_id_2;
+
+  ret = clSetKernelArg(search_post_sss_ml, 3, sizeof(cl_int), &n_id_2_host);
+  if (ret!=0) {
+    cout << "clSetKernelArg search_post_sss_ml 3 " << ret << "\n";
+    ABORT(-1);
+  }
+
+  cl_event write_done[2];
+  ret = clEnqueueWriteBuffer(cmdQueue, search_post_est, CL_FALSE, 0, sizeof(est_host), est_host, 0, NULL, &(write_done[0]));
+  ret |= clEnqueueWriteBuffer(cmdQueue, search_post_np_inv, CL_FALSE, 0, sizeof(np_inv_host), np_inv_host, 0, NULL, &(write_done[1]));
+  if (ret!=0) {
+    cout << "clEnqueueWriteBuffer search_post_sss_ml " << ret << "\n";
+    ABORT(-1);
+  }
+
+  size_t global_work_size[2] = {168, 4};
+  cl_event sss_ml_done;
+  ret = clEnqueueNDRangeKernel(cmdQueue, search_post_sss_ml, 2, NULL, global_work_size, NULL, 2, write_done, &sss_ml_done);
+  if (ret!=0) {
+    cout << "clEnqueueNDRangeKernel search_post_sss_ml " << ret << "\n";
+    ABORT(-1);
+  }
+
+  ret = clEnqueueReadBuffer(cmdQueue, search_post_log_lik, CL_FALSE, 0, sizeof(log_lik_host), log_lik_host, 1, &sss_ml_done, NULL);
+  if (ret!=0) {
+    cout << "clEnqueueReadBuffer search_post_log_lik " << ret << "\n";
+    ABORT(-1);
+  }
+  clFinish(cmdQueue);
+  clReleaseEvent(write_done[0]);
+  clReleaseEvent(write_done[1]);
+  clReleaseEvent(sss_ml_done);
+
+  log_lik_nrm.set_size(168,2);
+  log_lik_ext.set_size(168,2);
+  for (uint8 t=0; t<168; t++) {
+    for (uint8 m=0; m<2; m++) {
+      log_lik_nrm(t,m) = log_lik_host[t*2+m];
+      log_lik_ext(t,m) = log_lik_host[(168+t)*2+m];
+    }
+  }
+
+  return(ret);
+}
+
+void lte_opencl_t::release_tracker_fd()
+{
+  if (tracker_fd_in_host!=0) {
+    bigmem_free(tracker_fd_in_host);
+    tracker_fd_in_host = 0;
+  }
+  if (tracker_fd_out_host!=0) {
+    bigmem_free(tracker_fd_out_host);
+    tracker_fd_out_host = 0;
+  }
+
+  cl_mem * bufs[] = {&tracker_fd_in, &tracker_fd_dphi, &tracker_fd_late, &tracker_fd_n_half, &tracker_fd_twiddle, &tracker_fd_out};
+  for (uint i=0; i<sizeof(bufs)/sizeof(bufs[0]); i++) {
+    if (*bufs[i] != 0) {
+      clReleaseMemObject(*bufs[i]);
+      *bufs[i] = 0;
+    }
+  }
+
+  if (tracker_fd_foc != 0) {
+    clReleaseKernel(tracker_fd_foc);
+    tracker_fd_foc = 0;
+  }
+  if (tracker_fd_dft != 0) {
+    clReleaseKernel(tracker_fd_dft);
+    tracker_fd_dft = 0;
+  }
+}
+
+int lte_opencl_t::setup_tracker_fd(std::string tracker_fd_kernels_filename, const uint16 & n_fft_in, const uint16 & n_sc_max_in)
+{
+  // in case setup multiple times
+  release_tracker_fd();
+
+  tracker_fd_n_fft = n_fft_in;
+  tracker_fd_n_sc_max = n_sc_max_in;
+
+  tracker_fd_in_host = (float *)bigmem_alloc(sizeof(float)*TRACKER_FD_MAX_ROWS*tracker_fd_n_fft*2, true); // *2 for i&q
+  tracker_fd_out_host = (float *)bigmem_alloc(sizeof(float)*TRACKER_FD_MAX_ROWS*tracker_fd_n_sc_max*2, true);
+
+  int ret = 0;
+
+  // ---------------------------------------gen kernels---------------------
+  cl_program program = build_program(tracker_fd_kernels_filename, "setup_tracker_fd");
+
+  tracker_fd_foc = clCreateKernel(program, "tracker_foc", &ret);
+  if (ret!=0) {
+    cout << "clCreateKernel tracker_fd_foc " << ret << "\n";
+    ABORT(-1);
+  }
+
+  tracker_fd_dft = clCreateKernel(program, "tracker_dft", &ret);
+  if (ret!=0) {
+    cout << "clCreateKernel tracker_fd_dft " << ret << "\n";
+    ABORT(-1);
+  }
+
+  // ---------------------------------------gen kernels---------------------
+
+  // ---------------------------------gen buffers---------------------------
+  struct {
+    cl_mem * buf;
+    cl_mem_flags flags;
+    size_t size;
+    const char * name;
+  } bufs[] = {
+    {&tracker_fd_in, CL_MEM_READ_WRITE, 2*sizeof(float)*TRACKER_FD_MAX_ROWS*tracker_fd_n_fft, "tracker_fd_in"},
+    {&tracker_fd_dphi, CL_MEM_READ_ONLY, sizeof(float)*TRACKER_FD_MAX_ROWS, "tracker_fd_dphi"},
+    {&tracker_fd_late, CL_MEM_READ_ONLY, sizeof(float)*TRACKER_FD_MAX_ROWS, "tracker_fd_late"},
+    {&tracker_fd_n_half, CL_MEM_READ_ONLY, sizeof(cl_int)*TRACKER_FD_MAX_ROWS, "tracker_fd_n_half"},
+    {&tracker_fd_twiddle, CL_MEM_READ_ONLY, 2*sizeof(float)*tracker_fd_n_fft, "tracker_fd_twiddle"},
+    {&tracker_fd_out, CL_MEM_WRITE_ONLY, 2*sizeof(float)*TRACKER_FD_MAX_ROWS*tracker_fd_n_sc_max, "tracker_fd_out"}
+  };
+  for (uint i=0; i<sizeof(bufs)/sizeof(bufs[0]); i++) {
+    *bufs[i].buf = clCreateBuffer(context, bufs[i].flags, bufs[i].size, NULL, &ret);
+    if (ret!=0) {
+      cout << "clCreateBuffer " << bufs[i].name << " " << ret << "\n";
+      ABORT(-1);
+    }
+  }
+  // The twiddle factors of the DFT only depend on n_fft.
+  float * twiddle_host = new float[2*tracker_fd_n_fft];
+  for (uint16 m=0; m<tracker_fd_n_fft; m++) {
+    twiddle_host[2*m+0] = cos(-2*pi*m/tracker_fd_n_fft);
+    twiddle_host[2*m+1] = sin(-2*pi*m/tracker_fd_n_fft);
+  }
+  ret = clEnqueueWriteBuffer(cmdQueue, tracker_fd_twiddle, CL_TRUE, 0, 2*tracker_fd_n_fft*sizeof(float), twiddle_host, 0, NULL, NULL);
+  delete [] twiddle_host;
+  if (ret!=0) {
+    cout << "clEnqueueWriteBuffer tracker_fd_twiddle " << ret << "\n";
+    ABORT(-1);
+  }
+  // ---------------------------------gen buffers---------------------------
+
+  // ------------------------------set buffers as kernel's args---------------------------
+  ret = clSetKernelArg(tracker_fd_foc, 0, sizeof(cl_mem), &tracker_fd_in);
+  ret |= clSetKernelArg(tracker_fd_foc, 1, sizeof(cl_mem), &tracker_fd_dphi);
+  if (ret!=0) {
+    cout << "clSetKernelArg tracker_fd_foc " << ret << "\n";
+    ABORT(-1);
+  }
+
+  const cl_int n_fft_host = tracker_fd_n_fft;
+  ret = clSetKernelArg(tracker_fd_dft, 0, sizeof(cl_mem), &tracker_fd_in);
+  ret |= clSetKernelArg(tracker_fd_dft, 1, sizeof(cl_int), &n_fft_host);
+  ret |= clSetKernelArg(tracker_fd_dft, 2, sizeof(cl_mem), &tracker_fd_twiddle);
+  ret |= clSetKernelArg(tracker_fd_dft, 3, sizeof(cl_mem), &tracker_fd_late);
+  ret |= clSetKernelArg(tracker_fd_dft, 4, sizeof(cl_mem), &tracker_fd_n_half);
+  ret |= clSetKernelArg(tracker_fd_dft, 5, sizeof(cl_mem), &tracker_fd_out);
+  if (ret!=0) {
+    cout << "clSetKernelArg tracker_fd_dft " << ret << "\n";
+    ABORT(-1);
+  }
+  // ------------------------------set buffers as kernel's args---------------------------
+
+  clReleaseProgram(program);
+
+  return(ret);
+}
+
+int lte_opencl_t::tracker_fd(const cmat & data, const vec & dphi, const vec & late, const ivec & n_half, cmat & syms)
+{
+  int ret = 0;
+
+  const size_t n_rows = data.rows();
+  if ((tracker_fd_dft==0)||(n_rows>TRACKER_FD_MAX_ROWS)||(data.cols()!=tracker_fd_n_fft)||(2*max(n_half)>tracker_fd_n_sc_max)) {
+    cout << "tracker_fd: batch does not fit the buffers of setup_tracker_fd\n";
+    ABORT(-1);
+  }
+
+  for (size_t r=0; r<n_rows; r++) {
+    for (uint16 n=0; n<tracker_fd_n_fft; n++) {
+      const size_t idx = r*tracker_fd_n_fft + n;
+      tracker_fd_in_host[2*idx+0] = real( data(r,n) );
+      tracker_fd_in_host[2*idx+1] = imag( data(r,n) );
+    }
+  }
+  float dphi_host[TRACKER_FD_MAX_ROWS];
+  float late_host[TRACKER_FD_MAX_ROWS];
+  cl_int n_half_host[TRACKER_FD_MAX_ROWS];
+  for (size_t r=0; r<n_rows; r++) {
+    dphi_host[r] = dphi(r);
+    late_host[r] = late(r);
+    n_half_host[r] = n_half(r);
+  }
+
+  cl_event write_done[4];
+  ret = clEnqueueWriteBuffer(cmdQueue, tracker_fd_in, CL_FALSE, 0, 2*n_rows*tracker_fd_n_fft*sizeof(float), tracker_fd_in_host, 0, NULL, &(write_done[0]));
+  ret |= clEnqueueWriteBuffer(cmdQueue, tracker_fd_dphi, CL_FALSE, 0, n_rows*sizeof(float), dphi_host, 0, NULL, &(write_done[1]));
+  ret |= clEnqueueWriteBuffer(cmdQueue, tracker_fd_late, CL_FALSE, 0, n_rows*sizeof(float), late_host, 0, NULL, &(write_done[2]));
+  ret |= clEnqueueWriteBuffer(cmdQueue, tracker_fd_n_half, CL_FALSE, 0, n_rows*sizeof(cl_int), n_half_host, 0, NULL, &(write_done[3]));
+  if (ret!=0) {
+    cout << "clEnqueueWriteBuffer tracker_fd_dft " << ret << "\n";
+    ABORT(-1);
+  }
+
+  size_t foc_work_size[2] = {tracker_fd_n_fft, n_rows};
+  cl_event foc_done;
+  ret = clEnqueueNDRangeKernel(cmdQueue, tracker_fd_foc, 2, NULL, foc_work_size, NULL, 4, write_done, &foc_done);
+  if (ret!=0) {
+    cout << "clEnqueueNDRangeKernel tracker_fd_foc " << ret << "\n";
+    ABORT(-1);
+  }
+
+  size_t global_work_size[2] = {tracker_fd_n_sc_max, n_rows};
+  cl_event dft_done;
+  ret = clEnqueueNDRangeKernel(cmdQueue, tracker_fd_dft, 2, NULL, global_work_size, NULL, 1, &foc_done, &dft_done);
+  if (ret!=0) {
+    cout << "clEnqueueNDRangeKernel tracker_fd_dft " << ret << "\n";
+    ABORT(-1);
+  }
+
+  ret = clEnqueueReadBuffer(cmdQueue, tracker_fd_out, CL_FALSE, 0, 2*n_rows*tracker_fd_n_sc_max*sizeof(float), tracker_fd_out_host, 1, &dft_done, NULL);
+  if (ret!=0) {
+    cout << "clEnqueueReadBuffer tracker_fd_out " << ret << "\n";
+    ABORT(-1);
+  }
+  clFinish(cmdQueue);
+  for (uint8 i=0; i<4; i++) {
+    clReleaseEvent(write_done[i]);
+  }
+  clReleaseEvent(foc_done);
+  clReleaseEvent(dft_done);
+
+  syms.set_size(n_rows,tracker_fd_n_sc_max);
+  for (size_t r=0; r<n_rows; r++) {
+    for (uint16 c=0; c<tracker_fd_n_sc_max; c++) {
+      const size_t idx = r*tracker_fd_n_sc_max + c;
+      syms(r,c) = complex <double>( tracker_fd_out_host[2*idx+0], tracker_fd_out_host[2*idx+1] );
+    }
+  }
+
+  return(ret);
+}
+
+int lte_opencl_t::setup_opencl()
+{
+  int ret;
+  ret = clGetPlatformIDs(0, NULL, &num_platform);
+  if (ret!=0) {
+    cout << "clGetPlatformIDs " << ret << "\n";
+    ABORT(-1);
+  }
+
+  cout << "OpenCL: number of platforms " << num_platform << "\n";
+  if ( num_platform > MAX_NUM_PLATFORM ) {
+    cout << "Warning! num_platform > MAX_NUM_PLATFORM! set num_platform to MAX_NUM_PLATFORM\n";
+    num_platform = MAX_NUM_PLATFORM;
+  }
+
+  ret = clGetPlatformIDs(num_platform, platforms, NULL);
+  if (ret!=0) {
+    cout << "clGetPlatformIDs " << ret << "\n";
+    ABORT(-1);
+  }
+
+  char info_return[1024];
+  cl_device_id tmp_devices[MAX_NUM_DEVICE];
+
+  for (uint pidx=0; pidx<num_platform; pidx++) {
+    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_NAME, 1024, info_return, NULL);
+    if (ret!=0) {
+      cout << "clGetPlatformInfo CL_PLATFORM_NAME " << ret << "\n";
+      ABORT(-1);
+    }
+    if ( pidx==platform_id ) cout << "Platform " << pidx << " NAME: " << info_return << "\n";
+
+    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_VENDOR, 1024, info_return, NULL);
+    if (ret!=0) {
+      cout << "clGetPlatformInfo CL_PLATFORM_VENDOR " << ret << "\n";
+      ABORT(-1);
+    }
+    DBG( cout << "Platform " << pidx << " VENDOR: " << info_return << "\n"; )
+
+    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_VERSION, 1024, info_return, NULL);
+    if (ret!=0) {
+      cout << "clGetPlatformInfo CL_PLATFORM_VERSION " << ret << "\n";
+      ABORT(-1);
+    }
+    DBG( cout << "Platform " << pidx << " VERSION: " << info_return << "\n"; )
+
+    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_PROFILE, 1024, info_return, NULL);
+    if (ret!=0) {
+      cout << "clGetPlatformInfo CL_PLATFORM_PROFILE " << ret << "\n";
+      ABORT(-1);
+    }
+    if ( pidx==platform_id ) cout << "Platform " << pidx << " PROFILE: " << info_return << "\n";
+
+    ret = clGetPlatformInfo( platforms[pidx], CL_PLATFORM_EXTENSIONS, 1024, info_return, NULL);
+    if (ret!=0) {
+      cout << "clGetPlatformInfo CL_PLATFORM_EXTENSIONS " << ret << "\n";
+      ABORT(-1);
+    }
+    DBG( cout << "Platform " << pidx << " EXTENSIONS: " << info_return << "\n"; )
+
+    cl_uint numDevices;
+    ret = clGetDeviceIDs(platforms[pidx], CL_DEVICE_TYPE_ALL, 0, NULL, &numDevices);
+    if (ret!=0) {
+      cout << "clGetDeviceIDs " << ret << "\n";
+      ABORT(-1);
+    }
+    if ( pidx==platform_id ) cout << "OpenCL: number of devices " << numDevices << "\n";
+
+    ret = clGetDeviceIDs(platforms[pidx], CL_DEVICE_TYPE_ALL, numDevices, tmp_devices, NULL);
+    if (ret!=0) {
+      cout << "clGetDeviceIDs " << ret << "\n";
+      ABORT(-1);
+    }
+
+    if (pidx == platform_id) {
+      context = clCreateContext(NULL, numDevices, tmp_devices, NULL, NULL, &ret);
+      if (ret!=0) {
+        cout << "clCreateContext " << ret << "\n";
+        ABORT(-1);
+      }
+
+      for (uint didx=0; didx<numDevices; didx++) {
+        devices[didx] = tmp_devices[didx];
+        if (didx == device_id) {
+          cmdQueue = clCreateCommandQueue(context, tmp_devices[didx], CL_QUEUE_PROFILING_ENABLE, &ret);
+          if (ret!=0) {
+            cout << "clCreateCommandQueue " << ret << "\n";
+            ABORT(-1);
+          }
+        }
+      }
+      num_device = numDevices;
+    }
+
+    // display devices info of all platforms
+    for (uint didx=0; didx<numDevices; didx++) {
+      ret = clGetDeviceInfo( tmp_devices[didx], CL_DEVICE_NAME,	1024, info_return, NULL);
+      if (ret!=0) {
+        cout << "clGetDeviceInfo CL_DEVICE_NAME " << ret << "\n";
+        ABORT(-1);
+      }
+      if ( pidx==platform_id && didx==device_id ) cout << "Platform " << pidx<< " Device " << didx << " NAME: " << info_return << "\n";
 
       ret = clGetDeviceInfo( tmp_devices[didx], CL_DEVICE_VENDOR,	1024, info_return, NULL);
       if (ret!=0) {
@@ -1686,23 +2162,21 @@ void sp_est(
 // be aligned with a spacing of 19200 samples and thus it is possible
 // to determine boht that the true downlink center frequency is 740MHz and
 // that the frequency error of the local oscillator is 0Hz.
+//
+// Every row of xc may use a different k_factor. The start index of every
+// half frame is computed once per row.
 void xc_combine(
   // Inputs
   const cvec & capbuf,
 //  const vcf3d & xc,
   const vector <mat> & xc,
-  const double & fc_requested,
-  const double & fc_programmed,
   const double & fs_programmed,
-  const vec & f_search_set,
+  const vec & k_factor_set,
   // Outputs
   vector <mat>  & xc_incoherent_single,
-  uint16 & n_comb_xc,
-  // end of Outpus
-  const bool & sampling_carrier_twist,
-  const double k_factor_in
+  uint16 & n_comb_xc
 ) {
-  const uint16 n_f=f_search_set.length();
+  const uint16 n_f=k_factor_set.length();
 //  n_comb_xc=floor_i((xc[0].size()-100)/9600);
   n_comb_xc=floor_i((xc[0].cols()-100)/9600);
 
@@ -1715,15 +2189,16 @@ void xc_combine(
   xc_incoherent_single[0].set_size(n_f, 9600);
   xc_incoherent_single[1].set_size(n_f, 9600);
   xc_incoherent_single[2].set_size(n_f, 9600);
-  double k_factor;
+  ivec start_index(n_comb_xc);
   for (uint16 foi=0;foi<n_f;foi++) {
     // Combine incoherently
-    const double f_off=f_search_set[foi];
-    if (sampling_carrier_twist) {
-//        k_factor=(fc_requested-f_off)/fc_programmed;
-        k_factor=(fc_programmed-f_off)/fc_programmed;
-    } else {
-        k_factor = k_factor_in;
+    // Because of the large supported frequency offsets and the large
+    // amount of time represented by the capture buffer, the length
+    // in samples, of a frame varies by the frequency offset.
+    for (uint16 m=0;m<n_comb_xc;m++) {
+      //double actual_time_offset=m*.005*k_factor;
+      //double actual_start_index=itpp::round_i(actual_time_offset*FS_LTE/16);
+      start_index(m)=itpp::round_i(m*.005*k_factor_set(foi)*fs_programmed);
     }
 
     for (uint8 t=0;t<3;t++) {
@@ -1732,12 +2207,7 @@ void xc_combine(
 //      }
       xc_incoherent_single[t].set_row(foi, zeros(9600));
       for (uint16 m=0;m<n_comb_xc;m++) {
-        // Because of the large supported frequency offsets and the large
-        // amount of time represented by the capture buffer, the length
-        // in samples, of a frame varies by the frequency offset.
-        //double actual_time_offset=m*.005*k_factor;
-        //double actual_start_index=itpp::round_i(actual_time_offset*FS_LTE/16);
-        double actual_start_index=itpp::round_i(m*.005*k_factor*fs_programmed);
+        const int32 actual_start_index=start_index(m);
         for (uint16 idx=0;idx<9600;idx++) {
 //          xc_incoherent_single[t][idx][foi]+=sqr(xc[t][idx+actual_start_index][foi]);
           xc_incoherent_single[t](foi,idx)+=xc[t](foi, idx+actual_start_index);
@@ -1887,7 +2357,7 @@ void normalize(
 //  for( uint32 i=0; i<len; i++){
 //    acc = acc + real(s(i)*conj(s(i)));
 //  }
-  double acc = sum( real(elem_mult(s, conj(s))) );
+  double acc = cvec_simd::power(s._data(),len);
   s = sqrt(len)*s/sqrt(acc);
 }
 
@@ -1986,6 +2456,7 @@ void pss_fix_location_corr(
 
   vec tmp(num_fo_pss);
   mat corr_store(end_position-start_position+1, num_fo_pss);
+  bigmem_advise(corr_store);
   corr_store.zeros();
   cvec chn_tmp(len_pss);
 
@@ -2036,6 +2507,7 @@ void pss_moving_corr(
   uint32 len = length(s);
   uint32 len_half_store = 64;
   mat corr_store(2*len_half_store+1, num_fo_pss);
+  bigmem_advise(corr_store);
   corr_store.zeros();
 
 //  hit_pss_fo_set_idx.set_length(0,false);
@@ -2178,12 +2650,63 @@ void conv_capbuf_with_pss(
   const uint16 len_pss = pss_fo_set.cols();
   const uint16 num_fo_pss = pss_fo_set.rows();
 
-  cvec tmp(num_fo_pss);
-  cvec chn_tmp(len_pss);
+  // Each column of the transpose is one of the PSS sequences so that
+  // the correlations can be performed directly on the memory of s.
+  const cmat pss_fo_set_t=pss_fo_set.transpose();
+  const complex <double> * pss_p=pss_fo_set_t._data();
+  const complex <double> * s_p=s._data();
   for(uint32 i=0; i<(len - (len_pss-1)); i++) {
-    chn_tmp = s(i, (i+len_pss-1));
-    tmp = pss_fo_set*chn_tmp;
-    corr_store.set_col(i, real( elem_mult( tmp,conj(tmp) )) );
+    for (uint16 j=0; j<num_fo_pss; j++) {
+      corr_store(j,i) = norm(cvec_simd::dot(pss_p+j*len_pss, s_p+i, len_pss));
+    }
+  }
+}
+
+void pss_fo_set_fft_gen(
+  // Inputs
+  const cmat & pss_fo_set,
+  const uint16 & n_fft,
+  // Output
+  cmat & pss_fo_set_fft
+) {
+  ASSERT(n_fft>pss_fo_set.cols());
+  pss_fo_set_fft.set_size(pss_fo_set.rows(),n_fft,false);
+  for (int32 j=0;j<pss_fo_set.rows();j++) {
+    pss_fo_set_fft.set_row(j,fft(reverse(pss_fo_set.get_row(j)),n_fft));
+  }
+}
+
+void conv_capbuf_with_pss_fft(
+  // Inputs
+  const cvec & s,
+  const cmat & pss_fo_set_fft,
+  const uint16 & len_pss,
+  // Output
+  mat & corr_store
+) {
+  const uint32 len = length(s);
+  const uint16 n_fft = pss_fo_set_fft.cols();
+  const uint16 num_fo_pss = pss_fo_set_fft.rows();
+  // Every block of n_fft input samples produces this many correlations.
+  // The first len_pss-1 outputs of every block are wrapped around and
+  // are discarded.
+  const uint16 n_valid = n_fft-(len_pss-1);
+  const uint32 n_corr = len-(len_pss-1);
+
+  cvec block(n_fft);
+  for (uint32 first=0; first<n_corr; first+=n_valid) {
+    const uint32 n_in=MIN((uint32)n_fft,len-first);
+    const uint32 n_out=n_in-(len_pss-1);
+    block.set_subvector(0,s.mid(first,n_in));
+    if (n_in<n_fft)
+      block.set_subvector(n_in,zeros_c(n_fft-n_in));
+    const cvec block_fd=fft(block);
+    for (uint16 j=0; j<num_fo_pss; j++) {
+      const cvec y=ifft(elem_mult(block_fd,pss_fo_set_fft.get_row(j)));
+      for (uint32 i=0; i<n_out; i++) {
+        corr_store(j,first+i) = norm(y(i+len_pss-1));
+      }
+    }
   }
 }
 
@@ -2243,6 +2766,8 @@ void sampling_ppm_f_search_set_by_pss(
   const uint16 num_pss = 3;
 
   mat corr_store(num_fo_pss, len_short);
+  // The correlation results are the largest buffers in the searcher.
+  bigmem_advise(corr_store);
 //  mat corr_store_sub(num_fo_pss/num_loop, len_short);
 
   static Real_Timer tt;
@@ -2272,9 +2797,12 @@ void sampling_ppm_f_search_set_by_pss(
 
     n_f = num_fo_orig;
 
+    for (uint16 t=0; t<num_pss; t++) {
+      xc[t].set_size(n_f, len_short);
+      bigmem_advise(xc[t]);
+    }
     for (uint16 foi=0; foi<n_f; foi++) {
       for (uint16 t=0; t<num_pss; t++) {
-        xc[t].set_size(n_f, len_short);
         col_idx = t*num_fo_orig + foi;
         xc[t].set_row(foi, corr_store.get_row(col_idx));
       }
@@ -2464,9 +2992,12 @@ void sampling_ppm_f_search_set_by_pss(
   fo_idx_set.set_length(real_count, true);
 
   n_f = real_count;
+  for (uint16 t=0; t<num_pss; t++) {
+    xc[t].set_size(n_f, len_short);
+    bigmem_advise(xc[t]);
+  }
   for (uint16 foi=0; foi<n_f; foi++) {
     for (uint16 t=0; t<num_pss; t++) {
-      xc[t].set_size(n_f, len_short);
       col_idx = t*num_fo_orig + fo_idx_set[foi];
       xc[t].set_row(foi, corr_store.get_row(col_idx));
     }
@@ -2477,6 +3008,27 @@ void sampling_ppm_f_search_set_by_pss(
   DBG( cout << "Hit     FO idx " << fo_idx_set << "\n"; )
 }
 
+// k_factor of each frequency offset hypothesis. In twisted mode, the
+// k_factor follows from the frequency offset.
+vec k_factor_per_fo(
+  const vec & f_search_set,
+  const double & fc_programmed,
+  const bool & sampling_carrier_twist,
+  const double k_factor
+) {
+  const uint16 n_f=length(f_search_set);
+  vec k_factor_set(n_f);
+  for (uint16 foi=0;foi<n_f;foi++) {
+    if (sampling_carrier_twist) {
+//      k_factor_set(foi)=(fc_requested-f_search_set(foi))/fc_programmed;
+      k_factor_set(foi)=(fc_programmed-f_search_set(foi))/fc_programmed;
+    } else {
+      k_factor_set(foi)=k_factor;
+    }
+  }
+  return k_factor_set;
+}
+
 // Correlate the received signal against all possible PSS and all possible
 // frequency offsets.
 // This is the main function that calls all of the previously declared
@@ -2504,11 +3056,38 @@ void xcorr_pss(
   const bool & sampling_carrier_twist,
   const double k_factor
 ) {
+  const vec k_factor_set=k_factor_per_fo(f_search_set,fc_programmed,sampling_carrier_twist,k_factor);
+  xcorr_pss(capbuf,f_search_set,k_factor_set,ds_comb_arm,fc_requested,fc_programmed,fs_programmed,xc,xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,xc_incoherent_single,xc_incoherent,sp_incoherent,sp,n_comb_xc,n_comb_sp);
+}
+
+void xcorr_pss(
+  // Inputs
+  const cvec & capbuf,
+  const vec & f_search_set,
+  const vec & k_factor_set,
+  const uint8 & ds_comb_arm,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  const vector <mat> & xc,
+  // Outputs
+  mat & xc_incoherent_collapsed_pow,
+  imat & xc_incoherent_collapsed_frq,
+  // Following used only for debugging...
+  vector <mat>  & xc_incoherent_single,
+  vector <mat>  & xc_incoherent,
+  vec & sp_incoherent,
+  vec & sp,
+  uint16 & n_comb_xc,
+  uint16 & n_comb_sp
+) {
+  ASSERT(length(f_search_set)==length(k_factor_set));
+  ASSERT(xc[0].rows()==length(k_factor_set));
   // Perform correlations
 //  xc_correlate(capbuf,f_search_set,fc_requested,fc_programmed,fs_programmed,sampling_carrier_twist,k_factor,xc);
 //  xc_correlate_new(capbuf,f_search_set,pss_fo_set,xc);
   // Incoherently combine correlations
-  xc_combine(capbuf,xc,fc_requested,fc_programmed,fs_programmed,f_search_set,xc_incoherent_single,n_comb_xc,sampling_carrier_twist,k_factor);
+  xc_combine(capbuf,xc,fs_programmed,k_factor_set,xc_incoherent_single,n_comb_xc);
   // Combine according to delay spread
   xc_delay_spread(xc_incoherent_single,ds_comb_arm,xc_incoherent);
   // Estimate received signal power
@@ -2532,6 +3111,24 @@ void peak_search(
   const double k_factor,
   // Outputs
   list <Cell> & cells
+) {
+  const vec k_factor_set=k_factor_per_fo(f_search_set,fc_programmed,sampling_carrier_twist,k_factor);
+  peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,f_search_set,k_factor_set,fc_requested,fc_programmed,xc_incoherent_single,ds_comb_arm,cells);
+}
+
+void peak_search(
+  // Inputs
+  const mat & xc_incoherent_collapsed_pow,
+  const imat & xc_incoherent_collapsed_frq,
+  const vec & Z_th1,
+  const vec & f_search_set,
+  const vec & k_factor_set,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const vector <mat> & xc_incoherent_single,
+  const uint8 & ds_comb_arm,
+  // Outputs
+  list <Cell> & cells
 ) {
   // Create local copy we can write to and destroy.
   mat xc_incoherent_working=xc_incoherent_collapsed_pow;
@@ -2575,14 +3172,7 @@ void peak_search(
     cell.ind=best_ind;
     cell.freq=f_search_set(xc_incoherent_collapsed_frq(peak_n_id_2,peak_ind));
     cell.n_id_2=peak_n_id_2;
-
-    if (sampling_carrier_twist) {
-//      cell.k_factor = (fc_requested-cell.freq)/fc_programmed;
-      cell.k_factor = (fc_programmed-cell.freq)/fc_programmed;
-    }
-    else {
-      cell.k_factor = k_factor;
-    }
+    cell.k_factor=k_factor_set(xc_incoherent_collapsed_frq(peak_n_id_2,peak_ind));
 
     cells.push_back(cell); // for tdd test
     cells.push_back(cell); // for fdd test
@@ -2621,6 +3211,130 @@ void peak_search(
   }
 }
 
+void reject_image_peaks(
+  // Inputs
+  const double & freq_correction,
+  // Inputs&Outputs
+  list <Cell> & cells
+) {
+  list <Cell>::iterator it=cells.begin();
+  while (it!=cells.end()) {
+    // The image is created by the receiver, so the frequency is mirrored
+    // around the DC of the raw samples. The captured samples were shifted
+    // by -freq_correction, which moves the DC to -freq_correction.
+    const double f_bb=(*it).freq+freq_correction;
+    // The image of a PSS is its conjugate. Only the roots of n_id_2 1 and
+    // 2 (29 and 34) are conjugates of each other. The conjugate of the
+    // root of n_id_2 0 (25) is root 38, which is not a PSS, so the image
+    // of an n_id_2 0 cell is never detected as a PSS.
+    const int8 n_id_2_image=3-(*it).n_id_2;
+    bool is_image=false;
+    // A peak close to DC is its own image.
+    if (((*it).n_id_2!=0)&&(fabs(f_bb)>IQ_IMAGE_F_TOL)) {
+      for (list <Cell>::const_iterator ref=cells.begin();ref!=cells.end();ref++) {
+        if ((*ref).n_id_2!=n_id_2_image)
+          continue;
+        if ((*ref).pss_pow*udb10(-IQ_IMAGE_MARGIN_DB)<(*it).pss_pow)
+          continue;
+        const int32 dt=itpp_ext::matlab_mod((*ref).ind-(*it).ind,9600);
+        if (
+          (fabs((*ref).freq+freq_correction+f_bb)<=IQ_IMAGE_F_TOL)&&
+          (MIN(dt,9600-dt)<=IQ_IMAGE_T_TOL)
+        ) {
+          is_image=true;
+          break;
+        }
+      }
+    }
+    if (is_image) {
+      if (verbosity>=2) {
+        cout << "  Rejecting image peak at " << (*it).freq/1e3 << " kHz n_id_2 " << (int)(*it).n_id_2 << endl;
+      }
+      it=cells.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+uint16 sym_dft_offset(
+  const cp_type_t::cp_type_t & cp_type,
+  const uint8 & slot_num,
+  const uint8 & sym_num
+) {
+  if (cp_type==cp_type_t::NORMAL) {
+    return slot_num*960+10+sym_num*137;
+  } else {
+    return slot_num*960+32+sym_num*160;
+  }
+}
+
+// Normalized correlation between the last 128 samples of a known
+// sequence and the received samples.
+static double norm_xc(
+  const cvec & ref,
+  const complex <double> * x
+) {
+  const complex <double> * r=ref._data()+length(ref)-128;
+  const double p_ref=cvec_simd::power(r,128);
+  const double p_x=cvec_simd::power(x,128);
+  return sqr(cvec_simd::cdot(r,x,128))/MAX(p_ref*p_x,1e-30);
+}
+
+uint16 pss_sss_distance(
+  const cp_type_t::cp_type_t & cp_type,
+  const int8 & duplex_mode
+) {
+  const uint8 n_symb_dl=(cp_type==cp_type_t::NORMAL)?7:6;
+  if (duplex_mode==1) {
+    return sym_dft_offset(cp_type,2,2)-sym_dft_offset(cp_type,1,n_symb_dl-1);
+  } else {
+    return sym_dft_offset(cp_type,0,n_symb_dl-1)-sym_dft_offset(cp_type,0,n_symb_dl-2);
+  }
+}
+
+bool known_cell_detect(
+  // Inputs
+  const cvec & capbuf,
+  const int16 & n_id_1,
+  const int8 & n_id_2,
+  const cp_type_t::cp_type_t & cp_type,
+  const int8 & duplex_mode,
+  const SSS_td & sss_td,
+  const uint32 & pss_start,
+  const uint32 & n_lag,
+  const double & thresh,
+  // Outputs
+  uint32 & pss_lag,
+  uint8 & half,
+  double & pss_xc
+) {
+  const uint16 distance=pss_sss_distance(cp_type,duplex_mode);
+  if ((pss_start<distance)||(pss_start+n_lag-1+128>(unsigned)length(capbuf)))
+    return false;
+
+  // Search for the PSS.
+  const cvec & pss=ROM_TABLES.pss_td[n_id_2];
+  pss_xc=-1;
+  pss_lag=0;
+  for (uint32 lag=0;lag<n_lag;lag++) {
+    const double xc=norm_xc(pss,capbuf._data()+pss_start+lag);
+    if (xc>pss_xc) {
+      pss_xc=xc;
+      pss_lag=lag;
+    }
+  }
+  if (pss_xc<thresh)
+    return false;
+
+  // Confirm the cell ID and find the half frame using the SSS.
+  const complex <double> * sss_p=capbuf._data()+pss_start+pss_lag-distance;
+  const double xc_0=norm_xc(sss_td(n_id_1,n_id_2,0),sss_p);
+  const double xc_1=norm_xc(sss_td(n_id_1,n_id_2,10),sss_p);
+  half=(xc_1>xc_0)?1:0;
+  return MAX(xc_0,xc_1)>=thresh;
+}
+
 // Simple helper function to perform FOC and return only the subcarriers
 // occupied by the PSS or SSS.
 //
@@ -2641,9 +3355,11 @@ inline cvec extract_psss(
   return concat(dft_out.right(31),dft_out.mid(1,31));
 }
 
-// Perform channel estimation and extract the SSS subcarriers.
+// Perform channel estimation and extract the SSS subcarriers. The DFTs are
+// performed on lte_ocl unless it is NULL.
 void sss_detect_getce_sss(
   // Inputs
+  lte_opencl_t * lte_ocl,
   const Cell & cell,
   const cvec & capbuf,
   const double & fc_requested,
@@ -2696,25 +3412,50 @@ void sss_detect_getce_sss(
   // access to an SSS.
   vec pss_loc_set=itpp_ext::matlab_range(peak_loc,k_factor*9600,(double)capbuf.length()-125-9);
   uint16 n_pss=length(pss_loc_set);
+  ivec pss_dft_location(n_pss);
+  for (uint16 k=0;k<n_pss;k++) {
+    pss_dft_location(k)=itpp::round_i(pss_loc_set(k))+9-2;
+  }
   vec pss_np(n_pss);
+  cmat pss_raw(n_pss,62);
   cmat h_raw(n_pss,62);
   cmat h_sm(n_pss,62);
   cmat sss_nrm_raw(n_pss,62);
   cmat sss_ext_raw(n_pss,62);
 #ifndef NDEBUG
   pss_np=NAN;
+  pss_raw=NAN;
   h_raw=NAN;
   h_sm=NAN;
   sss_nrm_raw=NAN;
   sss_ext_raw=NAN;
 #endif
 
-  for (uint16 k=0;k<n_pss;k++) {
-    uint32 pss_loc=itpp::round_i(pss_loc_set(k));
-    uint32 pss_dft_location=pss_loc+9-2;
+  // Extract the PSS and the SSS assuming extended and normal CP.
+  bool on_device=false;
+#ifdef USE_OPENCL
+  if (lte_ocl!=NULL) {
+    // All the DFTs are performed in one batch. The 2 sample time offset is
+    // removed by compensating for DFTs that were taken 2 samples early.
+    cmat dft_out;
+    lte_ocl->dft128(capbuf,concat(pss_dft_location,pss_dft_location-sss_ext_offset,pss_dft_location-sss_nrm_offset),zeros(3*n_pss),-2*ones(3*n_pss),2*pi*(-peak_freq)/(fs_programmed*k_factor),31,dft_out);
+    pss_raw=dft_out.get_rows(0,n_pss-1);
+    sss_ext_raw=dft_out.get_rows(n_pss,2*n_pss-1);
+    sss_nrm_raw=dft_out.get_rows(2*n_pss,3*n_pss-1);
+    on_device=true;
+  }
+#endif
+  if (!on_device) {
+    for (uint16 k=0;k<n_pss;k++) {
+      pss_raw.set_row(k,extract_psss(capbuf.mid(pss_dft_location(k),128),-peak_freq,k_factor,fs_programmed));
+      sss_ext_raw.set_row(k,extract_psss(capbuf.mid(pss_dft_location(k)-sss_ext_offset,128),-peak_freq,k_factor,fs_programmed));
+      sss_nrm_raw.set_row(k,extract_psss(capbuf.mid(pss_dft_location(k)-sss_nrm_offset,128),-peak_freq,k_factor,fs_programmed));
+    }
+  }
 
+  for (uint16 k=0;k<n_pss;k++) {
     // Calculate channel response
-    h_raw.set_row(k,elem_mult(extract_psss(capbuf.mid(pss_dft_location,128),-peak_freq,k_factor,fs_programmed),conj(ROM_TABLES.pss_fd[n_id_2_est])));
+    h_raw.set_row(k,elem_mult(pss_raw.get_row(k),conj(ROM_TABLES.pss_fd[n_id_2_est])));
     // Basic smoothing. Average nearest 6 subcarriers.
     for (uint8 t=0;t<62;t++) {
       uint8 lt=MAX(0,t-6);
@@ -2724,14 +3465,6 @@ void sss_detect_getce_sss(
 
     // Estimate noise power
     pss_np(k)=sigpower(h_sm.get_row(k)-h_raw.get_row(k));
-
-    // Calculate SSS in the frequency domain for extended and normal CP
-    uint32 sss_dft_location=0;
-    sss_dft_location=pss_dft_location-sss_ext_offset;
-    sss_ext_raw.set_row(k,extract_psss(capbuf.mid(sss_dft_location,128),-peak_freq,k_factor,fs_programmed));
-
-    sss_dft_location=pss_dft_location-sss_nrm_offset;
-    sss_nrm_raw.set_row(k,extract_psss(capbuf.mid(sss_dft_location,128),-peak_freq,k_factor,fs_programmed));
   }
 
   // Combine results from different slots
@@ -2778,7 +3511,7 @@ double sss_detect_ml_helper(
   cvec sss_h12_try(to_cvec(sss_h12_try_orig));
 
   // Compensate for phase errors between the est and try sequences
-  double ang=arg(sum(elem_mult(conj(sss_h12_est),sss_h12_try)));
+  double ang=arg(cvec_simd::cdot(sss_h12_est._data(),sss_h12_try._data(),length(sss_h12_est)));
   sss_h12_try*=exp(J*-ang);
 
   // Calculate the log likelihood
@@ -2788,9 +3521,11 @@ double sss_detect_ml_helper(
   return log_lik;
 }
 
-// Perform maximum likelihood detection on the combined SSS signals.
+// Perform maximum likelihood detection on the combined SSS signals. The
+// detection is performed on lte_ocl unless it is NULL.
 void sss_detect_ml(
   // Inputs
+  lte_opencl_t * lte_ocl,
   const Cell & cell,
   const vec & sss_h1_np_est,
   const vec & sss_h2_np_est,
@@ -2812,6 +3547,12 @@ void sss_detect_ml(
   vec sss_h12_np_est=concat(sss_h1_np_est,sss_h2_np_est);
   cvec sss_h12_nrm_est=concat(sss_h1_nrm_est,sss_h2_nrm_est);
   cvec sss_h12_ext_est=concat(sss_h1_ext_est,sss_h2_ext_est);
+#ifdef USE_OPENCL
+  if (lte_ocl!=NULL) {
+    lte_ocl->sss_ml(cell.n_id_2,sss_h12_np_est,sss_h12_nrm_est,sss_h12_ext_est,log_lik_nrm,log_lik_ext);
+    return;
+  }
+#endif
   for (uint8 t=0;t<168;t++) {
     // Construct the SSS sequence that will be compared against the
     // received sequence.
@@ -2829,9 +3570,11 @@ void sss_detect_ml(
   }
 }
 
-// Detect the SSS, if present
-Cell sss_detect(
+// Detect the SSS, if present. The DFTs and the detection are performed on
+// lte_ocl unless it is NULL.
+static Cell sss_detect_helper(
   // Inputs
+  lte_opencl_t * lte_ocl,
   const Cell & cell,
   const cvec & capbuf,
   const double & thresh2_n_sigma,
@@ -2852,9 +3595,9 @@ Cell sss_detect(
 ) {
   double k_factor;
   // Get the channel estimates and extract the raw SSS subcarriers
-  sss_detect_getce_sss(cell,capbuf,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,sampling_carrier_twist,tdd_flag);
+  sss_detect_getce_sss(lte_ocl,cell,capbuf,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,sampling_carrier_twist,tdd_flag);
   // Perform maximum likelihood detection
-  sss_detect_ml(cell,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,log_lik_nrm,log_lik_ext);
+  sss_detect_ml(lte_ocl,cell,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,log_lik_nrm,log_lik_ext);
 
   // Determine normal/ extended CP
   mat log_lik;
@@ -2917,7 +3660,59 @@ Cell sss_detect(
     cell_out.duplex_mode=tdd_flag;
   }
 
-  return cell_out;
+  return cell_out;
+}
+
+Cell sss_detect(
+  // Inputs
+  const Cell & cell,
+  const cvec & capbuf,
+  const double & thresh2_n_sigma,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  // Only used for testing...
+  vec & sss_h1_np_est,
+  vec & sss_h2_np_est,
+  cvec & sss_h1_nrm_est,
+  cvec & sss_h2_nrm_est,
+  cvec & sss_h1_ext_est,
+  cvec & sss_h2_ext_est,
+  mat & log_lik_nrm,
+  mat & log_lik_ext,
+  const bool & sampling_carrier_twist,
+  const int & tdd_flag
+) {
+  return sss_detect_helper(NULL,cell,capbuf,thresh2_n_sigma,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
+}
+
+Cell sss_detect(
+  // Inputs
+  lte_opencl_t & lte_ocl,
+  const Cell & cell,
+  const cvec & capbuf,
+  const double & thresh2_n_sigma,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  // Only used for testing...
+  vec & sss_h1_np_est,
+  vec & sss_h2_np_est,
+  cvec & sss_h1_nrm_est,
+  cvec & sss_h2_nrm_est,
+  cvec & sss_h1_ext_est,
+  cvec & sss_h2_ext_est,
+  mat & log_lik_nrm,
+  mat & log_lik_ext,
+  const bool & sampling_carrier_twist,
+  const int & tdd_flag
+) {
+  lte_opencl_t * device=NULL;
+#ifdef USE_OPENCL
+  if (lte_ocl.search_post_ready(length(capbuf)))
+    device=&lte_ocl;
+#endif
+  return sss_detect_helper(device,cell,capbuf,thresh2_n_sigma,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
 }
 
 double refine_fo(
@@ -2951,9 +3746,7 @@ double refine_fo(
   double k_factor_tmp, pss_from_frame_start, pss_sp, corr_tmp;
   uint16 pss_count;
   uint32 pss_idx;
-  cvec chn_tmp(len_pss);
   cvec pss_fo(len_pss);
-  cvec tmp_val(1);
 
   vec corr_val(4);
   for (uint16 i=0; i<4; i++) {
@@ -2977,19 +3770,13 @@ double refine_fo(
     while ( (pss_sp+len_pss+1)<=(len-1)  ) {
       pss_idx = round_i(pss_sp);
 
-      chn_tmp = capbuf(pss_idx, (pss_idx+len_pss-1));
-      tmp_val = sum(elem_mult(chn_tmp, pss_fo));
-      corr_tmp = real( tmp_val*conj(tmp_val) );
+      corr_tmp = norm(cvec_simd::dot(capbuf._data()+pss_idx, pss_fo._data(), len_pss));
       corr_val(i) = corr_val(i) + corr_tmp;
 
-      chn_tmp = capbuf(pss_idx+1, (pss_idx+1+len_pss-1));
-      tmp_val = sum(elem_mult(chn_tmp, pss_fo));
-      corr_tmp = real( tmp_val*conj(tmp_val) );
+      corr_tmp = norm(cvec_simd::dot(capbuf._data()+pss_idx+1, pss_fo._data(), len_pss));
       corr_val(i) = corr_val(i) + corr_tmp;
 
-      chn_tmp = capbuf(pss_idx-1, (pss_idx-1+len_pss-1));
-      tmp_val = sum(elem_mult(chn_tmp, pss_fo));
-      corr_tmp = real( tmp_val*conj(tmp_val) );
+      corr_tmp = norm(cvec_simd::dot(capbuf._data()+pss_idx-1, pss_fo._data(), len_pss));
       corr_val(i) = corr_val(i) + corr_tmp;
 
       pss_count = pss_count + 1;
@@ -3140,8 +3927,11 @@ Cell pss_sss_foe(
 // Note that this function is inefficient in that it returns the time/
 // frequency grid for nearly all samples in the capture buffer whereas
 // in reality, we are only interested in the OFDM symbols containing the MIB.
-void extract_tfg(
+//
+// FOC and the DFTs are performed on lte_ocl unless it is NULL.
+static void extract_tfg_helper(
   // Inputs
+  lte_opencl_t * lte_ocl,
   const Cell & cell,
   const cvec & capbuf_raw,
   const double & fc_requested,
@@ -3181,12 +3971,10 @@ void extract_tfg(
     dft_location=dft_location-.01*fs_programmed*k_factor;
   }
 
-  // Perform FOC
-  cvec capbuf=fshift(capbuf_raw,-freq_fine,fs_programmed*k_factor);
-
   // Extract 6 frames + 2 slots worth of data
   uint16 n_ofdm_sym=6*10*2*n_symb_dl+2*n_symb_dl;
   tfg=cmat(n_ofdm_sym,72);
+  bigmem_advise(tfg);
   tfg_timestamp=vec(n_ofdm_sym);
 #ifndef NDEBUG
   tfg=NAN;
@@ -3194,10 +3982,8 @@ void extract_tfg(
 #endif
   uint16 sym_num=0;
   for (uint16 t=0;t<n_ofdm_sym;t++) {
-    cvec dft_out=dft(capbuf.mid(round_i(dft_location),128));
-    tfg.set_row(t,concat(dft_out.right(36),dft_out.mid(1,36)));
-    // Record the time offset where the DFT _should_ have been taken.
-    // It was actually taken at the nearest sample boundary.
+    // Record the time offset where the DFT _should_ be taken. It will
+    // actually be taken at the nearest sample boundary.
     tfg_timestamp(t)=dft_location;
     // Calculate location of next DFT
     if (n_symb_dl==6) {
@@ -3212,21 +3998,85 @@ void extract_tfg(
     }
   }
 
-  // Compensate for the residual time offset.
-  ivec cn=concat(itpp_ext::matlab_range(-36,-1),itpp_ext::matlab_range(1,36));
-  for (uint16 t=0;t<n_ofdm_sym;t++) {
-    double ideal_offset=tfg_timestamp(t);
-    double actual_offset=round_i(ideal_offset);
-    // How late were we in locating the DFT
-    double late=actual_offset-ideal_offset;
-    // Compensate for the improper location of the DFT
-    tfg.set_row(t,elem_mult(tfg.get_row(t),exp((-J*2*pi*late/128)*cn)));
+  bool on_device=false;
+#ifdef USE_OPENCL
+  if (lte_ocl!=NULL) {
+    // FOC is applied to the samples of each DFT only and the residual time
+    // offset is compensated for on the device.
+    const double dphi=2*pi*(-freq_fine)/(fs_programmed*k_factor);
+    ivec start(n_ofdm_sym);
+    vec phase0(n_ofdm_sym);
+    vec late(n_ofdm_sym);
+    for (uint16 t=0;t<n_ofdm_sym;t++) {
+      start(t)=round_i(tfg_timestamp(t));
+      phase0(t)=dphi*start(t);
+      late(t)=start(t)-tfg_timestamp(t);
+    }
+    lte_ocl->dft128(capbuf_raw,start,phase0,late,dphi,36,tfg);
+    on_device=true;
+  }
+#endif
+  if (!on_device) {
+    // Perform FOC
+    cvec capbuf=fshift(capbuf_raw,-freq_fine,fs_programmed*k_factor);
+
+    for (uint16 t=0;t<n_ofdm_sym;t++) {
+      cvec dft_out=dft(capbuf.mid(round_i(tfg_timestamp(t)),128));
+      tfg.set_row(t,concat(dft_out.right(36),dft_out.mid(1,36)));
+    }
+
+    // Compensate for the residual time offset.
+    ivec cn=concat(itpp_ext::matlab_range(-36,-1),itpp_ext::matlab_range(1,36));
+    for (uint16 t=0;t<n_ofdm_sym;t++) {
+      double ideal_offset=tfg_timestamp(t);
+      double actual_offset=round_i(ideal_offset);
+      // How late were we in locating the DFT
+      double late=actual_offset-ideal_offset;
+      // Compensate for the improper location of the DFT
+      tfg.set_row(t,elem_mult(tfg.get_row(t),exp((-J*2*pi*late/128)*cn)));
+    }
   }
   // At this point, tfg(t,:) contains the results of a DFT that was performed
   // at time offset tfg_timestamp(t). Note that tfg_timestamp(t) is not an
   // integer!
 }
 
+void extract_tfg(
+  // Inputs
+  const Cell & cell,
+  const cvec & capbuf_raw,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  // Outputs
+  cmat & tfg,
+  vec & tfg_timestamp,
+  const bool & sampling_carrier_twist
+) {
+  extract_tfg_helper(NULL,cell,capbuf_raw,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
+}
+
+void extract_tfg(
+  // Inputs
+  lte_opencl_t & lte_ocl,
+  const Cell & cell,
+  const cvec & capbuf_raw,
+  const double & fc_requested,
+  const double & fc_programmed,
+  const double & fs_programmed,
+  // Outputs
+  cmat & tfg,
+  vec & tfg_timestamp,
+  const bool & sampling_carrier_twist
+) {
+  lte_opencl_t * device=NULL;
+#ifdef USE_OPENCL
+  if (lte_ocl.search_post_ready(length(capbuf_raw)))
+    device=&lte_ocl;
+#endif
+  extract_tfg_helper(device,cell,capbuf_raw,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
+}
+
 // Perform 'superfine' TOE/FOE/TOC/FOC.
 //
 // First, the residual frequency offset is measured using all the samples
@@ -3275,9 +4125,10 @@ Cell tfoec(
       rs_extracted.set_row(t,elem_mult(rs_extracted.get_row(t),conj(rs_dl.get_rs(mod(t,20),sym_num))));
     }
     // FOE, subcarrier by subcarrier.
+    // Columns are contiguous in memory.
     for (uint16 t=0;t<12;t++) {
-      cvec col=rs_extracted.get_col(t);
-      foe=foe+sum(elem_mult(conj(col(0,n_slot-2)),col(1,-1)));
+      const complex <double> * col=rs_extracted._data()+t*n_slot;
+      foe=foe+cvec_simd::cdot(col,col+1,n_slot-1);
     }
   }
   double k_factor;
@@ -3361,8 +4212,8 @@ Cell tfoec(
     r1v=elem_mult(r1v,conj(rs_dl.get_rs(r1_slot_num,r1_sym_num)));
     cvec r2v=tfg_comp.get_row(r2_offset).get(itpp_ext::matlab_range(r2_shift,6,71));
     r2v=elem_mult(r2v,conj(rs_dl.get_rs(r2_slot_num,r2_sym_num)));
-    complex<double> toe1=sum(elem_mult(conj(r1v),r2v));
-    complex<double> toe2=sum(elem_mult(conj(r2v(0,10)),r1v(1,11)));
+    complex<double> toe1=cvec_simd::cdot(r1v._data(),r2v._data(),12);
+    complex<double> toe2=cvec_simd::cdot(r2v._data(),r1v._data()+1,11);
     toe+=toe1+toe2;
   }
   double delay=-arg(toe)/3/(2*pi/128);
@@ -3680,6 +4531,9 @@ void ce_interp_hex(
 //
 // Each invocation of this function performs CE/ filtering for one particular
 // antenna port.
+//
+// sp is the power of the RS received from this port. It is close to zero
+// if the eNodeB does not transmit on this port.
 void chan_est(
   // Inputs
   const Cell & cell,
@@ -3688,7 +4542,8 @@ void chan_est(
   const uint8 & port,
   // Outputs
   cmat & ce_tfg,
-  double & np
+  double & np,
+  double & sp
 ) {
   const int8 n_symb_dl=cell.n_symb_dl();
   const uint16 n_ofdm=tfg.rows();
@@ -3782,6 +4637,8 @@ void chan_est(
 
   // Estimate noise power
   np=sigpower(cvectorize(ce_filt)-cvectorize(ce_raw));
+  // Estimate received RS power
+  sp=MAX(sigpower(cvectorize(ce_raw))-np,0.0);
 
   // There is no appreciable difference in performance between these
   // algorithms for high SNR values.
@@ -3793,11 +4650,15 @@ void chan_est(
 // Examine the time/ frequency grid and extract the RE that belong to the PBCH.
 // Also return the channel estimates for that RE from all 4 possible eNodeB
 // ports.
+//
+// n_frames is the number of 10ms PBCH bursts to extract, starting with the
+// first frame of the TFG.
 void pbch_extract(
   // Inputs
   const Cell & cell,
   const cmat & tfg,
   const Array <cmat> & ce,
+  const uint8 & n_frames,
   // Outputs
   cvec & pbch_sym,
   cmat & pbch_ce
@@ -3807,15 +4668,15 @@ void pbch_extract(
   const uint16 m_bit=(cell.cp_type==cp_type_t::NORMAL)?1920:1728;
   const uint8 v_shift_m3=mod(cell.n_id_cell(),3);
 
-  pbch_sym=cvec(m_bit/2);
+  pbch_sym=cvec(m_bit/8*n_frames);
   // One channel estimate from each of 4 ports for each RE.
-  pbch_ce=cmat(4,m_bit/2);
+  pbch_ce=cmat(4,m_bit/8*n_frames);
 #ifndef NDEBUG
   pbch_sym=NAN;
   pbch_ce=NAN;
 #endif
   uint32 idx=0;
-  for (uint8 fr=0;fr<=3;fr++) {
+  for (uint8 fr=0;fr<n_frames;fr++) {
     for (uint8 sym=0;sym<=3;sym++) {
       for (uint8 sc=0;sc<=71;sc++) {
         // Skip if there might be an RS occupying this position.
@@ -3832,32 +4693,469 @@ void pbch_extract(
       }
     }
   }
-  ASSERT(idx==m_bit/2);
+  ASSERT(idx==m_bit/8*n_frames);
+}
+
+// Perform channel compensation and also estimate noise power in each
+// symbol. Then extract the bits from the complex modulated symbols.
+//
+// pbch_np contains, for each port, the noise power of the channel
+// estimate of each RE.
+vec pbch_demod(
+  // Inputs
+  const cvec & pbch_sym,
+  const cmat & pbch_ce,
+  const mat & pbch_np,
+  const uint8 & n_ports
+) {
+  vec np;
+  cvec syms;
+  if (n_ports==1) {
+    cvec gain=conj(elem_div(pbch_ce.get_row(0),to_cvec(sqr(pbch_ce.get_row(0)))));
+    syms=elem_mult(pbch_sym,gain);
+    np=elem_mult(pbch_np.get_row(0),sqr(gain));
+  } else {
+    syms.set_size(length(pbch_sym));
+    np.set_size(length(pbch_sym));
+#ifndef NDEBUG
+    syms=NAN;
+    np=NAN;
+#endif
+    for (int32 t=0;t<length(syms);t+=2) {
+      // Simple zero-forcing
+      // http://en.wikipedia.org/wiki/Space-time_block_coding_based_transmit_diversity
+      complex <double> h1,h2;
+      double np_temp;
+      if (n_ports==2) {
+        h1=(pbch_ce(0,t)+pbch_ce(0,t+1))/2;
+        h2=(pbch_ce(1,t)+pbch_ce(1,t+1))/2;
+        np_temp=(pbch_np(0,t)+pbch_np(1,t))/2;
+      } else {
+        if (mod(t,4)==0) {
+          h1=(pbch_ce(0,t)+pbch_ce(0,t+1))/2;
+          h2=(pbch_ce(2,t)+pbch_ce(2,t+1))/2;
+          np_temp=(pbch_np(0,t)+pbch_np(2,t))/2;
+        } else {
+          h1=(pbch_ce(1,t)+pbch_ce(1,t+1))/2;
+          h2=(pbch_ce(3,t)+pbch_ce(3,t+1))/2;
+          np_temp=(pbch_np(1,t)+pbch_np(3,t))/2;
+        }
+      }
+      complex <double> x1=pbch_sym(t);
+      complex <double> x2=pbch_sym(t+1);
+      double scale=pow(h1.real(),2)+pow(h1.imag(),2)+pow(h2.real(),2)+pow(h2.imag(),2);
+      syms(t)=(conj(h1)*x1+h2*conj(x2))/scale;
+      syms(t+1)=conj((-conj(h2)*x1+h1*conj(x2))/scale);
+      np(t)=(pow(abs(h1)/scale,2)+pow(abs(h2)/scale,2))*np_temp;
+      np(t+1)=np(t);
+    }
+    // 3dB factor comes from precoding for transmit diversity
+    syms=syms*pow(2,0.5);
+  }
+
+  return lte_demodulate(syms,np,modulation_t::QAM);
+}
+
+// Decode the unscrambled and deratematched PBCH soft bits and compare
+// the received CRC against the CRC calculated from the decoded bits.
+bool pbch_decode(
+  // Inputs
+  const mat & d_est,
+  const uint8 & n_ports,
+  // Outputs
+  bvec & c_est
+) {
+  // Decode
+  c_est=lte_conv_decode(d_est);
+  // Calculate received CRC
+  bvec crc_est=lte_calc_crc(c_est(0,23),CRC16);
+  // Apply CRC mask
+  if (n_ports==2) {
+    for (uint8 t=0;t<16;t++) {
+      crc_est(t)=1-((int)crc_est(t));
+    }
+  } else if (n_ports==4) {
+    for (uint8 t=1;t<length(crc_est);t+=2) {
+      crc_est(t)=1-((int)crc_est(t));
+    }
+  }
+  return crc_est==c_est(24,-1);
+}
+
+// The coded bits that change when the 8 SFN bits of the MIB are xor'd
+// with sfn_xor. Both the CRC and the convolutional code are linear and the
+// CRC mask is the same for every TTI so this is independent of the rest
+// of the MIB.
+static bmat pbch_sfn_delta(
+  const uint8 & sfn_xor
+) {
+  bvec c(24);
+  c.zeros();
+  for (uint8 t=0;t<8;t++) {
+    c(6+t)=(sfn_xor>>(7-t))&1;
+  }
+  return lte_conv_encode(concat(c,lte_calc_crc(c,CRC16)));
+}
+
+// Successive PBCH TTI's carry the same MIB except for the 8 MSB's of
+// the SFN, which are incremented by one every TTI. Thus, if the SFN of
+// the current TTI were known, the soft bits of all previous TTI's could be
+// converted into soft bits for the current TTI and simply added together.
+//
+// The SFN is not known. However, the pattern of SFN bits that differ between
+// this TTI and a previous TTI depends only on the lower bits of the SFN.
+// The 256 possible SFN values are grouped according to the patterns they
+// produce and one decoding attempt is made per group. A decoded MIB is
+// only accepted if its SFN belongs to the group that was tried. This keeps
+// the false detection probability similar to that of a single decoding
+// attempt.
+bool pbch_decode_combined(
+  // Inputs
+  const mat & d_est,
+  const int32 & frame_num,
+  const uint8 & n_ports,
+  const pbch_history_t & pbch_history,
+  // Outputs
+  bvec & c_est
+) {
+  const uint8 n_ports_idx=(n_ports==4)?2:(n_ports-1);
+
+  // Find the TTI's that share the frame alignment of this TTI.
+  vector <int32> tti_offset;
+  vector <mat> d_prev;
+  for (pbch_history_t::const_iterator it=pbch_history.begin();it!=pbch_history.end();++it) {
+    const int32 frame_offset=(*it).frame_num-frame_num;
+    if ((frame_offset==0)||(itpp_ext::matlab_mod(frame_offset,4)!=0)||(abs(frame_offset/4)>PBCH_COMBINE_MAX_TTI)) {
+      continue;
+    }
+    if ((*it).d_est(n_ports_idx).size()==0) {
+      continue;
+    }
+    tti_offset.push_back(frame_offset/4);
+    d_prev.push_back((*it).d_est(n_ports_idx));
+  }
+  if (tti_offset.empty()) {
+    return false;
+  }
+
+  // Group the possible SFN's according to which SFN bits differ.
+  map < vector <uint8>, vector <uint8> > sfn_groups;
+  for (uint16 sfn_msb=0;sfn_msb<256;sfn_msb++) {
+    vector <uint8> sfn_xor(tti_offset.size());
+    for (uint8 t=0;t<tti_offset.size();t++) {
+      sfn_xor[t]=sfn_msb^itpp_ext::matlab_mod(sfn_msb+tti_offset[t],256);
+    }
+    sfn_groups[sfn_xor].push_back(sfn_msb);
+  }
+
+  map <uint8, bmat> delta_cache;
+  for (map < vector <uint8>, vector <uint8> >::const_iterator group=sfn_groups.begin();group!=sfn_groups.end();++group) {
+    const vector <uint8> & sfn_xor=(*group).first;
+    mat d_comb=d_est;
+    for (uint8 t=0;t<sfn_xor.size();t++) {
+      if (delta_cache.find(sfn_xor[t])==delta_cache.end()) {
+        delta_cache[sfn_xor[t]]=pbch_sfn_delta(sfn_xor[t]);
+      }
+      const bmat & delta=delta_cache[sfn_xor[t]];
+      for (uint8 r=0;r<3;r++) {
+        for (uint8 c=0;c<40;c++) {
+          d_comb(r,c)+=delta(r,c)?-d_prev[t](r,c):d_prev[t](r,c);
+        }
+      }
+    }
+
+    bvec c_try;
+    if (!pbch_decode(d_comb,n_ports,c_try)) {
+      continue;
+    }
+    uint8 sfn_msb_dec=0;
+    for (uint8 t=0;t<8;t++) {
+      sfn_msb_dec=(sfn_msb_dec<<1)|((int)c_try(6+t));
+    }
+    if (find((*group).second.begin(),(*group).second.end(),sfn_msb_dec)!=(*group).second.end()) {
+      c_est=c_try;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Store the soft bits of a TTI and remove TTI's that can no longer be
+// combined with new TTI's.
+void pbch_history_add(
+  pbch_history_t & pbch_history,
+  const int32 & frame_num,
+  const Array <mat> & d_est
+) {
+  pbch_tti_t tti;
+  tti.frame_num=frame_num;
+  tti.d_est=d_est;
+  pbch_history.push_back(tti);
+
+  pbch_history_t::iterator it=pbch_history.begin();
+  while (it!=pbch_history.end()) {
+    if (frame_num-(*it).frame_num>4*PBCH_COMBINE_MAX_TTI) {
+      it=pbch_history.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Decide in which order the 1, 2, and 4 port hypotheses should be tried
+// based on the RS power received on each port.
+//
+// A port that is not used by the eNodeB only contributes noise to its
+// channel estimate. If the RS SNR on port 0 is high enough that such a port
+// can be reliably recognized, the hypotheses that require the port are
+// tried last. They are never dropped because a deep fade on one port can
+// look the same as an unused port.
+static ivec mib_port_order(
+  // Inputs
+  const vec & sp_v,
+  const vec & np_v
+) {
+  const double snr0=sp_v(0)/np_v(0);
+  // RS power on the other ports relative to port 0.
+  const double r1=(sp_v(1)/np_v(1))/snr0;
+  const double r23=(sp_v(2)/np_v(2)+sp_v(3)/np_v(3))/2/snr0;
+  const bool reliable=snr0>=udb10(6.0);
+
+  ivec order;
+  if (r23>=udb10(-6.0)) {
+    order="4 2 1";
+  } else if (r1>=udb10(-6.0)) {
+    order="2 4 1";
+  } else {
+    order="1 2 4";
+  }
+  if (reliable) {
+    ivec likely;
+    ivec fallback;
+    for (uint8 t=0;t<length(order);t++) {
+      if (((order(t)>=2)&&(r1<udb10(-10.0)))||((order(t)==4)&&(r23<udb10(-10.0)))) {
+        fallback=concat(fallback,order(t));
+      } else {
+        likely=concat(likely,order(t));
+      }
+    }
+    order=concat(likely,fallback);
+  }
+  DBG( cout << "MIB port order " << order << " snr0 " << db10(snr0) << "dB r1 " << db10(r1) << "dB r23 " << db10(r23) << "dB\n"; )
+
+  return order;
+}
+
+// A MIB that passes the CRC can still contain a bandwidth code that is
+// not defined in 36.331. Such a MIB must be the result of a false CRC
+// pass.
+static bool mib_plausible(
+  const bvec & c_est
+) {
+  const uint8 bw_packed=((int)c_est(0))*4+((int)c_est(1))*2+((int)c_est(2));
+  return bw_packed<=5;
+}
+
+// Fraction of the received soft bits whose sign agrees with the re-encoded
+// MIB. Soft bits that were not received (zero) are ignored. This is close
+// to 0.5 when the CRC was passed by chance.
+static double pbch_agreement(
+  const bvec & c_est,
+  const mat & d_est
+) {
+  const bmat d=lte_conv_encode(c_est);
+  uint16 n_agree=0;
+  uint16 n_total=0;
+  for (uint8 r=0;r<3;r++) {
+    for (uint8 c=0;c<40;c++) {
+      if (d_est(r,c)==0) {
+        continue;
+      }
+      n_total++;
+      // ln(P0/P1) is positive for a 0.
+      if ((d_est(r,c)>0)==(((int)d(r,c))==0)) {
+        n_agree++;
+      }
+    }
+  }
+  return (n_total==0)?0:((double)n_agree)/n_total;
+}
+
+// Unpack a successfully decoded MIB into cell_out.
+//
+// tti_start is the frame, relative to the first frame of the TFG, where
+// the decoded PBCH TTI begins.
+static void mib_unpack(
+  // Inputs
+  const bvec & c_est,
+  const uint8 & n_ports,
+  const int8 & tti_start,
+  // Outputs
+  Cell & cell_out
+) {
+  cell_out.n_ports=n_ports;
+  ivec c_est_ivec=to_ivec(c_est);
+  // DL bandwidth
+  const uint8 bw_packed=c_est_ivec(0)*4+c_est_ivec(1)*2+c_est_ivec(2);
+  switch (bw_packed) {
+    case 0:
+      cell_out.n_rb_dl=6;
+      break;
+    case 1:
+      cell_out.n_rb_dl=15;
+      break;
+    case 2:
+      cell_out.n_rb_dl=25;
+      break;
+    case 3:
+      cell_out.n_rb_dl=50;
+      break;
+    case 4:
+      cell_out.n_rb_dl=75;
+      break;
+    case 5:
+      cell_out.n_rb_dl=100;
+      break;
+  }
+  // PHICH duration
+  cell_out.phich_duration=c_est_ivec(3)?phich_duration_t::EXTENDED:phich_duration_t::NORMAL;
+  // PHICH resources
+  uint8 phich_res=c_est_ivec(4)*2+c_est_ivec(5);
+  switch (phich_res) {
+    case 0:
+      cell_out.phich_resource=phich_resource_t::oneSixth;
+      break;
+    case 1:
+      cell_out.phich_resource=phich_resource_t::half;
+      break;
+    case 2:
+      cell_out.phich_resource=phich_resource_t::one;
+      break;
+    case 3:
+      cell_out.phich_resource=phich_resource_t::two;
+      break;
+  }
+  // Calculate SFN of the first frame of the TFG
+  int16 sfn_temp=128*c_est_ivec(6)+64*c_est_ivec(7)+32*c_est_ivec(8)+16*c_est_ivec(9)+8*c_est_ivec(10)+4*c_est_ivec(11)+2*c_est_ivec(12)+c_est_ivec(13);
+  cell_out.sfn=itpp_ext::matlab_mod(sfn_temp*4-tti_start,1024);
+}
+
+// Each PBCH TTI consists of four 10ms bursts, each of which contains
+// every coded bit of the MIB at least 3 times. For strong cells, the MIB can
+// be decoded from only one or two bursts, which requires channel estimation
+// over only the first one or two frames of the TFG.
+//
+// The position of the bursts within the TTI is not known. Each position
+// is tried in the same way that a decoder would try different redundancy
+// versions.
+static bool decode_mib_bursts(
+  // Inputs
+  const Cell & cell,
+  const cmat & tfg,
+  const RS_DL & rs_dl,
+  const bvec & scr,
+  const uint8 & n_bursts,
+  // Outputs
+  Cell & cell_out
+) {
+  const int8 n_symb_dl=cell.n_symb_dl();
+  const uint16 m_bit=length(scr);
+  const uint16 burst_len=m_bit/4;
+
+  // Channel estimation only on the frames that are needed
+  cmat tfg_part=tfg.get_rows(0,n_bursts*10*2*n_symb_dl-1);
+  Array <cmat> ce_part(4);
+  vec np_v(4);
+  vec sp_v(4);
+  for (uint8 t=0;t<4;t++) {
+    chan_est(cell,rs_dl,tfg_part,t,ce_part(t),np_v(t),sp_v(t));
+  }
+  const ivec port_order=mib_port_order(sp_v,np_v);
+
+  cvec pbch_sym;
+  cmat pbch_ce;
+  pbch_extract(cell,tfg_part,ce_part,n_bursts,pbch_sym,pbch_ce);
+  mat pbch_np(4,length(pbch_sym));
+  for (uint8 t=0;t<4;t++) {
+    pbch_np.set_row(t,np_v(t)*ones(length(pbch_sym)));
+  }
+
+  // 4 positions are tried for 1 burst and 3 for 2 bursts, in addition to
+  // the 4 frame alignments of the full search. These extra CRC trials
+  // raise the probability that noise passes the CRC, so a MIB found here
+  // must also be consistent with the received soft bits.
+  bvec c_est;
+  for (uint8 k=0;k<length(port_order);k++) {
+    const uint8 n_ports=port_order(k);
+    vec e_bursts=pbch_demod(pbch_sym,pbch_ce,pbch_np,n_ports);
+    for (uint8 burst_pos=0;burst_pos<=4-n_bursts;burst_pos++) {
+      // Bits that were not received are simply erased.
+      vec e_est(m_bit);
+      e_est.zeros();
+      const uint16 offset=burst_pos*burst_len;
+      for (int32 t=0;t<length(e_bursts);t++) {
+        e_est(offset+t)=scr(offset+t)?-e_bursts(t):e_bursts(t);
+      }
+      mat d_est=lte_conv_deratematch(e_est,40);
+      if ((pbch_decode(d_est,n_ports,c_est))&&(mib_plausible(c_est))&&(pbch_agreement(c_est,d_est)>=PBCH_BURST_MIN_AGREEMENT)) {
+        mib_unpack(c_est,n_ports,-burst_pos,cell_out);
+        return true;
+      }
+    }
+  }
+
+  return false;
 }
 
 // Blindly try various frame alignments and numbers of antennas to try
 // to find a valid MIB.
-Cell decode_mib(
+//
+// Decoding is first attempted using only the first burst of the TFG, then
+// the first two bursts, and finally entire TTI's.
+//
+// If pbch_history is not NULL, failed attempts are also combined with
+// (and stored into) the soft bits of previous attempts.
+static Cell decode_mib_helper(
   const Cell & cell,
   const cmat & tfg,
-  const RS_DL & rs_dl
+  const RS_DL & rs_dl,
+  const int32 & frame_num,
+  pbch_history_t * pbch_history
 ) {
   // Local shortcuts
   const int8 n_symb_dl=cell.n_symb_dl();
 
   Cell cell_out=cell;
 
+  // Scrambling sequence of one TTI
+  const bvec scr=lte_pn(cell.n_id_cell(),(cell.cp_type==cp_type_t::NORMAL)?1920:1728);
+
+  // Early exit for strong cells.
+  for (uint8 n_bursts=1;n_bursts<=2;n_bursts++) {
+    if (decode_mib_bursts(cell,tfg,rs_dl,scr,n_bursts,cell_out)) {
+      if (pbch_history!=NULL) {
+        pbch_history->clear();
+      }
+      return cell_out;
+    }
+  }
+
   // Channel estimation. This is automatically performed for four antennas
   // and for every RE, not only the RE's that contain an MIB!!!
   Array <cmat> ce_tfg(4);
   vec np_v(4);
-  chan_est(cell,rs_dl,tfg,0,ce_tfg(0),np_v(0));
-  chan_est(cell,rs_dl,tfg,1,ce_tfg(1),np_v(1));
-  chan_est(cell,rs_dl,tfg,2,ce_tfg(2),np_v(2));
-  chan_est(cell,rs_dl,tfg,3,ce_tfg(3),np_v(3));
+  vec sp_v(4);
+  chan_est(cell,rs_dl,tfg,0,ce_tfg(0),np_v(0),sp_v(0));
+  chan_est(cell,rs_dl,tfg,1,ce_tfg(1),np_v(1),sp_v(1));
+  chan_est(cell,rs_dl,tfg,2,ce_tfg(2),np_v(2),sp_v(2));
+  chan_est(cell,rs_dl,tfg,3,ce_tfg(3),np_v(3),sp_v(3));
+  // Most likely number of ports first
+  const ivec port_order=mib_port_order(sp_v,np_v);
 
   // Try various frame offsets and number of TX antennas.
   bvec c_est;
+  vector <pbch_tti_t> failed_tti;
   for (uint8 frame_timing_guess=0;frame_timing_guess<=3;frame_timing_guess++) {
     const uint16 ofdm_sym_set_start=frame_timing_guess*10*2*n_symb_dl;
     ivec ofdm_sym_set=itpp_ext::matlab_range(ofdm_sym_set_start,ofdm_sym_set_start+3*10*2*n_symb_dl+2*n_symb_dl-1);
@@ -3873,135 +5171,71 @@ Cell decode_mib(
     // Extract symbols and channel estimates for the PBCH
     cvec pbch_sym;
     cmat pbch_ce;
-    pbch_extract(cell,tfg_try,ce_try,pbch_sym,pbch_ce);
+    pbch_extract(cell,tfg_try,ce_try,4,pbch_sym,pbch_ce);
+    mat pbch_np(4,length(pbch_sym));
+    for (uint8 t=0;t<4;t++) {
+      pbch_np.set_row(t,np_v(t)*ones(length(pbch_sym)));
+    }
 
     // Try 1, 2, and 4 ports.
-    vec np;
-    cvec syms;
-    for (uint8 n_ports_pre=1;n_ports_pre<=3;n_ports_pre++) {
-      const uint8 n_ports=(n_ports_pre==3)?4:n_ports_pre;
-      // Perform channel compensation and also estimate noise power in each
-      // symbol.
-      if (n_ports==1) {
-        cvec gain=conj(elem_div(pbch_ce.get_row(0),to_cvec(sqr(pbch_ce.get_row(0)))));
-        syms=elem_mult(pbch_sym,gain);
-        np=np_v(0)*sqr(gain);
-      } else {
-        syms.set_size(length(pbch_sym));
-        np.set_size(length(pbch_sym));
-#ifndef NDEBUG
-        syms=NAN;
-        np=NAN;
-#endif
-        for (int32 t=0;t<length(syms);t+=2) {
-          // Simple zero-forcing
-          // http://en.wikipedia.org/wiki/Space-time_block_coding_based_transmit_diversity
-          complex <double> h1,h2;
-          double np_temp;
-          if (n_ports==2) {
-            h1=(pbch_ce(0,t)+pbch_ce(0,t+1))/2;
-            h2=(pbch_ce(1,t)+pbch_ce(1,t+1))/2;
-            np_temp=mean(np_v(0,1));
-          } else {
-            if (mod(t,4)==0) {
-              h1=(pbch_ce(0,t)+pbch_ce(0,t+1))/2;
-              h2=(pbch_ce(2,t)+pbch_ce(2,t+1))/2;
-              np_temp=(np_v(0)+np_v(2))/2;
-            } else {
-              h1=(pbch_ce(1,t)+pbch_ce(1,t+1))/2;
-              h2=(pbch_ce(3,t)+pbch_ce(3,t+1))/2;
-              np_temp=(np_v(1)+np_v(3))/2;
-            }
-          }
-          complex <double> x1=pbch_sym(t);
-          complex <double> x2=pbch_sym(t+1);
-          double scale=pow(h1.real(),2)+pow(h1.imag(),2)+pow(h2.real(),2)+pow(h2.imag(),2);
-          syms(t)=(conj(h1)*x1+h2*conj(x2))/scale;
-          syms(t+1)=conj((-conj(h2)*x1+h1*conj(x2))/scale);
-          np(t)=(pow(abs(h1)/scale,2)+pow(abs(h2)/scale,2))*np_temp;
-          np(t+1)=np(t);
-        }
-        // 3dB factor comes from precoding for transmit diversity
-        syms=syms*pow(2,0.5);
-      }
-
+    pbch_tti_t tti;
+    tti.frame_num=frame_num+frame_timing_guess;
+    tti.d_est.set_size(3);
+    for (uint8 k=0;k<length(port_order);k++) {
+      const uint8 n_ports=port_order(k);
+      const uint8 n_ports_pre=(n_ports==4)?3:n_ports;
       // Extract the bits from the complex modulated symbols.
-      vec e_est=lte_demodulate(syms,np,modulation_t::QAM);
+      vec e_est=pbch_demod(pbch_sym,pbch_ce,pbch_np,n_ports);
       // Unscramble
-      bvec scr=lte_pn(cell.n_id_cell(),length(e_est));
       for (int32 t=0;t<length(e_est);t++) {
         if (scr(t)) e_est(t)=-e_est(t);
       }
       // Undo ratematching
       mat d_est=lte_conv_deratematch(e_est,40);
-      // Decode
-      c_est=lte_conv_decode(d_est);
-      // Calculate received CRC
-      bvec crc_est=lte_calc_crc(c_est(0,23),CRC16);
-      // Apply CRC mask
-      if (n_ports==2) {
-        for (uint8 t=0;t<16;t++) {
-          crc_est(t)=1-((int)crc_est(t));
-        }
-      } else if (n_ports==4) {
-        for (uint8 t=1;t<length(crc_est);t+=2) {
-          crc_est(t)=1-((int)crc_est(t));
-        }
+      tti.d_est(n_ports_pre-1)=d_est;
+      // Decode, first on its own and then combined with previous TTI's.
+      bool found=(pbch_decode(d_est,n_ports,c_est))&&(mib_plausible(c_est));
+      if ((!found)&&(pbch_history!=NULL)) {
+        found=(pbch_decode_combined(d_est,tti.frame_num,n_ports,*pbch_history,c_est))&&(mib_plausible(c_est));
       }
       // Did we find it?
-      if (crc_est==c_est(24,-1)) {
+      if (found) {
         // YES!
-        cell_out.n_ports=n_ports;
-        // Unpack the MIB
-        ivec c_est_ivec=to_ivec(c_est);
-        // DL bandwidth
-        const uint8 bw_packed=c_est_ivec(0)*4+c_est_ivec(1)*2+c_est_ivec(2);
-        switch (bw_packed) {
-          case 0:
-            cell_out.n_rb_dl=6;
-            break;
-          case 1:
-            cell_out.n_rb_dl=15;
-            break;
-          case 2:
-            cell_out.n_rb_dl=25;
-            break;
-          case 3:
-            cell_out.n_rb_dl=50;
-            break;
-          case 4:
-            cell_out.n_rb_dl=75;
-            break;
-          case 5:
-            cell_out.n_rb_dl=100;
-            break;
-        }
-        // PHICH duration
-        cell_out.phich_duration=c_est_ivec(3)?phich_duration_t::EXTENDED:phich_duration_t::NORMAL;
-        // PHICH resources
-        uint8 phich_res=c_est_ivec(4)*2+c_est_ivec(5);
-        switch (phich_res) {
-          case 0:
-            cell_out.phich_resource=phich_resource_t::oneSixth;
-            break;
-          case 1:
-            cell_out.phich_resource=phich_resource_t::half;
-            break;
-          case 2:
-            cell_out.phich_resource=phich_resource_t::one;
-            break;
-          case 3:
-            cell_out.phich_resource=phich_resource_t::two;
-            break;
+        mib_unpack(c_est,n_ports,frame_timing_guess,cell_out);
+        if (pbch_history!=NULL) {
+          pbch_history->clear();
         }
-        // Calculate SFN
-        int8 sfn_temp=128*c_est_ivec(6)+64*c_est_ivec(7)+32*c_est_ivec(8)+16*c_est_ivec(9)+8*c_est_ivec(10)+4*c_est_ivec(11)+2*c_est_ivec(12)+c_est_ivec(13);
-        cell_out.sfn=itpp_ext::matlab_mod(sfn_temp*4-frame_timing_guess,1024);
         return cell_out;
       }
     }
+    failed_tti.push_back(tti);
+  }
+
+  // Keep the soft bits around so that they can be combined with the
+  // next attempt.
+  if (pbch_history!=NULL) {
+    for (uint8 t=0;t<failed_tti.size();t++) {
+      pbch_history_add(*pbch_history,failed_tti[t].frame_num,failed_tti[t].d_est);
+    }
   }
 
   return cell_out;
 }
 
+Cell decode_mib(
+  const Cell & cell,
+  const cmat & tfg,
+  const RS_DL & rs_dl
+) {
+  return decode_mib_helper(cell,tfg,rs_dl,0,NULL);
+}
+
+Cell decode_mib(
+  const Cell & cell,
+  const cmat & tfg,
+  const RS_DL & rs_dl,
+  const int32 & frame_num,
+  pbch_history_t & pbch_history
+) {
+  return decode_mib_helper(cell,tfg,rs_dl,frame_num,&pbch_history);
+}
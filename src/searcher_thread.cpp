@@ -29,6 +29,8 @@
 #include <sstream>
 #include <signal.h>
 #include <queue>
+#include <deque>
+#include <map>
 //#include <valgrind/callgrind.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -41,6 +43,8 @@
 #include "itpp_ext.h"
 #include "searcher.h"
 #include "dsp.h"
+#include "spur.h"
+#include "placement.h"
 #include "LTE-Tracker.h"
 #include "filter_coef.h"
 
@@ -61,9 +65,88 @@ using namespace std;
 
 #define DS_COMB_ARM 2
 
-// This is the searcher process. It requests captured data from the main
-// thread and launches a new thread for every cell it finds. Each new
-// cell thread then requests sample data from the main thread.
+// One holdoff entry per verified correlation peak.
+typedef struct {
+  uint8 n_id_2;
+  uint16 bin;
+  uint64 expires;
+} search_holdoff_t;
+
+// Number of decimated samples the producer has published.
+static uint64 ring_n_written(
+  const capbuf_sync_t & capbuf_sync
+) {
+  return __atomic_load_n(&capbuf_sync.n_written,__ATOMIC_ACQUIRE);
+}
+
+// Copy n samples starting with decimated sample number first out of the
+// ring buffer. The producer keeps writing while the samples are copied.
+// Returns false if it may have overwritten some of them, in which case
+// the copy must be discarded.
+static bool ring_copy(
+  // Inputs
+  const capbuf_sync_t & capbuf_sync,
+  const uint64 & first,
+  const uint32 & n,
+  // Outputs
+  cvec & samples,
+  vec & timestamp,
+  uint64 & sample_num
+) {
+  samples.set_size(n);
+  timestamp.set_size(n);
+  for (uint32 t=0;t<n;t++) {
+    const uint32 idx=(first+t)%SEARCH_RING_LENGTH;
+    samples(t)=capbuf_sync.ring(idx);
+    timestamp(t)=capbuf_sync.ring_timestamp(idx);
+  }
+  sample_num=capbuf_sync.ring_sample_num[first%SEARCH_RING_LENGTH];
+  // Sample number n_written is being written and has replaced sample
+  // number n_written-SEARCH_RING_LENGTH.
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return first+SEARCH_RING_LENGTH>ring_n_written(capbuf_sync);
+}
+
+// Correlation bin where the PSS of a tracked cell is located. This is the
+// inverse of the frame start calculation of sss_detect().
+static uint16 tracked_pss_bin(
+  tracked_cell_t & tracked_cell
+) {
+  double offset;
+  if (tracked_cell.duplex_mode==0) {
+    offset=-(128+9-960-2);
+  } else if (tracked_cell.cp_type==cp_type_t::NORMAL) {
+    offset=2*(128+9)+1+1920+2;
+  } else {
+    offset=2*(128+32)+1920+2;
+  }
+  return itpp_ext::matlab_mod(round_i(tracked_cell.frame_timing()+offset),9600);
+}
+
+// Zero out the correlations of one PSS within SEARCH_MASK_ARM samples of
+// bin.
+static void mask_bin(
+  mat & xc_incoherent_collapsed_pow,
+  const uint8 & n_id_2,
+  const uint16 & bin
+) {
+  for (int16 t=-SEARCH_MASK_ARM;t<=SEARCH_MASK_ARM;t++) {
+    xc_incoherent_collapsed_pow(n_id_2,itpp_ext::matlab_mod(bin+t,9600))=0;
+  }
+}
+
+// This is the searcher process. It continuously consumes the decimated
+// samples written by the producer thread and launches a new thread for
+// every cell it finds. Each new cell thread then requests sample data from
+// the main thread.
+//
+// Only one out of every search_duty half frames is examined. The PSS
+// correlations of every examined half frame are added to sliding
+// incoherent accumulators, indexed by the timestamp of the samples modulo
+// half a frame. Whenever an accumulator crosses the detection threshold,
+// the most recent 80ms of samples are used to detect the SSS and to decode
+// the MIB. This results in a constant CPU load and a bounded detection
+// latency.
 void searcher_thread(
   capbuf_sync_t & capbuf_sync,
   global_thread_data_t & global_thread_data,
@@ -79,41 +162,34 @@ void searcher_thread(
     cerr << "Error: could not reduce searcher process priority" << endl;
     ABORT(-1);
   }
-
-  // Keep track of serial numbers to be used when launching a new
-  // tracker thread.
-  ivec serial_num(504);
-  serial_num=1;
+  // The searcher only gets whatever CPU time the trackers leave over.
+  global_thread_data.placement.apply(thread_role_t::SEARCHER);
 
   // Shortcut
   const double & fc_requested=global_thread_data.fc_requested;
   const double & fc_programmed=global_thread_data.fc_programmed;
   const double & fs_programmed=global_thread_data.fs_programmed;
-//  double freq_correction;
+  const uint16 search_duty=global_thread_data.search_duty();
 
   const bool sampling_carrier_twist = global_thread_data.sampling_carrier_twist();
   double k_factor = global_thread_data.k_factor();
-//  double correction = global_thread_data.correction();
 
   vec coef(( sizeof( chn_6RB_filter_coef )/sizeof(float) ));
   for (uint16 i=0; i<length(coef); i++) {
     coef(i) = chn_6RB_filter_coef[i];
   }
+  const uint16 filter_half=(length(coef)-1)/2;
 
   // Calculate the threshold vector
   const uint8 thresh1_n_nines=12;
   double rx_cutoff=(6*12*15e3/2+4*15e3)/(FS_LTE/16/2);
 
   // for PSS correlate
-  //cout << "DS_COMB_ARM override!!!" << endl;
-#define DS_COMB_ARM 2
   mat xc_incoherent_collapsed_pow;
   imat xc_incoherent_collapsed_frq;
   vector <mat> xc_incoherent_single(3);
   vector <mat> xc_incoherent(3);
   vec sp_incoherent;
-  vector <mat> xc(3);
-  vec sp;
 
   // for SSS detection
 #define THRESH2_N_SIGMA 3
@@ -134,84 +210,229 @@ void searcher_thread(
   cmat tfg_comp;
   vec tfg_comp_timestamp;
 
-  vec period_ppm;
-  double xcorr_pss_time;
-
-  Real_Timer tt; // for profiling
-
   // Get the current frequency offset (because it won't change anymore after main thread launches this thread, so move it outside loop)
   vec f_search_set(1);
   cmat pss_fo_set;// pre-generate frequencies offseted pss time domain sequence
     // because it is already included in global_thread_data.frequency_offset();
   f_search_set(0)=global_thread_data.frequency_offset();
   pss_fo_set_gen(f_search_set, pss_fo_set);
+  const uint16 n_f=length(f_search_set);
+  const uint16 len_pss=pss_fo_set.cols();
+  // A direct correlation of every half frame would take 3*137 complex
+  // multiplications per sample, which is more than a core can sustain at
+  // the default duty. Fast convolution takes about a tenth of that.
+  cmat pss_fo_set_fft;
+  pss_fo_set_fft_gen(pss_fo_set,SEARCH_N_FFT,pss_fo_set_fft);
 
-//  freq_correction = fc_programmed*(correction-1)/correction;
-
-//  cout << opencl_platform << " " << opencl_device <<  " " << sampling_carrier_twist << "\n";
   uint16 opencl_platform = global_thread_data.opencl_platform();
   uint16 opencl_device = global_thread_data.opencl_device();
   lte_opencl_t lte_ocl(opencl_platform, opencl_device);
 
+  // The streamed half frames are too short to be worth sending to the
+  // OpenCL device. Only the capture buffers used for verification are.
   #ifdef USE_OPENCL
   uint16 filter_workitem = global_thread_data.filter_workitem();
-  uint16 xcorr_workitem = global_thread_data.xcorr_workitem();
-  #ifdef FILTER_MCHN_SIMPLE_KERNEL
-  lte_ocl.setup_filter_mchn((string)"filter_mchn_simple_kernel.cl", CAPLENGTH, length(f_search_set)*3, pss_fo_set.cols(), xcorr_workitem);
-  #else
-  lte_ocl.setup_filter_mchn((string)"filter_mchn_kernels.cl", CAPLENGTH, length(f_search_set)*3, pss_fo_set.cols(), xcorr_workitem);
-  #endif
   lte_ocl.setup_filter_my((string)"filter_my_kernels.cl", CAPLENGTH, filter_workitem);
+  lte_ocl.setup_search_post((string)"search_post_kernels.cl", CAPLENGTH);
   #endif
 
+  // Spurs are learned separately for each center frequency.
+  spur_excision_t spur;
+
+  // The received power of a correlation at offset l is estimated from the
+  // 274 samples centered on the PSS, so len_pss samples are needed before
+  // the half frame and len_pss-1 after it. The channel filter needs a few
+  // more on either side.
+  const uint32 n_hf=len_pss+9600+len_pss-1;
+  const uint32 n_pre=len_pss+filter_half;
+  const uint32 n_copy=n_hf+2*filter_half;
+
+  // Sliding incoherent accumulators, indexed by timestamp modulo 9600, and
+  // the contributions of the examined half frames that are still part of
+  // the accumulators.
+  vector <mat> xc_acc(3,zeros(n_f,9600));
+  vec sp_acc=zeros(9600);
+  deque <vector <mat> > xc_hist;
+  deque <vec> sp_hist;
+  list <search_holdoff_t> holdoff;
+  uint64 n_examined=0;
+
+  // Decimated sample number of the first sample of the next half frame.
+  uint64 next=n_pre;
+
   // Loop forever.
   while (true) {
-    // Used to measure searcher cycle time.
-    tt.tic();
-
-    // Request data.
-    {
+    // Wait for the next half frame to become available.
+    cvec hf;
+    vec hf_timestamp;
+    uint64 hf_sample_num;
+    if (ring_n_written(capbuf_sync)<next-n_pre+n_copy) {
       boost::mutex::scoped_lock lock(capbuf_sync.mutex);
-      capbuf_sync.request=true;
-
-      // Wait for data to become ready.
-      capbuf_sync.condition.wait(lock);
+      while (ring_n_written(capbuf_sync)<next-n_pre+n_copy) {
+        capbuf_sync.condition.wait(lock);
+      }
+    }
+    const uint64 n_written=ring_n_written(capbuf_sync);
+    // Skip ahead to the most recent samples if the searcher has fallen
+    // too far behind, for example after verifying several peaks.
+    if (next-n_pre+SEARCH_RING_LENGTH/2<n_written) {
+      next=n_written-n_copy+n_pre;
+    }
+    if (!ring_copy(capbuf_sync,next-n_pre,n_copy,hf,hf_timestamp,hf_sample_num)) {
+      // The searcher was descheduled for most of the ring. Start over
+      // with the most recent samples.
+      next=ring_n_written(capbuf_sync)-n_copy+n_pre;
+      continue;
+    }
+    const uint64 n_behind=n_written-(next-n_pre+n_copy);
+    const double hf_ts=hf_timestamp(n_pre);
+    next+=search_duty*9600;
+    n_examined++;
+
+    // DC and IQ imbalance were already removed by the producer.
+    // Spurs would otherwise raise the detection threshold.
+    spur.excise(fc_programmed,hf);
+    filter_my(coef,hf);
+    hf=hf.mid(filter_half,n_hf);
+
+    // Correlate against the PSS and estimate the received power.
+    mat corr(3*n_f,9600);
+    conv_capbuf_with_pss_fft(hf.right(n_hf-len_pss),pss_fo_set_fft,len_pss,corr);
+    vec sp_hf(9600);
+    double acc=0;
+    for (uint16 t=0;t<2*len_pss;t++) {
+      acc+=sqr(hf(t));
+    }
+    sp_hf(0)=acc/(2*len_pss);
+    for (uint16 t=1;t<9600;t++) {
+      acc+=sqr(hf(t+2*len_pss-1))-sqr(hf(t-1));
+      sp_hf(t)=acc/(2*len_pss);
     }
 
-    // Results are stored in this vector.
-    list<Cell> detected_cells;
-
-    // Local reference to the capture buffer.
-    cvec &capbuf=capbuf_sync.capbuf;
+    // Add to the accumulators. Correlation offset t of this half frame
+    // belongs to bin r0+t.
+    const uint16 r0=itpp_ext::matlab_mod(round_i(hf_ts),9600);
+    vector <mat> xc_new(3,mat(n_f,9600));
+    vec sp_new(9600);
+    for (uint16 t=0;t<9600;t++) {
+      const uint16 bin=(r0+t)%9600;
+      for (uint8 n_id_2=0;n_id_2<3;n_id_2++) {
+        for (uint16 foi=0;foi<n_f;foi++) {
+          xc_new[n_id_2](foi,bin)=corr(n_id_2*n_f+foi,t);
+        }
+      }
+      sp_new(bin)=sp_hf(t);
+    }
+    for (uint8 n_id_2=0;n_id_2<3;n_id_2++) {
+      xc_acc[n_id_2]+=xc_new[n_id_2];
+    }
+    sp_acc+=sp_new;
+    xc_hist.push_back(xc_new);
+    sp_hist.push_back(sp_new);
+    if (xc_hist.size()>SEARCH_N_COMB) {
+      for (uint8 n_id_2=0;n_id_2<3;n_id_2++) {
+        xc_acc[n_id_2]-=xc_hist.front()[n_id_2];
+      }
+      sp_acc-=sp_hist.front();
+      xc_hist.pop_front();
+      sp_hist.pop_front();
+    }
+    // Sliding sums accumulate rounding errors. Start over from the
+    // contributions that are still part of them every now and then.
+    if (n_examined%SEARCH_N_COMB==0) {
+      for (uint8 n_id_2=0;n_id_2<3;n_id_2++) {
+        xc_acc[n_id_2].zeros();
+        for (uint16 k=0;k<xc_hist.size();k++) {
+          xc_acc[n_id_2]+=xc_hist[k][n_id_2];
+        }
+      }
+      sp_acc.zeros();
+      for (uint16 k=0;k<sp_hist.size();k++) {
+        sp_acc+=sp_hist[k];
+      }
+    }
 
-    capbuf = capbuf - mean(capbuf); // remove DC
+    // Time it takes for a new cell to fill the accumulators.
+    global_thread_data.searcher_cycle_time(SEARCH_N_COMB*search_duty*.005+n_behind/fs_programmed);
+    if (xc_hist.size()<SEARCH_N_COMB)
+      continue;
 
-    #ifdef USE_OPENCL
-      lte_ocl.filter_my(capbuf); // be careful! capbuf.zeros() will slow down the xcorr part pretty much!
-    #else
-      filter_my(coef, capbuf);
-    #endif
-
-    // Correlate
-    uint16 n_comb_xc;
-    uint16 n_comb_sp;
-    if (verbosity>=2) {
-      cout << "  Calculating PSS correlations" << endl;
+    // Same processing as xcorr_pss().
+    const uint16 n_comb_xc=SEARCH_N_COMB;
+    for (uint8 n_id_2=0;n_id_2<3;n_id_2++) {
+      xc_incoherent_single[n_id_2]=xc_acc[n_id_2]/n_comb_xc;
     }
+    sp_incoherent=sp_acc/n_comb_xc;
+    xc_delay_spread(xc_incoherent_single,DS_COMB_ARM,xc_incoherent);
+    xc_peak_freq(xc_incoherent,xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq);
 
-    sampling_ppm_f_search_set_by_pss(lte_ocl, 0, capbuf, pss_fo_set, 1, 0, f_search_set, period_ppm, xc, xcorr_pss_time);
-
-    xcorr_pss(capbuf,f_search_set,DS_COMB_ARM,fc_requested,fc_programmed,fs_programmed,xc,xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,xc_incoherent_single,xc_incoherent,sp_incoherent,sp,n_comb_xc,n_comb_sp,sampling_carrier_twist,k_factor);
+    // Ignore the cells that are already being tracked and the peaks that
+    // were verified recently.
+    {
+      boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+      list<tracked_cell_t *>::iterator tci=tracked_cell_list.tracked_cells.begin();
+      while (tci!=tracked_cell_list.tracked_cells.end()) {
+        mask_bin(xc_incoherent_collapsed_pow,(*tci)->n_id_cell%3,tracked_pss_bin(*(*tci)));
+        ++tci;
+      }
+    }
+    list <search_holdoff_t>::iterator hoi=holdoff.begin();
+    while (hoi!=holdoff.end()) {
+      if ((*hoi).expires<=n_examined) {
+        hoi=holdoff.erase(hoi);
+        continue;
+      }
+      mask_bin(xc_incoherent_collapsed_pow,(*hoi).n_id_2,(*hoi).bin);
+      ++hoi;
+    }
 
     // Calculate the threshold vector
     double R_th1=chi2cdf_inv(1-pow(10.0,-thresh1_n_nines),2*n_comb_xc*(2*DS_COMB_ARM+1));
     vec Z_th1=R_th1*sp_incoherent/rx_cutoff/137/n_comb_xc/(2*DS_COMB_ARM+1);
 
     // Search for the peaks
+    list<Cell> detected_cells;
+    peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,f_search_set,fc_requested,fc_programmed,xc_incoherent_single,DS_COMB_ARM, sampling_carrier_twist, (const double)k_factor, detected_cells);
+    // The ring holds the samples without any frequency correction.
+    reject_image_peaks(0,detected_cells);
+    if (detected_cells.empty())
+      continue;
     if (verbosity>=2) {
-      cout << "  Searching for and examining correlation peaks..." << endl;
+      cout << "  Verifying " << detected_cells.size()/2 << " correlation peaks..." << endl;
+    }
+
+    // Capture buffer containing the most recent samples.
+    cvec capbuf;
+    vec capbuf_timestamp;
+    uint64 capbuf_sample_num;
+    // Copy again if the producer overwrote the oldest samples meanwhile.
+    while (!ring_copy(capbuf_sync,ring_n_written(capbuf_sync)-CAPLENGTH,CAPLENGTH,capbuf,capbuf_timestamp,capbuf_sample_num)) {
+    }
+    const double capbuf_ts=capbuf_timestamp(0);
+    // The trackers keep refining k_factor.
+    k_factor=global_thread_data.k_factor();
+    // Timestamp units per captured sample.
+    const double period=(FS_LTE/16)/(fs_programmed*k_factor);
+
+    // Spurs would otherwise raise the detection threshold.
+    spur.excise(fc_programmed,capbuf);
+
+    #ifdef USE_OPENCL
+      lte_ocl.filter_my(capbuf); // be careful! capbuf.zeros() will slow down the xcorr part pretty much!
+    #else
+      filter_my(coef, capbuf);
+    #endif
+
+    // Do not verify these peaks again for a while and convert the bins to
+    // offsets within the capture buffer.
+    for (list<Cell>::iterator it=detected_cells.begin();it!=detected_cells.end();++it) {
+      search_holdoff_t h;
+      h.n_id_2=(*it).n_id_2;
+      h.bin=(*it).ind;
+      h.expires=n_examined+SEARCH_HOLDOFF;
+      holdoff.push_back(h);
+      (*it).ind=round_i(itpp_ext::matlab_mod((*it).ind-capbuf_ts,9600.0)/period)%9600;
     }
-    peak_search(xc_incoherent_collapsed_pow,xc_incoherent_collapsed_frq,Z_th1,f_search_set,fc_requested,fc_programmed,xc_incoherent_single,DS_COMB_ARM, sampling_carrier_twist, (const double)k_factor, detected_cells);
 
     // Loop and check each peak
     list<Cell>::iterator iterator=detected_cells.begin();
@@ -220,26 +441,25 @@ void searcher_thread(
       tdd_flag = !tdd_flag;
 
       // Detect SSS if possible
-#define THRESH2_N_SIGMA 3
-      (*iterator)=sss_detect((*iterator),capbuf,THRESH2_N_SIGMA,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est_meas,sss_h2_np_est_meas,sss_h1_nrm_est_meas,sss_h2_nrm_est_meas,sss_h1_ext_est_meas,sss_h2_ext_est_meas,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
+      (*iterator)=sss_detect(lte_ocl,(*iterator),capbuf,THRESH2_N_SIGMA,fc_requested,fc_programmed,fs_programmed,sss_h1_np_est_meas,sss_h2_np_est_meas,sss_h1_nrm_est_meas,sss_h2_nrm_est_meas,sss_h1_ext_est_meas,sss_h2_ext_est_meas,log_lik_nrm,log_lik_ext,sampling_carrier_twist,tdd_flag);
       if ((*iterator).n_id_1!=-1) {
         if (verbosity>=2) {
           cout << "Detected PSS/SSS correspoding to cell ID: " << (*iterator).n_id_cell() << endl;
         }
 
+        // Fine FOE
+        (*iterator)=pss_sss_foe((*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,sampling_carrier_twist,tdd_flag);
+
         // Check to see if this cell has already been detected previously.
-        bool match=false;
+        // A cell that reuses the cell ID of a tracked cell but has a
+        // different timing or frequency offset gets its own track. The
+        // coarse frequency of the peak search is not accurate enough to
+        // tell such cells apart.
+        const double frame_timing=itpp_ext::matlab_mod((*iterator).frame_start*period+capbuf_ts,19200.0);
+        bool match;
         {
           boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
-          list<tracked_cell_t *>::iterator tci=tracked_cell_list.tracked_cells.begin();
-          match=false;
-          while (tci!=tracked_cell_list.tracked_cells.end()) {
-            if ((*(*tci)).n_id_cell==(*iterator).n_id_cell()) {
-              match=true;
-              break;
-            }
-            ++tci;
-          }
+          match=cell_is_tracked(tracked_cell_list,(*iterator).n_id_cell(),frame_timing,(*iterator).freq_fine);
         }
         if (match) {
           if (verbosity>=2) {
@@ -249,11 +469,8 @@ void searcher_thread(
           continue;
         }
 
-        // Fine FOE
-        (*iterator)=pss_sss_foe((*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,sampling_carrier_twist,tdd_flag);
-
         // Extract time and frequency grid
-        extract_tfg((*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
+        extract_tfg(lte_ocl,(*iterator),capbuf,fc_requested,fc_programmed,fs_programmed,tfg,tfg_timestamp,sampling_carrier_twist);
 
         // Create object containing all RS
         RS_DL rs_dl((*iterator).n_id_cell(),6,(*iterator).cp_type);
@@ -263,29 +480,18 @@ void searcher_thread(
 
         // Finally, attempt to decode the MIB
         (*iterator)=decode_mib((*iterator),tfg_comp,rs_dl);
-        //cout << (*iterator) << endl << endl;
-        //sleep(100000);
         if ((*iterator).n_rb_dl==-1) {
           // No MIB could be successfully decoded.
           iterator=detected_cells.erase(iterator);
           continue;
         }
 
-        /*
-        if (verbosity>=1) {
-          cout << "Detected a new cell!" << endl;
-          cout << "  cell ID: " << (*iterator).n_id_cell() << endl;
-          cout << "  RX power level: " << db10((*iterator).pss_pow) << " dB" << endl;
-          cout << "  residual frequency offset: " << (*iterator).freq_superfine << " Hz" << endl;
-          cout << "  frame start: " << (*iterator).frame_start << endl;
-        }
-        */
-
-  //      cout << ((*iterator).frame_start) <<  " " << k_factor << " " << capbuf_sync.late << (*iterator).k_factor <<  "\n";
-  //      (*iterator).frame_start = 3619.95;
-  //      capbuf_sync.late = 0;
         // Launch a cell tracker process!
-        //tracked_cell_t * new_cell = new tracked_cell_t((*iterator).n_id_cell(),(*iterator).n_ports,(*iterator).cp_type,(*iterator).frame_start/k_factor+capbuf_sync.late,serial_num((*iterator).n_id_cell()));
+        uint32 track_id;
+        {
+          boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+          track_id=++tracked_cell_list.last_track_id;
+        }
         tracked_cell_t * new_cell = new tracked_cell_t(
           (*iterator).n_id_cell(),
           (*iterator).n_ports,
@@ -294,17 +500,54 @@ void searcher_thread(
           (*iterator).n_rb_dl,
           (*iterator).phich_duration,
           (*iterator).phich_resource,
-          (*iterator).frame_start*(FS_LTE/16)/(fs_programmed*k_factor)+capbuf_sync.late,
-          serial_num((*iterator).n_id_cell())//,
-  //        (*iterator).freq_superfine
+          itpp_ext::matlab_mod((*iterator).frame_start*period+capbuf_ts,19200.0),
+          track_id,
+          MIN((*iterator).n_rb_dl,global_thread_data.n_rb_track_max),
+          (*iterator).freq_superfine
         );
 
-        serial_num((*iterator).n_id_cell())++;
+        // Hand the channel estimates and the SFN found by the searcher
+        // over to the tracker so that it does not need to start from
+        // scratch.
+        {
+          const uint8 n_ports=(*iterator).n_ports;
+          cmat ce(n_ports,tfg_comp.cols());
+          vec sp(n_ports);
+          vec np(n_ports);
+          for (uint8 port=0;port<n_ports;port++) {
+            cmat ce_tfg;
+            chan_est((*iterator),rs_dl,tfg_comp,port,ce_tfg,np(port),sp(port));
+            ce.set_row(port,sum(ce_tfg,1)/ce_tfg.rows());
+          }
+          tracker_warm_start(global_thread_data,*new_cell,ce,sp,np);
+
+          // extract_tfg starts the TFG one frame before frame_start, if
+          // possible. cell.sfn is the SFN of that frame.
+          const double frame_len=.01*fs_programmed*k_factor;
+          const double dft_offset=(((*iterator).cp_type==cp_type_t::NORMAL)?10:32)*16/FS_LTE*fs_programmed*k_factor;
+          double tfg_frame_start=(*iterator).frame_start;
+          if (tfg_frame_start+dft_offset-frame_len>-0.5)
+            tfg_frame_start-=frame_len;
+          new_cell->init_sample_num=capbuf_sample_num+round_i(tfg_frame_start*global_thread_data.oversample);
+          new_cell->init_sfn=(*iterator).sfn;
+        }
+
         // Cannot launch thread here. If thread was launched here, it would
         // have the same (low) priority as the searcher thread.
         {
           boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
-          tracked_cell_list.tracked_cells.push_back(new_cell);
+          // The re-acquisition thread may have resumed the track of this
+          // cell while the MIB was being decoded.
+          if (cell_is_tracked(tracked_cell_list,new_cell->n_id_cell,new_cell->frame_timing(),(*iterator).freq_fine)) {
+            delete new_cell;
+            new_cell=NULL;
+          } else {
+            tracked_cell_list.tracked_cells.push_back(new_cell);
+          }
+        }
+        if (new_cell==NULL) {
+          ++iterator;
+          continue;
         }
         //CALLGRIND_START_INSTRUMENTATION;
   #define MAX_DETECTED 1e6
@@ -323,10 +566,6 @@ void searcher_thread(
         continue;
       }
     }
-
-    global_thread_data.searcher_cycle_time(tt.toc());
-//    global_thread_data.searcher_cycle_time(xcorr_pss_time);
   }
   // Will never reach here...
 }
-
@@ -0,0 +1,130 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include <itpp/signal/transforms.h>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include "common.h"
+#include "macros.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "spur.h"
+
+using namespace itpp;
+using namespace std;
+
+spur_excision_t::spur_excision_t() {
+  notch_fraction=0;
+}
+
+uint16 spur_excision_t::excise(
+  // Inputs
+  const double & fc,
+  // Inputs&Outputs
+  cvec & capbuf
+) {
+  const uint16 M=SPUR_FFT_LENGTH;
+  const uint32 len=length(capbuf);
+  const uint32 n_seg=len/M;
+  notch_fraction=0;
+  if (n_seg==0)
+    return 0;
+
+  // Averaged periodogram. The Hann window keeps the leakage of strong
+  // spurs from raising the noise floor of the surrounding bins.
+  vec win(M);
+  for (uint16 t=0;t<M;t++) {
+    win(t)=0.5-0.5*cos(2*pi*t/M);
+  }
+  vec psd(M);
+  psd.zeros();
+  cvec seg(M);
+  for (uint32 s=0;s<n_seg;s++) {
+    for (uint16 t=0;t<M;t++) {
+      seg(t)=capbuf(s*M+t)*win(t);
+    }
+    psd+=sqr(fft(seg));
+  }
+
+  map <int32,ivec>::iterator it=hits.find(round_i(fc/1e3));
+  if (it==hits.end()) {
+    ivec h(M);
+    h.zeros();
+    it=hits.insert(make_pair(round_i(fc/1e3),h)).first;
+  }
+  ivec & h=it->second;
+
+  // Compare every bin against the median of the surrounding bins.
+  ivec detected(M);
+  ivec mask(M);
+  mask.zeros();
+  vector <double> ref;
+  ref.reserve(2*SPUR_REF_HALF_WIDTH);
+  for (uint16 k=0;k<M;k++) {
+    ref.clear();
+    for (int16 d=-SPUR_REF_HALF_WIDTH;d<=SPUR_REF_HALF_WIDTH;d++) {
+      if ((d<-SPUR_NOTCH_HALF_WIDTH)||(d>SPUR_NOTCH_HALF_WIDTH))
+        ref.push_back(psd(itpp_ext::matlab_mod(k+d,M)));
+    }
+    nth_element(ref.begin(),ref.begin()+ref.size()/2,ref.end());
+    const double floor_pow=ref[ref.size()/2]+1e-30;
+
+    const bool learned=h(k)>=SPUR_LEARN_COUNT;
+    detected(k)=psd(k)>floor_pow*udb10(learned?SPUR_LEARNED_THRESH_DB:SPUR_THRESH_DB);
+    // Learned spurs are removed even when they are masked by a signal.
+    if (detected(k)||learned) {
+      for (int16 d=-SPUR_NOTCH_HALF_WIDTH;d<=SPUR_NOTCH_HALF_WIDTH;d++) {
+        mask(itpp_ext::matlab_mod(k+d,M))=1;
+      }
+    }
+  }
+
+  uint16 n_notch=0;
+  uint16 n_spur=0;
+  for (uint16 k=0;k<M;k++) {
+    n_notch+=mask(k);
+    n_spur+=mask(k)&&!mask(itpp_ext::matlab_mod(k-1,M));
+  }
+  if (n_notch>SPUR_MAX_NOTCH_FRACTION*M) {
+    if (verbosity>=2) {
+      cout << "  Spur excision skipped, " << n_notch << " of " << M << " bins above threshold" << endl;
+    }
+    return 0;
+  }
+  for (uint16 k=0;k<M;k++) {
+    h(k)=detected(k)?MIN(h(k)+1,SPUR_MEMORY):MAX(h(k)-1,0);
+  }
+  if (n_spur==0)
+    return 0;
+
+  // Zero the spurs in the spectrum of the entire capture.
+  cvec X=fft(capbuf);
+  for (uint32 j=0;j<len;j++) {
+    if (mask(round_i((double)j*M/len)%M))
+      X(j)=0;
+  }
+  capbuf=ifft(X);
+  notch_fraction=(double)n_notch/M;
+
+  if (verbosity>=2) {
+    cout << "  Removed " << n_spur << " spurs, " << notch_fraction*100 << "% of the spectrum" << endl;
+  }
+  return n_spur;
+}
+
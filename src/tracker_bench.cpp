@@ -0,0 +1,790 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Measures how many cells the producer and tracker threads of LTE-Tracker
+// can sustain. Synthetic cells are handed directly to the trackers, as if
+// the searcher had found them, and the samples are read from memory.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <list>
+#include <vector>
+#include <queue>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <curses.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "placement.h"
+#include "LTE-Tracker.h"
+
+using namespace itpp;
+using namespace std;
+
+uint8 verbosity=1;
+
+// Length of the synthetic signal, which is repeated for as long as
+// necessary. Must be a multiple of 4 frames so that PBCH TTI's remain
+// aligned when the signal wraps around.
+#define BENCH_FRAMES 8
+// RMS amplitude of the signal relative to the full scale of the 8 bit
+// samples.
+#define BENCH_RMS 0.2
+// Signal time that is processed before the measurements begin, allowing
+// the tracker threads to start and settle.
+#define BENCH_WARMUP 1.0
+// Samples are fed in chunks of this many frames.
+#define BENCH_CHUNK_FRAMES 1
+// When feeding as fast as possible, new samples are only fed when the
+// producer's fifo holds less than this many seconds of samples and every
+// tracker fifo holds less than this many seconds of OFDM symbols.
+#define BENCH_BACKLOG 0.1
+
+// Simple usage screen.
+void print_usage() {
+  cout << "LTE-Tracker-bench (" << BUILD_TYPE << ") help. " << MAJOR_VERSION << "." << MINOR_VERSION << "." << PATCH_LEVEL << endl << endl;
+  cout << "LTE-Tracker-bench [optional_parameters]" << endl;
+  cout << "  Measures how many synthetic cells the LTE-Tracker producer and tracker" << endl;
+  cout << "  threads can process in real time. The number of cells is doubled until" << endl;
+  cout << "  the trackers fall behind and the drop point is then refined by bisection." << endl;
+  cout << "  Basic options" << endl;
+  cout << "    -h --help" << endl;
+  cout << "      print this help screen" << endl;
+  cout << "    -v --verbose" << endl;
+  cout << "      increase status messages from program" << endl;
+  cout << "    -b --brief" << endl;
+  cout << "      reduce status messages from program" << endl;
+  cout << "  Cell options:" << endl;
+  cout << "    -n --max-cells n" << endl;
+  cout << "      largest number of cells to try (default: 256, at most 504)" << endl;
+  cout << "    -p --ports n" << endl;
+  cout << "      number of transmit antenna ports of every cell: 1, 2, or 4 (default: 2)" << endl;
+  cout << "    -e --extended" << endl;
+  cout << "      cells use the extended cyclic prefix" << endl;
+  cout << "    -s --snr dB" << endl;
+  cout << "      SNR of every cell, per resource element (default: 20)" << endl;
+  cout << "    -t --timing-spread n" << endl;
+  cout << "      frame timings are spread uniformly over n samples at 1.92MHz (default: 19200)" << endl;
+  cout << "    -W --wideband n_rb" << endl;
+  cout << "      cells and trackers use n_rb RB's (6, 15, 25, 50, 75, or 100; default: 6)" << endl;
+  cout << "  Benchmark options:" << endl;
+  cout << "    -d --duration s" << endl;
+  cout << "      seconds of signal to measure for each number of cells (default: 5)" << endl;
+  cout << "    -r --realtime" << endl;
+  cout << "      feed samples at the real time rate instead of as fast as possible." << endl;
+  cout << "      The drop point is then the first number of cells that causes data to be dropped." << endl;
+  cout << "    -P --placement mode" << endl;
+  cout << "      thread placement, as in LTE-Tracker: none (default), pin, or rt" << endl;
+  cout << "    -S --searcher D" << endl;
+  cout << "      also run the searcher, examining one half frame out of every D, and" << endl;
+  cout << "      report its CPU use (default: the searcher does not run)" << endl;
+  cout << "    -T --tracker-opencl" << endl;
+  cout << "      measure the capacity twice, with the tracker DFTs performed on the host" << endl;
+  cout << "      and in batches on the OpenCL device, as with LTE-Tracker -T" << endl;
+}
+
+// Parse the command line arguments and return optional parameters as
+// variables.
+// Also performs some basic sanity checks on the parameters.
+void parse_commandline(
+  // Inputs
+  const int & argc,
+  char * const argv[],
+  // Outputs
+  uint16 & n_cells_max,
+  int8 & n_ports,
+  cp_type_t::cp_type_t & cp_type,
+  double & snr_db,
+  double & timing_spread,
+  int8 & n_rb,
+  double & duration,
+  bool & realtime,
+  placement_t::placement_t & placement_mode,
+  uint16 & search_duty,
+  bool & tracker_opencl
+) {
+  // Default values
+  n_cells_max=256;
+  n_ports=2;
+  cp_type=cp_type_t::NORMAL;
+  snr_db=20;
+  timing_spread=19200;
+  n_rb=6;
+  duration=5;
+  realtime=false;
+  placement_mode=placement_t::NONE;
+  search_duty=0;
+  tracker_opencl=false;
+
+  while (1) {
+    static struct option long_options[] = {
+      {"help",          no_argument,       0, 'h'},
+      {"verbose",       no_argument,       0, 'v'},
+      {"brief",         no_argument,       0, 'b'},
+      {"max-cells",     required_argument, 0, 'n'},
+      {"ports",         required_argument, 0, 'p'},
+      {"extended",      no_argument,       0, 'e'},
+      {"snr",           required_argument, 0, 's'},
+      {"timing-spread", required_argument, 0, 't'},
+      {"wideband",      required_argument, 0, 'W'},
+      {"duration",      required_argument, 0, 'd'},
+      {"realtime",      no_argument,       0, 'r'},
+      {"placement",     required_argument, 0, 'P'},
+      {"searcher",      required_argument, 0, 'S'},
+      {"tracker-opencl", no_argument,      0, 'T'},
+      {0, 0, 0, 0}
+    };
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+    int c = getopt_long (argc, argv, "hvbn:p:es:t:W:d:rP:S:T",
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1)
+      break;
+
+    switch (c) {
+      char * endp;
+      case 0:
+        // Code should only get here if a long option was given a non-null
+        // flag value.
+        cout << "Check code!" << endl;
+        ABORT(-1);
+        break;
+      case 'h':
+        print_usage();
+        ABORT(-1);
+        break;
+      case 'v':
+        verbosity=2;
+        break;
+      case 'b':
+        verbosity=0;
+        break;
+      case 'n':
+        n_cells_max=strtol(optarg,&endp,10);
+        if ((optarg==endp)||(*endp!='\0')||(n_cells_max<1)||(n_cells_max>504)) {
+          cerr << "Error: number of cells must be between 1 and 504" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'p':
+        n_ports=strtol(optarg,&endp,10);
+        if ((optarg==endp)||(*endp!='\0')||((n_ports!=1)&&(n_ports!=2)&&(n_ports!=4))) {
+          cerr << "Error: number of ports must be 1, 2, or 4" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'e':
+        cp_type=cp_type_t::EXTENDED;
+        break;
+      case 's':
+        snr_db=strtod(optarg,&endp);
+        if ((optarg==endp)||(*endp!='\0')) {
+          cerr << "Error: could not parse SNR" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 't':
+        timing_spread=strtod(optarg,&endp);
+        if ((optarg==endp)||(*endp!='\0')||(timing_spread<0)||(timing_spread>19200)) {
+          cerr << "Error: timing spread must be between 0 and 19200 samples" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'W':
+        n_rb=strtol(optarg,&endp,10);
+        if ((optarg==endp)||(*endp!='\0')) {
+          cerr << "Error: could not parse number of RB's" << endl;
+          ABORT(-1);
+        }
+        if ((n_rb!=6)&&(n_rb!=15)&&(n_rb!=25)&&(n_rb!=50)&&(n_rb!=75)&&(n_rb!=100)) {
+          cerr << "Error: number of RB's must be 6, 15, 25, 50, 75, or 100" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'd':
+        duration=strtod(optarg,&endp);
+        if ((optarg==endp)||(*endp!='\0')||(duration<=0)) {
+          cerr << "Error: could not parse duration" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'r':
+        realtime=true;
+        break;
+      case 'P':
+        placement_mode=placement_parse(optarg);
+        break;
+      case 'S':
+        search_duty=strtol(optarg,&endp,10);
+        if ((optarg==endp)||(*endp!='\0')||(search_duty<1)) {
+          cerr << "Error: search duty must be at least 1" << endl;
+          ABORT(-1);
+        }
+        break;
+      case 'T':
+#ifdef USE_OPENCL
+        tracker_opencl=true;
+#else
+        cerr << "Error: the tracker can only use OpenCL when it was built with OpenCL support" << endl;
+        ABORT(-1);
+#endif
+        break;
+      case '?':
+        /* getopt_long already printed an error message. */
+        ABORT(-1);
+      default:
+        ABORT(-1);
+    }
+  }
+
+  // Error if extra arguments are found on the command line
+  if (optind<argc) {
+    cerr << "Error: unknown/extra arguments specified on command line" << endl;
+    ABORT(-1);
+  }
+}
+
+// Results of one benchmark run.
+typedef struct {
+  uint16 n_cells;
+  // Signal time divided by the time it took to process it.
+  double realtime_factor;
+  // OFDM symbols processed per second, summed over all trackers.
+  double syms_per_sec;
+  // CPU time used per second of signal, as a fraction of one core.
+  double cpu_per_cell;
+  double cpu_producer;
+  // Zero when the searcher is not running.
+  double cpu_searcher;
+  // The thread that batches the tracker DFTs for the OpenCL device. Zero
+  // when the DFTs are performed by the trackers.
+  double cpu_tracker_fd;
+  // Largest backlog of any tracker, in OFDM symbols, and of the producer,
+  // in samples.
+  uint32 fifo_peak_size;
+  uint32 sampbuf_peak_size;
+  // Worst case delay, in seconds, between a sample being fed to the
+  // producer and its OFDM symbol being processed by a tracker. Only
+  // meaningful when feeding in real time.
+  double peak_latency;
+  uint32 cell_seconds_dropped;
+  uint32 raw_seconds_dropped;
+  // Number of cells whose tracker lost lock.
+  uint32 n_lost;
+} bench_result_t;
+
+// CPU time consumed so far by a thread.
+static double thread_cpu_time(
+  boost::thread & thread
+) {
+  clockid_t cid;
+  struct timespec ts;
+  if ((pthread_getcpuclockid(thread.native_handle(),&cid)!=0)||(clock_gettime(cid,&ts)!=0))
+    return NAN;
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+// CPU time consumed so far by a thread of this process that is only known
+// by its kernel thread ID.
+static double tid_cpu_time(
+  const uint32 & tid
+) {
+  stringstream fn;
+  fn << "/proc/self/task/" << tid << "/stat";
+  ifstream stat(fn.str().c_str());
+  string line;
+  if (!getline(stat,line))
+    return NAN;
+  // The fields after the command name, which may contain spaces. utime
+  // and stime are fields 14 and 15.
+  const size_t pos=line.rfind(')');
+  if (pos==string::npos)
+    return NAN;
+  stringstream fields(line.substr(pos+1));
+  string field;
+  for (uint8 k=3;k<=13;k++)
+    fields >> field;
+  unsigned long utime,stime;
+  if (!(fields >> utime >> stime))
+    return NAN;
+  return (double)(utime+stime)/sysconf(_SC_CLK_TCK);
+}
+
+// Sum of the signals of n_cells cells, quantized to interleaved 8 bit I/Q
+// samples, and the cells with their frame timing.
+static void bench_signal(
+  // Inputs
+  const uint16 & n_cells,
+  const int8 & n_ports,
+  const cp_type_t::cp_type_t & cp_type,
+  const double & snr_db,
+  const double & timing_spread,
+  const int8 & n_rb,
+  const uint16 & oversample,
+  // Outputs
+  vector <int8> & samples,
+  vector <Cell> & cells,
+  vector <cvec> & port_gain,
+  double & scale,
+  double & np
+) {
+  // The same cells are generated every time so that runs with different
+  // numbers of cells can be compared.
+  RNG_reset(12345);
+  const uint32 n_samp=BENCH_FRAMES*19200*oversample;
+  cvec sig=zeros_c(n_samp);
+  cells.resize(n_cells);
+  port_gain.resize(n_cells);
+  for (uint16 k=0;k<n_cells;k++) {
+    Cell & cell=cells[k];
+    // Spread the cell ID's over all the possible values.
+    const uint16 n_id_cell=mod(k*307+11,504);
+    cell.n_id_1=n_id_cell/3;
+    cell.n_id_2=n_id_cell%3;
+    cell.duplex_mode=0;
+    cell.cp_type=cp_type;
+    cell.n_ports=n_ports;
+    cell.n_rb_dl=n_rb;
+    cell.phich_duration=phich_duration_t::NORMAL;
+    cell.phich_resource=phich_resource_t::one;
+    cell.sfn=0;
+    // Frame start, in samples at the full sample rate.
+    cell.frame_start=floor_i(randu()*timing_spread*oversample);
+    port_gain[k].set_size(n_ports);
+    for (uint8 t=0;t<n_ports;t++) {
+      port_gain[k](t)=exp(complex<double>(0,2*pi*randu()));
+    }
+
+    const cvec x=lte_dl_generate(cell,port_gain[k],BENCH_FRAMES,oversample);
+    const uint32 offset=cell.frame_start;
+    for (uint32 t=0;t<n_samp;t++) {
+      sig((t+offset)%n_samp)+=x(t);
+    }
+  }
+
+  // Each RE has unit power and the receiver's DFT is not normalized.
+  np=1/(128*oversample*pow(10,snr_db/10));
+  sig+=randn_c(n_samp)*sqrt(np);
+  scale=BENCH_RMS/sqrt(sigpower(sig));
+  np=np*scale*scale*128*oversample;
+
+  samples.resize(2*n_samp);
+  for (uint32 t=0;t<n_samp;t++) {
+    samples[2*t]=RAIL(round_i(real(sig(t))*scale*128.0),-128,127);
+    samples[2*t+1]=RAIL(round_i(imag(sig(t))*scale*128.0),-128,127);
+  }
+}
+
+// Track n_cells synthetic cells and measure how fast the producer and the
+// trackers can process them.
+static bench_result_t bench_run(
+  const uint16 & n_cells,
+  const int8 & n_ports,
+  const cp_type_t::cp_type_t & cp_type,
+  const double & snr_db,
+  const double & timing_spread,
+  const int8 & n_rb,
+  const uint16 & oversample,
+  const double & duration,
+  const bool & realtime,
+  const placement_t::placement_t & placement_mode,
+  const uint16 & search_duty,
+  const bool & tracker_opencl
+) {
+  vector <int8> samples;
+  vector <Cell> cells;
+  vector <cvec> port_gain;
+  double scale;
+  double np;
+  bench_signal(n_cells,n_ports,cp_type,snr_db,timing_spread,n_rb,oversample,samples,cells,port_gain,scale,np);
+
+  // There is no frequency offset and no sampling clock error.
+  double fc=739e6;
+  const double fs_programmed=FS_LTE/16;
+  global_thread_data_t global_thread_data(fc,fc,fs_programmed,oversample,n_rb,placement_mode);
+  global_thread_data.frequency_offset(0);
+  global_thread_data.initial_frequency_offset(0);
+  global_thread_data.k_factor(1);
+  global_thread_data.correction(1);
+  global_thread_data.sampling_carrier_twist(false);
+  global_thread_data.opencl_platform(0);
+  global_thread_data.opencl_device(0);
+  global_thread_data.filter_workitem(32);
+  global_thread_data.search_duty(MAX(search_duty,1));
+  global_thread_data.tracker_opencl(tracker_opencl);
+
+  // Hand the cells to the trackers the way the searcher would, with
+  // perfect channel estimates.
+  tracked_cell_list_t tracked_cell_list;
+  tracked_cell_list.last_track_id=0;
+  for (uint16 k=0;k<n_cells;k++) {
+    const Cell & cell=cells[k];
+    // The producer's first sample is number 1 and has a timestamp of
+    // 1/oversample-1. frame_timing is 2 samples ahead of the frame start.
+    const double frame_timing=itpp_ext::matlab_mod((cell.frame_start+1)/oversample-1-2,19200.0);
+    tracked_cell_t * new_cell=new tracked_cell_t(
+      cell.n_id_cell(),
+      cell.n_ports,
+      cell.duplex_mode,
+      cell.cp_type,
+      cell.n_rb_dl,
+      cell.phich_duration,
+      cell.phich_resource,
+      frame_timing,
+      ++tracked_cell_list.last_track_id,
+      n_rb,
+      0
+    );
+    cmat ce(n_ports,72);
+    for (uint8 port=0;port<n_ports;port++) {
+      ce.set_row(port,ones_c(72)*port_gain[k](port)*scale);
+    }
+    tracker_warm_start(global_thread_data,*new_cell,ce,ones(n_ports)*scale*scale,ones(n_ports)*np);
+    new_cell->init_sample_num=(uint64)cell.frame_start+1;
+    new_cell->init_sfn=cell.sfn;
+    tracked_cell_list.tracked_cells.push_back(new_cell);
+  }
+
+  // The re-acquisition thread is not running and neither is the searcher,
+  // unless requested. The producer fills the searcher's ring buffer
+  // either way.
+  sampbuf_sync_t sampbuf_sync;
+  sampbuf_sync.fifo_peak_size=0;
+  sampbuf_sync.resampler=NULL;
+  capbuf_sync_t capbuf_sync;
+  capbuf_sync.ring.set_size(SEARCH_RING_LENGTH);
+  capbuf_sync.ring_timestamp.set_size(SEARCH_RING_LENGTH);
+  capbuf_sync.ring_sample_num.resize(SEARCH_RING_LENGTH);
+  capbuf_sync.n_written=0;
+  reacq_sync_t reacq_sync;
+  reacq_sync.request=false;
+  boost::thread producer_thr(producer_thread,boost::ref(sampbuf_sync),boost::ref(capbuf_sync),boost::ref(reacq_sync),boost::ref(global_thread_data),boost::ref(tracked_cell_list),boost::ref(fc));
+  // All the cells are already being tracked, so the searcher only costs
+  // CPU time.
+  boost::thread searcher_thr;
+  if (search_duty>0)
+    searcher_thr=boost::thread(searcher_thread,boost::ref(capbuf_sync),boost::ref(global_thread_data),boost::ref(tracked_cell_list));
+  // This thread takes the place of the pre-producer.
+  global_thread_data.placement.apply(thread_role_t::PRE_PRODUCER);
+
+  const uint32 chunk_size=2*BENCH_CHUNK_FRAMES*19200*oversample;
+  const double chunk_time=BENCH_CHUNK_FRAMES*0.01;
+  const uint16 syms_per_sec=(cp_type==cp_type_t::NORMAL)?14000:12000;
+  const uint32 sampbuf_limit=2*round_i(BENCH_BACKLOG*fs_programmed*oversample);
+  const uint32 fifo_limit=round_i(BENCH_BACKLOG*syms_per_sec);
+
+  // Measurements taken at the beginning and at the end of the measurement
+  // interval.
+  double wall_start=0;
+  double cpu_producer_start=0;
+  double cpu_searcher_start=0;
+  double cpu_tracker_fd_start=0;
+  vector <double> cpu_start(n_cells);
+  uint32 fifo_start=0;
+  uint32 cell_seconds_dropped_start=0;
+  uint32 raw_seconds_dropped_start=0;
+
+  Real_Timer wall_timer;
+  wall_timer.tic();
+  uint32 offset=0;
+  double signal_time=0;
+  bool measuring=false;
+  while (signal_time<BENCH_WARMUP+duration) {
+    if (realtime) {
+      // Wait until the previous chunk would have been received.
+      const double ahead=signal_time-wall_timer.get_time();
+      if (ahead>0)
+        boost::this_thread::sleep(boost::posix_time::microseconds(round_i(ahead*1e6)));
+    } else {
+      // Wait until the producer and the trackers have caught up.
+      while (true) {
+        bool busy;
+        {
+          boost::mutex::scoped_lock lock(sampbuf_sync.mutex);
+          busy=sampbuf_sync.fifo.size()>sampbuf_limit;
+        }
+        {
+          boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+          list <tracked_cell_t *>::iterator it=tracked_cell_list.tracked_cells.begin();
+          while ((!busy)&&(it!=tracked_cell_list.tracked_cells.end())) {
+            boost::mutex::scoped_lock lock2((*it)->fifo_mutex);
+            busy=(*it)->fifo.size()+(*it)->fd_jobs_pending>fifo_limit;
+            ++it;
+          }
+        }
+        if (!busy)
+          break;
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+    }
+
+    // Start measuring once the trackers have settled.
+    if ((!measuring)&&(signal_time>=BENCH_WARMUP)) {
+      measuring=true;
+      wall_start=wall_timer.get_time();
+      cpu_producer_start=thread_cpu_time(producer_thr);
+      if (search_duty>0)
+        cpu_searcher_start=thread_cpu_time(searcher_thr);
+      if (tracker_opencl)
+        cpu_tracker_fd_start=tid_cpu_time(global_thread_data.tracker_fd_thread_id);
+      uint16 k=0;
+      boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+      for (list <tracked_cell_t *>::iterator it=tracked_cell_list.tracked_cells.begin();it!=tracked_cell_list.tracked_cells.end();++it) {
+        cpu_start[k++]=thread_cpu_time((*it)->thread);
+        boost::mutex::scoped_lock lock2((*it)->fifo_mutex);
+        fifo_start+=(*it)->fifo.size()+(*it)->fd_jobs_pending;
+        (*it)->fifo_peak_size=0;
+      }
+      {
+        boost::mutex::scoped_lock lock2(sampbuf_sync.mutex);
+        sampbuf_sync.fifo_peak_size=0;
+      }
+      cell_seconds_dropped_start=global_thread_data.cell_seconds_dropped();
+      raw_seconds_dropped_start=global_thread_data.raw_seconds_dropped();
+    }
+
+    {
+      boost::mutex::scoped_lock lock(sampbuf_sync.mutex);
+      for (uint32 t=0;t<chunk_size;t++) {
+        sampbuf_sync.fifo.push_back(samples[offset++]);
+        if (offset==samples.size())
+          offset=0;
+      }
+      sampbuf_sync.fifo_peak_size=MAX(sampbuf_sync.fifo.size(),sampbuf_sync.fifo_peak_size);
+      sampbuf_sync.condition.notify_one();
+    }
+    signal_time+=chunk_time;
+  }
+
+  // Wait for the producer to distribute the last samples.
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(sampbuf_sync.mutex);
+      if (sampbuf_sync.fifo.size()<2)
+        break;
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+  }
+
+  bench_result_t result;
+  result.n_cells=n_cells;
+  const double wall_time=wall_timer.get_time()-wall_start;
+  result.realtime_factor=duration/wall_time;
+  result.cpu_producer=(thread_cpu_time(producer_thr)-cpu_producer_start)/duration;
+  result.cpu_searcher=(search_duty>0)?(thread_cpu_time(searcher_thr)-cpu_searcher_start)/duration:0;
+  result.cpu_tracker_fd=tracker_opencl?(tid_cpu_time(global_thread_data.tracker_fd_thread_id)-cpu_tracker_fd_start)/duration:0;
+  result.cpu_per_cell=0;
+  result.fifo_peak_size=0;
+  uint32 fifo_end=0;
+  uint16 n_tracked=0;
+  {
+    uint16 k=0;
+    boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+    for (list <tracked_cell_t *>::iterator it=tracked_cell_list.tracked_cells.begin();it!=tracked_cell_list.tracked_cells.end();++it) {
+      // Cells only ever leave the list when they are lost.
+      result.cpu_per_cell+=thread_cpu_time((*it)->thread)-cpu_start[k++];
+      boost::mutex::scoped_lock lock2((*it)->fifo_mutex);
+      fifo_end+=(*it)->fifo.size()+(*it)->fd_jobs_pending;
+      result.fifo_peak_size=MAX(result.fifo_peak_size,(*it)->fifo_peak_size);
+      n_tracked++;
+    }
+    result.n_lost=tracked_cell_list.lost_cells.size();
+  }
+  result.cpu_per_cell=(n_tracked>0)?result.cpu_per_cell/n_tracked/duration:NAN;
+  result.syms_per_sec=((double)n_tracked*syms_per_sec*duration-((double)fifo_end-fifo_start))/wall_time;
+  {
+    boost::mutex::scoped_lock lock(sampbuf_sync.mutex);
+    result.sampbuf_peak_size=sampbuf_sync.fifo_peak_size/2;
+  }
+  // Samples wait in the producer's fifo and then, as part of an OFDM
+  // symbol, in the tracker's fifo.
+  result.peak_latency=result.sampbuf_peak_size/(fs_programmed*oversample)+(double)result.fifo_peak_size/syms_per_sec;
+  result.cell_seconds_dropped=global_thread_data.cell_seconds_dropped()-cell_seconds_dropped_start;
+  result.raw_seconds_dropped=global_thread_data.raw_seconds_dropped()-raw_seconds_dropped_start;
+
+  // The producer, the searcher, and the trackers block on their fifos
+  // once all the data has been processed. Interrupt them there.
+  producer_thr.interrupt();
+  producer_thr.join();
+  if (search_duty>0) {
+    searcher_thr.interrupt();
+    searcher_thr.join();
+  }
+  list <tracked_cell_t *> all_cells=tracked_cell_list.tracked_cells;
+  all_cells.insert(all_cells.end(),tracked_cell_list.lost_cells.begin(),tracked_cell_list.lost_cells.end());
+  for (list <tracked_cell_t *>::iterator it=all_cells.begin();it!=all_cells.end();++it) {
+    (*it)->thread.interrupt();
+    (*it)->thread.join();
+    (*it)->wait_fd_jobs();
+    delete (*it);
+  }
+
+  return result;
+}
+
+// Print one line of the results table.
+static void print_result(
+  const bench_result_t & r
+) {
+  cout << setw(6) << r.n_cells;
+  cout << setw(10) << setprecision(3) << fixed << r.realtime_factor;
+  cout << setw(10) << setprecision(3) << fixed << r.syms_per_sec/1e6;
+  cout << setw(10) << setprecision(2) << fixed << r.cpu_per_cell*100;
+  cout << setw(10) << setprecision(2) << fixed << r.cpu_producer*100;
+  cout << setw(10) << setprecision(2) << fixed << r.cpu_searcher*100;
+  cout << setw(10) << setprecision(2) << fixed << r.cpu_tracker_fd*100;
+  cout << setw(10) << r.fifo_peak_size;
+  cout << setw(10) << r.sampbuf_peak_size;
+  cout << setw(8) << setprecision(1) << fixed << r.peak_latency*1e3;
+  cout << setw(8) << r.cell_seconds_dropped;
+  cout << setw(8) << r.raw_seconds_dropped;
+  cout << setw(6) << r.n_lost;
+  cout << endl;
+}
+
+// A run is sustainable if it kept up with real time without dropping
+// data and without losing any of the cells.
+static bool sustained(
+  const bench_result_t & r,
+  const bool & realtime
+) {
+  if ((r.n_lost>0)||(r.cell_seconds_dropped>0)||(r.raw_seconds_dropped>0))
+    return false;
+  return realtime||(r.realtime_factor>=1);
+}
+
+// Double the number of cells until they can no longer be sustained and
+// then bisect to find the largest number of cells that can. The CPU time
+// of the thread that batches the DFTs for the OpenCL device is shared by
+// all the cells.
+static void find_capacity(
+  const uint16 & n_cells_max,
+  const int8 & n_ports,
+  const cp_type_t::cp_type_t & cp_type,
+  const double & snr_db,
+  const double & timing_spread,
+  const int8 & n_rb,
+  const uint16 & oversample,
+  const double & duration,
+  const bool & realtime,
+  const placement_t::placement_t & placement_mode,
+  const uint16 & search_duty,
+  const bool & tracker_opencl
+) {
+  uint16 good=0;
+  uint16 bad=0;
+  double cpu_per_cell=NAN;
+  uint16 n_cells=1;
+  while (true) {
+    const bench_result_t r=bench_run(n_cells,n_ports,cp_type,snr_db,timing_spread,n_rb,oversample,duration,realtime,placement_mode,search_duty,tracker_opencl);
+    print_result(r);
+    if (sustained(r,realtime)) {
+      good=n_cells;
+      cpu_per_cell=r.cpu_per_cell+r.cpu_tracker_fd/n_cells;
+    } else {
+      bad=n_cells;
+    }
+    if (bad==0) {
+      if (n_cells==n_cells_max)
+        break;
+      n_cells=MIN(2*n_cells,n_cells_max);
+    } else {
+      if (bad-good<=1)
+        break;
+      n_cells=(good+bad)/2;
+    }
+  }
+
+  cout << endl;
+  if (bad==0) {
+    cout << "All " << good << " cells were sustained" << endl;
+  } else {
+    cout << "Drop point: " << bad << " cells" << endl;
+  }
+  if (good>0) {
+    cout << "Largest sustained number of cells: " << good << " (" << setprecision(1) << fixed << 1/cpu_per_cell << " cells per core)" << endl;
+  }
+}
+
+// Main routine.
+int main(
+  const int argc,
+  char * const argv[]
+) {
+  // Command line parameters are stored here.
+  uint16 n_cells_max;
+  int8 n_ports;
+  cp_type_t::cp_type_t cp_type;
+  double snr_db;
+  double timing_spread;
+  int8 n_rb;
+  double duration;
+  bool realtime;
+  placement_t::placement_t placement_mode;
+  uint16 search_duty;
+  bool tracker_opencl;
+  parse_commandline(argc,argv,n_cells_max,n_ports,cp_type,snr_db,timing_spread,n_rb,duration,realtime,placement_mode,search_duty,tracker_opencl);
+
+  // Lowest sample rate that can carry the requested bandwidth.
+  uint16 oversample=1;
+  while (lte_max_rb(oversample)<n_rb)
+    oversample++;
+
+  if (verbosity>=1) {
+    cout << "LTE-Tracker capacity benchmark" << endl;
+    cout << "  " << (int)n_ports << " ports, " << cp_type << " CP, " << (int)n_rb << " RB's at " << oversample*1.92 << " MHz" << endl;
+    cout << "  SNR " << snr_db << " dB, timing spread " << timing_spread << " samples" << endl;
+    cout << "  " << duration << " s of signal per run, " << (realtime?"fed in real time":"fed as fast as possible") << endl;
+    if (search_duty>0) {
+      cout << "  Searcher examines one half frame out of every " << search_duty << endl;
+    }
+    cout << "  " << boost::thread::hardware_concurrency() << " CPU's" << endl;
+    cout << endl;
+  }
+
+  // With -T, the capacity is measured both without and with the OpenCL
+  // device.
+  for (uint8 pass=0;pass<(tracker_opencl?2:1);pass++) {
+    const bool use_opencl=(pass==1);
+    if (pass>0)
+      cout << endl;
+    if (tracker_opencl) {
+      cout << "Tracker DFTs performed " << (use_opencl?"in batches on the OpenCL device":"by the trackers on the host") << endl;
+    }
+    if (verbosity>=1) {
+      cout << " cells  realtime   Msym/s   %cpu/cell %producer %searcher    %batch  fifo pk   in pk  lat ms  c-drop  r-drop  lost" << endl;
+    }
+    find_capacity(n_cells_max,n_ports,cp_type,snr_db,timing_spread,n_rb,oversample,duration,realtime,placement_mode,search_duty,use_opencl);
+  }
+
+  return 0;
+}
@@ -0,0 +1,84 @@
+// An OpenCL accelerated LTE Cell Scanner
+//
+// Written by Jiao Xianjun <putaoshu@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// kernels for the trackers of LTE-Tracker
+// !!!This file should be put into $PATH directory or any other location where program can discover in runtime!!!
+
+#define PI_F 3.14159265358979f
+
+// Frequency offset correction of the OFDM symbols of all the tracked
+// cells, in place. Row r of in holds the n_fft samples of one symbol and
+// sample n is rotated by dphi[r]*n.
+__kernel void tracker_foc( __global float2* in,
+                           __global const float* dphi
+                           )
+{// one work item per sample (1st dim) of every symbol (2nd dim)
+  const int n = get_global_id(0);
+  const int r = get_global_id(1);
+  const int n_fft = get_global_size(0);
+  const float2 x = in[r*n_fft + n];
+  float cs, sn;
+  sn = sincos(dphi[r]*n, &cs);
+  in[r*n_fft + n] = (float2)( x.x*cs - x.y*sn, x.x*sn + x.y*cs );
+}
+
+// Batched DFTs of the OFDM symbols of all the tracked cells, after
+// tracker_foc. Row r of in holds the n_fft samples of one symbol and the
+// DFT starts n_fft/64 samples into the symbol, wrapping around to its
+// beginning. twiddle[m] is exp(-2*pi*i*m/n_fft). Only the subcarriers
+// -n_half[r]..-1 and 1..n_half[r] are returned, in that order, and
+// subcarrier k is rotated by -2*pi*late[r]*k/128 to compensate for a DFT
+// that was taken late[r] samples (at 1.92MHz) away from where it should
+// have been. The rest of the row is set to zero.
+__kernel void tracker_dft( __global const float2* in,
+                           const int n_fft,
+                           __constant float2* twiddle,
+                           __global const float* late,
+                           __global const int* n_half,
+                           __global float2* out
+                           )
+{// one work item per subcarrier (1st dim) of every symbol (2nd dim)
+  const int c = get_global_id(0);
+  const int r = get_global_id(1);
+  const int n_sc_max = get_global_size(0);
+  const int nh = n_half[r];
+  if (c>=2*nh) {
+    out[r*n_sc_max + c] = (float2)(0.0f, 0.0f);
+    return;
+  }
+  const int k = (c<nh)?(c-nh):(c-nh+1);
+  const int n_delay = n_fft/64;
+  __global const float2* x = in + r*n_fft;
+
+  // The twiddle index k*(n-n_delay) mod n_fft advances by k mod n_fft for
+  // each sample. n_fft need not be a power of 2.
+  const int dtw = (k<0)?(k+n_fft):k;
+  int tw = (k*(n_fft-n_delay)) % n_fft;
+  tw = (tw<0)?(tw+n_fft):tw;
+  float2 acc = (float2)(0.0f, 0.0f);
+  int n;
+  for (n=0; n<n_fft; n++) {
+    const float2 w = twiddle[tw];
+    acc = acc + (float2)( x[n].x*w.x - x[n].y*w.y, x[n].x*w.y + x[n].y*w.x );
+    tw += dtw;
+    tw = (tw>=n_fft)?(tw-n_fft):tw;
+  }
+
+  float cs, sn;
+  sn = sincos(-2.0f*PI_F*late[r]*k/128.0f, &cs);
+  out[r*n_sc_max + c] = (float2)( acc.x*cs - acc.y*sn, acc.x*sn + acc.y*cs );
+}
@@ -25,6 +25,7 @@
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
 #include <list>
+#include <map>
 #include <sstream>
 #include <signal.h>
 #include <queue>
@@ -37,6 +38,8 @@
 #include "itpp_ext.h"
 #include "searcher.h"
 #include "dsp.h"
+#include "placement.h"
+#include "ce_filter.h"
 #include "LTE-Tracker.h"
 
 #ifdef HAVE_RTLSDR
@@ -78,6 +81,8 @@ typedef struct {
   double sp;
   double sp_raw;
   double np;
+  // MSE of ce_filt.
+  double ce_err;
   cvec ce_filt;
 } ce_filt_fifo_pdu_t;
 typedef struct {
@@ -87,6 +92,7 @@ typedef struct {
   double sp;
   double sp_raw;
   double np;
+  double ce_err;
   cvec ce_interp;
 } ce_interp_fifo_pdu_t;
 typedef struct {
@@ -96,8 +102,47 @@ typedef struct {
   vec np;
 } mib_fifo_pdu_t;
 
-// Pop 128 time domain samples from the fifo, convert to the frequency
-// domain, and extract the 72 desired subcarriers.
+// Channel estimation filters shared by all the trackers.
+static const ce_filter_bank_t ce_filter_bank;
+
+// Perform FOC to remove ICI, remove the 2 sample delay, convert to the
+// frequency domain, extract the tracked subcarriers and compensate for
+// the fact that the DFT was located improperly.
+void tracker_sym_fd(
+  const cvec & data,
+  const double & dphi,
+  const double & late,
+  const uint16 & n_half,
+  cvec & syms
+) {
+  const uint16 n_fft=length(data);
+  const uint16 n_delay=n_fft/64;
+  cvec dft_in(n_fft);
+  //dft_in=concat(dft_in(2,-1),dft_in(0,1));
+  cvec_simd::rotate(data._data()+n_delay,dphi*n_delay,dphi,dft_in._data(),n_fft-n_delay);
+  cvec_simd::rotate(data._data(),0,dphi,dft_in._data()+n_fft-n_delay,n_delay);
+  cvec dft_out=dft(dft_in);
+  //syms=concat(dft_out.right(36),dft_out.mid(1,36));
+  syms.set_size(2*n_half);
+  for (uint16 t=0;t<n_half;t++) {
+    syms(t+n_half)=dft_out(t+1);
+    syms(t)=dft_out(n_fft-n_half+t);
+  }
+  complex <double> coeff;
+  double phase;
+  const double k=2*pi*late/128;
+  for (uint16 t=1;t<=n_half;t++) {
+    phase=-k*t;
+    coeff.real()=cos(phase);
+    coeff.imag()=sin(phase);
+    syms(n_half-1+t)*=coeff;
+    coeff.imag()=-coeff.imag();
+    syms(n_half-t)*=coeff;
+  }
+}
+
+// Pop one OFDM symbol of time domain samples from the fifo, convert to the
+// frequency domain, and extract the subcarriers that are being tracked.
 void get_fd(
   global_thread_data_t & global_thread_data,
   tracked_cell_t & tracked_cell,
@@ -110,7 +155,8 @@ void get_fd(
   double & bulk_phase_offset,
   cvec & syms,
   double & frequency_offset,
-  double & frame_timing
+  double & frame_timing,
+  double & k_factor
 ) {
   td_fifo_pdu_t pdu;
   {
@@ -133,39 +179,13 @@ void get_fd(
     tracked_cell.fifo.pop();
   }
 
-  // Convert to frequency domain and extract 6 center RB's.
+  // Convert to frequency domain and extract the tracked RB's.
   // Also perform FOC to remove ICI
   frequency_offset=pdu.frequency_offset;
   frame_timing=pdu.frame_timing;
+  k_factor=pdu.k_factor;
 
-  double k_factor;
-  if (global_thread_data.sampling_carrier_twist()) {
-  //  double k_factor=(fc_requested-frequency_offset)/fc_programmed;
-    k_factor=(fc_programmed-frequency_offset)/fc_programmed;
-  } else {
-    k_factor=global_thread_data.k_factor();
-  }
-
-  // Directly manipulate data on the fifo to minimize vector copies.
-  // Remove ICI
-  fshift_inplace(pdu.data,-frequency_offset,fs_programmed*k_factor);
-  // Remove the 2 sample delay
-  cvec dft_in(128);
-  //dft_in=concat(dft_in(2,-1),dft_in(0,1));
-  for (uint8 t=0;t<126;t++) {
-    dft_in(t)=pdu.data.get(t+2);
-  }
-  dft_in(126)=pdu.data.get(0);
-  dft_in(127)=pdu.data.get(1);
-  cvec dft_out=dft(dft_in);
-  //syms=concat(dft_out.right(36),dft_out.mid(1,36));
-  syms.set_size(72);
-  for (uint8 t=0;t<36;t++) {
-    syms(t+36)=dft_out(t+1);
-    syms(t)=dft_out(92+t);
-  }
-  // Compensate for the fact that the DFT was located improperly and also
-  // for the bulk phase offset due to frequency errors.
+  // Compensate for the bulk phase offset due to frequency errors.
   uint8 n_samp_elapsed;
   // How many time samples have passed since the previous DFT?
   if (tracked_cell.cp_type==cp_type_t::EXTENDED) {
@@ -173,20 +193,20 @@ void get_fd(
   } else {
     n_samp_elapsed=(sym_num==0)?128+10:128+9;
   }
-  //syms=exp(J*bulk_phase_offset)*elem_mult(syms,exp((-J*2*pi*tracked_cell.fifo.front().late/128)*cn));
-  complex <double> coeff;
-  double phase;
-  const double k=2*pi*pdu.late/128;
   bulk_phase_offset=WRAP(bulk_phase_offset+2*pi*n_samp_elapsed*(1/(FS_LTE/16))*-frequency_offset,-pi,pi);
   const complex <double> bpo_coeff=complex<double>(cos(bulk_phase_offset),sin(bulk_phase_offset));
-  for (uint8 t=1;t<=36;t++) {
-    phase=-k*t;
-    coeff.real()=cos(phase);
-    coeff.imag()=sin(phase);
-    syms(35+t)*=bpo_coeff*coeff;
-    coeff.imag()=-coeff.imag();
-    syms(36-t)*=bpo_coeff*coeff;
+
+  // The producer may have already performed the FOC, the DFT and the TOC
+  // on the OpenCL device.
+  if (length(pdu.syms)) {
+    syms=pdu.syms*bpo_coeff;
+    return;
   }
+
+  const uint16 & oversample=global_thread_data.oversample;
+  const double dphi=2*pi*-frequency_offset/(fs_programmed*oversample*k_factor);
+  tracker_sym_fd(pdu.data,dphi,pdu.late,tracked_cell.n_sc()/2,syms);
+  syms*=bpo_coeff;
   // At this point, we have the frequency domain data for this slot and
   // this symbol number. FOC and TOC has already been performed.
 }
@@ -196,24 +216,22 @@ cvec filter_ce(
   const ce_raw_fifo_pdu_t & rs_curr,
   const ce_raw_fifo_pdu_t & rs_next
 ) {
-  cvec ce_filt(12);
-  for (uint8 t=0;t<12;t++) {
+  const int16 n_rs=length(rs_curr.ce);
+  // The RS of the previous and next OFDM symbols lie either to the right
+  // or to the left of the RS of the current OFDM symbol.
+  const int16 lo=(rs_prev.shift<rs_curr.shift)?0:-1;
+  cvec ce_filt(n_rs);
+  for (int16 t=0;t<n_rs;t++) {
     complex <double> total=0;
     uint8 n_total=0;
-    ivec ind;
-    ind=itpp_ext::matlab_range(t-1,t+1);
-    del_oob(ind);
-    total=sum(rs_curr.ce.get(ind));
-    n_total=length(ind);
-    if (rs_prev.shift<rs_curr.shift) {
-      ind=itpp_ext::matlab_range(t,t+1);
-    } else {
-      ind=itpp_ext::matlab_range(t-1,t);
+    for (int16 k=MAX(t-1,0);k<=MIN(t+1,n_rs-1);k++) {
+      total+=rs_curr.ce(k);
+      n_total++;
+    }
+    for (int16 k=MAX(t+lo,0);k<=MIN(t+lo+1,n_rs-1);k++) {
+      total+=rs_prev.ce(k)+rs_next.ce(k);
+      n_total+=2;
     }
-    del_oob(ind);
-    total=total+sum(rs_prev.ce.get(ind));
-    total=total+sum(rs_next.ce.get(ind));
-    n_total+=2*length(ind);
     ce_filt(t)=total/n_total;
   }
   return ce_filt;
@@ -221,6 +239,7 @@ cvec filter_ce(
 
 void do_foe(
   global_thread_data_t & global_thread_data,
+  tracked_cell_t & tracked_cell,
   const ce_raw_fifo_pdu_t & rs_prev,
   const ce_raw_fifo_pdu_t & rs_next,
   const double & rs_curr_np,
@@ -229,7 +248,9 @@ void do_foe(
   //if (rs_prev.frame_timing!=rs_next.frame_timing)
   //  return;
 
-  cvec foe=elem_mult(conj(rs_prev.ce),rs_next.ce);
+  const uint16 n_rs=length(ce_filt);
+  cvec foe(n_rs);
+  cvec_simd::mult_conj(rs_prev.ce._data(),rs_next.ce._data(),foe._data(),n_rs);
   // Calculate the noise on each FOE estimate.
   vec foe_np=rs_curr_np*rs_curr_np+2*rs_curr_np*sqr(ce_filt);
   // Calculate the weight to use for each estimate
@@ -264,6 +285,10 @@ void do_foe(
   // is that we will lose one of many (millions?) of updates.
   global_thread_data.frequency_offset(
   ( global_thread_data.frequency_offset()*(1/.000001) + (frequency_offset+residual_f)*(1/residual_f_np) )/(1/.000001+1/residual_f_np) );
+  // The frequency offset of this cell alone. The searcher uses it to
+  // recognize detections of this cell.
+  tracked_cell.frequency_offset(
+  ( tracked_cell.frequency_offset()*(1/.000001) + (frequency_offset+residual_f)*(1/residual_f_np) )/(1/.000001+1/residual_f_np) );
 }
 
 void do_toe_v2(
@@ -271,35 +296,65 @@ void do_toe_v2(
   const ce_raw_fifo_pdu_t & rs_prev,
   const ce_raw_fifo_pdu_t & rs_curr,
   const double & rs_curr_sp,
-  const double & rs_curr_np
+  const double & rs_curr_np,
+  // Outputs
+  double & diff_applied,
+  double & diff_applied_np
 ) {
   complex <double> toe1;
   complex <double> toe2;
-  if (rs_prev.shift<rs_curr.shift) {
-    toe1=sum(elem_mult(conj(rs_prev.ce),rs_curr.ce))/12;
-    toe2=(
-      sum(elem_mult(conj(rs_curr.ce(0,4)),rs_prev.ce(1,5)))+
-      sum(elem_mult(conj(rs_curr.ce(6,10)),rs_prev.ce(7,11)))
-    )/10;
-  } else {
-    toe1=sum(elem_mult(conj(rs_curr.ce),rs_prev.ce))/12;
-    toe2=(
-      sum(elem_mult(conj(rs_prev.ce(0,4)),rs_curr.ce(1,5)))+
-      sum(elem_mult(conj(rs_prev.ce(6,10)),rs_curr.ce(7,11)))
-    )/10;
+  // r1 is the RS with the smaller shift.
+  const complex <double> * r1=rs_prev.ce._data();
+  const complex <double> * r2=rs_curr.ce._data();
+  if (rs_prev.shift>=rs_curr.shift) {
+    r1=rs_curr.ce._data();
+    r2=rs_prev.ce._data();
   }
+  const uint16 n_rs=length(rs_curr.ce);
+  const uint16 n_rs_half=n_rs/2;
+  toe1=cvec_simd::cdot(r1,r2,n_rs)/(double)n_rs;
+  toe2=(
+    cvec_simd::cdot(r2,r1+1,n_rs_half-1)+
+    cvec_simd::cdot(r2+n_rs_half,r1+n_rs_half+1,n_rs_half-1)
+  )/(double)(n_rs-2);
   toe1=toe1/sqrt(rs_curr_sp);
   toe2=toe2/sqrt(rs_curr_sp);
   double delay=-(arg(toe1)+arg(toe2))/2/3/(2*pi/128);
-  double delay_np=MAX(rs_curr_np/rs_curr_sp/2/12,.001);
+  double delay_np=MAX(rs_curr_np/rs_curr_sp/2/n_rs,.001);
 
   // Update frame timing based on TOE
   // This is the only thread that can update the frame timing. Reads and
   // writes to frame_timing are automatically locked by the class.
   double diff=WRAP((rs_curr.frame_timing+delay)-tracked_cell.frame_timing(),-19200.0/2,19200.0/2);
-  diff=(0*(1/.0001)+diff*(1/delay_np))/(1/.0001+1/delay_np);
+  const double weight=(1/delay_np)/(1/.0001+1/delay_np);
+  diff=diff*weight;
   tracked_cell.frame_timing(itpp_ext::matlab_mod(tracked_cell.frame_timing()+diff,19200.0));
   //cout << "TO: " << setprecision(15) << tracked_cell.frame_timing << endl;
+  diff_applied=diff;
+  diff_applied_np=weight*weight*delay_np;
+}
+
+// Update the sampling clock estimate. The frame timing of a cell drifts
+// by diff samples in elapsed samples when k_factor_capture, the k_factor
+// used to timestamp those samples, is wrong.
+void do_sclk(
+  global_thread_data_t & global_thread_data,
+  const double & diff,
+  const double & diff_np,
+  const double & elapsed,
+  const double & k_factor_capture
+) {
+  const double rate=diff/elapsed;
+  const double rate_np=MAX(diff_np/(elapsed*elapsed),1e-20);
+  // Every tracker measures the same drift. The report is therefore
+  // converted to an absolute k_factor so that it is not applied once per
+  // tracker on top of the corrections of the other trackers.
+  const double k_factor_meas=k_factor_capture*(1+rate);
+  // As with the frequency offset, an update from another tracker thread
+  // may occasionally be lost. This does not matter.
+  const double k_factor=global_thread_data.k_factor();
+  global_thread_data.k_factor(
+    ( k_factor*(1/SCLK_PRIOR_NP) + k_factor_meas*(1/rate_np) )/(1/SCLK_PRIOR_NP+1/rate_np) );
 }
 
 void do_toe(
@@ -345,27 +400,29 @@ void do_ac_fd(
   const double & rs_curr_sp,
   const double & rs_curr_np
 ) {
+  // Only the first 12 lags are measured, regardless of how many RB's
+  // are being tracked.
+  const uint16 n_rs=length(rs_curr.ce);
   cvec ac_fd(12);
-  ac_fd=complex <double> (0,0);
   for (uint8 d=0;d<12;d++) {
-    for (uint8 t=0;t<12-d;t++) {
-      ac_fd(d)+=conj(rs_curr.ce(t))*rs_curr.ce(t+d);
-    }
-    ac_fd(d)=ac_fd(d)/(12-d);
+    ac_fd(d)=cvec_simd::cdot(rs_curr.ce._data(),rs_curr.ce._data()+d,n_rs-d)/(double)(n_rs-d);
   }
   // Normalize
   //ac_fd=ac_fd/ac_fd(0);
   ac_fd=ac_fd/rs_curr_sp;
-  vec ac_fd_np=(rs_curr_np*rs_curr_np/(rs_curr_sp*rs_curr_sp)+2*rs_curr_np/rs_curr_sp)/itpp_ext::matlab_range(12.0,-1.0,1.0);
+  vec ac_fd_np=(rs_curr_np*rs_curr_np/(rs_curr_sp*rs_curr_sp)+2*rs_curr_np/rs_curr_sp)/itpp_ext::matlab_range((double)n_rs,-1.0,n_rs-11.0);
   {
     boost::mutex::scoped_lock lock(tracked_cell.meas_mutex);
     tracked_cell.ac_fd=elem_div(tracked_cell.ac_fd*(1/.00001)+elem_mult(ac_fd,to_cvec(1.0/ac_fd_np)),to_cvec(1/.00001+1.0/ac_fd_np));
+    tracked_cell.ac_fd_weight=elem_div(tracked_cell.ac_fd_weight*(1/.00001)+1.0/ac_fd_np,1/.00001+1.0/ac_fd_np);
   }
 }
 
-// Estimate the time domain autocorrelation function.
+// Estimate the time domain autocorrelation function. Ports 2 and 3 have
+// half as many RS symbols as ports 0 and 1 and are averaged separately.
 void do_ac_td(
   tracked_cell_t & tracked_cell,
+  const uint8 & port_num,
   const ce_raw_fifo_pdu_t & rs_curr,
   const double & rs_curr_sp,
   deque <cvec> & ce_history
@@ -383,29 +440,38 @@ void do_ac_td(
     this_xc=NAN;
 #endif
     for (uint8 t=0;t<72;t++) {
-      this_xc(t)=elem_mult_sum(conj(ce_history[71]),ce_history[71-t])/12;
+      this_xc(t)=cvec_simd::cdot(ce_history[71]._data(),ce_history[71-t]._data(),length(rs_curr.ce))/length(rs_curr.ce);
     }
     this_xc=this_xc/rs_curr_sp;
 
     // Update average
     boost::mutex::scoped_lock lock(tracked_cell.meas_mutex);
-    tracked_cell.ac_td=(tracked_cell.ac_td*(1/.00001)+this_xc*1/1)/(1/.00001+1);
+    if (port_num<2) {
+      tracked_cell.ac_td=(tracked_cell.ac_td*(1/.00001)+this_xc*1/1)/(1/.00001+1);
+      tracked_cell.ac_td_weight=(tracked_cell.ac_td_weight*(1/.00001)+1)/(1/.00001+1);
+    } else {
+      tracked_cell.ac_td_23=(tracked_cell.ac_td_23*(1/.00001)+this_xc*1/1)/(1/.00001+1);
+      tracked_cell.ac_td_23_weight=(tracked_cell.ac_td_23_weight*(1/.00001)+1)/(1/.00001+1);
+    }
   }
 }
 
-void interp72(
+// Linearly interpolate the channel estimates on the RS to all the tracked
+// subcarriers.
+void interp_sc(
   const ce_filt_fifo_pdu_t & rs,
   cvec & interp
 ) {
-  interp.set_size(72);
-  uint8 l_x=rs.shift;
+  const uint16 n_rs=length(rs.ce_filt);
+  interp.set_size(6*n_rs);
+  uint16 l_x=rs.shift;
   complex <double> l_y=rs.ce_filt(0);
-  uint8 r_x=rs.shift+6;
+  uint16 r_x=rs.shift+6;
   complex <double> r_y=rs.ce_filt(1);
-  uint8 ptr=1;
-  for (uint8 t=0;t<72;t++) {
+  uint16 ptr=1;
+  for (uint16 t=0;t<6*n_rs;t++) {
     // Advance points if necessary
-    if ((t>r_x)&&(ptr<11)) {
+    if ((t>r_x)&&(ptr<n_rs-1)) {
       l_x=r_x;
       l_y=r_y;
       r_x+=6;
@@ -426,9 +492,9 @@ void interp2d(
 ) {
   // Interpolate in the frequency domain.
   cvec rs_prev_interp;
-  interp72(rs_prev,rs_prev_interp);
+  interp_sc(rs_prev,rs_prev_interp);
   cvec rs_curr_interp;
-  interp72(rs_curr,rs_curr_interp);
+  interp_sc(rs_curr,rs_curr_interp);
 
   // Interpolate in the time domain and push onto FIFO
   uint8 slot_num=rs_prev.slot_num;
@@ -458,6 +524,7 @@ void interp2d(
     double rs_mid_sp=rs_prev.sp+(rs_curr.sp-rs_prev.sp)*(time_offset/time_diff);
     double rs_mid_sp_raw=rs_prev.sp_raw+(rs_curr.sp_raw-rs_prev.sp_raw)*(time_offset/time_diff);
     double rs_mid_np=rs_prev.np+(rs_curr.np-rs_prev.np)*(time_offset/time_diff);
+    double rs_mid_ce_err=rs_prev.ce_err+(rs_curr.ce_err-rs_prev.ce_err)*(time_offset/time_diff);
 
     // Push onto the interpolated CE fifo.
     ce_interp_fifo_pdu_t pdu;
@@ -466,6 +533,7 @@ void interp2d(
     pdu.sp=rs_mid_sp;
     pdu.sp_raw=rs_mid_sp_raw;
     pdu.np=rs_mid_np;
+    pdu.ce_err=rs_mid_ce_err;
     if (!ce_interp_fifo_initialized) {
       // Repeat the very first channel estimates so as to provide CE for
       // slot 0 sym 0.
@@ -562,18 +630,30 @@ int8 do_mib_decode(
   const uint8 & data_sym_num,
   const bvec & scr,
   deque <mib_fifo_pdu_t> & mib_fifo,
-  bool & mib_fifo_synchronized
+  bool & mib_fifo_synchronized,
+  int32 & mib_frame_num,
+  pbch_history_t & pbch_history,
+  uint8 & mib_skip
 ) {
   //static int mib_successes=0;
 
   // Assemble symbols for MIB decoding.
   if ((data_slot_num==1)&&(data_sym_num<=3)) {
-    mib_fifo_pdu_t pdu;
-    pdu.syms=syms;
-    pdu.ce=ce;
-    pdu.sp=sp;
-    pdu.np=np;
-    mib_fifo.push_back(pdu);
+    if (mib_skip) {
+      // The SFN is known. Discard frames until the beginning of the next
+      // PBCH TTI.
+      if (data_sym_num==3) {
+        mib_skip--;
+        mib_frame_num++;
+      }
+    } else {
+      mib_fifo_pdu_t pdu;
+      pdu.syms=syms;
+      pdu.ce=ce;
+      pdu.sp=sp;
+      pdu.np=np;
+      mib_fifo.push_back(pdu);
+    }
   }
 
   // Does the MIB fifo have enough data to attempt MIB decoding?
@@ -591,68 +671,8 @@ int8 do_mib_decode(
     //cout << "pbch_sym: " << pbch_sym << endl;
     //cout << "pbch_ce: " << pbch_ce << endl;
 
-    vec np_mib;
-    cvec syms_mib;
-    // Much of the following code is copied from the searcher...
-    // TODO: wrap copied code into a function.
-    // Perform channel compensation and also estimate noise power in each
-    // symbol.
-    if (tracked_cell.n_ports==1) {
-      cvec gain=conj(elem_div(pbch_ce.get_row(0),to_cvec(sqr(pbch_ce.get_row(0)))));
-      syms_mib=elem_mult(pbch_sym,gain);
-      np_mib=elem_mult(np_pre.get_row(0),sqr(gain));
-      //cout << db10(np_mib) << endl;
-      //cout << np_mib << endl;
-      //cout << abs(gain) << endl;
-      //cout << np_pre.get_row(0) << endl;
-      //cout << (np_pre.get_row(0)<0) << endl;
-      //ABORT(-1);
-    } else {
-      syms_mib.set_size(length(pbch_sym));
-      np_mib.set_size(length(pbch_sym));
-#ifndef NDEBUG
-      syms_mib=NAN;
-      np_mib=NAN;
-#endif
-      for (int32 t=0;t<length(syms_mib);t+=2) {
-        // Simple zero-forcing
-        // http://en.wikipedia.org/wiki/Space-time_block_coding_based_transmit_diversity
-        complex <double> h1,h2;
-        double np_temp;
-        if (tracked_cell.n_ports==2) {
-          h1=(pbch_ce(0,t)+pbch_ce(0,t+1))/2;
-          h2=(pbch_ce(1,t)+pbch_ce(1,t+1))/2;
-          np_temp=(np_pre(0,t)+np_pre(1,t))/2;
-        } else {
-          if (mod(t,4)==0) {
-            h1=(pbch_ce(0,t)+pbch_ce(0,t+1))/2;
-            h2=(pbch_ce(2,t)+pbch_ce(2,t+1))/2;
-            np_temp=(np_pre(0,t)+np_pre(2,t))/2;
-          } else {
-            h1=(pbch_ce(1,t)+pbch_ce(1,t+1))/2;
-            h2=(pbch_ce(3,t)+pbch_ce(3,t+1))/2;
-            np_temp=(np_pre(1,t)+np_pre(3,t))/2;
-          }
-        }
-        complex <double> x1=pbch_sym(t);
-        complex <double> x2=pbch_sym(t+1);
-        double scale=pow(h1.real(),2)+pow(h1.imag(),2)+pow(h2.real(),2)+pow(h2.imag(),2);
-        syms_mib(t)=(conj(h1)*x1+h2*conj(x2))/scale;
-        syms_mib(t+1)=conj((-conj(h2)*x1+h1*conj(x2))/scale);
-        np_mib(t)=(pow(abs(h1)/scale,2)+pow(abs(h2)/scale,2))*np_temp;
-        np_mib(t+1)=np_mib(t);
-      }
-      // 3dB factor comes from precoding for transmit diversity
-      syms_mib*=pow(2,0.5);
-    }
-    //cout << abs(syms_mib) << endl;
-    //cout << arg(syms_mib) << endl;
-    //cout << db10(np_mib) << endl;
-    //ABORT(-1);
-    //cout << "syms_mib: " << syms_mib << endl;
-
     // Extract the bits from the complex modulated symbols.
-    vec e_est=lte_demodulate(syms_mib,np_mib,modulation_t::QAM);
+    vec e_est=pbch_demod(pbch_sym,pbch_ce,np_pre,tracked_cell.n_ports);
     // Unscramble
     //bvec scr=lte_pn(tracked_cell.n_id_cell,length(e_est));
     for (int32 t=0;t<length(e_est);t++) {
@@ -660,19 +680,12 @@ int8 do_mib_decode(
     }
     // Undo ratematching
     mat d_est=lte_conv_deratematch(e_est,40);
-    // Decode
-    bvec c_est=lte_conv_decode(d_est);
-    // Calculate received CRC
-    bvec crc_est=lte_calc_crc(c_est(0,23),CRC16);
-    // Apply CRC mask
-    if (tracked_cell.n_ports==2) {
-      for (uint8 t=0;t<16;t++) {
-        crc_est(t)=1-((int)crc_est(t));
-      }
-    } else if (tracked_cell.n_ports==4) {
-      for (uint8 t=1;t<length(crc_est);t+=2) {
-        crc_est(t)=1-((int)crc_est(t));
-      }
+    // Decode. If this TTI cannot be decoded on its own, try again after
+    // combining it with the previous TTI's.
+    bvec c_est;
+    bool crc_ok=pbch_decode(d_est,tracked_cell.n_ports,c_est);
+    if (!crc_ok) {
+      crc_ok=pbch_decode_combined(d_est,mib_frame_num,tracked_cell.n_ports,pbch_history,c_est);
     }
 
     // Unpack MIB information bits that are used to determine whether
@@ -725,7 +738,7 @@ int8 do_mib_decode(
 
     // Did we find it?
     if (
-      (crc_est==c_est(24,-1)) &&
+      crc_ok &&
       (n_rb_dl_est==tracked_cell.n_rb_dl) &&
       (phich_duration_est==tracked_cell.phich_duration) &&
       (phich_resource_est==tracked_cell.phich_resource)
@@ -738,7 +751,13 @@ int8 do_mib_decode(
       for (uint8 t=0;t<16;t++) {
         mib_fifo.pop_front();
       }
+      mib_frame_num+=4;
+      pbch_history.clear();
     } else {
+      // Keep the soft bits for combining with later TTI's.
+      Array <mat> d_est_ports(3);
+      d_est_ports((tracked_cell.n_ports==4)?2:(tracked_cell.n_ports-1))=d_est;
+      pbch_history_add(pbch_history,mib_frame_num,d_est_ports);
       if (mib_fifo_synchronized) {
         {
           boost::mutex::scoped_lock lock(tracked_cell.meas_mutex);
@@ -747,6 +766,12 @@ int8 do_mib_decode(
         for (uint8 t=0;t<16;t++) {
           mib_fifo.pop_front();
         }
+        mib_frame_num+=4;
+        // The TTI alignment may be wrong, for example if the SFN handed
+        // over by the searcher was wrong. Slide through the frames again.
+        if (tracked_cell.mib_decode_failures>=MIB_RESYNC_THRESHOLD) {
+          mib_fifo_synchronized=false;
+        }
       } else {
         {
           boost::mutex::scoped_lock lock(tracked_cell.meas_mutex);
@@ -755,6 +780,7 @@ int8 do_mib_decode(
         for (uint8 t=0;t<4;t++) {
           mib_fifo.pop_front();
         }
+        mib_frame_num++;
       }
     }
 
@@ -772,6 +798,34 @@ int8 do_mib_decode(
   return 0;
 }
 
+// State of the PSS/SSS measurements of one tracker.
+typedef struct {
+  // Conjugated frequency domain PSS and SSS of the cell. The SSS of slot 0
+  // and of slot 10 differ.
+  cvec pss_ref;
+  cvec sss_ref[2];
+  // SSS symbol that is waiting for the PSS symbol that follows it.
+  cvec sss_sym;
+  // Scratch space, allocated once.
+  cvec ce_pss_raw;
+  cvec ce_sss_raw;
+  cvec sync_ce;
+} sync_meas_t;
+
+// Compute the references of a cell and allocate the scratch space.
+void sync_meas_init(
+  const tracked_cell_t & tracked_cell,
+  sync_meas_t & sm
+) {
+  sm.pss_ref=conj(ROM_TABLES.pss_fd[tracked_cell.n_id_2]);
+  // The SSS is real.
+  for (uint8 t=0;t<2;t++)
+    sm.sss_ref[t]=to_cvec(ROM_TABLES.sss_fd(tracked_cell.n_id_1,tracked_cell.n_id_2,t));
+  sm.ce_pss_raw.set_size(62);
+  sm.ce_sss_raw.set_size(62);
+  sm.sync_ce=zeros_c(72);
+}
+
 // Measure signal and noise power using the SSS and PSS. More accurate
 // than using the CRS.
 // Also perform channel estimation and store results.
@@ -780,7 +834,7 @@ void do_pss_sss_sigpower_ce(
   const cvec & syms,
   const uint8 & slot_num,
   const uint8 & sym_num,
-  cvec & sss_sym
+  sync_meas_t & sm
 ) {
   // Only examine PSS and SSS symbols
   if (((slot_num!=0)&&(slot_num!=10))||((sym_num!=tracked_cell.n_symb_dl()-2)&&(sym_num!=tracked_cell.n_symb_dl()-1))) {
@@ -789,37 +843,60 @@ void do_pss_sss_sigpower_ce(
 
   // Store the SSS symbol for when the PSS symbol arrives.
   if (sym_num==tracked_cell.n_symb_dl()-2) {
-    sss_sym=syms;
+    sm.sss_sym=syms;
     return;
   }
+  // Tracking may start in between the SSS and the PSS.
+  if (length(sm.sss_sym)==0)
+    return;
 
-  const cvec & pss_sym=syms;
+  const complex <double> * pss_sym=syms._data();
+  const complex <double> * sss_sym=sm.sss_sym._data();
 
   // Measure noise power on 'unoccupied' subcarriers.
-  const double np_blank=(sigpower(sss_sym(0,4))+sigpower(sss_sym(67,71))+sigpower(pss_sym(0,4))+sigpower(pss_sym(67,71)))/4;
+  const double np_blank=(
+    cvec_simd::power(sss_sym,5)+cvec_simd::power(sss_sym+67,5)+
+    cvec_simd::power(pss_sym,5)+cvec_simd::power(pss_sym+67,5)
+  )/20;
 
   // Rotate back.
-  cvec ce_sss_raw=elem_mult(sss_sym(5,66),to_cvec(ROM_TABLES.sss_fd(tracked_cell.n_id_1,tracked_cell.n_id_2,(slot_num==0)?0:1)));
-  cvec ce_pss_raw=elem_mult(pss_sym(5,66),conj(ROM_TABLES.pss_fd[tracked_cell.n_id_2]));
-
-  // Smoothing
-  cvec ce_smooth(62);
+  complex <double> * ce_sss_raw=sm.ce_sss_raw._data();
+  complex <double> * ce_pss_raw=sm.ce_pss_raw._data();
+  cvec_simd::mult(sss_sym+5,sm.sss_ref[(slot_num==0)?0:1]._data(),ce_sss_raw,62);
+  cvec_simd::mult(pss_sym+5,sm.pss_ref._data(),ce_pss_raw,62);
+
+  // Smoothing over a window of up to 13 subcarriers, using a running sum
+  // of both raw estimates. Signal and noise power are accumulated in the
+  // same pass.
+  complex <double> * ce_smooth=sm.sync_ce._data()+5;
+  complex <double> window=0;
+  for (uint8 t=0;t<=6;t++)
+    window+=ce_sss_raw[t]+ce_pss_raw[t];
+  double tp=0;
+  double np_sss=0;
+  double np_pss=0;
   for (uint8 t=0;t<62;t++) {
-    uint8 lt=MAX(0,t-6);
-    uint8 rt=MIN(t+6,61);
-    ce_smooth(t)=(sum(ce_sss_raw(lt,rt))+sum(ce_pss_raw(lt,rt)))/(2*(rt-lt+1));
-    //ce_smooth(t)=(sum(ce_sss_raw(lt,rt)))/(1*(rt-lt+1));
+    const uint8 lt=MAX(0,t-6);
+    const uint8 rt=MIN(t+6,61);
+    const complex <double> c=window/(double)(2*(rt-lt+1));
+    ce_smooth[t]=c;
+    tp+=norm(c);
+    np_sss+=norm(c-ce_sss_raw[t]);
+    np_pss+=norm(c-ce_pss_raw[t]);
+    // Slide the window.
+    if (t+7<62)
+      window+=ce_sss_raw[t+7]+ce_pss_raw[t+7];
+    if (t>=6)
+      window-=ce_sss_raw[t-6]+ce_pss_raw[t-6];
   }
 
   // Measure SP and NP
   // Note correction for estimation bias.
-  double np=(sigpower(ce_smooth-ce_sss_raw)*13/12+sigpower(ce_smooth-ce_pss_raw)*13/12)/2;
-  //double np=(sigpower(concat(ce_smooth-ce_sss_raw,ce_smooth-ce_pss_raw))*13/12)/1;
-  //double np=(sigpower(ce_smooth-ce_sss_raw)*13/12)/1;
-  double tp=sigpower(ce_smooth);
+  tp/=62;
+  const double np=(np_sss+np_pss)/62*13/12/2;
   // Note that this value can be negative! The expected value of this
   // measurement, however, is positive.
-  double sp=tp-np/13;
+  const double sp=tp-np/13;
 
   // Store results
   {
@@ -828,7 +905,7 @@ void do_pss_sss_sigpower_ce(
     tracked_cell.sync_sp=sp;
     tracked_cell.sync_np=np;
     tracked_cell.sync_np_blank=np_blank;
-    tracked_cell.sync_ce=concat(zeros_c(5),ce_smooth,zeros_c(5));
+    tracked_cell.sync_ce=sm.sync_ce;
     if (isnan(tracked_cell.sync_sp_av)) {
       tracked_cell.sync_tp_av=tp;
       tracked_cell.sync_sp_av=sp;
@@ -843,15 +920,98 @@ void do_pss_sss_sigpower_ce(
   }
 }
 
+void tracker_warm_start(
+  global_thread_data_t & global_thread_data,
+  tracked_cell_t & tracked_cell,
+  const cmat & ce,
+  const vec & sp,
+  const vec & np
+) {
+  const uint8 n_ports=tracked_cell.n_ports;
+  ASSERT(ce.rows()==n_ports);
+  ASSERT(ce.cols()<=tracked_cell.n_sc());
+
+  // Same bias correction as used by the tracker.
+  vec tp=sp+np/7;
+  // The searcher only estimated the central subcarriers.
+  tracked_cell.ce=zeros_c(n_ports,tracked_cell.n_sc());
+  tracked_cell.ce.set_submatrix(0,(tracked_cell.n_sc()-ce.cols())/2,ce);
+  for (uint8 t=0;t<n_ports;t++) {
+    tracked_cell.crs_tp(t)=tp(t);
+    tracked_cell.crs_sp_raw(t)=sp(t);
+    tracked_cell.crs_np(t)=np(t);
+  }
+  tracked_cell.crs_tp_av=tracked_cell.crs_tp;
+  tracked_cell.crs_sp_raw_av=tracked_cell.crs_sp_raw;
+  tracked_cell.crs_np_av=tracked_cell.crs_np;
+
+  // Frequency domain autocorrelation of the port 0 channel, sampled at the
+  // RS spacing.
+  const double sp0=MAX(.00001,sp(0));
+  const uint16 n_rs=ce.cols()/6;
+  cvec rs(n_rs);
+  for (uint16 k=0;k<n_rs;k++) {
+    rs(k)=ce(0,6*k);
+  }
+  for (uint8 d=0;d<MIN(n_rs,length(tracked_cell.ac_fd));d++) {
+    tracked_cell.ac_fd(d)=cvec_simd::cdot(rs._data(),rs._data()+d,n_rs-d)/(double)(n_rs-d)/sp0;
+  }
+  tracked_cell.ac_fd_weight=1;
+
+  // The searcher's frequency offset estimate of this cell is combined with
+  // the system frequency offset in the same way as one do_foe() update
+  // that used the RS of port 0.
+  if (!isnan(tracked_cell.freq_superfine)) {
+    const double foe_np=(np(0)*np(0)+2*np(0)*sp0)/(sp0*sp0)/n_rs;
+    const double residual_f_np=MAX(foe_np/2,.001);
+    global_thread_data.frequency_offset(
+    ( global_thread_data.frequency_offset()*(1/.000001) + tracked_cell.freq_superfine*(1/residual_f_np) )/(1/.000001+1/residual_f_np) );
+  }
+}
+
+void tracker_resume(
+  tracked_cell_t & tracked_cell,
+  const tracked_cell_t & lost_cell
+) {
+  tracked_cell.crs_tp=lost_cell.crs_tp;
+  tracked_cell.crs_sp_raw=lost_cell.crs_sp_raw;
+  tracked_cell.crs_np=lost_cell.crs_np;
+  tracked_cell.crs_tp_av=lost_cell.crs_tp_av;
+  tracked_cell.crs_sp_raw_av=lost_cell.crs_sp_raw_av;
+  tracked_cell.crs_np_av=lost_cell.crs_np_av;
+  tracked_cell.ce=lost_cell.ce;
+  tracked_cell.sync_tp=lost_cell.sync_tp;
+  tracked_cell.sync_sp=lost_cell.sync_sp;
+  tracked_cell.sync_np=lost_cell.sync_np;
+  tracked_cell.sync_np_blank=lost_cell.sync_np_blank;
+  tracked_cell.sync_ce=lost_cell.sync_ce;
+  tracked_cell.sync_tp_av=lost_cell.sync_tp_av;
+  tracked_cell.sync_sp_av=lost_cell.sync_sp_av;
+  tracked_cell.sync_np_av=lost_cell.sync_np_av;
+  tracked_cell.sync_np_blank_av=lost_cell.sync_np_blank_av;
+  tracked_cell.ac_fd=lost_cell.ac_fd;
+  tracked_cell.ac_td=lost_cell.ac_td;
+  tracked_cell.ac_td_23=lost_cell.ac_td_23;
+  tracked_cell.ac_fd_weight=lost_cell.ac_fd_weight;
+  tracked_cell.ac_td_weight=lost_cell.ac_td_weight;
+  tracked_cell.ac_td_23_weight=lost_cell.ac_td_23_weight;
+}
+
 // Process that tracks a cell that has been found by the searcher.
 void tracker_thread(
   tracked_cell_t & tracked_cell,
   global_thread_data_t & global_thread_data
 ) {
+  global_thread_data.placement.apply(thread_role_t::TRACKER);
+
   // Pre-compute some information.
   //ivec cn=concat(itpp_ext::matlab_range(-36,-1),itpp_ext::matlab_range(1,36));
   // Reference symbols
-  RS_DL rs_dl(tracked_cell.n_id_cell,6,tracked_cell.cp_type);
+  RS_DL rs_dl(tracked_cell.n_id_cell,tracked_cell.n_rb_track,tracked_cell.cp_type);
+  const uint16 n_sc=tracked_cell.n_sc();
+  const uint16 n_rs=2*tracked_cell.n_rb_track;
+  // The PSS, SSS, and PBCH occupy the central 6 RB's.
+  const uint16 sc_6rb=tracked_cell.sc_offset_6rb();
   // MIB scrambling sequence.
   const bvec scr=lte_pn(tracked_cell.n_id_cell,(tracked_cell.cp_type==cp_type_t::NORMAL)?1920:1728);
 
@@ -867,7 +1027,22 @@ void tracker_thread(
   vector <uint8> ce_interp_fifo_initialized(tracked_cell.n_ports,0);
   deque <mib_fifo_pdu_t> mib_fifo;
   bool mib_fifo_synchronized=false;
-  cvec sss_sym;
+  // Absolute frame number of the first frame in mib_fifo and the soft bits
+  // of the TTI's that could not be decoded.
+  int32 mib_frame_num=0;
+  pbch_history_t pbch_history;
+  // Frames to skip before the MIB fifo is aligned with a PBCH TTI.
+  uint8 mib_skip=0;
+  bool first_symbol=true;
+  sync_meas_t sync_meas;
+  sync_meas_init(tracked_cell,sync_meas);
+  // Timing corrections applied since the sampling clock was last updated.
+  double sclk_diff=0;
+  double sclk_diff_np=0;
+  uint16 sclk_n_slots=0;
+  // The k_factor the received samples were timestamped with.
+  double sclk_k_factor_sum=0;
+  uint32 sclk_n_syms=0;
   //double mib_fifo_decode_failures=0;
   // Store the channel estimates so that the time domain channel
   // autocorrelation function can be estimated.
@@ -895,8 +1070,22 @@ void tracker_thread(
     cvec syms;
     double frequency_offset;
     double frame_timing;
+    double k_factor;
     //get_fd(tracked_cell,global_thread_data.fc,slot_num,sym_num,cn,bulk_phase_offset,syms,frequency_offset,frame_timing);
-    get_fd(global_thread_data,tracked_cell,global_thread_data.fc_requested,global_thread_data.fc_programmed,global_thread_data.fs_programmed,slot_num,sym_num,bulk_phase_offset,syms,frequency_offset,frame_timing);
+    get_fd(global_thread_data,tracked_cell,global_thread_data.fc_requested,global_thread_data.fc_programmed,global_thread_data.fs_programmed,slot_num,sym_num,bulk_phase_offset,syms,frequency_offset,frame_timing,k_factor);
+    sclk_k_factor_sum+=k_factor;
+    sclk_n_syms++;
+
+    // If the searcher decoded the SFN, the MIB fifo can be aligned with
+    // the PBCH TTI's from the start.
+    if (first_symbol) {
+      first_symbol=false;
+      if (tracked_cell.sfn_first>=0) {
+        mib_frame_num=tracked_cell.sfn_first;
+        mib_skip=mod(4-mod(tracked_cell.sfn_first,4),4);
+        mib_fifo_synchronized=true;
+      }
+    }
 
     // Save this information into the data fifo for further processing
     // once channel estimates are ready. Channel estimates for this OFDM
@@ -914,11 +1103,12 @@ void tracker_thread(
       if (isnan(shift))
         continue;
       //cout << "S" << shift << endl;
-      cvec rs_raw=syms(itpp_ext::matlab_range(round_i(shift),6,71));
+      cvec rs_raw=syms(itpp_ext::matlab_range(round_i(shift),6,n_sc-1));
       //cout << "A" << rs_dl.get_rs(slot_num,sym_num) << endl;
       //cout << slot_num << " x " << sym_num << endl;
       //cout << "B" << rs_raw << endl;
-      cvec ce_raw=elem_mult(rs_raw,conj(rs_dl.get_rs(slot_num,sym_num)));
+      cvec ce_raw(n_rs);
+      cvec_simd::mult_conj(rs_dl.get_rs(slot_num,sym_num)._data(),rs_raw._data(),ce_raw._data(),n_rs);
       ce_raw_fifo_pdu_t cerp;
       cerp.shift=shift;
       cerp.slot_num=slot_num;
@@ -944,7 +1134,8 @@ void tracker_thread(
       ce_raw_fifo_pdu_t & rs_curr=ce_raw_fifo[port_num][1];
       ce_raw_fifo_pdu_t & rs_next=ce_raw_fifo[port_num][2];
 
-      // Perform primitive filtering by averaging nearby samples.
+      // Perform primitive filtering by averaging nearby samples. This is
+      // only used for the power measurements and for FOE.
       const cvec rs_curr_filt=filter_ce(rs_prev,rs_curr,rs_next);
       // Note correction for the estimation bias.
       const double rs_curr_np=sigpower(rs_curr.ce-rs_curr_filt)*7/6;
@@ -965,21 +1156,45 @@ void tracker_thread(
       pdu.sp=rs_curr_sp;
       pdu.sp_raw=rs_curr_sp_raw;
       pdu.np=rs_curr_np;
-      pdu.ce_filt=rs_curr_filt;
+      // The channel estimates themselves come from the MMSE filter that
+      // matches the measured delay spread, Doppler, and SNR. Until the
+      // autocorrelation averages have seen enough RS, the primitive
+      // filter is used instead.
+      double rho_fd;
+      double rho_td;
+      double ac_td_weight;
+      {
+        boost::mutex::scoped_lock lock(tracked_cell.meas_mutex);
+        rho_fd=abs(tracked_cell.ac_fd_est()(1));
+        rho_td=abs(tracked_cell.ac_td_est(port_num)(CE_FILTER_AC_TD_LAG));
+        ac_td_weight=(port_num<2)?tracked_cell.ac_td_weight:tracked_cell.ac_td_23_weight;
+      }
+      if (ac_td_weight<CE_FILTER_AC_TD_MIN_WEIGHT) {
+        pdu.ce_filt=rs_curr_filt;
+        pdu.ce_err=rs_curr_np/7;
+      } else {
+        const uint16 ce_filter_idx=ce_filter_bank.select(port_num,rho_fd,rho_td,rs_curr_sp/rs_curr_np);
+        pdu.ce_filt=ce_filter_bank.filter(ce_filter_idx,rs_prev.ce,rs_curr.ce,rs_next.ce,rs_prev.shift<rs_curr.shift);
+        pdu.ce_err=rs_curr_sp*ce_filter_bank.mse(ce_filter_idx);
+      }
       ce_filt_fifo[port_num].push_back(pdu);
 
       // FOE
-      do_foe(global_thread_data,rs_prev,rs_next,rs_curr_np,rs_curr_filt);
+      do_foe(global_thread_data,tracked_cell,rs_prev,rs_next,rs_curr_np,rs_curr_filt);
 
       // TOE
       //do_toe(tracked_cell,rs_curr,rs_curr_filt,rs_curr_np);
-      do_toe_v2(tracked_cell,rs_prev,rs_curr,rs_curr_sp,rs_curr_np);
+      double diff_applied;
+      double diff_applied_np;
+      do_toe_v2(tracked_cell,rs_prev,rs_curr,rs_curr_sp,rs_curr_np,diff_applied,diff_applied_np);
+      sclk_diff+=diff_applied;
+      sclk_diff_np+=diff_applied_np;
 
       // Estimate frequency domain autocorrelations.
       do_ac_fd(tracked_cell,rs_curr,rs_curr_sp,rs_curr_np);
 
       // Estimate the time domain autocorrelation function.
-      do_ac_td(tracked_cell,rs_curr,rs_curr_sp,ce_history[port_num]);
+      do_ac_td(tracked_cell,port_num,rs_curr,rs_curr_sp,ce_history[port_num]);
 
       // Finished working with the raw channel estimates.
       ce_raw_fifo[port_num].pop_front();
@@ -1021,11 +1236,12 @@ void tracker_thread(
       // For this OFDM symbol, extract the symbols, the channel estimates,
       // signal power, etc.
       cvec & syms=data_fifo.front().syms;
-      cmat ce(tracked_cell.n_ports,72);
+      cmat ce(tracked_cell.n_ports,n_sc);
       vec tp(tracked_cell.n_ports);
       vec sp(tracked_cell.n_ports);
       vec sp_raw(tracked_cell.n_ports);
       vec np(tracked_cell.n_ports);
+      vec ce_err(tracked_cell.n_ports);
       uint8 data_slot_num=data_fifo.front().slot_num;
       uint8 data_sym_num=data_fifo.front().sym_num;
       for (uint8 t=0;t<tracked_cell.n_ports;t++) {
@@ -1034,6 +1250,7 @@ void tracker_thread(
         sp(t)=ce_interp_fifo[t].front().sp;
         sp_raw(t)=ce_interp_fifo[t].front().sp_raw;
         np(t)=ce_interp_fifo[t].front().np;
+        ce_err(t)=ce_interp_fifo[t].front().ce_err;
       }
 
       // Store channel estimates
@@ -1068,11 +1285,16 @@ void tracker_thread(
         }
       }
 
+      // The remaining tasks only use the central 6 RB's.
+      const cvec syms_6rb=(n_sc==72)?syms:syms.mid(sc_6rb,72);
+      const cmat ce_6rb=(n_sc==72)?ce:ce.get_cols(sc_6rb,sc_6rb+71);
+
       // Measure signal power and noise power on PSS/SSS (more accurate)
-      do_pss_sss_sigpower_ce(tracked_cell,syms,data_slot_num,data_sym_num,sss_sym);
+      do_pss_sss_sigpower_ce(tracked_cell,syms_6rb,data_slot_num,data_sym_num,sync_meas);
 
-      // Perform MIB decoding
-      if (do_mib_decode(tracked_cell,syms,ce,sp,np,data_slot_num,data_sym_num,scr,mib_fifo,mib_fifo_synchronized)==-1) {
+      // Perform MIB decoding. The demodulator sees the channel estimation
+      // error as additional noise.
+      if (do_mib_decode(tracked_cell,syms_6rb,ce_6rb,sp,np+ce_err,data_slot_num,data_sym_num,scr,mib_fifo,mib_fifo_synchronized,mib_frame_num,pbch_history,mib_skip)==-1) {
         // We have failed to detect an MIB for a long time. Exit this
         // thread.
         //cout << "Tracker thread exiting..." << endl;
@@ -1088,6 +1310,22 @@ void tracker_thread(
 
     // Increase the local counter.
     slot_sym_inc(tracked_cell.n_symb_dl(),slot_num,sym_num);
+
+    // Use the timing drift to track the sampling clock. When sampling and
+    // carrier are twisted, k_factor follows the frequency offset instead.
+    if (sym_num==0) {
+      sclk_n_slots++;
+      if (sclk_n_slots==SCLK_UPDATE_SLOTS) {
+        if (!global_thread_data.sampling_carrier_twist()) {
+          do_sclk(global_thread_data,sclk_diff,sclk_diff_np,sclk_n_slots*960.0,sclk_k_factor_sum/sclk_n_syms);
+        }
+        sclk_diff=0;
+        sclk_diff_np=0;
+        sclk_n_slots=0;
+        sclk_k_factor_sum=0;
+        sclk_n_syms=0;
+      }
+    }
   }
 }
 
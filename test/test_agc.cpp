@@ -0,0 +1,126 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include <map>
+#include <stdio.h>
+#include "common.h"
+#include "macros.h"
+#include "dsp.h"
+#include "agc.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Simulated 8 bit receiver. The signal has a power of p_in_dbfs at the
+// ADC when the gain is 0dB.
+cvec simulated_capture(
+  const double & p_in_dbfs,
+  const int16 & gain,
+  const uint32 & n
+) {
+  cvec x=randn_c(n)*sqrt(udb10(p_in_dbfs+gain));
+  cvec r(n);
+  for (uint32 t=0;t<n;t++) {
+    const double re=MIN(MAX(round_i(x(t).real()*128),-128),127)/128.0;
+    const double im=MIN(MAX(round_i(x(t).imag()*128),-128),127)/128.0;
+    r(t)=complex<double>(re,im);
+  }
+  return r;
+}
+
+// Run the control loop the same way agc_set_gain() does and check that it
+// settles at a gain that neither clips nor wastes ADC range.
+uint32 check_settle(
+  agc_t & agc,
+  const double & fc,
+  const double & p_in_dbfs
+) {
+  uint8 n_iter=0;
+  while (n_iter<AGC_MAX_ITER) {
+    n_iter++;
+    cvec capbuf=simulated_capture(p_in_dbfs,agc.gain(fc),AGC_HEAD_LENGTH);
+    if (!agc.update(fc,agc_measure(capbuf,AGC_HEAD_LENGTH,agc.clip_level)))
+      break;
+  }
+
+  const int16 g=agc.gain(fc);
+  agc_stats_t stats=agc_measure(simulated_capture(p_in_dbfs,g,AGC_HEAD_LENGTH),AGC_HEAD_LENGTH,agc.clip_level);
+  const bool at_min=(g==min(agc.gain_table));
+  const bool at_max=(g==max(agc.gain_table));
+  const double step=agc.gain_table(1)-agc.gain_table(0);
+
+  uint32 failed=0;
+  // Settled within the allowed number of iterations.
+  failed+=agc.update(fc,stats);
+  // Not clipping, unless the gain cannot be reduced any further.
+  failed+=(stats.clip_rate>AGC_CLIP_RATE_MAX)&&!at_min;
+  // Close to the target, unless the gain cannot be changed any further.
+  const double error=AGC_TARGET_DBFS-stats.rms_dbfs;
+  failed+=(error>AGC_HYSTERESIS_DB+step)&&!at_max;
+  failed+=(error<-AGC_HYSTERESIS_DB-step)&&!at_min;
+  if (failed) {
+    cout << "Input " << p_in_dbfs << " dBFS settled at gain " << g << " rms " << stats.rms_dbfs << " dBFS clip rate " << stats.clip_rate << endl;
+  }
+  return failed;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+  RNG_reset(0);
+
+  const dev_type_t::dev_type_t devs[]={dev_type_t::RTLSDR,dev_type_t::HACKRF};
+  for (uint8 d=0;d<sizeof(devs)/sizeof(devs[0]);d++) {
+    agc_t agc(devs[d],-9999);
+    // Every input level is a different center frequency.
+    for (int32 p=-90;p<=10;p+=5) {
+      failed+=check_settle(agc,700e6+p*1e6,p);
+    }
+  }
+
+  // Gains are remembered per center frequency and survive a save/load.
+  {
+    agc_t agc(dev_type_t::RTLSDR,0);
+    failed+=check_settle(agc,739e6,-60);
+    failed+=check_settle(agc,2645e6,-20);
+    failed+=agc.known(1800e6);
+    failed+=(agc.gain(739e6)<=agc.gain(2645e6));
+
+    const string filename="test_agc_gains.txt";
+    agc.save(filename);
+    agc_t agc_loaded(dev_type_t::RTLSDR,0);
+    agc_loaded.load(filename);
+    remove(filename.c_str());
+    failed+=!agc_loaded.known(739e6);
+    failed+=agc_loaded.gain(739e6)!=agc.gain(739e6);
+    failed+=agc_loaded.gain(2645e6)!=agc.gain(2645e6);
+    failed+=agc_loaded.gain(1800e6)!=agc.gain(1800e6);
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
@@ -0,0 +1,152 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include <vector>
+#include "common.h"
+#include "macros.h"
+#include "dsp.h"
+#include "ce_filter.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Same averaging filter as filter_ce() in the tracker.
+cvec filter_avg(
+  const cvec & ce_prev,
+  const cvec & ce_curr,
+  const cvec & ce_next,
+  const bool & prev_left
+) {
+  const int16 n_rs=length(ce_curr);
+  const int16 lo=prev_left?0:-1;
+  cvec ce_filt(n_rs);
+  for (int16 t=0;t<n_rs;t++) {
+    complex <double> total=0;
+    uint8 n_total=0;
+    for (int16 k=MAX(t-1,0);k<=MIN(t+1,n_rs-1);k++) {
+      total+=ce_curr(k);
+      n_total++;
+    }
+    for (int16 k=MAX(t+lo,0);k<=MIN(t+lo+1,n_rs-1);k++) {
+      total+=ce_prev(k)+ce_next(k);
+      n_total+=2;
+    }
+    ce_filt(t)=total/n_total;
+  }
+  return ce_filt;
+}
+
+// Mean squared error of the MMSE filter and of the averaging filter for a
+// static channel with an exponential power delay profile. mse_design is
+// the MSE that the filter bank predicts for the selected MMSE filter.
+void ce_mse(
+  // Inputs
+  const ce_filter_bank_t & ce_filter_bank,
+  const double & ds,
+  const double & snr_db,
+  // Outputs
+  double & mse_mmse,
+  double & mse_avg,
+  double & mse_design
+) {
+  const uint16 n_rs=50;
+  const uint16 n_trials=400;
+  const uint8 n_paths=20;
+  const double np=udb10(-snr_db);
+  // The RS of the current OFDM symbol are on subcarriers 6*t and the RS of
+  // the previous and next OFDM symbols are on subcarriers 6*t+3.
+  const bool prev_left=false;
+  const double rho_fd=abs(1.0/complex <double>(1,2*pi*6*15e3*ds));
+  const uint16 idx=ce_filter_bank.select(0,rho_fd,1.0,udb10(snr_db));
+  mse_design=ce_filter_bank.mse(idx);
+
+  mse_mmse=0;
+  mse_avg=0;
+  for (uint16 trial=0;trial<n_trials;trial++) {
+    const vec delay=-ds*log(randu(n_paths));
+    const cvec gain=randn_c(n_paths)/sqrt((double)n_paths);
+    cvec h_curr(n_rs);
+    cvec h_other(n_rs);
+    for (uint16 t=0;t<n_rs;t++) {
+      h_curr(t)=sum(elem_mult(gain,exp(to_cvec(zeros(n_paths),-2*pi*15e3*6*t*delay))));
+      h_other(t)=sum(elem_mult(gain,exp(to_cvec(zeros(n_paths),-2*pi*15e3*(6*t+3)*delay))));
+    }
+    const cvec ce_prev=h_other+sqrt(np)*randn_c(n_rs);
+    const cvec ce_curr=h_curr+sqrt(np)*randn_c(n_rs);
+    const cvec ce_next=h_other+sqrt(np)*randn_c(n_rs);
+    mse_mmse+=sigpower(ce_filter_bank.filter(idx,ce_prev,ce_curr,ce_next,prev_left)-h_curr);
+    mse_avg+=sigpower(filter_avg(ce_prev,ce_curr,ce_next,prev_left)-h_curr);
+  }
+  mse_mmse/=n_trials;
+  mse_avg/=n_trials;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+  RNG_reset(1);
+
+  const ce_filter_bank_t ce_filter_bank;
+
+  // With a flat, static channel and a high SNR, the filter should only
+  // average.
+  {
+    const cmat & w=ce_filter_bank.weights(ce_filter_bank.select(0,1.0,1.0,udb10(30.0)));
+    const complex <double> w_sum=sum(w.get_row(0));
+    if (abs(w_sum-1.0)>0.05) {
+      cout << "Weights sum to " << w_sum << endl;
+      failed++;
+    }
+  }
+
+  // Both filters use the same observations so, on average, the MMSE filter
+  // is never worse than the averaging filter.
+  double mse_mmse;
+  double mse_avg;
+  double mse_design;
+  ce_mse(ce_filter_bank,0.1e-6,0.0,mse_mmse,mse_avg,mse_design);
+  if (mse_mmse>1.02*mse_avg) {
+    cout << "Short delay spread: MSE " << db10(mse_mmse) << " dB vs " << db10(mse_avg) << " dB" << endl;
+    failed++;
+  }
+  // Averaging a frequency selective channel causes a large bias at high SNR.
+  ce_mse(ce_filter_bank,1.6e-6,20.0,mse_mmse,mse_avg,mse_design);
+  if (mse_mmse>mse_avg) {
+    cout << "Long delay spread: MSE " << db10(mse_mmse) << " dB vs " << db10(mse_avg) << " dB" << endl;
+    failed++;
+  }
+  // The tracker adds the predicted MSE to the noise seen by the
+  // demodulator, so it should match the measured MSE.
+  if (abs(db10(mse_mmse)-db10(mse_design))>3) {
+    cout << "Predicted MSE " << db10(mse_design) << " dB vs " << db10(mse_mmse) << " dB" << endl;
+    failed++;
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
+
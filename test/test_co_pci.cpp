@@ -0,0 +1,122 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Check that detections are assigned to the right one of two tracks that
+// share a physical cell ID, and that the live frequency offset of a track
+// is used to do so.
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <list>
+#include <queue>
+#include <curses.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "searcher.h"
+#include "placement.h"
+#include "LTE-Tracker.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+tracked_cell_t * new_track(
+  const uint16 & n_id_cell,
+  const double & ft,
+  const uint32 & track_id,
+  const double & freq_superfine
+) {
+  return new tracked_cell_t(
+    n_id_cell,
+    2,
+    0,
+    cp_type_t::NORMAL,
+    25,
+    phich_duration_t::NORMAL,
+    phich_resource_t::one,
+    ft,
+    track_id,
+    25,
+    freq_superfine
+  );
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+
+  // Two cells that reuse cell ID 301, 3ms apart.
+  const uint16 pci=301;
+  tracked_cell_list_t tracked_cell_list;
+  tracked_cell_list.last_track_id=0;
+  tracked_cell_t * a=new_track(pci,1000,++tracked_cell_list.last_track_id,0);
+  tracked_cell_t * b=new_track(pci,6760,++tracked_cell_list.last_track_id,200);
+  tracked_cell_list.tracked_cells.push_back(a);
+  tracked_cell_list.tracked_cells.push_back(b);
+
+  // Detections close to either track belong to that track.
+  failed+=!a->matches(pci,1003,100);
+  failed+=b->matches(pci,1003,100);
+  failed+=!b->matches(pci,6755,-300);
+  failed+=a->matches(pci,6755,-300);
+  failed+=!cell_is_tracked(tracked_cell_list,pci,6765,150);
+  // A third cell with the same cell ID but other timing, or a cell with
+  // another cell ID, needs a track of its own.
+  failed+=cell_is_tracked(tracked_cell_list,pci,12000,0);
+  failed+=cell_is_tracked(tracked_cell_list,pci+1,1000,0);
+  if (failed) {
+    cout << "Detections assigned to the wrong track" << endl;
+  }
+
+  // The tracker of a refines the frequency offset of its cell. Detections
+  // are compared with that estimate, not with the frequency offset that
+  // was measured when the track was created.
+  a->frequency_offset(6000);
+  if (!cell_is_tracked(tracked_cell_list,pci,1000,7000)) {
+    cout << "Detection at the live frequency offset was not recognized" << endl;
+    failed++;
+  }
+  // A co-channel cell with the same timing as a but with a frequency
+  // offset that is far from that of a.
+  if (cell_is_tracked(tracked_cell_list,pci,1000,-1000)) {
+    cout << "Detection far from the live frequency offset was recognized" << endl;
+    failed++;
+  }
+
+  while (!tracked_cell_list.tracked_cells.empty()) {
+    delete tracked_cell_list.tracked_cells.front();
+    tracked_cell_list.tracked_cells.pop_front();
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
+
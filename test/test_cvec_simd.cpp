@@ -0,0 +1,98 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include "common.h"
+#include "macros.h"
+#include "cvec_simd.h"
+
+using namespace std;
+using namespace itpp;
+using namespace cvec_simd;
+
+// Compare every implementation of every kernel against the equivalent
+// itpp expression. The lengths are chosen so that the remainder loops
+// of all the vector implementations are exercised.
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+  const double tol=1e-9;
+  const level_t levels[]={LEVEL_SCALAR,LEVEL_SSE3,LEVEL_AVX2,LEVEL_AVX512,LEVEL_NEON};
+  const uint32 lengths[]={0,1,2,3,4,5,7,8,11,12,62,128,1001};
+
+  RNG_reset(0);
+  cout << "Detected implementation: " << level_name(active_level()) << endl;
+  for (uint8 l=0;l<sizeof(levels)/sizeof(levels[0]);l++) {
+    const level_t level=levels[l];
+    if (!level_supported(level))
+      continue;
+    uint32 failed_level=0;
+    for (uint8 k=0;k<sizeof(lengths)/sizeof(lengths[0]);k++) {
+      const uint32 n=lengths[k];
+      const cvec a=randn_c(n);
+      const cvec b=randn_c(n);
+      const vec b_real=randn(n);
+      const complex <double> alpha(0.3,-1.7);
+      cvec y(n);
+      vec y_real(n);
+      const double scale=MAX(1.0,(double)n);
+
+      failed_level+=abs(dot(level,a._data(),b._data(),n)-sum(elem_mult(a,b)))>tol*scale;
+      failed_level+=abs(rdot(level,a._data(),b_real._data(),n)-sum(elem_mult(a,to_cvec(b_real))))>tol*scale;
+      failed_level+=abs(cdot(level,a._data(),b._data(),n)-sum(elem_mult(conj(a),b)))>tol*scale;
+      failed_level+=abs(power(level,a._data(),n)-sum(sqr(a)))>tol*scale;
+
+      mult(level,a._data(),b._data(),y._data(),n);
+      failed_level+=(n>0)&&(max(abs(y-elem_mult(a,b)))>tol);
+
+      mult_conj(level,a._data(),b._data(),y._data(),n);
+      failed_level+=(n>0)&&(max(abs(y-elem_mult(conj(a),b)))>tol);
+
+      y=b;
+      mac(level,a._data(),b._data(),y._data(),n);
+      failed_level+=(n>0)&&(max(abs(y-(b+elem_mult(a,b))))>tol);
+
+      y=b;
+      axpy(level,alpha,a._data(),y._data(),n);
+      failed_level+=(n>0)&&(max(abs(y-(b+alpha*a)))>tol);
+
+      mag2(level,a._data(),y_real._data(),n);
+      failed_level+=(n>0)&&(max(abs(y_real-sqr(a)))>tol);
+
+      // In place operation, as used by fshift_inplace.
+      y=a;
+      rotate(level,y._data(),0.4,-0.023,y._data(),n);
+      cvec r(n);
+      for (uint32 t=0;t<n;t++) {
+        r(t)=a(t)*exp(complex<double>(0,0.4-0.023*t));
+      }
+      failed_level+=(n>0)&&(max(abs(y-r))>tol);
+    }
+    cout << level_name(level) << ": " << failed_level << " failures" << endl;
+    failed+=failed_level;
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
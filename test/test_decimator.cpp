@@ -0,0 +1,107 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "dsp.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Decimate a tone of frequency f that was sampled at factor*1.92MHz and
+// return the decimated samples.
+cvec decimate_tone(
+  const uint16 & factor,
+  const double & f,
+  const uint32 & n_out
+) {
+  const double fs=factor*(FS_LTE/16);
+  decimator_t decimator(factor);
+  cvec y(n_out);
+  uint32 n=0;
+  uint32 t=0;
+  while (n<n_out) {
+    complex <double> s;
+    if (decimator.push(exp(complex<double>(0,2*pi*f*t/fs)),s))
+      y(n++)=s;
+    t++;
+  }
+  return y;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+
+  // Sample rate to bandwidth mapping.
+  failed+=lte_oversample(NAN)!=1;
+  failed+=lte_oversample(1.92e6)!=1;
+  failed+=lte_oversample(1.92e6*(1+100e-6))!=1;
+  failed+=lte_oversample(15.36e6)!=8;
+  failed+=lte_oversample(30.72e6)!=16;
+  failed+=lte_max_rb(1)!=6;
+  failed+=lte_max_rb(2)!=15;
+  failed+=lte_max_rb(4)!=25;
+  failed+=lte_max_rb(8)!=50;
+  failed+=lte_max_rb(12)!=75;
+  failed+=lte_max_rb(16)!=100;
+
+  const uint16 factors[]={1,2,4,8,16};
+  for (uint8 k=0;k<sizeof(factors)/sizeof(factors[0]);k++) {
+    const uint16 factor=factors[k];
+    decimator_t decimator(factor);
+    const uint32 n_out=200;
+    const uint16 d=decimator.delay();
+
+    // A tone within the central 6 RB's passes with unit gain. Output
+    // sample n is produced when input sample (n+1)*factor-1 arrives and is
+    // delayed by delay() output samples.
+    const double f_in=450e3;
+    cvec y=decimate_tone(factor,f_in,n_out);
+    double err=0;
+    for (uint32 t=2*d;t<n_out;t++) {
+      const double t_out=t-d+(factor-1.0)/factor;
+      err=MAX(err,abs(y(t)-exp(complex<double>(0,2*pi*f_in*t_out/(FS_LTE/16)))));
+    }
+    failed+=err>1e-2;
+
+    // A tone well outside of the 1.92MHz band is rejected.
+    if (factor>1) {
+      cvec z=decimate_tone(factor,-1.7e6,n_out);
+      const double rejection=-db10(sigpower(z.mid(2*d,n_out-2*d)));
+      if (rejection<40) {
+        cout << "Factor " << factor << " rejection " << rejection << " dB" << endl;
+        failed++;
+      }
+    }
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
@@ -0,0 +1,169 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Decode the MIB of synthetic cells with 1, 2, and 4 ports from a TFG
+// and check that noise is not decoded as a MIB. Also check that a port
+// that is received much weaker than port 0 does not prevent decoding.
+#include <itpp/itbase.h>
+#include <itpp/signal/transforms.h>
+#include <list>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "dsp.h"
+#include "searcher.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Build the TFG of x the same way extract_tfg does for a cell whose
+// first frame starts at the first sample of x.
+cmat build_tfg(
+  const cvec & x,
+  const Cell & cell,
+  const uint16 & oversample
+) {
+  const int8 n_symb_dl=cell.n_symb_dl();
+  const uint16 n_fft=128*oversample;
+  const uint16 n_ofdm_sym=6*10*2*n_symb_dl+2*n_symb_dl;
+  cmat tfg(n_ofdm_sym,72);
+  for (uint16 t=0;t<n_ofdm_sym;t++) {
+    const uint16 fr=t/(20*n_symb_dl);
+    const uint8 slot_num=(t/n_symb_dl)%20;
+    const uint8 sym_num=t%n_symb_dl;
+    const uint32 dft_start=(fr*19200+slot_num*960+((cell.cp_type==cp_type_t::NORMAL)?(10+137*sym_num):(32+160*sym_num)))*oversample;
+    const cvec dft_out=dft(x.mid(dft_start,n_fft));
+    tfg.set_row(t,concat(dft_out.right(36),dft_out.mid(1,36)));
+  }
+  return tfg;
+}
+
+// The cell to decode. Only the parameters found by the PSS/SSS search are
+// filled in.
+Cell detected_cell(
+  const Cell & cell
+) {
+  Cell cell_in;
+  cell_in.n_id_1=cell.n_id_1;
+  cell_in.n_id_2=cell.n_id_2;
+  cell_in.duplex_mode=cell.duplex_mode;
+  cell_in.cp_type=cell.cp_type;
+  return cell_in;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+  RNG_reset(13);
+
+  const uint8 ports[]={1,2,4};
+  const cp_type_t::cp_type_t cp_types[]={cp_type_t::NORMAL,cp_type_t::EXTENDED};
+  for (uint8 k=0;k<sizeof(ports)/sizeof(ports[0]);k++) {
+    for (uint8 m=0;m<2;m++) {
+      // A 3MHz cell sampled at 3.84MHz. The first frame is the second
+      // frame of a PBCH TTI.
+      const uint16 oversample=2;
+      Cell cell;
+      cell.n_id_1=101;
+      cell.n_id_2=1;
+      cell.duplex_mode=0;
+      cell.cp_type=cp_types[m];
+      cell.n_ports=ports[k];
+      cell.n_rb_dl=15;
+      cell.phich_duration=phich_duration_t::EXTENDED;
+      cell.phich_resource=phich_resource_t::one;
+      cell.sfn=101;
+      cvec port_gain(cell.n_ports);
+      for (uint8 t=0;t<cell.n_ports;t++) {
+        port_gain(t)=exp(complex<double>(0,0.9*t+0.2))*(1-0.1*t);
+      }
+      const cvec x=lte_dl_generate(cell,port_gain,7,oversample);
+      RS_DL rs_dl(cell.n_id_cell(),6,cell.cp_type);
+      const cmat tfg=build_tfg(x,cell,oversample);
+      const double np=0.01;
+      const cmat noise=sqrt(np)*randn_c(tfg.rows(),tfg.cols());
+
+      // The whole TFG.
+      Cell decoded=decode_mib(detected_cell(cell),tfg+noise,rs_dl);
+      if ((decoded.n_ports!=cell.n_ports)||(decoded.n_rb_dl!=cell.n_rb_dl)||(decoded.sfn!=cell.sfn)||(decoded.phich_duration!=cell.phich_duration)||(decoded.phich_resource!=cell.phich_resource)) {
+        cout << (int)cell.n_ports << " ports, " << cell.cp_type << " CP: MIB mismatch" << endl;
+        failed++;
+      }
+
+      // Only the first frame contains the cell. This can only be decoded
+      // from a single burst.
+      cmat tfg_burst=noise;
+      const int8 n_symb_dl=cell.n_symb_dl();
+      tfg_burst.set_submatrix(0,0,tfg.get_rows(0,20*n_symb_dl-1)+noise.get_rows(0,20*n_symb_dl-1));
+      decoded=decode_mib(detected_cell(cell),tfg_burst,rs_dl);
+      if ((decoded.n_ports!=cell.n_ports)||(decoded.n_rb_dl!=cell.n_rb_dl)||(decoded.sfn!=cell.sfn)) {
+        cout << (int)cell.n_ports << " ports, " << cell.cp_type << " CP: single burst MIB mismatch" << endl;
+        failed++;
+      }
+
+      // Noise only.
+      decoded=decode_mib(detected_cell(cell),noise,rs_dl);
+      if (decoded.n_rb_dl!=-1) {
+        cout << (int)cell.n_ports << " ports, " << cell.cp_type << " CP: MIB decoded from noise" << endl;
+        failed++;
+      }
+    }
+  }
+
+  // A 2 port cell whose second port is received 15dB below the first, as
+  // happens in a deep fade. The 2 port hypothesis is tried last but it
+  // must still be tried.
+  {
+    const uint16 oversample=2;
+    Cell cell;
+    cell.n_id_1=33;
+    cell.n_id_2=0;
+    cell.duplex_mode=0;
+    cell.cp_type=cp_type_t::NORMAL;
+    cell.n_ports=2;
+    cell.n_rb_dl=15;
+    cell.phich_duration=phich_duration_t::NORMAL;
+    cell.phich_resource=phich_resource_t::half;
+    cell.sfn=512;
+    cvec port_gain(2);
+    port_gain(0)=complex<double>(1,0);
+    port_gain(1)=exp(complex<double>(0,1.3))*udb20(-15.0);
+    const cvec x=lte_dl_generate(cell,port_gain,7,oversample);
+    RS_DL rs_dl(cell.n_id_cell(),6,cell.cp_type);
+    const cmat tfg=build_tfg(x,cell,oversample);
+    const cmat noise=sqrt(0.01)*randn_c(tfg.rows(),tfg.cols());
+    const Cell decoded=decode_mib(detected_cell(cell),tfg+noise,rs_dl);
+    if ((decoded.n_ports!=cell.n_ports)||(decoded.n_rb_dl!=cell.n_rb_dl)||(decoded.sfn!=cell.sfn)) {
+      cout << "Faded second port: MIB mismatch" << endl;
+      failed++;
+    }
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
+
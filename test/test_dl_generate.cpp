@@ -0,0 +1,189 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include <itpp/signal/transforms.h>
+#include <list>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "searcher.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Return the subcarriers of one OFDM symbol of x, the same way the tracker
+// does.
+cvec demod_sym(
+  const cvec & x,
+  const Cell & cell,
+  const uint16 & oversample,
+  const uint16 & fr,
+  const uint8 & slot_num,
+  const uint8 & sym_num
+) {
+  const uint16 n_fft=128*oversample;
+  const uint16 n_half=6*cell.n_rb_dl;
+  const uint32 dft_start=(fr*19200+slot_num*960+((cell.cp_type==cp_type_t::NORMAL)?(10+137*sym_num):(32+160*sym_num)))*oversample;
+  const cvec dft_out=dft(x.mid(dft_start,n_fft));
+  cvec syms(2*n_half);
+  for (uint16 t=0;t<n_half;t++) {
+    syms(t)=dft_out(n_fft-n_half+t);
+    syms(n_half+t)=dft_out(t+1);
+  }
+  return syms;
+}
+
+// Decode the MIB of the TTI that begins with frame 0 of x. Returns the
+// number of errors.
+uint32 check_mib(
+  const cvec & x,
+  const Cell & cell,
+  const cvec & port_gain,
+  const uint16 & oversample
+) {
+  const uint8 n_ports=cell.n_ports;
+  const uint16 sc_6rb=6*(cell.n_rb_dl-6);
+  const uint8 v_shift_m3=mod(cell.n_id_cell(),3);
+  const uint16 m_bit=(cell.cp_type==cp_type_t::NORMAL)?1920:1728;
+
+  // Ideal channel estimates.
+  cvec pbch_sym(m_bit/2);
+  cmat pbch_ce(n_ports,m_bit/2);
+  mat np(n_ports,m_bit/2);
+  np=1e-3;
+  uint16 idx=0;
+  for (uint8 fr=0;fr<4;fr++) {
+    for (uint8 symn=0;symn<4;symn++) {
+      const cvec syms=demod_sym(x,cell,oversample,fr,1,symn);
+      for (uint16 sc=0;sc<72;sc++) {
+        if ((mod(sc,3)==v_shift_m3)&&((symn==0)||(symn==1)||((symn==3)&&(cell.cp_type==cp_type_t::EXTENDED)))) {
+          continue;
+        }
+        pbch_sym(idx)=syms(sc_6rb+sc);
+        pbch_ce.set_col(idx,port_gain);
+        idx++;
+      }
+    }
+  }
+  if (idx!=m_bit/2)
+    return 1;
+
+  // Same processing as the tracker.
+  vec e_est=pbch_demod(pbch_sym,pbch_ce,np,n_ports);
+  const bvec scr=lte_pn(cell.n_id_cell(),m_bit);
+  for (int32 t=0;t<length(e_est);t++) {
+    if (scr(t)) e_est(t)=-e_est(t);
+  }
+  const mat d_est=lte_conv_deratematch(e_est,40);
+  bvec c_est;
+  uint32 failed=0;
+  if (!pbch_decode(d_est,n_ports,c_est)) {
+    cout << "MIB CRC failed with " << (int)n_ports << " ports" << endl;
+    return 1;
+  }
+
+  // The CRC mask identifies the number of ports.
+  const uint8 wrong_ports=(n_ports==1)?2:1;
+  bvec c_wrong;
+  failed+=pbch_decode(d_est,wrong_ports,c_wrong);
+
+  // Bandwidth, PHICH, and the 8 MSB's of the SFN.
+  const ivec c=to_ivec(c_est);
+  failed+=(c(0)*4+c(1)*2+c(2))!=1;
+  failed+=c(3)!=1;
+  failed+=(c(4)*2+c(5))!=2;
+  uint16 sfn_msb=0;
+  for (uint8 t=0;t<8;t++) {
+    sfn_msb=sfn_msb*2+c(6+t);
+  }
+  failed+=sfn_msb!=(cell.sfn>>2);
+  return failed;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+
+  const uint8 ports[]={1,2,4};
+  const cp_type_t::cp_type_t cp_types[]={cp_type_t::NORMAL,cp_type_t::EXTENDED};
+  for (uint8 k=0;k<sizeof(ports)/sizeof(ports[0]);k++) {
+    for (uint8 m=0;m<2;m++) {
+      // A 3MHz cell sampled at 3.84MHz.
+      const uint16 oversample=2;
+      Cell cell;
+      cell.n_id_1=57;
+      cell.n_id_2=2;
+      cell.duplex_mode=0;
+      cell.cp_type=cp_types[m];
+      cell.n_ports=ports[k];
+      cell.n_rb_dl=15;
+      cell.phich_duration=phich_duration_t::EXTENDED;
+      cell.phich_resource=phich_resource_t::one;
+      cell.sfn=100;
+      cvec port_gain(cell.n_ports);
+      for (uint8 t=0;t<cell.n_ports;t++) {
+        port_gain(t)=exp(complex<double>(0,0.7*t+0.3))*(1-0.1*t);
+      }
+      const cvec x=lte_dl_generate(cell,port_gain,4,oversample);
+      failed+=length(x)!=4*19200*oversample;
+
+      // PSS and SSS in the central 6 RB's of slots 0 and 10.
+      const uint16 sc_6rb=6*(cell.n_rb_dl-6);
+      const uint8 n_symb_dl=cell.n_symb_dl();
+      for (uint8 slot_num=0;slot_num<=10;slot_num+=10) {
+        const cvec pss=demod_sym(x,cell,oversample,0,slot_num,n_symb_dl-1).mid(sc_6rb+5,62)/port_gain(0);
+        failed+=max(abs(pss-ROM_TABLES.pss_fd[cell.n_id_2]))>1e-9;
+        const cvec sss=demod_sym(x,cell,oversample,0,slot_num,n_symb_dl-2).mid(sc_6rb+5,62)/port_gain(0);
+        failed+=max(abs(sss-to_cvec(ROM_TABLES.sss_fd(cell.n_id_1,cell.n_id_2,slot_num))))>1e-9;
+      }
+
+      // CRS of every port over the whole bandwidth.
+      RS_DL rs_dl(cell.n_id_cell(),cell.n_rb_dl,cell.cp_type);
+      for (uint8 port=0;port<cell.n_ports;port++) {
+        const uint8 sym_num=(port<2)?0:1;
+        const cvec syms=demod_sym(x,cell,oversample,1,3,sym_num);
+        const cvec & rs=rs_dl.get_rs(3,sym_num);
+        const uint16 shift=rs_dl.get_shift(3,sym_num,port);
+        double err=0;
+        for (uint16 t=0;t<length(rs);t++) {
+          err=MAX(err,abs(syms(shift+6*t)/port_gain(port)-rs(t)));
+        }
+        failed+=err>1e-9;
+      }
+
+      const uint32 mib_failed=check_mib(x,cell,port_gain,oversample);
+      if (mib_failed) {
+        cout << (int)cell.n_ports << " ports, " << cell.cp_type << " CP: MIB mismatch" << endl;
+      }
+      failed+=mib_failed;
+    }
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
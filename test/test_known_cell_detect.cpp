@@ -0,0 +1,127 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Look for the PSS and SSS of known cells in synthetic captures, the way
+// the monitoring verification and the re-acquisition thread do.
+#include <itpp/itbase.h>
+#include <list>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "searcher.h"
+#include "monitor.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+  RNG_reset(3);
+  const SSS_td sss_td;
+
+  for (uint8 c=0;c<2;c++) {
+    Cell cell;
+    cell.n_id_1=131;
+    cell.n_id_2=1;
+    cell.duplex_mode=0;
+    cell.cp_type=(c==0)?cp_type_t::NORMAL:cp_type_t::EXTENDED;
+    cell.n_ports=2;
+    cell.n_rb_dl=6;
+    cell.phich_duration=phich_duration_t::NORMAL;
+    cell.phich_resource=phich_resource_t::one;
+    cell.sfn=0;
+    const uint8 n_symb_dl=cell.n_symb_dl();
+    cvec x=lte_dl_generate(cell,ones_c(2),3,1);
+    x+=sqrt(0.1)*randn_c(length(x));
+
+    // A verification capture starts anywhere in the frame. The first PSS
+    // that lies in the search window is reported.
+    const uint32 distance=pss_sss_distance(cell.cp_type,cell.duplex_mode);
+    const uint32 cap_starts[]={0,4321,12000};
+    for (uint8 k=0;k<sizeof(cap_starts)/sizeof(cap_starts[0]);k++) {
+      const cvec capbuf=x.mid(cap_starts[k],MONITOR_VERIFY_CAPLENGTH);
+      uint32 pss_lag;
+      uint8 half;
+      double pss_xc;
+      if (!known_cell_detect(capbuf,cell.n_id_1,cell.n_id_2,cell.cp_type,cell.duplex_mode,sss_td,distance,9600,MONITOR_VERIFY_THRESH,pss_lag,half,pss_xc)) {
+        cout << "CP " << (int)c << " start " << cap_starts[k] << ": cell not found (PSS correlation " << pss_xc << ")" << endl;
+        failed++;
+        continue;
+      }
+      // Location of the PSS in the frame.
+      const uint32 pss_pos=cap_starts[k]+distance+pss_lag;
+      const uint32 pss_expected=sym_dft_offset(cell.cp_type,0,n_symb_dl-1);
+      const uint32 in_half=pss_pos%9600;
+      if ((in_half<pss_expected-2)||(in_half>pss_expected+2)) {
+        cout << "CP " << (int)c << " start " << cap_starts[k] << ": PSS at " << in_half << " instead of " << pss_expected << endl;
+        failed++;
+      }
+      if (half!=(pss_pos%19200)/9600) {
+        cout << "CP " << (int)c << " start " << cap_starts[k] << ": wrong half frame" << endl;
+        failed++;
+      }
+    }
+
+    // Another cell ID in the same PSS group, another PSS, the wrong CP
+    // length, or no cell at all must not be found.
+    const cvec capbuf=x.left(MONITOR_VERIFY_CAPLENGTH);
+    uint32 pss_lag;
+    uint8 half;
+    double pss_xc;
+    if (known_cell_detect(capbuf,cell.n_id_1+1,cell.n_id_2,cell.cp_type,cell.duplex_mode,sss_td,distance,9600,MONITOR_VERIFY_THRESH,pss_lag,half,pss_xc)) {
+      cout << "CP " << (int)c << ": found a cell with another SSS" << endl;
+      failed++;
+    }
+    if (known_cell_detect(capbuf,cell.n_id_1,(cell.n_id_2+1)%3,cell.cp_type,cell.duplex_mode,sss_td,distance,9600,MONITOR_VERIFY_THRESH,pss_lag,half,pss_xc)) {
+      cout << "CP " << (int)c << ": found a cell with another PSS" << endl;
+      failed++;
+    }
+    const cp_type_t::cp_type_t other_cp=(c==0)?cp_type_t::EXTENDED:cp_type_t::NORMAL;
+    if (known_cell_detect(capbuf,cell.n_id_1,cell.n_id_2,other_cp,cell.duplex_mode,sss_td,pss_sss_distance(other_cp,cell.duplex_mode),9600,MONITOR_VERIFY_THRESH,pss_lag,half,pss_xc)) {
+      cout << "CP " << (int)c << ": found a cell with the wrong CP length" << endl;
+      failed++;
+    }
+    const cvec noise=sqrt(0.1)*randn_c(MONITOR_VERIFY_CAPLENGTH);
+    if (known_cell_detect(noise,cell.n_id_1,cell.n_id_2,cell.cp_type,cell.duplex_mode,sss_td,distance,9600,MONITOR_VERIFY_THRESH,pss_lag,half,pss_xc)) {
+      cout << "CP " << (int)c << ": found a cell in noise" << endl;
+      failed++;
+    }
+    // The capture is too short for the search window.
+    if (known_cell_detect(capbuf.left(9600),cell.n_id_1,cell.n_id_2,cell.cp_type,cell.duplex_mode,sss_td,distance,9600,MONITOR_VERIFY_THRESH,pss_lag,half,pss_xc)) {
+      cout << "CP " << (int)c << ": searched beyond the end of the capture" << endl;
+      failed++;
+    }
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
@@ -0,0 +1,105 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Step the monitoring scheduler through scans and verifications on a
+// simulated clock.
+#include <itpp/itbase.h>
+#include "common.h"
+#include "macros.h"
+#include "monitor.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Check the next job of the schedule.
+uint32 expect(
+  const monitor_schedule_t & schedule,
+  const bool & scan,
+  const double & time,
+  const char * what
+) {
+  if ((schedule.scan_due()!=scan)||(abs(schedule.next_job()-time)>1e-9)) {
+    cout << what << ": expected a " << (scan?"scan":"verification") << " at " << time << ", got a " << (schedule.scan_due()?"scan":"verification") << " at " << schedule.next_job() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+
+  // Scans every 60s, verifications every 10s in between.
+  {
+    monitor_schedule_t schedule(60,10);
+    failed+=expect(schedule,true,0,"start");
+    schedule.scan_done(0,5,2);
+    failed+=expect(schedule,false,15,"after scan");
+    for (uint8 t=0;t<4;t++) {
+      schedule.verify_done(15+10*t+1,true);
+    }
+    // Verifications at 15, 25, 35, 45, and 55s.
+    failed+=expect(schedule,false,55,"fifth verification");
+    schedule.verify_done(56,true);
+    failed+=expect(schedule,true,60,"end of interval");
+    // The next interval starts when the scan starts, not when it ends.
+    schedule.scan_done(60,64,2);
+    failed+=expect(schedule,false,74,"second interval");
+  }
+
+  // A missing cell makes the next scan due immediately.
+  {
+    monitor_schedule_t schedule(60,10);
+    schedule.scan_done(0,5,2);
+    schedule.verify_done(16,false);
+    failed+=expect(schedule,true,16,"missing cell");
+  }
+
+  // Without verifications, or without any known cell, only scans are
+  // performed.
+  {
+    monitor_schedule_t schedule(60,0);
+    schedule.scan_done(0,5,2);
+    failed+=expect(schedule,true,60,"verification disabled");
+  }
+  {
+    monitor_schedule_t schedule(60,10);
+    schedule.scan_done(0,5,0);
+    failed+=expect(schedule,true,60,"no cells");
+  }
+
+  // A scan that takes longer than the interval is followed by another
+  // scan right away.
+  {
+    monitor_schedule_t schedule(60,10);
+    schedule.scan_done(0,70,2);
+    failed+=expect(schedule,true,60,"long scan");
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
@@ -0,0 +1,137 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Check that the PBCH soft bits of several TTI's, none of which can be
+// decoded on its own, are combined into a MIB with the correct SFN.
+#include <itpp/itbase.h>
+#include <list>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "searcher.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Coded bits of a 2 port MIB with the given 8 MSB's of the SFN.
+bmat mib_encode(
+  const uint8 & sfn_msb
+) {
+  bvec c(24);
+  c.zeros();
+  // 5MHz, extended PHICH duration, PHICH resource 1.
+  c(1)=1;
+  c(2)=1;
+  c(3)=1;
+  c(4)=1;
+  for (uint8 t=0;t<8;t++) {
+    c(6+t)=(sfn_msb>>(7-t))&1;
+  }
+  // The CRC mask of 2 ports inverts every CRC bit.
+  bvec crc=lte_calc_crc(c,CRC16);
+  for (uint8 t=0;t<16;t++) {
+    crc(t)=1-((int)crc(t));
+  }
+  return lte_conv_encode(concat(c,crc));
+}
+
+// Soft bits of one TTI. Only the output of generator k of the
+// convolutional code is received. This alone is a rate 1 code so the few
+// bits that are received with the wrong sign cannot be corrected.
+mat tti_soft_bits(
+  const uint8 & sfn_msb,
+  const uint8 & k
+) {
+  const bmat d=mib_encode(sfn_msb);
+  mat d_est(3,40);
+  d_est.zeros();
+  for (uint8 c=0;c<40;c++) {
+    d_est(k,c)=d(k,c)?-1.0:1.0;
+  }
+  d_est(k,3+11*k)=-d_est(k,3+11*k);
+  d_est(k,17+11*k)=-d_est(k,17+11*k);
+  return d_est;
+}
+
+// 8 MSB's of the SFN of a decoded MIB.
+uint8 sfn_msb_decoded(
+  const bvec & c_est
+) {
+  uint8 sfn_msb=0;
+  for (uint8 t=0;t<8;t++) {
+    sfn_msb=(sfn_msb<<1)|((int)c_est(6+t));
+  }
+  return sfn_msb;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+
+  // The SFN wraps around between the second and the third TTI.
+  const uint8 sfn_msb_first=254;
+  pbch_history_t pbch_history;
+  bvec c_est;
+  for (uint8 tti=0;tti<3;tti++) {
+    const uint8 sfn_msb=(sfn_msb_first+tti)&255;
+    const mat d_est=tti_soft_bits(sfn_msb,tti);
+    const int32 frame_num=4*tti;
+    if (pbch_decode(d_est,2,c_est)) {
+      cout << "TTI " << (int)tti << " could be decoded on its own" << endl;
+      failed++;
+    }
+    if (tti<2) {
+      Array <mat> d_est_ports(3);
+      d_est_ports(1)=d_est;
+      pbch_history_add(pbch_history,frame_num,d_est_ports);
+      continue;
+    }
+
+    // Soft bits that are not 40ms apart are not combined.
+    if (pbch_decode_combined(d_est,frame_num+1,2,pbch_history,c_est)) {
+      cout << "TTI's with a different frame alignment were combined" << endl;
+      failed++;
+    }
+    // Every coded bit has now been received once.
+    if (!pbch_decode_combined(d_est,frame_num,2,pbch_history,c_est)) {
+      cout << "Combined TTI's could not be decoded" << endl;
+      failed++;
+    } else if (sfn_msb_decoded(c_est)!=sfn_msb) {
+      cout << "Decoded SFN " << (int)sfn_msb_decoded(c_est) << " instead of " << (int)sfn_msb << endl;
+      failed++;
+    }
+    // The soft bits of the other port hypotheses were not stored.
+    if (pbch_decode_combined(d_est,frame_num,1,pbch_history,c_est)) {
+      cout << "Combined with the soft bits of another port hypothesis" << endl;
+      failed++;
+    }
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
+
@@ -0,0 +1,174 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Lose a synthetic cell, re-acquire it with the re-acquisition thread's
+// detector, and check that the track is resumed only once.
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <list>
+#include <queue>
+#include <curses.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "searcher.h"
+#include "placement.h"
+#include "LTE-Tracker.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Track of the cell, as it was when it was lost.
+tracked_cell_t * new_track(
+  const Cell & cell,
+  const double & ft,
+  const uint32 & track_id
+) {
+  return new tracked_cell_t(
+    cell.n_id_cell(),
+    cell.n_ports,
+    cell.duplex_mode,
+    cell.cp_type,
+    cell.n_rb_dl,
+    cell.phich_duration,
+    cell.phich_resource,
+    ft,
+    track_id,
+    6,
+    0
+  );
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+  RNG_reset(7);
+
+  // A 1.4MHz cell sampled at 1.92MHz whose frame starts at sample 0.
+  Cell cell;
+  cell.n_id_1=88;
+  cell.n_id_2=2;
+  cell.duplex_mode=0;
+  cell.cp_type=cp_type_t::NORMAL;
+  cell.n_ports=1;
+  cell.n_rb_dl=6;
+  cell.phich_duration=phich_duration_t::NORMAL;
+  cell.phich_resource=phich_resource_t::one;
+  cell.sfn=0;
+  cvec x=lte_dl_generate(cell,ones_c(1),2,1);
+  x+=sqrt(0.1)*randn_c(length(x));
+  // frame_timing is 2 samples ahead of the start of the frame.
+  const double ft_true=19200-2;
+  const SSS_td sss_td;
+
+  // The re-acquisition capture starts somewhere in the first frame. At
+  // 1.92MHz, one sample is one timestamp unit.
+  const uint32 cap_start=3000;
+  const cvec capbuf=x.mid(cap_start,REACQ_CAPLENGTH);
+  const double timestamp=cap_start;
+  const double period=1;
+
+  // The timing drifted by 7 samples while the cell was lost.
+  tracked_cell_list_t tracked_cell_list;
+  tracked_cell_list.last_track_id=0;
+  tracked_cell_t * lost_cell=new_track(cell,ft_true+7,++tracked_cell_list.last_track_id);
+  lost_cell->crs_sp_raw_av(0)=0.5;
+  tracked_cell_list.lost_cells.push_back(lost_cell);
+
+  double frame_timing;
+  if (!reacq_detect(*lost_cell,sss_td,capbuf,timestamp,period,frame_timing)) {
+    cout << "Lost cell was not re-acquired" << endl;
+    failed++;
+  } else if (abs(WRAP(frame_timing-ft_true,-19200.0/2,19200.0/2))>1) {
+    cout << "Re-acquired with frame timing " << frame_timing << " instead of " << ft_true << endl;
+    failed++;
+  }
+
+  // A cell that drifted beyond the search window, or a cell with another
+  // cell ID, is not found.
+  {
+    tracked_cell_t * far_cell=new_track(cell,ft_true+3*REACQ_WINDOW,100);
+    double ft;
+    if (reacq_detect(*far_cell,sss_td,capbuf,timestamp,period,ft)) {
+      cout << "Re-acquired a cell outside of the search window" << endl;
+      failed++;
+    }
+    delete far_cell;
+    Cell other=cell;
+    other.n_id_1=89;
+    tracked_cell_t * other_cell=new_track(other,ft_true,101);
+    if (reacq_detect(*other_cell,sss_td,capbuf,timestamp,period,ft)) {
+      cout << "Re-acquired a cell with another cell ID" << endl;
+      failed++;
+    }
+    delete other_cell;
+  }
+
+  // Resume the track. It keeps its track ID and its history.
+  tracked_cell_t * resumed=reacq_resume(tracked_cell_list,*lost_cell,true,ft_true);
+  if ((resumed==NULL)||(tracked_cell_list.tracked_cells.size()!=1)||(!tracked_cell_list.lost_cells.empty())) {
+    cout << "Track was not resumed" << endl;
+    failed++;
+  } else if ((resumed->track_id!=lost_cell->track_id)||(resumed->crs_sp_raw_av(0)!=0.5)||(resumed->frame_timing()!=ft_true)) {
+    cout << "Resumed track lost its history" << endl;
+    failed++;
+  }
+  delete lost_cell;
+
+  // The same cell is lost a second time but the searcher finds it again
+  // before the re-acquisition thread resumes it. The track must not be
+  // duplicated.
+  lost_cell=new_track(cell,ft_true,++tracked_cell_list.last_track_id);
+  tracked_cell_list.lost_cells.push_back(lost_cell);
+  if (!cell_is_tracked(tracked_cell_list,cell.n_id_cell(),ft_true+1,0)) {
+    cout << "Tracked cell was not recognized" << endl;
+    failed++;
+  }
+  if (reacq_resume(tracked_cell_list,*lost_cell,true,ft_true)!=NULL) {
+    cout << "Track of a cell that is already tracked was resumed" << endl;
+    failed++;
+  }
+  if ((tracked_cell_list.tracked_cells.size()!=1)||(!tracked_cell_list.lost_cells.empty())) {
+    cout << "Tracked cell list is inconsistent" << endl;
+    failed++;
+  }
+  delete lost_cell;
+
+  while (!tracked_cell_list.tracked_cells.empty()) {
+    delete tracked_cell_list.tracked_cells.front();
+    tracked_cell_list.tracked_cells.pop_front();
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
+
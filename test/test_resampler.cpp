@@ -0,0 +1,104 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <itpp/itbase.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "dsp.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Resample a tone of frequency f that was sampled at fs_in to 1.92MHz.
+cvec resample_tone(
+  resampler_t & resampler,
+  const double & fs_in,
+  const double & f,
+  const uint32 & n_in
+) {
+  cvec x(n_in);
+  for (uint32 t=0;t<n_in;t++) {
+    x(t)=exp(complex<double>(0,2*pi*f*t/fs_in));
+  }
+  return resampler.push(x);
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+
+  // Native RTL-SDR and HackRF rates, a rate below 1.92MHz, and a crystal
+  // correction of 50ppm.
+  const double rates[]={2.048e6,2.4e6,8e6,1.8e6,(FS_LTE/16)*(1+50e-6)};
+  for (uint8 k=0;k<sizeof(rates)/sizeof(rates[0]);k++) {
+    const double fs_in=rates[k];
+    resampler_t resampler(fs_in,FS_LTE/16);
+    const uint32 n_in=6000;
+    // Outputs whose filter extends before the first input sample.
+    const uint32 n_skip=ceil_i(resampler.delay()/resampler.step)+1;
+
+    // A tone within the central 6 RB's passes with unit gain and output
+    // sample t is the tone at time t*step input samples.
+    const double f_in=450e3;
+    cvec y=resample_tone(resampler,fs_in,f_in,n_in);
+    failed+=abs(length(y)-(n_in-resampler.delay())/resampler.step)>2;
+    double err=0;
+    for (int32 t=n_skip;t<length(y);t++) {
+      err=MAX(err,abs(y(t)-exp(complex<double>(0,2*pi*f_in*t*resampler.step/fs_in))));
+    }
+    if (err>1e-2) {
+      cout << "Rate " << fs_in << " error " << err << endl;
+      failed++;
+    }
+
+    // After a reset, the output is the same when the input is pushed one
+    // sample at a time.
+    resampler.reset();
+    cvec y_single(length(y)+resampler.max_out());
+    uint32 n_single=0;
+    for (uint32 t=0;t<n_in;t++) {
+      n_single+=resampler.push(exp(complex<double>(0,2*pi*f_in*t/fs_in)),y_single._data()+n_single);
+    }
+    failed+=n_single!=(unsigned)length(y);
+    failed+=max(abs(y_single.left(length(y))-y))>1e-12;
+
+    // A tone that would alias into the 1.92MHz band is rejected.
+    if (fs_in>2*1.25e6) {
+      resampler_t resampler_z(fs_in,FS_LTE/16);
+      cvec z=resample_tone(resampler_z,fs_in,1.25e6,n_in);
+      const double rejection=-db10(sigpower(z.right(length(z)-n_skip)));
+      if (rejection<40) {
+        cout << "Rate " << fs_in << " rejection " << rejection << " dB" << endl;
+        failed++;
+      }
+    }
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
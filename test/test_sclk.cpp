@@ -0,0 +1,118 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Several trackers report the same sampling clock drift. Check that the
+// global k_factor converges to the true value without overshooting.
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <list>
+#include <queue>
+#include <curses.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "searcher.h"
+#include "placement.h"
+#include "LTE-Tracker.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Run n_periods update periods of n_trackers trackers. Tracker t reports
+// with a noise power of rate_np(t). When lagged is true, the samples a
+// tracker processes during a period were timestamped with the k_factor
+// of the previous period, as happens when they wait in the tracker fifo.
+uint32 converge(
+  const double & k_true,
+  const vec & rate_np,
+  const uint16 & n_periods,
+  const bool & lagged,
+  const char * what
+) {
+  const double fs_programmed=1.92e6;
+  global_thread_data_t global_thread_data(739e6,739e6,fs_programmed,1,6,placement_t::NONE);
+  global_thread_data.k_factor(1);
+  const double elapsed=SCLK_UPDATE_SLOTS*960.0;
+
+  const double err_init=global_thread_data.k_factor()-k_true;
+  double err_prev=err_init;
+  double k_factor_prev=global_thread_data.k_factor();
+  for (uint16 p=0;p<n_periods;p++) {
+    const double k_factor_capture=lagged?k_factor_prev:global_thread_data.k_factor();
+    k_factor_prev=global_thread_data.k_factor();
+    // The timestamps advance k_true/k_factor_capture times faster than
+    // the frame timing of the cells.
+    const double diff=(k_true/k_factor_capture-1)*elapsed;
+    for (int32 t=0;t<length(rate_np);t++) {
+      do_sclk(global_thread_data,diff,rate_np(t)*elapsed*elapsed,elapsed,k_factor_capture);
+      const double err=global_thread_data.k_factor()-k_true;
+      if ((err*err_init<0)&&(abs(err)>1e-12)) {
+        cout << what << ": overshoot in period " << p << ", k_factor error " << err << endl;
+        return 1;
+      }
+      if (abs(err)>abs(err_prev)+1e-12) {
+        cout << what << ": k_factor error grew in period " << p << " from " << err_prev << " to " << err << endl;
+        return 1;
+      }
+      err_prev=err;
+    }
+  }
+  if (abs(err_prev)>1e-9) {
+    cout << what << ": k_factor did not converge, error " << err_prev << endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  uint32 failed=0;
+
+  // Confident reports. With the drift applied relative to the current
+  // k_factor, four such reports per period would move k_factor twice as
+  // far as needed.
+  failed+=converge(1+20e-6,SCLK_PRIOR_NP*ones(4),10,false,"4 trackers");
+  failed+=converge(1-35e-6,SCLK_PRIOR_NP*ones(4),10,true,"4 trackers, lagged");
+
+  // Eight trackers of very different quality.
+  vec rate_np(8);
+  for (uint8 t=0;t<8;t++) {
+    rate_np(t)=SCLK_PRIOR_NP*pow(10.0,t/2.0-1);
+  }
+  failed+=converge(1+50e-6,rate_np,20,true,"8 trackers");
+
+  // Two weak trackers converge slowly but steadily.
+  failed+=converge(1-5e-6,SCLK_PRIOR_NP*10*ones(2),300,false,"2 weak trackers");
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
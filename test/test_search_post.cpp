@@ -0,0 +1,117 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Compare the OpenCL implementation of sss_detect() and extract_tfg()
+// against the host implementation.
+#include <itpp/itbase.h>
+#include <list>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "dsp.h"
+#include "searcher.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Largest difference between a and b relative to the largest element of a.
+template <class T>
+double rel_err(
+  const Mat <T> & a,
+  const Mat <T> & b
+) {
+  return max(max(abs(a-b)))/max(max(abs(a)));
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  // lte_opencl_t aborts when there is no OpenCL device to test.
+  if (!opencl_device_present(0,0)) {
+    cout << "No OpenCL device, test skipped: passed" << endl;
+    return 0;
+  }
+
+  uint32 failed=0;
+  RNG_reset(1);
+
+  // A 1.4MHz cell with a frequency offset, sampled at 1.92MHz.
+  Cell cell;
+  cell.n_id_1=57;
+  cell.n_id_2=2;
+  cell.duplex_mode=0;
+  cell.cp_type=cp_type_t::NORMAL;
+  cell.n_ports=2;
+  cell.n_rb_dl=6;
+  cell.phich_duration=phich_duration_t::NORMAL;
+  cell.phich_resource=phich_resource_t::one;
+  cell.sfn=100;
+  cvec port_gain(2);
+  port_gain(0)=complex <double>(0.8,0.3);
+  port_gain(1)=complex <double>(-0.2,0.5);
+  const double fs=FS_LTE/16;
+  const double fc=739e6;
+  const double fo=1500;
+  const cvec capbuf=fshift(lte_dl_generate(cell,port_gain,CAPLENGTH/19200,1),fo,fs)+0.1*randn_c(CAPLENGTH);
+
+  // The PSS of the first half frame, as found by the PSS search.
+  Cell peak;
+  peak.ind=825;
+  peak.freq=fo;
+  peak.n_id_2=cell.n_id_2;
+  peak.k_factor=1;
+
+  lte_opencl_t lte_ocl(0,0);
+  lte_ocl.setup_search_post((string)"search_post_kernels.cl",CAPLENGTH);
+
+  vec sss_h1_np_est,sss_h2_np_est;
+  cvec sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est;
+  mat log_lik_nrm_host,log_lik_ext_host;
+  const Cell cell_host=sss_detect(peak,capbuf,3,fc,fc,fs,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,log_lik_nrm_host,log_lik_ext_host,false,0);
+  mat log_lik_nrm_dev,log_lik_ext_dev;
+  const Cell cell_dev=sss_detect(lte_ocl,peak,capbuf,3,fc,fc,fs,sss_h1_np_est,sss_h2_np_est,sss_h1_nrm_est,sss_h2_nrm_est,sss_h1_ext_est,sss_h2_ext_est,log_lik_nrm_dev,log_lik_ext_dev,false,0);
+  failed+=cell_host.n_id_1!=cell.n_id_1;
+  failed+=cell_host.cp_type!=cell.cp_type;
+  failed+=cell_dev.n_id_1!=cell_host.n_id_1;
+  failed+=cell_dev.cp_type!=cell_host.cp_type;
+  failed+=abs(cell_dev.frame_start-cell_host.frame_start)>1e-9;
+  failed+=rel_err(log_lik_nrm_host,log_lik_nrm_dev)>1e-3;
+  failed+=rel_err(log_lik_ext_host,log_lik_ext_dev)>1e-3;
+
+  Cell cell_tfg(cell_host);
+  cell_tfg.freq_fine=fo;
+  cmat tfg_host,tfg_dev;
+  vec tfg_timestamp_host,tfg_timestamp_dev;
+  extract_tfg(cell_tfg,capbuf,fc,fc,fs,tfg_host,tfg_timestamp_host,false);
+  extract_tfg(lte_ocl,cell_tfg,capbuf,fc,fc,fs,tfg_dev,tfg_timestamp_dev,false);
+  failed+=max(abs(tfg_timestamp_host-tfg_timestamp_dev))>1e-9;
+  failed+=rel_err(tfg_host,tfg_dev)>1e-3;
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
+
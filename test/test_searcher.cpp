@@ -0,0 +1,180 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Stream a synthetic cell through the searcher's ring buffer and check
+// that the searcher finds it once, with the right frame timing and SFN.
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <list>
+#include <queue>
+#include <curses.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "searcher.h"
+#include "placement.h"
+#include "LTE-Tracker.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// Number of frames of signal that are streamed.
+#define N_FRAMES 64
+
+// Number of cells that the searcher has handed over to the trackers.
+static uint32 n_tracked(
+  tracked_cell_list_t & tracked_cell_list
+) {
+  boost::mutex::scoped_lock lock(tracked_cell_list.mutex);
+  return tracked_cell_list.tracked_cells.size();
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+#ifdef USE_OPENCL
+  // The searcher constructs an lte_opencl_t, which aborts when there is no
+  // OpenCL device.
+  if (!opencl_device_present(0,0)) {
+    cout << "No OpenCL device, test skipped: passed" << endl;
+    return 0;
+  }
+#endif
+
+  uint32 failed=0;
+  RNG_reset(11);
+
+  // A 1.4MHz cell sampled at 1.92MHz whose first frame, with SFN 0,
+  // starts at sample 0.
+  Cell cell;
+  cell.n_id_1=23;
+  cell.n_id_2=1;
+  cell.duplex_mode=0;
+  cell.cp_type=cp_type_t::NORMAL;
+  cell.n_ports=1;
+  cell.n_rb_dl=6;
+  cell.phich_duration=phich_duration_t::NORMAL;
+  cell.phich_resource=phich_resource_t::one;
+  cell.sfn=0;
+  cvec x=lte_dl_generate(cell,ones_c(1),N_FRAMES,1);
+  x+=sqrt(0.1)*randn_c(length(x));
+  // frame_timing is 2 samples ahead of the start of the frame.
+  const double ft_true=19200-2;
+
+  // There is no frequency offset and no sampling clock error.
+  const double fc=739e6;
+  const double fs_programmed=FS_LTE/16;
+  global_thread_data_t global_thread_data(fc,fc,fs_programmed,1,6,placement_t::NONE);
+  global_thread_data.frequency_offset(0);
+  global_thread_data.initial_frequency_offset(0);
+  global_thread_data.k_factor(1);
+  global_thread_data.correction(1);
+  global_thread_data.sampling_carrier_twist(false);
+  global_thread_data.opencl_platform(0);
+  global_thread_data.opencl_device(0);
+  global_thread_data.filter_workitem(32);
+  global_thread_data.search_duty(1);
+
+  tracked_cell_list_t tracked_cell_list;
+  tracked_cell_list.last_track_id=0;
+  capbuf_sync_t capbuf_sync;
+  capbuf_sync.ring.set_size(SEARCH_RING_LENGTH);
+  capbuf_sync.ring_timestamp.set_size(SEARCH_RING_LENGTH);
+  capbuf_sync.ring_sample_num.resize(SEARCH_RING_LENGTH);
+  capbuf_sync.n_written=0;
+  boost::thread searcher_thr(searcher_thread,boost::ref(capbuf_sync),boost::ref(global_thread_data),boost::ref(tracked_cell_list));
+
+  // Write the signal into the ring, one half frame at a time and at about
+  // the real time rate, the way the producer does. Producer sample number
+  // t+1 has timestamp t.
+  for (uint32 hf=0;hf<2*N_FRAMES;hf++) {
+    {
+      boost::mutex::scoped_lock lock(capbuf_sync.mutex);
+      for (uint32 t=hf*9600;t<(hf+1)*9600;t++) {
+        const uint32 ring_idx=capbuf_sync.n_written%SEARCH_RING_LENGTH;
+        capbuf_sync.ring(ring_idx)=x(t);
+        capbuf_sync.ring_timestamp(ring_idx)=t%19200;
+        capbuf_sync.ring_sample_num[ring_idx]=t+1;
+        capbuf_sync.n_written++;
+      }
+      capbuf_sync.condition.notify_one();
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+  }
+
+  // The searcher may still be verifying the cell.
+  for (uint16 t=0;(t<300)&&(n_tracked(tracked_cell_list)==0);t++) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+  }
+  searcher_thr.interrupt();
+  searcher_thr.join();
+
+  // The cell must have been found once, even though the searcher kept
+  // seeing it for the rest of the signal.
+  if (tracked_cell_list.tracked_cells.size()!=1) {
+    cout << "Searcher started " << tracked_cell_list.tracked_cells.size() << " tracks instead of 1" << endl;
+    failed++;
+  }
+  if (!tracked_cell_list.tracked_cells.empty()) {
+    tracked_cell_t & found=*tracked_cell_list.tracked_cells.front();
+    if (found.n_id_cell!=cell.n_id_cell()) {
+      cout << "Found cell ID " << found.n_id_cell << " instead of " << cell.n_id_cell() << endl;
+      failed++;
+    }
+    if ((found.n_ports!=cell.n_ports)||(found.n_rb_dl!=cell.n_rb_dl)) {
+      cout << "MIB was not decoded correctly" << endl;
+      failed++;
+    }
+    if (abs(WRAP(found.frame_timing()-ft_true,-19200.0/2,19200.0/2))>2) {
+      cout << "Found with frame timing " << found.frame_timing() << " instead of " << ft_true << endl;
+      failed++;
+    }
+    // The tracker is warm started at the beginning of a frame whose SFN
+    // is known.
+    const int64 frame=round_i((found.init_sample_num-1)/19200.0);
+    if (abs((int64)found.init_sample_num-1-frame*19200)>2) {
+      cout << "Tracker would start at sample " << found.init_sample_num << ", which is not the start of a frame" << endl;
+      failed++;
+    } else if (found.init_sfn!=frame%1024) {
+      cout << "Tracker would start with SFN " << found.init_sfn << " instead of " << frame%1024 << endl;
+      failed++;
+    }
+  }
+
+  while (!tracked_cell_list.tracked_cells.empty()) {
+    delete tracked_cell_list.tracked_cells.front();
+    tracked_cell_list.tracked_cells.pop_front();
+  }
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
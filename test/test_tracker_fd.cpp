@@ -0,0 +1,110 @@
+// Copyright 2012 Evrytania LLC (http://www.evrytania.com)
+//
+// Written by James Peroulas <james@evrytania.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Compare the batched OpenCL DFTs of the tracked OFDM symbols against
+// tracker_sym_fd(), which the trackers use on the host.
+#include <unistd.h>
+#include <itpp/itbase.h>
+#include <itpp/signal/transforms.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <list>
+#include <queue>
+#include <curses.h>
+#include "common.h"
+#include "macros.h"
+#include "lte_lib.h"
+#include "constants.h"
+#include "capbuf.h"
+#include "itpp_ext.h"
+#include "dsp.h"
+#include "searcher.h"
+#include "placement.h"
+#include "LTE-Tracker.h"
+
+using namespace std;
+using namespace itpp;
+
+uint8 verbosity=1;
+
+// One batch of random OFDM symbols of cells with different frequency
+// offsets, timing errors and bandwidths.
+uint32 test_batch(
+  const uint16 & oversample,
+  const uint16 & n_rows
+) {
+  const uint16 n_fft=128*oversample;
+  const uint16 n_sc_max=MIN(12*100,12*6*oversample);
+  const ivec n_sc_try="72 180 300 600 900 1200";
+
+  lte_opencl_t lte_ocl(0,0);
+  lte_ocl.setup_tracker_fd((string)"tracker_kernels.cl",n_fft,n_sc_max);
+
+  const cmat data=randn_c(n_rows,n_fft);
+  const vec dphi=2*pi*(randu(n_rows)-0.5)*20e3/(FS_LTE/16*oversample);
+  const vec late=randu(n_rows)*6-3;
+  ivec n_half(n_rows);
+  for (uint16 r=0;r<n_rows;r++) {
+    n_half(r)=n_sc_try(randi(0,length(n_sc_try)-1))/2;
+    n_half(r)=MIN(n_half(r),n_sc_max/2);
+  }
+
+  cmat syms;
+  lte_ocl.tracker_fd(data,dphi,late,n_half,syms);
+
+  uint32 failed=0;
+  for (uint16 r=0;r<n_rows;r++) {
+    cvec syms_host;
+    tracker_sym_fd(data.get_row(r),dphi(r),late(r),n_half(r),syms_host);
+    const cvec syms_dev=syms.get_row(r);
+    const double err=max(abs(syms_dev.left(2*n_half(r))-syms_host))/max(abs(syms_host));
+    const bool padded=(2*n_half(r)==n_sc_max)||(max(abs(syms_dev.right(n_sc_max-2*n_half(r))))==0);
+    if ((err>1e-3)||(!padded)) {
+      cout << "oversample " << oversample << " row " << r << ": relative error " << err << endl;
+      failed++;
+    }
+  }
+  return failed;
+}
+
+int main(
+  int argc,
+  char *argv[]
+) {
+  // lte_opencl_t aborts when there is no OpenCL device to test.
+  if (!opencl_device_present(0,0)) {
+    cout << "No OpenCL device, test skipped: passed" << endl;
+    return 0;
+  }
+
+  uint32 failed=0;
+  RNG_reset(1);
+
+  failed+=test_batch(1,100);
+  // n_fft is not a power of 2.
+  failed+=test_batch(3,20);
+  failed+=test_batch(16,10);
+
+  if (failed) {
+    cout << "FAILED!!!" << endl;
+  } else {
+    cout << "passed" << endl;
+  }
+
+  return failed;
+}
+